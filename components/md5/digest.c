@@ -0,0 +1,180 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "md5.h"
+#include "digest.h"
+
+#define ROTL64(x, c) (((x) << (c)) | ((x) >> (64 - (c))))
+
+// xxHash64 primes
+#define P1 0x9E3779B185EBCA87ULL
+#define P2 0xC2B2AE3D27D4EB4FULL
+#define P3 0x165667B19E3779F9ULL
+#define P4 0x85EBCA77C2B2AE63ULL
+#define P5 0x27D4EB2F165667C5ULL
+
+#if DIGEST_ID == DIGEST_ID_SIPHASH
+// Fixed SipHash key: the digests of different sniffers must be comparable
+static const uint8_t sip_key[16] = {
+    'E', 'T', 'S', '-', 'P', 'o', 'l', 'i', 'T', 'O', '-', 's', 'n', 'i', 'f', 'f'
+};
+#endif
+
+static uint64_t load64(const uint8_t *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+#else
+    return (uint64_t) p[0] | ((uint64_t) p[1] << 8) | ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24)
+        | ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40) | ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+#endif
+}
+
+static uint32_t load32(const uint8_t *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+#else
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+#endif
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * P2;
+    acc = ROTL64(acc, 31);
+    return acc * P1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * P1 + P4;
+}
+
+uint64_t xxh64(const uint8_t *data, size_t len, uint64_t seed)
+{
+    const uint8_t *end = data + len;
+    uint64_t h, v1, v2, v3, v4;
+
+    if (len >= 32) { // four lanes of 8 bytes
+        v1 = seed + P1 + P2;
+        v2 = seed + P2;
+        v3 = seed;
+        v4 = seed - P1;
+
+        do {
+            v1 = xxh64_round(v1, load64(data));
+            v2 = xxh64_round(v2, load64(data + 8));
+            v3 = xxh64_round(v3, load64(data + 16));
+            v4 = xxh64_round(v4, load64(data + 24));
+            data += 32;
+        } while (data + 32 <= end);
+
+        h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + P5;
+    }
+
+    h += (uint64_t) len;
+
+    // tail: 8, 4 and 1 bytes at a time
+    while (data + 8 <= end) {
+        h ^= xxh64_round(0, load64(data));
+        h = ROTL64(h, 27) * P1 + P4;
+        data += 8;
+    }
+    if (data + 4 <= end) {
+        h ^= (uint64_t) load32(data) * P1;
+        h = ROTL64(h, 23) * P2 + P3;
+        data += 4;
+    }
+    while (data < end) {
+        h ^= (*data) * P5;
+        h = ROTL64(h, 11) * P1;
+        data++;
+    }
+
+    // avalanche
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+#define SIPROUND \
+    v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+    v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32);
+
+uint64_t siphash24(const uint8_t *key, const uint8_t *data, size_t len)
+{
+    uint64_t k0 = load64(key), k1 = load64(key + 8);
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+    uint64_t m, b = (uint64_t) len << 56;
+    const uint8_t *end = data + (len & ~(size_t) 7);
+    int left = len & 7;
+
+    for (; data != end; data += 8) {
+        m = load64(data);
+        v3 ^= m;
+        SIPROUND
+        SIPROUND
+        v0 ^= m;
+    }
+
+    // last 0-7 bytes, with the length in the top byte
+    while (left--)
+        b |= (uint64_t) data[left] << (8 * left);
+
+    v3 ^= b;
+    SIPROUND
+    SIPROUND
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SIPROUND
+    SIPROUND
+    SIPROUND
+    SIPROUND
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+#if DIGEST_ID != DIGEST_ID_MD5
+static void store64(uint64_t val, uint8_t *p)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+        p[i] = (uint8_t) (val >> (8 * i));
+}
+#endif
+
+void digest(const uint8_t *data, size_t len, uint8_t *out)
+{
+#if DIGEST_ID == DIGEST_ID_XXH64
+    store64(xxh64(data, len, 0), out);
+    memset(out + 8, 0, DIGEST_LEN - 8);
+#elif DIGEST_ID == DIGEST_ID_SIPHASH
+    store64(siphash24(sip_key, data, len), out);
+    memset(out + 8, 0, DIGEST_LEN - 8);
+#else
+    md5(data, len, out);
+#endif
+}
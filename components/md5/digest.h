@@ -0,0 +1,34 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+
+// Digest of a sniffed packet, used only to recognise the same packet (e.g. captured by
+// more sniffers): the algorithm is chosen with menuconfig and must be the same on all of them.
+// MD5 fills the 16 bytes, the 64-bit hashes fill the first 8 bytes (little endian) and
+// leave the others to zero.
+
+#define DIGEST_LEN 16
+
+#define DIGEST_ID_MD5 0
+#define DIGEST_ID_XXH64 1
+#define DIGEST_ID_SIPHASH 2
+
+#if defined(CONFIG_DIGEST_XXH64)
+#define DIGEST_ID DIGEST_ID_XXH64
+#elif defined(CONFIG_DIGEST_SIPHASH)
+#define DIGEST_ID DIGEST_ID_SIPHASH
+#else
+#define DIGEST_ID DIGEST_ID_MD5
+#endif
+
+void digest(const uint8_t *data, size_t len, uint8_t *out);
+
+// The single algorithms, available whatever the choice
+uint64_t xxh64(const uint8_t *data, size_t len, uint64_t seed);
+uint64_t siphash24(const uint8_t *key, const uint8_t *data, size_t len); // key is 16 bytes
+
+#endif
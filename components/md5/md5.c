@@ -1,145 +1,210 @@
-#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 
-// Constants are the integer part of the sines of integers (in radians) * 2^32.
-const uint32_t k[64] = {
-	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee ,
-	0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501 ,
-	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be ,
-	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821 ,
-	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa ,
-	0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8 ,
-	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed ,
-	0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a ,
-	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c ,
-	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70 ,
-	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05 ,
-	0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665 ,
-	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039 ,
-	0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1 ,
-	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1 ,
-	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
-};
-
-// r specifies the per-round shift amounts
-const uint32_t r[] = {7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
-                      5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
-                      4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
-                      6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+#include "md5.h"
+
+// Round functions
+#define F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define H(x, y, z) ((x) ^ (y) ^ (z))
+#define I(x, y, z) ((y) ^ ((x) | ~(z)))
 
 // leftrotate function definition
 #define LEFTROTATE(x, c) (((x) << (c)) | ((x) >> (32 - (c))))
 
-static void to_bytes(uint32_t val, uint8_t *bytes);
-static uint32_t to_int32(const uint8_t *bytes);
-
-void md5(const uint8_t *initial_msg, size_t initial_len, uint8_t *digest) {
+// One step: the constants are the integer part of the sines of integers (in radians) * 2^32,
+// the shift amounts are the per-round ones of RFC 1321
+#define STEP(f, a, b, c, d, x, t, s) \
+    (a) += f((b), (c), (d)) + (x) + (t); \
+    (a) = LEFTROTATE((a), (s)) + (b);
 
-    // These vars will contain the hash
-    uint32_t h0, h1, h2, h3;
+static uint32_t load32(const uint8_t *p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // the words of the message are little endian: a single (possibly unaligned) load
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+#else
+    return (uint32_t) p[0]
+        | ((uint32_t) p[1] << 8)
+        | ((uint32_t) p[2] << 16)
+        | ((uint32_t) p[3] << 24);
+#endif
+}
 
-    // Message (to prepare)
-    uint8_t *msg = NULL;
+static void store32(uint32_t val, uint8_t *p)
+{
+    p[0] = (uint8_t) val;
+    p[1] = (uint8_t) (val >> 8);
+    p[2] = (uint8_t) (val >> 16);
+    p[3] = (uint8_t) (val >> 24);
+}
 
-    size_t new_len, offset;
+// Process nblocks 512-bit chunks of data
+static void md5_blocks(uint32_t *h, const uint8_t *data, size_t nblocks)
+{
     uint32_t w[16];
-    uint32_t a, b, c, d, i, f, g, temp;
+    uint32_t a, b, c, d;
+    int i;
 
-    // Initialize variables - simple count in nibbles:
-    h0 = 0x67452301;
-    h1 = 0xefcdab89;
-    h2 = 0x98badcfe;
-    h3 = 0x10325476;
+    while (nblocks--) {
 
-    //Pre-processing:
-    //append "1" bit to message
-    //append "0" bits until message length in bits ≡ 448 (mod 512)
-    //append length mod (2^64) to message
+        // break chunk into sixteen 32-bit words w[j], 0 ≤ j ≤ 15
+        for (i = 0; i < 16; i++)
+            w[i] = load32(data + i*4);
+
+        a = h[0];
+        b = h[1];
+        c = h[2];
+        d = h[3];
+
+        STEP(F, a, b, c, d, w[0], 0xd76aa478, 7)
+        STEP(F, d, a, b, c, w[1], 0xe8c7b756, 12)
+        STEP(F, c, d, a, b, w[2], 0x242070db, 17)
+        STEP(F, b, c, d, a, w[3], 0xc1bdceee, 22)
+        STEP(F, a, b, c, d, w[4], 0xf57c0faf, 7)
+        STEP(F, d, a, b, c, w[5], 0x4787c62a, 12)
+        STEP(F, c, d, a, b, w[6], 0xa8304613, 17)
+        STEP(F, b, c, d, a, w[7], 0xfd469501, 22)
+        STEP(F, a, b, c, d, w[8], 0x698098d8, 7)
+        STEP(F, d, a, b, c, w[9], 0x8b44f7af, 12)
+        STEP(F, c, d, a, b, w[10], 0xffff5bb1, 17)
+        STEP(F, b, c, d, a, w[11], 0x895cd7be, 22)
+        STEP(F, a, b, c, d, w[12], 0x6b901122, 7)
+        STEP(F, d, a, b, c, w[13], 0xfd987193, 12)
+        STEP(F, c, d, a, b, w[14], 0xa679438e, 17)
+        STEP(F, b, c, d, a, w[15], 0x49b40821, 22)
+
+        STEP(G, a, b, c, d, w[1], 0xf61e2562, 5)
+        STEP(G, d, a, b, c, w[6], 0xc040b340, 9)
+        STEP(G, c, d, a, b, w[11], 0x265e5a51, 14)
+        STEP(G, b, c, d, a, w[0], 0xe9b6c7aa, 20)
+        STEP(G, a, b, c, d, w[5], 0xd62f105d, 5)
+        STEP(G, d, a, b, c, w[10], 0x02441453, 9)
+        STEP(G, c, d, a, b, w[15], 0xd8a1e681, 14)
+        STEP(G, b, c, d, a, w[4], 0xe7d3fbc8, 20)
+        STEP(G, a, b, c, d, w[9], 0x21e1cde6, 5)
+        STEP(G, d, a, b, c, w[14], 0xc33707d6, 9)
+        STEP(G, c, d, a, b, w[3], 0xf4d50d87, 14)
+        STEP(G, b, c, d, a, w[8], 0x455a14ed, 20)
+        STEP(G, a, b, c, d, w[13], 0xa9e3e905, 5)
+        STEP(G, d, a, b, c, w[2], 0xfcefa3f8, 9)
+        STEP(G, c, d, a, b, w[7], 0x676f02d9, 14)
+        STEP(G, b, c, d, a, w[12], 0x8d2a4c8a, 20)
+
+        STEP(H, a, b, c, d, w[5], 0xfffa3942, 4)
+        STEP(H, d, a, b, c, w[8], 0x8771f681, 11)
+        STEP(H, c, d, a, b, w[11], 0x6d9d6122, 16)
+        STEP(H, b, c, d, a, w[14], 0xfde5380c, 23)
+        STEP(H, a, b, c, d, w[1], 0xa4beea44, 4)
+        STEP(H, d, a, b, c, w[4], 0x4bdecfa9, 11)
+        STEP(H, c, d, a, b, w[7], 0xf6bb4b60, 16)
+        STEP(H, b, c, d, a, w[10], 0xbebfbc70, 23)
+        STEP(H, a, b, c, d, w[13], 0x289b7ec6, 4)
+        STEP(H, d, a, b, c, w[0], 0xeaa127fa, 11)
+        STEP(H, c, d, a, b, w[3], 0xd4ef3085, 16)
+        STEP(H, b, c, d, a, w[6], 0x04881d05, 23)
+        STEP(H, a, b, c, d, w[9], 0xd9d4d039, 4)
+        STEP(H, d, a, b, c, w[12], 0xe6db99e5, 11)
+        STEP(H, c, d, a, b, w[15], 0x1fa27cf8, 16)
+        STEP(H, b, c, d, a, w[2], 0xc4ac5665, 23)
+
+        STEP(I, a, b, c, d, w[0], 0xf4292244, 6)
+        STEP(I, d, a, b, c, w[7], 0x432aff97, 10)
+        STEP(I, c, d, a, b, w[14], 0xab9423a7, 15)
+        STEP(I, b, c, d, a, w[5], 0xfc93a039, 21)
+        STEP(I, a, b, c, d, w[12], 0x655b59c3, 6)
+        STEP(I, d, a, b, c, w[3], 0x8f0ccc92, 10)
+        STEP(I, c, d, a, b, w[10], 0xffeff47d, 15)
+        STEP(I, b, c, d, a, w[1], 0x85845dd1, 21)
+        STEP(I, a, b, c, d, w[8], 0x6fa87e4f, 6)
+        STEP(I, d, a, b, c, w[15], 0xfe2ce6e0, 10)
+        STEP(I, c, d, a, b, w[6], 0xa3014314, 15)
+        STEP(I, b, c, d, a, w[13], 0x4e0811a1, 21)
+        STEP(I, a, b, c, d, w[4], 0xf7537e82, 6)
+        STEP(I, d, a, b, c, w[11], 0xbd3af235, 10)
+        STEP(I, c, d, a, b, w[2], 0x2ad7d2bb, 15)
+        STEP(I, b, c, d, a, w[9], 0xeb86d391, 21)
 
-    for (new_len = initial_len + 1; new_len % (512/8) != 448/8; new_len++)
-        ;
+        // Add this chunk's hash to result so far:
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
 
-    msg = (uint8_t*)malloc(new_len + 8);
-    memcpy(msg, initial_msg, initial_len);
-    msg[initial_len] = 0x80; // append the "1" bit; most significant bit is "first"
-    for (offset = initial_len + 1; offset < new_len; offset++)
-        msg[offset] = 0; // append "0" bits
+        data += 64;
+    }
+}
 
-    // append the len in bits at the end of the buffer.
-    to_bytes(initial_len*8, msg + new_len);
-    // initial_len>>29 == initial_len*8>>32, but avoids overflow.
-    to_bytes(initial_len>>29, msg + new_len + 4);
+void md5_init(md5_ctx_t *ctx)
+{
+    // Initialize variables - simple count in nibbles:
+    ctx->h[0] = 0x67452301;
+    ctx->h[1] = 0xefcdab89;
+    ctx->h[2] = 0x98badcfe;
+    ctx->h[3] = 0x10325476;
+    ctx->len = 0;
+}
 
-    // Process the message in successive 512-bit chunks:
-    //for each 512-bit chunk of message:
-    for(offset=0; offset<new_len; offset += (512/8)) {
+void md5_update(md5_ctx_t *ctx, const uint8_t *data, size_t len)
+{
+    size_t used = ctx->len % 64, n;
+
+    ctx->len += len;
+
+    if (used > 0) { // complete the pending block first
+        n = 64 - used < len ? 64 - used : len;
+        memcpy(ctx->block + used, data, n);
+        data += n;
+        len -= n;
+        if (used + n < 64)
+            return;
+        md5_blocks(ctx->h, ctx->block, 1);
+    }
 
-        // break chunk into sixteen 32-bit words w[j], 0 ≤ j ≤ 15
-        for (i = 0; i < 16; i++)
-            w[i] = to_int32(msg + offset + i*4);
-
-        // Initialize hash value for this chunk:
-        a = h0;
-        b = h1;
-        c = h2;
-        d = h3;
-
-        // Main loop:
-        for(i = 0; i<64; i++) {
-
-            if (i < 16) {
-                f = (b & c) | ((~b) & d);
-                g = i;
-            } else if (i < 32) {
-                f = (d & b) | ((~d) & c);
-                g = (5*i + 1) % 16;
-            } else if (i < 48) {
-                f = b ^ c ^ d;
-                g = (3*i + 5) % 16;
-            } else {
-                f = c ^ (b | (~d));
-                g = (7*i) % 16;
-            }
-
-            temp = d;
-            d = c;
-            c = b;
-            b = b + LEFTROTATE((a + f + k[i] + w[g]), r[i]);
-            a = temp;
-
-        }
+    // whole blocks are hashed in place, without copies
+    md5_blocks(ctx->h, data, len / 64);
+    data += len & ~(size_t)63;
+    len &= 63;
 
-        // Add this chunk's hash to result so far:
-        h0 += a;
-        h1 += b;
-        h2 += c;
-        h3 += d;
+    memcpy(ctx->block, data, len);
+}
 
+void md5_final(md5_ctx_t *ctx, uint8_t *digest)
+{
+    //Pre-processing:
+    //append "1" bit to message
+    //append "0" bits until message length in bits ≡ 448 (mod 512)
+    //append length mod (2^64) to message
+    size_t used = ctx->len % 64;
+    uint64_t bits = ctx->len * 8;
+
+    ctx->block[used++] = 0x80; // append the "1" bit; most significant bit is "first"
+    if (used > 56) { // no room for the length: one more block
+        memset(ctx->block + used, 0, 64 - used);
+        md5_blocks(ctx->h, ctx->block, 1);
+        used = 0;
     }
+    memset(ctx->block + used, 0, 56 - used);
 
-    // cleanup
-    free(msg);
+    // append the len in bits at the end of the block.
+    store32((uint32_t) bits, ctx->block + 56);
+    store32((uint32_t) (bits >> 32), ctx->block + 60);
+    md5_blocks(ctx->h, ctx->block, 1);
 
     //var char digest[16] := h0 append h1 append h2 append h3 //(Output is in little-endian)
-    to_bytes(h0, digest);
-    to_bytes(h1, digest + 4);
-    to_bytes(h2, digest + 8);
-    to_bytes(h3, digest + 12);
+    store32(ctx->h[0], digest);
+    store32(ctx->h[1], digest + 4);
+    store32(ctx->h[2], digest + 8);
+    store32(ctx->h[3], digest + 12);
 }
 
-static void to_bytes(uint32_t val, uint8_t *bytes)
+void md5(const uint8_t *initial_msg, size_t initial_len, uint8_t *digest)
 {
-    bytes[0] = (uint8_t) val;
-    bytes[1] = (uint8_t) (val >> 8);
-    bytes[2] = (uint8_t) (val >> 16);
-    bytes[3] = (uint8_t) (val >> 24);
-}
+    md5_ctx_t ctx;
 
-static uint32_t to_int32(const uint8_t *bytes)
-{
-    return (uint32_t) bytes[0]
-        | ((uint32_t) bytes[1] << 8)
-        | ((uint32_t) bytes[2] << 16)
-        | ((uint32_t) bytes[3] << 24);
+    md5_init(&ctx);
+    md5_update(&ctx, initial_msg, initial_len);
+    md5_final(&ctx, digest);
 }
@@ -1 +1,21 @@
+#ifndef MD5_H
+#define MD5_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Streaming MD5: no heap use, the state and one 64-byte block live in the context.
+typedef struct {
+    uint32_t h[4];      // hash state
+    uint64_t len;       // bytes hashed so far
+    uint8_t block[64];  // bytes waiting for a whole block
+} md5_ctx_t;
+
+void md5_init(md5_ctx_t *ctx);
+void md5_update(md5_ctx_t *ctx, const uint8_t *data, size_t len);
+void md5_final(md5_ctx_t *ctx, uint8_t *digest);
+
+// One shot MD5 of a buffer, digest is 16 bytes
 void md5(const uint8_t *initial_msg, size_t initial_len, uint8_t *digest);
+
+#endif
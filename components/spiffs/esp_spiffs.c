@@ -16,6 +16,7 @@
 #include "spiffs.h"
 #include "spiffs_nucleus.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_partition.h"
 #include "esp_spi_flash.h"
 #include "esp_image_format.h"
@@ -54,6 +55,7 @@ static int vfs_spiffs_open(void* ctx, const char * path, int flags, int mode);
 static ssize_t vfs_spiffs_write(void* ctx, int fd, const void * data, size_t size);
 static ssize_t vfs_spiffs_read(void* ctx, int fd, void * dst, size_t size);
 static int vfs_spiffs_close(void* ctx, int fd);
+static int vfs_spiffs_fsync(void* ctx, int fd);
 static off_t vfs_spiffs_lseek(void* ctx, int fd, off_t offset, int mode);
 static int vfs_spiffs_fstat(void* ctx, int fd, struct stat * st);
 static int vfs_spiffs_stat(void* ctx, const char * path, struct stat * st);
@@ -69,8 +71,12 @@ static long vfs_spiffs_telldir(void* ctx, DIR* pdir);
 static void vfs_spiffs_seekdir(void* ctx, DIR* pdir, long offset);
 static int vfs_spiffs_mkdir(void* ctx, const char* name, mode_t mode);
 static int vfs_spiffs_rmdir(void* ctx, const char* name);
-static void vfs_spiffs_update_mtime(spiffs *fs, spiffs_file f);
-static time_t vfs_spiffs_get_mtime(const spiffs_stat* s);
+static void vfs_spiffs_update_mtime(esp_spiffs_t *efs, spiffs_file fd, const char *path);
+static time_t vfs_spiffs_get_mtime(esp_spiffs_t *efs, const spiffs_stat* s);
+#ifdef SPIFFS_MTIME_DEFERRED
+static void vfs_spiffs_forget_mtime(esp_spiffs_t *efs, const char *path, const char *new_path);
+static esp_err_t vfs_spiffs_flush_mtimes(esp_spiffs_t *efs, time_t now);
+#endif
 
 static esp_spiffs_t * _efs[CONFIG_SPIFFS_MAX_PARTITIONS];
 
@@ -90,6 +96,12 @@ static void esp_spiffs_free(esp_spiffs_t ** efs)
     free(e->fds);
     free(e->cache);
     free(e->work);
+#if SPIFFS_RAM_INDEX
+    free(e->cfg.ram_index);
+#endif
+#ifdef CONFIG_SPIFFS_IO_STATS
+    free(e->sector_erases);
+#endif
     free(e);
 }
 
@@ -112,6 +124,24 @@ static esp_err_t esp_spiffs_by_label(const char* label, int * index){
     return ESP_ERR_NOT_FOUND;
 }
 
+static esp_err_t esp_spiffs_by_path(const char* path, int * index, const char** name){
+    int i;
+    size_t len;
+    esp_spiffs_t * p;
+    for (i = 0; i < CONFIG_SPIFFS_MAX_PARTITIONS; i++) {
+        p = _efs[i];
+        if (p && p->base_path[0]) {
+            len = strlen(p->base_path);
+            if (strncmp(path, p->base_path, len) == 0 && path[len] == '/') {
+                *index = i;
+                *name = path + len;
+                return ESP_OK;
+            }
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
 static esp_err_t esp_spiffs_get_empty(int * index){
     int i;
     for (i = 0; i < CONFIG_SPIFFS_MAX_PARTITIONS; i++) {
@@ -173,6 +203,7 @@ static esp_err_t esp_spiffs_init(const esp_vfs_spiffs_conf_t* conf)
     efs->cfg.phys_addr         = 0;
     efs->cfg.phys_erase_block  = g_rom_flashchip.sector_size;
     efs->cfg.phys_size         = partition->size;
+    efs->cfg.gc_policy         = SPIFFS_GC_POLICY;
 
     efs->by_label = conf->partition_label != NULL;
 
@@ -193,8 +224,7 @@ static esp_err_t esp_spiffs_init(const esp_vfs_spiffs_conf_t* conf)
     memset(efs->fds, 0, efs->fds_sz);
 
 #if SPIFFS_CACHE
-    efs->cache_sz = sizeof(spiffs_cache) + conf->max_files * (sizeof(spiffs_cache_page)
-                          + efs->cfg.log_page_size);
+    efs->cache_sz = SPIFFS_CACHE_BUF_SIZE(efs->cfg.log_page_size, CONFIG_SPIFFS_CACHE_PAGES);
     efs->cache = malloc(efs->cache_sz);
     if (efs->cache == NULL) {
         ESP_LOGE(TAG, "cache buffer could not be malloced");
@@ -213,6 +243,28 @@ static esp_err_t esp_spiffs_init(const esp_vfs_spiffs_conf_t* conf)
     }
     memset(efs->work, 0, work_sz);
 
+#if SPIFFS_RAM_INDEX
+    efs->cfg.ram_index_size = SPIFFS_RAM_INDEX_BUF_SIZE(efs->cfg.phys_size, efs->cfg.log_page_size,
+                                                        CONFIG_SPIFFS_RAM_INDEX_OBJECTS);
+    efs->cfg.ram_index = calloc(1, efs->cfg.ram_index_size);
+    if (efs->cfg.ram_index == NULL) {
+        ESP_LOGE(TAG, "ram index could not be malloced");
+        esp_spiffs_free(&efs);
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
+#ifdef CONFIG_SPIFFS_IO_STATS
+    vPortCPUInitializeMutex(&efs->io_mux);
+    efs->io.sectors = partition->size / efs->cfg.phys_erase_block;
+    efs->sector_erases = calloc(efs->io.sectors, sizeof(uint32_t));
+    if (efs->sector_erases == NULL) {
+        ESP_LOGE(TAG, "erase counters could not be malloced");
+        esp_spiffs_free(&efs);
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
     efs->fs = malloc(sizeof(spiffs));
     if (efs->fs == NULL) {
         ESP_LOGE(TAG, "spiffs could not be malloced");
@@ -224,8 +276,28 @@ static esp_err_t esp_spiffs_init(const esp_vfs_spiffs_conf_t* conf)
     efs->fs->user_data = (void *)efs;
     efs->partition = partition;
 
+#ifdef CONFIG_SPIFFS_CHECKPOINT
+#if SPIFFS_RAM_INDEX
+    uint32_t ckpt_size = SPIFFS_CHECKPOINT_MAX_SIZE(efs->cfg.ram_index_size);
+#else
+    uint32_t ckpt_size = SPIFFS_CHECKPOINT_MAX_SIZE(0);
+#endif
+    if (spiffs_api_ckpt_init(efs, CONFIG_SPIFFS_CHECKPOINT_PARTITION, ckpt_size) == ESP_OK) {
+        efs->cfg.ckpt_read_f   = spiffs_api_ckpt_read;
+        efs->cfg.ckpt_write_f  = spiffs_api_ckpt_write;
+        efs->cfg.ckpt_erase_f  = spiffs_api_ckpt_erase;
+    }
+    int64_t start = esp_timer_get_time();
+#endif
+
     s32_t res = SPIFFS_mount(efs->fs, &efs->cfg, efs->work, efs->fds, efs->fds_sz,
                             efs->cache, efs->cache_sz, spiffs_api_check);
+#ifdef CONFIG_SPIFFS_CHECKPOINT
+    if (res == SPIFFS_OK) {
+        ESP_LOGI(TAG, "mounted in %u us%s", (uint32_t)(esp_timer_get_time() - start),
+                 efs->fs->ckpt_live ? " from the checkpoint" : "");
+    }
+#endif
 
     if (conf->format_if_mount_failed && res != SPIFFS_OK) {
         ESP_LOGW(TAG, "mount failed, %i. formatting...", SPIFFS_errno(efs->fs));
@@ -269,6 +341,268 @@ esp_err_t esp_spiffs_info(const char* partition_label, size_t *total_bytes, size
     return ESP_OK;
 }
 
+esp_err_t esp_spiffs_get_io_stats(const char* partition_label, esp_spiffs_io_stats_t *stats, bool reset)
+{
+#ifdef CONFIG_SPIFFS_IO_STATS
+    int index;
+    if (esp_spiffs_by_label(partition_label, &index) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_spiffs_t * efs = _efs[index];
+
+    spiffs_api_lock(efs->fs);
+    portENTER_CRITICAL(&efs->io_mux);
+    *stats = efs->io;
+    if (reset) {
+        memset(&efs->io.read, 0, sizeof(efs->io.read));
+        memset(&efs->io.write, 0, sizeof(efs->io.write));
+        memset(&efs->io.erase, 0, sizeof(efs->io.erase));
+        efs->io.mtime_writes = 0;
+        efs->io.mtime_deferred = 0;
+    }
+    portEXIT_CRITICAL(&efs->io_mux);
+    stats->min_sector_erases = UINT32_MAX;
+    stats->max_sector_erases = 0;
+    for (uint32_t s = 0; s < efs->io.sectors; s++) {
+        if (efs->sector_erases[s] < stats->min_sector_erases) {
+            stats->min_sector_erases = efs->sector_erases[s];
+        }
+        if (efs->sector_erases[s] > stats->max_sector_erases) {
+            stats->max_sector_erases = efs->sector_erases[s];
+        }
+    }
+    spiffs_api_unlock(efs->fs);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t esp_spiffs_get_lock_stats(const char* partition_label, esp_spiffs_lock_stats_t *stats, bool reset)
+{
+#ifdef CONFIG_SPIFFS_LOCK_STATS
+    int index;
+    if (esp_spiffs_by_label(partition_label, &index) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_spiffs_t * efs = _efs[index];
+
+    spiffs_api_lock(efs->fs);
+    *stats = efs->locks;
+#if SPIFFS_READ_UNLOCKED
+    stats->unlocked_reads = efs->fs->stats_ra_unlocked;
+    stats->unlocked_retries = efs->fs->stats_ra_retries;
+#endif
+    if (reset) {
+        memset(&efs->locks, 0, sizeof(efs->locks));
+#if SPIFFS_READ_UNLOCKED
+        efs->fs->stats_ra_unlocked = efs->fs->stats_ra_retries = 0;
+#endif
+    }
+    spiffs_api_unlock(efs->fs);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t esp_spiffs_get_sector_erases(const char* partition_label, uint32_t *erases, size_t count)
+{
+#ifdef CONFIG_SPIFFS_IO_STATS
+    int index;
+    if (esp_spiffs_by_label(partition_label, &index) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_spiffs_t * efs = _efs[index];
+
+    if (count > efs->io.sectors) {
+        count = efs->io.sectors;
+    }
+    spiffs_api_lock(efs->fs);
+    memcpy(erases, efs->sector_erases, count * sizeof(uint32_t));
+    spiffs_api_unlock(efs->fs);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t esp_spiffs_get_cache_stats(const char* partition_label, esp_spiffs_cache_stats_t *stats, bool reset)
+{
+#if SPIFFS_CACHE
+    int index;
+    if (esp_spiffs_by_label(partition_label, &index) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_spiffs_t * efs = _efs[index];
+    spiffs_cache *cache = spiffs_get_cache(efs->fs);
+
+    memset(stats, 0, sizeof(*stats));
+    if (cache == NULL) {
+        return ESP_OK;
+    }
+    spiffs_api_lock(efs->fs);
+    stats->pages = cache->cpage_count;
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    if (reset) {
+        cache->hits = cache->misses = cache->evictions = 0;
+    }
+    spiffs_api_unlock(efs->fs);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t esp_spiffs_get_index_stats(const char* partition_label, esp_spiffs_index_stats_t *stats, bool reset)
+{
+#if SPIFFS_RAM_INDEX
+    int index;
+    if (esp_spiffs_by_label(partition_label, &index) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_spiffs_t * efs = _efs[index];
+
+    memset(stats, 0, sizeof(*stats));
+    spiffs_api_lock(efs->fs);
+    spiffs_ram_index *ri = spiffs_ram_index_get(efs->fs);
+    stats->bytes = efs->cfg.ram_index_size;
+    if (ri) {
+        stats->objects = ri->obj_count;
+        stats->capacity = ri->obj_max;
+        stats->partial = ri->partial;
+        stats->hits = ri->hits;
+        stats->scans = ri->scans;
+        if (reset) {
+            ri->hits = ri->scans = 0;
+        }
+    }
+    spiffs_api_unlock(efs->fs);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t esp_spiffs_checkpoint(const char* partition_label)
+{
+#ifdef CONFIG_SPIFFS_CHECKPOINT
+    int index;
+    if (esp_spiffs_by_label(partition_label, &index) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    spiffs *fs = _efs[index]->fs;
+    if (fs->cfg.ckpt_write_f == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (SPIFFS_checkpoint(fs) != SPIFFS_OK) {
+        ESP_LOGE(TAG, "checkpoint failed, %i", SPIFFS_errno(fs));
+        SPIFFS_clearerr(fs);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t esp_spiffs_sync_meta(const char* partition_label)
+{
+    int index;
+    if (esp_spiffs_by_label(partition_label, &index) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+#ifdef SPIFFS_MTIME_DEFERRED
+    return vfs_spiffs_flush_mtimes(_efs[index], 0);
+#else
+    return ESP_OK;
+#endif
+}
+
+esp_err_t esp_spiffs_gc(const char* partition_label, uint32_t budget_us, uint32_t *blocks)
+{
+    int index;
+    if (esp_spiffs_by_label(partition_label, &index) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    spiffs *fs = _efs[index]->fs;
+    int64_t start = esp_timer_get_time();
+    uint32_t n = 0;
+    do {
+        s32_t res = SPIFFS_gc_slice(fs, CONFIG_SPIFFS_GC_SLICE_PAGES);
+        if (res == SPIFFS_ERR_NO_DELETED_BLOCKS) {
+            SPIFFS_clearerr(fs);
+            break;
+        }
+        if (res < 0) {
+            ESP_LOGE(TAG, "gc failed, %i", SPIFFS_errno(fs));
+            SPIFFS_clearerr(fs);
+            return ESP_FAIL;
+        }
+        n++;
+    } while (esp_timer_get_time() - start < budget_us);
+    if (blocks) {
+        *blocks = n;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_spiffs_open(const char* path, esp_spiffs_file_t *file)
+{
+    const char* name;
+    spiffs_stat s;
+    if (esp_spiffs_by_path(path, &file->index, &name) != ESP_OK) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    spiffs *fs = _efs[file->index]->fs;
+    file->file = SPIFFS_open(fs, name, SPIFFS_O_RDONLY, 0);
+    if (file->file < 0) {
+        SPIFFS_clearerr(fs);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (SPIFFS_fstat(fs, file->file, &s) != SPIFFS_OK) {
+        SPIFFS_close(fs, file->file);
+        SPIFFS_clearerr(fs);
+        return ESP_ERR_NOT_FOUND;
+    }
+    file->size = s.size;
+    file->offset = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_spiffs_read_records(esp_spiffs_file_t *file, void *dst, size_t size,
+                                  esp_spiffs_record_len_t record_len, size_t *len)
+{
+    spiffs *fs = _efs[file->index]->fs;
+    s32_t res;
+    if (record_len) {
+        res = SPIFFS_read_records(fs, file->file, dst, size, record_len);
+    } else {
+        res = SPIFFS_read(fs, file->file, dst, size);
+    }
+    if (res < 0) {
+        ESP_LOGE(TAG, "read failed, %i", SPIFFS_errno(fs));
+        SPIFFS_clearerr(fs);
+        return ESP_FAIL;
+    }
+    *len = res;
+    res = SPIFFS_tell(fs, file->file);
+    file->offset = res < 0 ? file->size : res;
+    return ESP_OK;
+}
+
+esp_err_t esp_spiffs_close(esp_spiffs_file_t *file)
+{
+    spiffs *fs = _efs[file->index]->fs;
+    if (SPIFFS_close(fs, file->file) != SPIFFS_OK) {
+        SPIFFS_clearerr(fs);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 esp_err_t esp_spiffs_format(const char* partition_label)
 {
     bool partition_was_mounted = false;
@@ -295,6 +629,12 @@ esp_err_t esp_spiffs_format(const char* partition_label)
     }
 
     SPIFFS_unmount(_efs[index]->fs);
+#ifdef SPIFFS_MTIME_DEFERRED
+    /* the table is read by stat/fstat of other tasks under the FS lock */
+    spiffs_api_lock(_efs[index]->fs);
+    memset(_efs[index]->mtimes, 0, sizeof(_efs[index]->mtimes));
+    spiffs_api_unlock(_efs[index]->fs);
+#endif
 
     s32_t res = SPIFFS_format(_efs[index]->fs);
     if (res != SPIFFS_OK) {
@@ -336,6 +676,7 @@ esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t * conf)
         .open_p = &vfs_spiffs_open,
         .close_p = &vfs_spiffs_close,
         .fstat_p = &vfs_spiffs_fstat,
+        .fsync_p = &vfs_spiffs_fsync,
         .stat_p = &vfs_spiffs_stat,
         .link_p = &vfs_spiffs_link,
         .unlink_p = &vfs_spiffs_unlink,
@@ -380,6 +721,9 @@ esp_err_t esp_vfs_spiffs_unregister(const char* partition_label)
     if (err != ESP_OK) {
         return err;
     }
+#ifdef SPIFFS_MTIME_DEFERRED
+    vfs_spiffs_flush_mtimes(_efs[index], 0);
+#endif
     esp_spiffs_free(&_efs[index]);
     return ESP_OK;
 }
@@ -455,7 +799,7 @@ static int vfs_spiffs_open(void* ctx, const char * path, int flags, int mode)
         return -1;
     }
     if (!(spiffs_flags & SPIFFS_RDONLY)) {
-        vfs_spiffs_update_mtime(efs->fs, fd);
+        vfs_spiffs_update_mtime(efs, fd, path);
     }
     return fd;
 }
@@ -496,6 +840,19 @@ static int vfs_spiffs_close(void* ctx, int fd)
     return res;
 }
 
+/* write the cache page of the file and, with SPIFFS_APPEND_DEFER, its object index */
+static int vfs_spiffs_fsync(void* ctx, int fd)
+{
+    esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
+    int res = SPIFFS_fflush(efs->fs, fd);
+    if (res < 0) {
+        errno = spiffs_res_to_errno(SPIFFS_errno(efs->fs));
+        SPIFFS_clearerr(efs->fs);
+        return -1;
+    }
+    return 0;
+}
+
 static off_t vfs_spiffs_lseek(void* ctx, int fd, off_t offset, int mode)
 {
     esp_spiffs_t * efs = (esp_spiffs_t *)ctx;
@@ -521,7 +878,7 @@ static int vfs_spiffs_fstat(void* ctx, int fd, struct stat * st)
     }
     st->st_size = s.size;
     st->st_mode = S_IRWXU | S_IRWXG | S_IRWXO | S_IFREG;
-    st->st_mtime = vfs_spiffs_get_mtime(&s);
+    st->st_mtime = vfs_spiffs_get_mtime(efs, &s);
     st->st_atime = 0;
     st->st_ctime = 0;
     return res;
@@ -543,7 +900,7 @@ static int vfs_spiffs_stat(void* ctx, const char * path, struct stat * st)
     st->st_size = s.size;
     st->st_mode = S_IRWXU | S_IRWXG | S_IRWXO;
     st->st_mode |= (s.type == SPIFFS_TYPE_DIR)?S_IFDIR:S_IFREG;
-    st->st_mtime = vfs_spiffs_get_mtime(&s);
+    st->st_mtime = vfs_spiffs_get_mtime(efs, &s);
     st->st_atime = 0;
     st->st_ctime = 0;
     return res;
@@ -560,6 +917,9 @@ static int vfs_spiffs_rename(void* ctx, const char *src, const char *dst)
         SPIFFS_clearerr(efs->fs);
         return -1;
     }
+#ifdef SPIFFS_MTIME_DEFERRED
+    vfs_spiffs_forget_mtime(efs, src, dst);
+#endif
     return res;
 }
 
@@ -573,6 +933,9 @@ static int vfs_spiffs_unlink(void* ctx, const char *path)
         SPIFFS_clearerr(efs->fs);
         return -1;
     }
+#ifdef SPIFFS_MTIME_DEFERRED
+    vfs_spiffs_forget_mtime(efs, path, NULL);
+#endif
     return res;
 }
 
@@ -717,30 +1080,182 @@ static int vfs_spiffs_link(void* ctx, const char* n1, const char* n2)
     return -1;
 }
 
-static void vfs_spiffs_update_mtime(spiffs *fs, spiffs_file fd)
-{
 #ifdef CONFIG_SPIFFS_USE_MTIME
-    time_t t = time(NULL);
+/* Write t as the mtime of the file open as fd, or of path if fd < 0 */
+static s32_t vfs_spiffs_write_mtime(esp_spiffs_t *efs, spiffs_file fd, const char *path, time_t t)
+{
     spiffs_stat s;
-    int ret = SPIFFS_OK;
+    s32_t ret = SPIFFS_OK;
     if (CONFIG_SPIFFS_META_LENGTH > sizeof(t)) {
-        ret = SPIFFS_fstat(fs, fd, &s);
+        ret = (fd >= 0) ? SPIFFS_fstat(efs->fs, fd, &s) : SPIFFS_stat(efs->fs, path, &s);
     }
     if (ret == SPIFFS_OK) {
         memcpy(s.meta, &t, sizeof(t));
-        ret = SPIFFS_fupdate_meta(fs, fd, s.meta);
+        ret = (fd >= 0) ? SPIFFS_fupdate_meta(efs->fs, fd, s.meta) : SPIFFS_update_meta(efs->fs, path, s.meta);
     }
+    if (ret != SPIFFS_OK) {
+        SPIFFS_clearerr(efs->fs);
+        return ret;
+    }
+#ifdef CONFIG_SPIFFS_IO_STATS
+    portENTER_CRITICAL(&efs->io_mux);
+    efs->io.mtime_writes++;
+    portEXIT_CRITICAL(&efs->io_mux);
+#endif
+    return SPIFFS_OK;
+}
+#endif //CONFIG_SPIFFS_USE_MTIME
+
+#ifdef SPIFFS_MTIME_DEFERRED
+static esp_spiffs_mtime_t *vfs_spiffs_find_mtime(esp_spiffs_t *efs, const char *path)
+{
+    for (int i = 0; i < CONFIG_SPIFFS_MTIME_FILES; i++) {
+        if (efs->mtimes[i].name[0] != '\0' && strcmp(efs->mtimes[i].name, path) == 0) {
+            return &efs->mtimes[i];
+        }
+    }
+    return NULL;
+}
+
+/* Record that path has been opened for writing at t. Return true if its mtime
+ * can stay in RAM; evicted gets a dirty entry that made room for it (name
+ * empty if none), its mtime has to be written by the caller */
+static bool vfs_spiffs_defer_mtime(esp_spiffs_t *efs, const char *path, time_t t, esp_spiffs_mtime_t *evicted)
+{
+    bool deferred = true;
+    evicted->name[0] = '\0';
+
+    spiffs_api_lock(efs->fs);
+    esp_spiffs_mtime_t *e = vfs_spiffs_find_mtime(efs, path);
+    if (e == NULL) {
+        // a free entry, else the clean one opened least recently, else the dirty one
+        for (int i = 0; i < CONFIG_SPIFFS_MTIME_FILES; i++) {
+            esp_spiffs_mtime_t *m = &efs->mtimes[i];
+            if (m->name[0] == '\0') {
+                e = m;
+                break;
+            }
+            bool dirty = m->mtime != m->written;
+            if (e == NULL || (e->mtime != e->written && !dirty) ||
+                    ((e->mtime != e->written) == dirty && m->mtime < e->mtime)) {
+                e = m;
+            }
+        }
+        if (e->name[0] != '\0' && e->mtime != e->written) {
+            *evicted = *e;
+        }
+        strlcpy(e->name, path, sizeof(e->name));
+        e->written = 0;
+#ifdef CONFIG_SPIFFS_MTIME_PERIODIC
+        deferred = false; // the time of the last write is not known
+#endif
+    }
+#ifdef CONFIG_SPIFFS_MTIME_PERIODIC
+    else if (t - e->written >= CONFIG_SPIFFS_MTIME_PERIOD) {
+        deferred = false;
+    }
+#endif
+    e->mtime = t;
+    if (!deferred) {
+        e->written = t;
+    }
+#ifdef CONFIG_SPIFFS_IO_STATS
+    else {
+        portENTER_CRITICAL(&efs->io_mux);
+        efs->io.mtime_deferred++;
+        portEXIT_CRITICAL(&efs->io_mux);
+    }
+#endif
+    spiffs_api_unlock(efs->fs);
+    return deferred;
+}
+
+/* Drop the mtime of path (removed), or move it to new_path (renamed) */
+static void vfs_spiffs_forget_mtime(esp_spiffs_t *efs, const char *path, const char *new_path)
+{
+    spiffs_api_lock(efs->fs);
+    esp_spiffs_mtime_t *e = vfs_spiffs_find_mtime(efs, path);
+    if (e != NULL) {
+        if (new_path != NULL) {
+            strlcpy(e->name, new_path, sizeof(e->name));
+        } else {
+            memset(e, 0, sizeof(*e));
+        }
+    }
+    spiffs_api_unlock(efs->fs);
+}
+
+/* Write the dirty mtimes: all of them if now is 0, else (periodic policy)
+ * the ones not written for CONFIG_SPIFFS_MTIME_PERIOD seconds */
+static esp_err_t vfs_spiffs_flush_mtimes(esp_spiffs_t *efs, time_t now)
+{
+    esp_err_t err = ESP_OK;
+    for (int i = 0; i < CONFIG_SPIFFS_MTIME_FILES; i++) {
+        esp_spiffs_mtime_t m;
+        spiffs_api_lock(efs->fs);
+        m = efs->mtimes[i];
+        bool flush = m.name[0] != '\0' && m.mtime != m.written;
+#ifdef CONFIG_SPIFFS_MTIME_PERIODIC
+        flush = flush && (now == 0 || now - m.written >= CONFIG_SPIFFS_MTIME_PERIOD);
+#endif
+        if (flush) {
+            efs->mtimes[i].written = m.mtime;
+        }
+        spiffs_api_unlock(efs->fs);
+        if (!flush) {
+            continue;
+        }
+        // not locked while writing: SPIFFS takes the FS lock itself
+        s32_t ret = vfs_spiffs_write_mtime(efs, -1, m.name, m.mtime);
+        if (ret != SPIFFS_OK && ret != SPIFFS_ERR_NOT_FOUND) {
+            ESP_LOGW(TAG, "Failed to update mtime of %s (%d)", m.name, ret);
+            err = ESP_FAIL;
+        }
+    }
+    return err;
+}
+#endif //SPIFFS_MTIME_DEFERRED
+
+static void vfs_spiffs_update_mtime(esp_spiffs_t *efs, spiffs_file fd, const char *path)
+{
+#ifdef CONFIG_SPIFFS_USE_MTIME
+    time_t t = time(NULL);
+#ifdef SPIFFS_MTIME_DEFERRED
+    esp_spiffs_mtime_t evicted;
+    bool deferred = vfs_spiffs_defer_mtime(efs, path, t, &evicted);
+    if (evicted.name[0] != '\0') {
+        s32_t ret = vfs_spiffs_write_mtime(efs, -1, evicted.name, evicted.mtime);
+        if (ret != SPIFFS_OK && ret != SPIFFS_ERR_NOT_FOUND) {
+            ESP_LOGW(TAG, "Failed to update mtime of %s (%d)", evicted.name, ret);
+        }
+    }
+#ifdef CONFIG_SPIFFS_MTIME_PERIODIC
+    vfs_spiffs_flush_mtimes(efs, t);
+#endif
+    if (deferred) {
+        return;
+    }
+#endif //SPIFFS_MTIME_DEFERRED
+    s32_t ret = vfs_spiffs_write_mtime(efs, fd, path, t);
     if (ret != SPIFFS_OK) {
         ESP_LOGW(TAG, "Failed to update mtime (%d)", ret);
     }
 #endif //CONFIG_SPIFFS_USE_MTIME
 }
 
-static time_t vfs_spiffs_get_mtime(const spiffs_stat* s)
+static time_t vfs_spiffs_get_mtime(esp_spiffs_t *efs, const spiffs_stat* s)
 {
     time_t t = 0;
 #ifdef CONFIG_SPIFFS_USE_MTIME
     memcpy(&t, s->meta, sizeof(t));
+#ifdef SPIFFS_MTIME_DEFERRED
+    spiffs_api_lock(efs->fs);
+    esp_spiffs_mtime_t *e = vfs_spiffs_find_mtime(efs, (const char *)s->name);
+    if (e != NULL && e->mtime != e->written) {
+        t = e->mtime; // not written yet
+    }
+    spiffs_api_unlock(efs->fs);
+#endif
 #endif
     return t;
 }
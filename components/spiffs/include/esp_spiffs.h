@@ -16,6 +16,8 @@
 #define _ESP_SPIFFS_H_
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -32,6 +34,85 @@ typedef struct {
         bool format_if_mount_failed;    /*!< If true, it will format the file system if it fails to mount. */
 } esp_vfs_spiffs_conf_t;
 
+#define ESP_SPIFFS_IO_LAT_BUCKETS 8   /*!< Buckets of the latency histograms */
+
+/**
+ * @brief Flash operations of one kind (read, write or erase) done by SPIFFS
+ */
+typedef struct {
+        uint32_t ops;                   /*!< Number of operations */
+        uint32_t bytes;                 /*!< Bytes read, programmed or erased */
+        uint32_t errors;                /*!< Operations failed */
+        uint32_t time_us;               /*!< Total time of the operations */
+        uint32_t max_us;                /*!< Time of the slowest operation */
+        uint32_t lat[ESP_SPIFFS_IO_LAT_BUCKETS]; /*!< Latency histogram: lat[n] counts the operations that took less than 16 << 2n us (16 us, 64 us, ... 16 ms) and not less than the bound of lat[n-1], the last bucket all the slower ones */
+} esp_spiffs_io_op_stats_t;
+
+/**
+ * @brief Flash I/O of a SPIFFS partition since the mount or the last reset
+ */
+typedef struct {
+        esp_spiffs_io_op_stats_t read;  /*!< esp_partition_read calls */
+        esp_spiffs_io_op_stats_t write; /*!< esp_partition_write calls */
+        esp_spiffs_io_op_stats_t erase; /*!< esp_partition_erase_range calls */
+        uint32_t sectors;               /*!< Sectors in the partition */
+        uint32_t min_sector_erases;     /*!< Erases of the least erased sector since the mount (not reset) */
+        uint32_t max_sector_erases;     /*!< Erases of the most erased sector since the mount (not reset) */
+        uint32_t mtime_writes;          /*!< Index headers rewritten to store an mtime */
+        uint32_t mtime_deferred;        /*!< mtimes kept in RAM instead (see CONFIG_SPIFFS_MTIME_POLICY) */
+} esp_spiffs_io_stats_t;
+
+/**
+ * @brief Waits for the file system lock of a SPIFFS partition since the mount or the last reset
+ */
+typedef struct {
+        uint32_t ops;                   /*!< Times the lock was taken (SPIFFS calls, and again after a read ahead) */
+        uint32_t contended;             /*!< Times it was held by another task */
+        uint32_t wait_us;               /*!< Total time waited for it */
+        uint32_t max_us;                /*!< Longest wait */
+        uint32_t lat[ESP_SPIFFS_IO_LAT_BUCKETS]; /*!< Histogram of the waits, with the buckets of esp_spiffs_io_op_stats_t */
+        uint32_t unlocked_reads;        /*!< Reads ahead done with the lock released (CONFIG_SPIFFS_READ_UNLOCKED) */
+        uint32_t unlocked_retries;      /*!< Reads ahead thrown away because their file or the flash changed meanwhile */
+} esp_spiffs_lock_stats_t;
+
+/**
+ * @brief Read cache of a SPIFFS partition since the mount or the last reset
+ */
+typedef struct {
+        uint32_t pages;                 /*!< Pages in the cache (CONFIG_SPIFFS_CACHE_PAGES) */
+        uint32_t hits;                  /*!< Page reads served from the cache */
+        uint32_t misses;                /*!< Page reads that went to flash */
+        uint32_t evictions;             /*!< Pages dropped to make room for another one */
+} esp_spiffs_cache_stats_t;
+
+/**
+ * @brief RAM index of the object lookup of a SPIFFS partition
+ */
+typedef struct {
+        uint32_t bytes;                 /*!< RAM used by the index */
+        uint32_t objects;               /*!< Files in the index */
+        uint32_t capacity;              /*!< Files the index can hold (CONFIG_SPIFFS_RAM_INDEX_OBJECTS) */
+        bool partial;                   /*!< Some files are not in the index: a name not found is searched on flash */
+        uint32_t hits;                  /*!< Lookups (free page, file by id or by name) answered by the index */
+        uint32_t scans;                 /*!< Lookups that scanned the object lookup pages on flash */
+} esp_spiffs_index_stats_t;
+
+/**
+ * @brief Length of the record starting at rec, of which avail bytes are given:
+ * 0 if more bytes are needed to tell, < 0 if rec is not the start of a record
+ */
+typedef int (*esp_spiffs_record_len_t)(const uint8_t *rec, unsigned int avail);
+
+/**
+ * @brief A file opened by esp_spiffs_open, read without the VFS and stdio
+ */
+typedef struct {
+        int index;                      /*!< Partition of the file */
+        int file;                       /*!< SPIFFS file handle */
+        uint32_t size;                  /*!< Size of the file */
+        uint32_t offset;                /*!< Bytes read or skipped: the file has been read when it is size */
+} esp_spiffs_file_t;
+
 /**
  * Register and mount SPIFFS to VFS with given path prefix.
  *
@@ -95,6 +176,182 @@ esp_err_t esp_spiffs_format(const char* partition_label);
  */
 esp_err_t esp_spiffs_info(const char* partition_label, size_t *total_bytes, size_t *used_bytes);
 
+/**
+ * Get the flash I/O done by SPIFFS
+ *
+ * @param partition_label           Optional, label of the partition to get the statistics for.
+ *                                  If not specified, first partition with subtype=spiffs is used.
+ * @param[out] stats                Operations since the mount or the last reset
+ * @param reset                     If true, the counters of the operations are cleared
+ *                                  (the erases of each sector are never cleared)
+ *
+ * @return
+ *          - ESP_OK                  if success
+ *          - ESP_ERR_INVALID_STATE   if not mounted
+ *          - ESP_ERR_NOT_SUPPORTED   if CONFIG_SPIFFS_IO_STATS is not enabled
+ */
+esp_err_t esp_spiffs_get_io_stats(const char* partition_label, esp_spiffs_io_stats_t *stats, bool reset);
+
+/**
+ * Get the waits for the file system lock, taken by every SPIFFS call
+ *
+ * @param partition_label           Optional, label of the partition to get the statistics for.
+ *                                  If not specified, first partition with subtype=spiffs is used.
+ * @param[out] stats                Waits since the mount or the last reset
+ * @param reset                     If true, the counters are cleared
+ *
+ * @return
+ *          - ESP_OK                  if success
+ *          - ESP_ERR_INVALID_STATE   if not mounted
+ *          - ESP_ERR_NOT_SUPPORTED   if CONFIG_SPIFFS_LOCK_STATS is not enabled
+ */
+esp_err_t esp_spiffs_get_lock_stats(const char* partition_label, esp_spiffs_lock_stats_t *stats, bool reset);
+
+/**
+ * Get the statistics of the SPIFFS read cache
+ *
+ * @param partition_label           Optional, label of the partition to get the statistics for.
+ *                                  If not specified, first partition with subtype=spiffs is used.
+ * @param[out] stats                Lookups since the mount or the last reset
+ * @param reset                     If true, the counters are cleared
+ *
+ * @return
+ *          - ESP_OK                  if success
+ *          - ESP_ERR_INVALID_STATE   if not mounted
+ *          - ESP_ERR_NOT_SUPPORTED   if CONFIG_SPIFFS_CACHE is not enabled
+ */
+esp_err_t esp_spiffs_get_cache_stats(const char* partition_label, esp_spiffs_cache_stats_t *stats, bool reset);
+
+/**
+ * Get the statistics of the SPIFFS RAM index
+ *
+ * @param partition_label           Optional, label of the partition to get the statistics for.
+ *                                  If not specified, first partition with subtype=spiffs is used.
+ * @param[out] stats                Lookups since the mount or the last reset
+ * @param reset                     If true, the counters of the lookups are cleared
+ *
+ * @return
+ *          - ESP_OK                  if success
+ *          - ESP_ERR_INVALID_STATE   if not mounted
+ *          - ESP_ERR_NOT_SUPPORTED   if CONFIG_SPIFFS_RAM_INDEX is not enabled
+ */
+esp_err_t esp_spiffs_get_index_stats(const char* partition_label, esp_spiffs_index_stats_t *stats, bool reset);
+
+/**
+ * Save a checkpoint of the state found by the mount scan in the partition
+ * CONFIG_SPIFFS_CHECKPOINT_PARTITION, also done by esp_vfs_spiffs_unregister.
+ * The next mount uses it instead of reading the object lookup of every block
+ * if the SPIFFS partition has not been written since: call it when no write
+ * is expected for a while. Nothing is written if the checkpoint saved last is
+ * still valid.
+ *
+ * @param partition_label           Optional, label of the partition.
+ *                                  If not specified, first partition with subtype=spiffs is used.
+ *
+ * @return
+ *          - ESP_OK                  if success
+ *          - ESP_ERR_INVALID_STATE   if not mounted
+ *          - ESP_ERR_NOT_FOUND       if there is no checkpoint partition
+ *          - ESP_ERR_NOT_SUPPORTED   if CONFIG_SPIFFS_CHECKPOINT is not enabled
+ *          - ESP_FAIL                if the checkpoint could not be written
+ */
+esp_err_t esp_spiffs_checkpoint(const char* partition_label);
+
+/**
+ * Write the mtimes kept in RAM by CONFIG_SPIFFS_MTIME_PERIODIC or
+ * CONFIG_SPIFFS_MTIME_ON_SYNC to the index headers of their files, also done
+ * by esp_vfs_spiffs_unregister. Each costs a page program.
+ *
+ * @param partition_label           Optional, label of the partition.
+ *                                  If not specified, first partition with subtype=spiffs is used.
+ *
+ * @return
+ *          - ESP_OK                  if success (nothing to write with CONFIG_SPIFFS_MTIME_ON_OPEN)
+ *          - ESP_ERR_INVALID_STATE   if not mounted
+ *          - ESP_FAIL                if an mtime could not be written
+ */
+esp_err_t esp_spiffs_sync_meta(const char* partition_label);
+
+/**
+ * Garbage collect in the background: reclaim blocks in slices (see
+ * CONFIG_SPIFFS_GC_SLICE_PAGES) until CONFIG_SPIFFS_GC_BG_RESERVE blocks are
+ * free and CONFIG_SPIFFS_GC_BG_WATERMARK percent of the pages are free, or
+ * until budget_us have passed. SPIFFS is unlocked between two slices, the
+ * last one may end after the budget. Call it from a low priority task when
+ * the writers are idle, so that a write seldom has to move pages and erase
+ * a block itself.
+ *
+ * @param partition_label           Optional, label of the partition.
+ *                                  If not specified, first partition with subtype=spiffs is used.
+ * @param budget_us                 Time after which no slice is started
+ * @param[out] blocks               Optional, blocks reclaimed (0: nothing to do)
+ *
+ * @return
+ *          - ESP_OK                  if success
+ *          - ESP_ERR_INVALID_STATE   if not mounted
+ *          - ESP_FAIL                if a slice failed
+ */
+esp_err_t esp_spiffs_gc(const char* partition_label, uint32_t budget_us, uint32_t *blocks);
+
+/**
+ * Get the number of erases of each sector since the mount
+ *
+ * @param partition_label           Optional, label of the partition to get the erases for.
+ *                                  If not specified, first partition with subtype=spiffs is used.
+ * @param[out] erases               Erases of sector n in erases[n]
+ * @param count                     Size of erases: at most the sectors of the partition are set
+ *
+ * @return
+ *          - ESP_OK                  if success
+ *          - ESP_ERR_INVALID_STATE   if not mounted
+ *          - ESP_ERR_NOT_SUPPORTED   if CONFIG_SPIFFS_IO_STATS is not enabled
+ */
+esp_err_t esp_spiffs_get_sector_erases(const char* partition_label, uint32_t *erases, size_t count);
+
+/**
+ * Open a file for reading with esp_spiffs_read_records
+ *
+ * @param path                      Path of the file, with the base path of a registered partition
+ * @param[out] file                 The file opened
+ *
+ * @return
+ *          - ESP_OK                  if success
+ *          - ESP_ERR_INVALID_STATE   if no partition is registered at the base path
+ *          - ESP_ERR_NOT_FOUND       if the file can not be opened
+ */
+esp_err_t esp_spiffs_open(const char* path, esp_spiffs_file_t *file);
+
+/**
+ * Read whole records from a file into dst, as many as fit in size bytes,
+ * with a single copy from the SPIFFS pages: the start of a record that does
+ * not fit is read by the next call. If a record is not valid, longer than
+ * size or truncated by the end of the file, the rest of the file is skipped.
+ * Without record_len, size bytes are read.
+ *
+ * @param file                      A file opened by esp_spiffs_open
+ * @param[out] dst                  Where to put the records
+ * @param size                      Size of dst
+ * @param record_len                Optional, length of a record from its first bytes
+ * @param[out] len                  Bytes read, 0 at the end of the file
+ *
+ * @return
+ *          - ESP_OK                  if success
+ *          - ESP_FAIL                if the file could not be read
+ */
+esp_err_t esp_spiffs_read_records(esp_spiffs_file_t *file, void *dst, size_t size,
+                                  esp_spiffs_record_len_t record_len, size_t *len);
+
+/**
+ * Close a file opened by esp_spiffs_open
+ *
+ * @param file                      The file
+ *
+ * @return
+ *          - ESP_OK                  if success
+ *          - ESP_FAIL                if the file was not open
+ */
+esp_err_t esp_spiffs_close(esp_spiffs_file_t *file);
+
 #ifdef __cplusplus
 }
 #endif
@@ -101,6 +101,38 @@ extern void spiffs_api_unlock(struct spiffs_t *fs);
 #define SPIFFS_CACHE_WR             (0)
 #endif
 
+// Enables coalescing of the writes to files opened with SPIFFS_O_APPEND: the
+// write cache page of the file descriptor is filled up to the end of a data
+// page, whole data pages are written without updating the object index and
+// the index is updated every SPIFFS_APPEND_DEFER_PAGES pages, on flush and on
+// close.
+#if SPIFFS_CACHE_WR && defined(CONFIG_SPIFFS_APPEND_DEFER)
+#define SPIFFS_APPEND_DEFER         (1)
+#define SPIFFS_APPEND_DEFER_PAGES   CONFIG_SPIFFS_APPEND_DEFER_PAGES
+#else
+#define SPIFFS_APPEND_DEFER         (0)
+#endif
+
+// Enables the read ahead of sequential reads: SPIFFS_READ_AHEAD_PAGES data
+// pages are read at once into a buffer of SPIFFS_READ_AHEAD_SIZE bytes in the
+// file descriptor.
+#ifdef CONFIG_SPIFFS_READ_AHEAD
+#define SPIFFS_READ_AHEAD           (1)
+#define SPIFFS_READ_AHEAD_PAGES     CONFIG_SPIFFS_READ_AHEAD_PAGES
+#define SPIFFS_READ_AHEAD_SIZE      (CONFIG_SPIFFS_READ_AHEAD_PAGES * CONFIG_SPIFFS_PAGE_SIZE)
+#else
+#define SPIFFS_READ_AHEAD           (0)
+#endif
+
+// The pages read ahead are read from the flash with the file system lock
+// released (SPIFFS_UNLOCK, then SPIFFS_LOCK): they are read again if a block
+// has been erased or their file has changed meanwhile.
+#if SPIFFS_READ_AHEAD && defined(CONFIG_SPIFFS_READ_UNLOCKED)
+#define SPIFFS_READ_UNLOCKED        (1)
+#else
+#define SPIFFS_READ_UNLOCKED        (0)
+#endif
+
 // Enable/disable statistics on caching. Debug/test purpose only.
 #ifdef CONFIG_SPIFFS_CACHE_STATS
 #define SPIFFS_CACHE_STATS          (1)
@@ -109,6 +141,24 @@ extern void spiffs_api_unlock(struct spiffs_t *fs);
 #endif
 #endif
 
+// Enables/disable an index of the object lookup kept in RAM: bitmaps of the free
+// and deleted pages, and the object index header page of each object by id and
+// by hash of the name. If enabled, memory for it is given in spiffs_config.
+#ifdef CONFIG_SPIFFS_RAM_INDEX
+#define SPIFFS_RAM_INDEX            (1)
+#else
+#define SPIFFS_RAM_INDEX            (0)
+#endif
+
+// Enables/disable the mount checkpoint: the state found by the object lookup
+// scan at mount, saved through the checkpoint functions of spiffs_config and
+// used by the next mount if the flash has not been written since.
+#ifdef CONFIG_SPIFFS_CHECKPOINT
+#define SPIFFS_CHECKPOINT           (1)
+#else
+#define SPIFFS_CHECKPOINT           (0)
+#endif
+
 // Always check header of each accessed page to ensure consistent state.
 // If enabled it will increase number of reads, will increase flash.
 #ifdef CONFIG_SPIFFS_PAGE_CHECK
@@ -120,6 +170,12 @@ extern void spiffs_api_unlock(struct spiffs_t *fs);
 // Define maximum number of gc runs to perform to reach desired free pages.
 #define SPIFFS_GC_MAX_RUNS              CONFIG_SPIFFS_GC_MAX_RUNS
 
+// Background garbage collection (SPIFFS_gc_slice): blocks are reclaimed while
+// there are less than SPIFFS_GC_BG_RESERVE free blocks, or less than
+// SPIFFS_GC_BG_WATERMARK percent of free pages.
+#define SPIFFS_GC_BG_RESERVE            CONFIG_SPIFFS_GC_BG_RESERVE
+#define SPIFFS_GC_BG_WATERMARK          CONFIG_SPIFFS_GC_BG_WATERMARK
+
 // Enable/disable statistics on gc. Debug/test purpose only.
 #ifdef CONFIG_SPIFFS_GC_STATS
 #define SPIFFS_GC_STATS             (1)
@@ -143,6 +199,19 @@ extern void spiffs_api_unlock(struct spiffs_t *fs);
 // last erased and erase of this block.
 #define SPIFFS_GC_HEUR_W_ERASE_AGE      (50)
 
+// Victim policy of the garbage collection (spiffs_gc_policy), set in
+// spiffs_config.gc_policy by esp_spiffs.
+#if defined(CONFIG_SPIFFS_GC_POLICY_COST_BENEFIT)
+#define SPIFFS_GC_POLICY                (1)
+#elif defined(CONFIG_SPIFFS_GC_POLICY_HOT_COLD)
+#define SPIFFS_GC_POLICY                (2)
+#else
+#define SPIFFS_GC_POLICY                (0)
+#endif
+// Hot/cold policy: a block erased less than SPIFFS_GC_HOT_AGE percent of the
+// block count erases ago is hot.
+#define SPIFFS_GC_HOT_AGE               (25)
+
 // Object name maximum length. Note that this length include the
 // zero-termination character, meaning maximum string of characters
 // can at most be SPIFFS_OBJ_NAME_LEN - 1.
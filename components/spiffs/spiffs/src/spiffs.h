@@ -62,6 +62,8 @@ extern "C" {
 
 #define SPIFFS_ERR_SEEK_BOUNDS          -10040
 
+#define SPIFFS_ERR_CKPT                 -10041
+
 
 #define SPIFFS_ERR_INTERNAL             -10050
 
@@ -98,6 +100,16 @@ typedef s32_t (*spiffs_write)(u32_t addr, u32_t size, u8_t *src);
 typedef s32_t (*spiffs_erase)(u32_t addr, u32_t size);
 #endif // SPIFFS_HAL_CALLBACK_EXTRA
 
+#if SPIFFS_CHECKPOINT
+/* checkpoint read call function type: reads from the checkpoint saved last */
+typedef s32_t (*spiffs_ckpt_read)(struct spiffs_t *fs, u32_t offset, u32_t size, u8_t *dst);
+/* checkpoint write call function type: writes to the checkpoint saved last,
+   over erased bytes or clearing bits like a flash write */
+typedef s32_t (*spiffs_ckpt_write)(struct spiffs_t *fs, u32_t offset, u32_t size, const u8_t *src);
+/* checkpoint erase call function type: starts a new checkpoint, all bytes erased */
+typedef s32_t (*spiffs_ckpt_erase)(struct spiffs_t *fs);
+#endif // SPIFFS_CHECKPOINT
+
 /* file system check callback report operation */
 typedef enum {
   SPIFFS_CHECK_LOOKUP = 0,
@@ -135,9 +147,26 @@ typedef enum {
   SPIFFS_CB_DELETED
 } spiffs_fileop_type;
 
+/* garbage collection victim policy, scoring each block from its deleted and
+   used pages and its erase age (erases of the file system since the block was
+   last erased) */
+typedef enum {
+  /* the most deleted pages, weighted with SPIFFS_GC_HEUR_W_* */
+  SPIFFS_GC_POLICY_GREEDY = 0,
+  /* the most deleted pages times the age, per page read and moved */
+  SPIFFS_GC_POLICY_COST_BENEFIT,
+  /* cost-benefit, but the young (hot) blocks with used pages come last */
+  SPIFFS_GC_POLICY_HOT_COLD
+} spiffs_gc_policy;
+
 /* file system listener callback function */
 typedef void (*spiffs_file_callback)(struct spiffs_t *fs, spiffs_fileop_type op, spiffs_obj_id obj_id, spiffs_page_ix pix);
 
+/* record length function type of SPIFFS_read_records: the length of the record
+   starting at rec, of which avail bytes are given; 0 if more bytes are needed
+   to tell, < 0 if rec is not the start of a record */
+typedef s32_t (*spiffs_record_len)(const u8_t *rec, u32_t avail);
+
 #ifndef SPIFFS_DBG
 #define SPIFFS_DBG(...) \
     printf(__VA_ARGS__)
@@ -226,6 +255,22 @@ typedef struct {
   // an integer offset added to each file handle
   u16_t fh_ix_offset;
 #endif
+#if SPIFFS_RAM_INDEX
+  // memory for the ram index, built at mount, see SPIFFS_RAM_INDEX_BUF_SIZE;
+  // 0 if the object lookup is always scanned on flash
+  void *ram_index;
+  // size of ram_index
+  u32_t ram_index_size;
+#endif
+  // victim policy of the garbage collection, spiffs_gc_policy
+  u8_t gc_policy;
+#if SPIFFS_CHECKPOINT
+  // checkpoint functions, see SPIFFS_checkpoint; 0 if the object lookup is
+  // always scanned at mount
+  spiffs_ckpt_read ckpt_read_f;
+  spiffs_ckpt_write ckpt_write_f;
+  spiffs_ckpt_erase ckpt_erase_f;
+#endif
 } spiffs_config;
 
 typedef struct spiffs_t {
@@ -265,6 +310,14 @@ typedef struct spiffs_t {
   u8_t cleaning;
   // max erase count amongst all blocks
   spiffs_obj_id max_erase_count;
+#if SPIFFS_READ_UNLOCKED
+  // blocks erased since the mount: the pages read with the lock released are
+  // valid if it has not changed meanwhile
+  u32_t erase_seq;
+  // read aheads done with the lock released, and the ones found not valid
+  u32_t stats_ra_unlocked;
+  u32_t stats_ra_retries;
+#endif
 
 #if SPIFFS_GC_STATS
   u32_t stats_gc_runs;
@@ -287,6 +340,11 @@ typedef struct spiffs_t {
   spiffs_file_callback file_cb_f;
   // mounted flag
   u8_t mounted;
+#if SPIFFS_CHECKPOINT
+  // the checkpoint saved last matches the flash: it is invalidated before the
+  // next write or erase
+  u8_t ckpt_live;
+#endif
   // user data
   void *user_data;
   // config magic
@@ -378,6 +436,8 @@ s32_t SPIFFS_probe_fs(spiffs_config *config);
  * If SPIFFS_USE_MAGIC is enabled the mounting may fail with SPIFFS_ERR_NOT_A_FS
  * if the flash does not contain a recognizable file system.
  * In this case, SPIFFS_format must be called prior to remounting.
+ * If SPIFFS_CHECKPOINT is enabled and a valid checkpoint is found, the state
+ * saved in it is used instead of scanning the object lookup of every block.
  * @param fs            the file system struct
  * @param config        the physical and logical configuration of the file system
  * @param work          a memory work buffer comprising 2*config->log_page_size
@@ -395,7 +455,8 @@ s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
 
 /**
  * Unmounts the file system. All file handles will be flushed of any
- * cached writes and closed.
+ * cached writes and closed. If SPIFFS_CHECKPOINT is enabled a checkpoint is
+ * saved.
  * @param fs            the file system struct
  */
 void SPIFFS_unmount(spiffs *fs);
@@ -460,6 +521,21 @@ spiffs_file SPIFFS_open_by_page(spiffs *fs, spiffs_page_ix page_ix, spiffs_flags
  */
 s32_t SPIFFS_read(spiffs *fs, spiffs_file fh, void *buf, s32_t len);
 
+/**
+ * Reads whole records from given filehandle, as many as fit in len bytes:
+ * they are copied to buf straight from the data pages (or from the read
+ * ahead buffer of the file). The start of a record that does not fit is left
+ * for the next call. If a record is not valid, longer than len or truncated
+ * by the end of the file, the rest of the file is skipped.
+ * @param fs            the file system struct
+ * @param fh            the filehandle
+ * @param buf           where to put the records
+ * @param len           size of buf
+ * @param record_len    length of a record from its first bytes
+ * @returns number of bytes read (0 at the end of the file), or -1 if error
+ */
+s32_t SPIFFS_read_records(spiffs *fs, spiffs_file fh, void *buf, s32_t len, spiffs_record_len record_len);
+
 /**
  * Writes to given filehandle.
  * @param fs            the file system struct
@@ -674,6 +750,40 @@ s32_t SPIFFS_gc_quick(spiffs *fs, u16_t max_free_pages);
  */
 s32_t SPIFFS_gc(spiffs *fs, u32_t size);
 
+/**
+ * Reclaims one block in the background, so that a later write seldom has to
+ * run the garbage collector itself: a block without free pages whose used
+ * pages (at most max_pages) are moved elsewhere before it is erased, the one
+ * with the fewest used pages first. It does something only while there are
+ * less than SPIFFS_GC_BG_RESERVE free blocks or less than
+ * SPIFFS_GC_BG_WATERMARK percent of free pages, so it can be called whenever
+ * the system is idle; each call holds the lock for at most max_pages page
+ * moves and one erase.
+ * Returns the pages moved, or SPIFFS_ERR_NO_DELETED_BLOCKS (err_no is set)
+ * if there is nothing to reclaim within max_pages.
+ *
+ * @param fs            the file system struct
+ * @param max_pages     maximum number of used pages to move
+ */
+s32_t SPIFFS_gc_slice(spiffs *fs, u32_t max_pages);
+
+#if SPIFFS_CHECKPOINT
+/**
+ * Saves the state found by the object lookup scan at mount (block counters,
+ * free cursor, max erase count and the ram index, if any) through the
+ * checkpoint functions of the configuration. The next mount uses it instead
+ * of scanning if the flash has not been written since: the first write or
+ * erase after the checkpoint invalidates it.
+ * Nothing is written if the checkpoint saved last is still valid.
+ *
+ * Will set err_no to SPIFFS_ERR_NOT_CONFIGURED if there are no checkpoint
+ * functions, SPIFFS_ERR_CKPT if the checkpoint can not be written.
+ *
+ * @param fs            the file system struct
+ */
+s32_t SPIFFS_checkpoint(spiffs *fs);
+#endif
+
 /**
  * Check if EOF reached.
  * @param fs            the file system struct
@@ -10,20 +10,86 @@
 
 #if SPIFFS_CACHE
 
+// key of the write cache pages in the hash table, apart from the page indices of the read pages
+#define SPIFFS_CACHE_KEY_WR(obj_id) ((u32_t)(obj_id) | 0x10000)
+
+static u16_t spiffs_cache_bucket(spiffs_cache *cache, u32_t key) {
+  return (u16_t)((key * 2654435761u) >> 16) & cache->hash_mask;
+}
+
+static u32_t spiffs_cache_key(spiffs_cache_page *cp) {
+  if (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) {
+#if SPIFFS_CACHE_WR
+    return SPIFFS_CACHE_KEY_WR(cp->obj_id);
+#endif
+  }
+  return cp->pix;
+}
+
+static void spiffs_cache_hash_insert(spiffs *fs, spiffs_cache *cache, spiffs_cache_page *cp) {
+  (void)fs;
+  u16_t b = spiffs_cache_bucket(cache, spiffs_cache_key(cp));
+  cp->hnext = cache->hash[b];
+  cache->hash[b] = cp->ix;
+}
+
+static void spiffs_cache_hash_remove(spiffs *fs, spiffs_cache *cache, spiffs_cache_page *cp) {
+  u16_t *link = &cache->hash[spiffs_cache_bucket(cache, spiffs_cache_key(cp))];
+  while (*link != SPIFFS_CACHE_NIL) {
+    if (*link == cp->ix) {
+      *link = cp->hnext;
+      return;
+    }
+    link = &spiffs_get_cache_page_hdr(fs, cache, *link)->hnext;
+  }
+}
+
+static void spiffs_cache_lru_unlink(spiffs *fs, spiffs_cache *cache, spiffs_cache_page *cp) {
+  if (cp->prev != SPIFFS_CACHE_NIL) {
+    spiffs_get_cache_page_hdr(fs, cache, cp->prev)->next = cp->next;
+  } else {
+    cache->lru_first = cp->next;
+  }
+  if (cp->next != SPIFFS_CACHE_NIL) {
+    spiffs_get_cache_page_hdr(fs, cache, cp->next)->prev = cp->prev;
+  } else {
+    cache->lru_last = cp->prev;
+  }
+}
+
+static void spiffs_cache_lru_push(spiffs *fs, spiffs_cache *cache, spiffs_cache_page *cp) {
+  cp->prev = SPIFFS_CACHE_NIL;
+  cp->next = cache->lru_first;
+  if (cache->lru_first != SPIFFS_CACHE_NIL) {
+    spiffs_get_cache_page_hdr(fs, cache, cache->lru_first)->prev = cp->ix;
+  } else {
+    cache->lru_last = cp->ix;
+  }
+  cache->lru_first = cp->ix;
+}
+
+// marks a cached page as the most recently used
+static void spiffs_cache_page_touch(spiffs *fs, spiffs_cache *cache, spiffs_cache_page *cp) {
+  if (cache->lru_first != cp->ix) {
+    spiffs_cache_lru_unlink(fs, cache, cp);
+    spiffs_cache_lru_push(fs, cache, cp);
+  }
+}
+
 // returns cached page for give page index, or null if no such cached page
 static spiffs_cache_page *spiffs_cache_page_get(spiffs *fs, spiffs_page_ix pix) {
   spiffs_cache *cache = spiffs_get_cache(fs);
-  if ((cache->cpage_use_map & cache->cpage_use_mask) == 0) return 0;
-  int i;
-  for (i = 0; i < cache->cpage_count; i++) {
-    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-    if ((cache->cpage_use_map & (1<<i)) &&
-        (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) == 0 &&
+  if (cache->cpage_count == 0) return 0;
+  u16_t ix = cache->hash[spiffs_cache_bucket(cache, pix)];
+  while (ix != SPIFFS_CACHE_NIL) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, ix);
+    if ((cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) == 0 &&
         cp->pix == pix ) {
-      //SPIFFS_CACHE_DBG("CACHE_GET: have cache page "_SPIPRIi" for "_SPIPRIpg"\n", i, pix);
-      cp->last_access = cache->last_access;
+      //SPIFFS_CACHE_DBG("CACHE_GET: have cache page "_SPIPRIi" for "_SPIPRIpg"\n", ix, pix);
+      spiffs_cache_page_touch(fs, cache, cp);
       return cp;
     }
+    ix = cp->hnext;
   }
   //SPIFFS_CACHE_DBG("CACHE_GET: no cache for "_SPIPRIpg"\n", pix);
   return 0;
@@ -34,7 +100,7 @@ static s32_t spiffs_cache_page_free(spiffs *fs, int ix, u8_t write_back) {
   s32_t res = SPIFFS_OK;
   spiffs_cache *cache = spiffs_get_cache(fs);
   spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, ix);
-  if (cache->cpage_use_map & (1<<ix)) {
+  if (cp->flags & SPIFFS_CACHE_FLAG_USED) {
     if (write_back &&
         (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) == 0 &&
         (cp->flags & SPIFFS_CACHE_FLAG_DIRTY)) {
@@ -51,38 +117,35 @@ static s32_t spiffs_cache_page_free(spiffs *fs, int ix, u8_t write_back) {
     {
       SPIFFS_CACHE_DBG("CACHE_FREE: free cache page "_SPIPRIi" pix "_SPIPRIpg"\n", ix, cp->pix);
     }
-    cache->cpage_use_map &= ~(1 << ix);
+    spiffs_cache_hash_remove(fs, cache, cp);
+    spiffs_cache_lru_unlink(fs, cache, cp);
+    cp->next = cache->free_first;
+    cache->free_first = cp->ix;
     cp->flags = 0;
   }
 
   return res;
 }
 
-// removes the oldest accessed cached page
+// removes the least recently used cached page among the ones with the given flags, unless a page is free
 static s32_t spiffs_cache_page_remove_oldest(spiffs *fs, u8_t flag_mask, u8_t flags) {
   s32_t res = SPIFFS_OK;
   spiffs_cache *cache = spiffs_get_cache(fs);
 
-  if ((cache->cpage_use_map & cache->cpage_use_mask) != cache->cpage_use_mask) {
+  if (cache->free_first != SPIFFS_CACHE_NIL) {
     // at least one free cpage
     return SPIFFS_OK;
   }
 
-  // all busy, scan thru all to find the cpage which has oldest access
-  int i;
-  int cand_ix = -1;
-  u32_t oldest_val = 0;
-  for (i = 0; i < cache->cpage_count; i++) {
-    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-    if ((cache->last_access - cp->last_access) > oldest_val &&
-        (cp->flags & flag_mask) == flags) {
-      oldest_val = cache->last_access - cp->last_access;
-      cand_ix = i;
+  // all busy, walk from the least recently used one
+  u16_t ix = cache->lru_last;
+  while (ix != SPIFFS_CACHE_NIL) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, ix);
+    if ((cp->flags & flag_mask) == flags) {
+      cache->evictions++;
+      return spiffs_cache_page_free(fs, ix, 1);
     }
-  }
-
-  if (cand_ix >= 0) {
-    res = spiffs_cache_page_free(fs, cand_ix, 1);
+    ix = cp->prev;
   }
 
   return res;
@@ -91,22 +154,16 @@ static s32_t spiffs_cache_page_remove_oldest(spiffs *fs, u8_t flag_mask, u8_t fl
 // allocates a new cached page and returns it, or null if all cache pages are busy
 static spiffs_cache_page *spiffs_cache_page_allocate(spiffs *fs) {
   spiffs_cache *cache = spiffs_get_cache(fs);
-  if (cache->cpage_use_map == 0xffffffff) {
+  if (cache->free_first == SPIFFS_CACHE_NIL) {
     // out of cache memory
     return 0;
   }
-  int i;
-  for (i = 0; i < cache->cpage_count; i++) {
-    if ((cache->cpage_use_map & (1<<i)) == 0) {
-      spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-      cache->cpage_use_map |= (1<<i);
-      cp->last_access = cache->last_access;
-      //SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi"\n", i);
-      return cp;
-    }
-  }
-  // out of cache entries
-  return 0;
+  spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, cache->free_first);
+  cache->free_first = cp->next;
+  cp->flags = SPIFFS_CACHE_FLAG_USED;
+  spiffs_cache_lru_push(fs, cache, cp);
+  //SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi"\n", cp->ix);
+  return cp;
 }
 
 // drops the cache page for give page index
@@ -131,13 +188,12 @@ s32_t spiffs_phys_rd(
   s32_t res = SPIFFS_OK;
   spiffs_cache *cache = spiffs_get_cache(fs);
   spiffs_cache_page *cp =  spiffs_cache_page_get(fs, SPIFFS_PADDR_TO_PAGE(fs, addr));
-  cache->last_access++;
   if (cp) {
     // we've already got one, you see
 #if SPIFFS_CACHE_STATS
     fs->cache_hits++;
 #endif
-    cp->last_access = cache->last_access;
+    cache->hits++;
     u8_t *mem =  spiffs_get_cache_page(fs, cache, cp->ix);
     _SPIFFS_MEMCPY(dst, &mem[SPIFFS_PADDR_TO_PAGE_OFFSET(fs, addr)], len);
   } else {
@@ -148,14 +204,16 @@ s32_t spiffs_phys_rd(
 #if SPIFFS_CACHE_STATS
     fs->cache_misses++;
 #endif
+    cache->misses++;
     // this operation will always free one cache page (unless all already free),
     // the result code stems from the write operation of the possibly freed cache page
     res = spiffs_cache_page_remove_oldest(fs, SPIFFS_CACHE_FLAG_TYPE_WR, 0);
 
     cp = spiffs_cache_page_allocate(fs);
     if (cp) {
-      cp->flags = SPIFFS_CACHE_FLAG_WRTHRU;
+      cp->flags |= SPIFFS_CACHE_FLAG_WRTHRU;
       cp->pix = SPIFFS_PADDR_TO_PAGE(fs, addr);
+      spiffs_cache_hash_insert(fs, cache, cp);
       SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi" for pix "_SPIPRIpg "\n", cp->ix, cp->pix);
 
       s32_t res2 = SPIFFS_HAL_READ(fs,
@@ -207,9 +265,6 @@ s32_t spiffs_phys_wr(
     u8_t *mem =  spiffs_get_cache_page(fs, cache, cp->ix);
     _SPIFFS_MEMCPY(&mem[SPIFFS_PADDR_TO_PAGE_OFFSET(fs, addr)], src, len);
 
-    cache->last_access++;
-    cp->last_access = cache->last_access;
-
     if (cp->flags & SPIFFS_CACHE_FLAG_WRTHRU) {
       // page is being updated, no write-cache, just pass thru
       return SPIFFS_HAL_WRITE(fs, addr, len, src);
@@ -226,20 +281,16 @@ s32_t spiffs_phys_wr(
 // returns the cache page that this fd refers, or null if no cache page
 spiffs_cache_page *spiffs_cache_page_get_by_fd(spiffs *fs, spiffs_fd *fd) {
   spiffs_cache *cache = spiffs_get_cache(fs);
+  if (cache->cpage_count == 0) return 0;
+  u16_t ix = cache->hash[spiffs_cache_bucket(cache, SPIFFS_CACHE_KEY_WR(fd->obj_id))];
 
-  if ((cache->cpage_use_map & cache->cpage_use_mask) == 0) {
-    // all cpages free, no cpage cannot be assigned to obj_id
-    return 0;
-  }
-
-  int i;
-  for (i = 0; i < cache->cpage_count; i++) {
-    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-    if ((cache->cpage_use_map & (1<<i)) &&
-        (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) &&
+  while (ix != SPIFFS_CACHE_NIL) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, ix);
+    if ((cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) &&
         cp->obj_id == fd->obj_id) {
       return cp;
     }
+    ix = cp->hnext;
   }
 
   return 0;
@@ -257,8 +308,9 @@ spiffs_cache_page *spiffs_cache_page_allocate_by_fd(spiffs *fs, spiffs_fd *fd) {
     return 0;
   }
 
-  cp->flags = SPIFFS_CACHE_FLAG_TYPE_WR;
+  cp->flags |= SPIFFS_CACHE_FLAG_TYPE_WR;
   cp->obj_id = fd->obj_id;
+  spiffs_cache_hash_insert(fs, spiffs_get_cache(fs), cp);
   fd->cache_page = cp;
   SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi" for fd "_SPIPRIfd ":"_SPIPRIid "\n", cp->ix, fd->file_nbr, fd->obj_id);
   return cp;
@@ -282,38 +334,40 @@ void spiffs_cache_fd_release(spiffs *fs, spiffs_cache_page *cp) {
 
 #endif
 
-// initializes the cache
+// initializes the cache: the pages follow the cache struct, the hash buckets follow the pages
 void spiffs_cache_init(spiffs *fs) {
   if (fs->cache == 0) return;
   u32_t sz = fs->cache_size;
-  u32_t cache_mask = 0;
   int i;
+  if (sz < sizeof(spiffs_cache)) return;
   int cache_entries =
-      (sz - sizeof(spiffs_cache)) / (SPIFFS_CACHE_PAGE_SIZE(fs));
-  if (cache_entries <= 0) return;
+      (sz - sizeof(spiffs_cache)) / (SPIFFS_CACHE_PAGE_SIZE(fs) + 2*sizeof(u16_t));
+  if (cache_entries > SPIFFS_CACHE_NIL - 1) cache_entries = SPIFFS_CACHE_NIL - 1;
 
-  for (i = 0; i < cache_entries; i++) {
-    cache_mask <<= 1;
-    cache_mask |= 1;
+  // buckets: a power of two between cache_entries and 2*cache_entries
+  u32_t buckets = 1;
+  while (buckets < (u32_t)cache_entries) {
+    buckets <<= 1;
   }
 
-  spiffs_cache cache;
-  memset(&cache, 0, sizeof(spiffs_cache));
-  cache.cpage_count = cache_entries;
-  cache.cpages = (u8_t *)((u8_t *)fs->cache + sizeof(spiffs_cache));
-
-  cache.cpage_use_map = 0xffffffff;
-  cache.cpage_use_mask = cache_mask;
-  _SPIFFS_MEMCPY(fs->cache, &cache, sizeof(spiffs_cache));
-
   spiffs_cache *c = spiffs_get_cache(fs);
+  memset(c, 0, sizeof(spiffs_cache));
+  c->cpage_count = cache_entries;
+  c->cpages = (u8_t *)((u8_t *)fs->cache + sizeof(spiffs_cache));
+  c->hash = (u16_t *)(c->cpages + cache_entries * SPIFFS_CACHE_PAGE_SIZE(fs));
+  c->hash_mask = buckets - 1;
+  c->lru_first = c->lru_last = c->free_first = SPIFFS_CACHE_NIL;
+  if (cache_entries == 0) return; // no room for a page: every read goes to flash
 
   memset(c->cpages, 0, c->cpage_count * SPIFFS_CACHE_PAGE_SIZE(fs));
+  memset(c->hash, 0xff, buckets * sizeof(u16_t));
 
-  c->cpage_use_map &= ~(c->cpage_use_mask);
-  for (i = 0; i < cache.cpage_count; i++) {
-    spiffs_get_cache_page_hdr(fs, c, i)->ix = i;
+  for (i = 0; i < c->cpage_count; i++) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, c, i);
+    cp->ix = i;
+    cp->next = i + 1 < c->cpage_count ? i + 1 : SPIFFS_CACHE_NIL;
   }
+  c->free_first = 0;
 }
 
 #endif // SPIFFS_CACHE
@@ -0,0 +1,144 @@
+/*
+ * spiffs_checkpoint.c
+ *
+ * Checkpoint of the state found by the object lookup scan at mount, so that
+ * the next mount does not read the object lookup of every block. It is valid
+ * until the flash is written or erased: the first write or erase after it
+ * clears its live word (see SPIFFS_HAL_MODIFY).
+ */
+
+#include <stddef.h>
+
+#include "spiffs.h"
+#include "spiffs_nucleus.h"
+
+#if SPIFFS_CHECKPOINT
+
+#define SPIFFS_CKPT_SUM_SEED            2166136261u
+
+// FNV-1a
+static u32_t spiffs_checkpoint_sum(u32_t sum, const u8_t *p, u32_t len) {
+  while (len--) {
+    sum = (sum ^ *p++) * 16777619u;
+  }
+  return sum;
+}
+
+static u32_t spiffs_checkpoint_hdr_sum(const spiffs_checkpoint_hdr *hdr) {
+  return spiffs_checkpoint_sum(SPIFFS_CKPT_SUM_SEED, (const u8_t *)&hdr->data_size,
+      sizeof(spiffs_checkpoint_hdr) - offsetof(spiffs_checkpoint_hdr, data_size));
+}
+
+static s32_t spiffs_checkpoint_use(spiffs *fs, const spiffs_checkpoint_hdr *hdr) {
+  if (hdr->version != SPIFFS_CKPT_VERSION ||
+      hdr->phys_size != SPIFFS_CFG_PHYS_SZ(fs) ||
+      hdr->log_block_size != SPIFFS_CFG_LOG_BLOCK_SZ(fs) ||
+      hdr->log_page_size != SPIFFS_CFG_LOG_PAGE_SZ(fs) ||
+      hdr->free_cursor_block_ix >= fs->block_count ||
+      // the free cursor is left after the last entry of a full block
+      hdr->free_cursor_obj_lu_entry > SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs)) {
+    return SPIFFS_ERR_CKPT;
+  }
+  u32_t check = spiffs_checkpoint_hdr_sum(hdr);
+#if SPIFFS_RAM_INDEX
+  // a ram index is rebuilt by the scan if the checkpoint does not have it
+  if (fs->cfg.ram_index != 0) {
+    u8_t *data = spiffs_ram_index_ckpt_restore(fs, hdr->obj_count, hdr->partial, hdr->data_size);
+    if (data == 0) return SPIFFS_ERR_CKPT;
+    s32_t res = fs->cfg.ckpt_read_f(fs, sizeof(spiffs_checkpoint_hdr), hdr->data_size, data);
+    if (res != SPIFFS_OK) return SPIFFS_ERR_CKPT;
+    check = spiffs_checkpoint_sum(check, data, hdr->data_size);
+  } else
+#endif
+  if (hdr->data_size != 0) {
+    return SPIFFS_ERR_CKPT;
+  }
+  if (check != hdr->check) return SPIFFS_ERR_CKPT;
+
+  fs->free_blocks = hdr->free_blocks;
+  fs->stats_p_allocated = hdr->stats_p_allocated;
+  fs->stats_p_deleted = hdr->stats_p_deleted;
+  fs->free_cursor_block_ix = hdr->free_cursor_block_ix;
+  fs->free_cursor_obj_lu_entry = hdr->free_cursor_obj_lu_entry;
+  fs->max_erase_count = hdr->max_erase_count;
+#if SPIFFS_RAM_INDEX
+  if (hdr->data_size != 0) spiffs_ram_index_scan_end(fs);
+#endif
+  return SPIFFS_OK;
+}
+
+// Restores the state saved by the last checkpoint, at mount. Returns
+// SPIFFS_OK if it has been used, else the object lookup must be scanned
+s32_t spiffs_checkpoint_load(spiffs *fs) {
+  s32_t res;
+  spiffs_checkpoint_hdr hdr;
+  fs->ckpt_live = 0;
+  if (fs->cfg.ckpt_read_f == 0 || fs->cfg.ckpt_write_f == 0) return SPIFFS_ERR_NOT_CONFIGURED;
+  res = fs->cfg.ckpt_read_f(fs, 0, sizeof(spiffs_checkpoint_hdr), (u8_t *)&hdr);
+  if (res != SPIFFS_OK || hdr.magic != SPIFFS_CKPT_MAGIC || hdr.live != (u32_t)-1) {
+    return SPIFFS_ERR_CKPT;
+  }
+  // it must not outlive the first write, used or not
+  fs->ckpt_live = 1;
+  res = spiffs_checkpoint_use(fs, &hdr);
+  if (res != SPIFFS_OK) {
+    // e.g. saved with another configuration: it would look valid again to
+    // that configuration once this mount has changed the flash
+    SPIFFS_DBG("checkpoint: not used, dropped\n");
+    (void)spiffs_checkpoint_drop(fs);
+    return res;
+  }
+  SPIFFS_DBG("checkpoint: mounted from checkpoint, "_SPIPRIi" bytes of ram index\n", hdr.data_size);
+  return SPIFFS_OK;
+}
+
+// Saves a checkpoint of the current state, unless the last one is still valid
+s32_t spiffs_checkpoint_save(spiffs *fs) {
+  s32_t res;
+  spiffs_checkpoint_hdr hdr;
+  u8_t *data = 0;
+  if (fs->cfg.ckpt_write_f == 0 || fs->cfg.ckpt_erase_f == 0) return SPIFFS_ERR_NOT_CONFIGURED;
+  if (fs->ckpt_live) return SPIFFS_OK;
+
+  memset(&hdr, 0, sizeof(spiffs_checkpoint_hdr));
+  hdr.magic = SPIFFS_CKPT_MAGIC;
+  hdr.live = (u32_t)-1;
+  hdr.version = SPIFFS_CKPT_VERSION;
+  hdr.phys_size = SPIFFS_CFG_PHYS_SZ(fs);
+  hdr.log_block_size = SPIFFS_CFG_LOG_BLOCK_SZ(fs);
+  hdr.log_page_size = SPIFFS_CFG_LOG_PAGE_SZ(fs);
+  hdr.free_blocks = fs->free_blocks;
+  hdr.stats_p_allocated = fs->stats_p_allocated;
+  hdr.stats_p_deleted = fs->stats_p_deleted;
+  hdr.free_cursor_block_ix = fs->free_cursor_block_ix;
+  hdr.free_cursor_obj_lu_entry = fs->free_cursor_obj_lu_entry;
+  hdr.max_erase_count = fs->max_erase_count;
+#if SPIFFS_RAM_INDEX
+  hdr.data_size = spiffs_ram_index_ckpt_data(fs, &data, &hdr.obj_count, &hdr.partial);
+#endif
+  hdr.check = spiffs_checkpoint_sum(spiffs_checkpoint_hdr_sum(&hdr), data, hdr.data_size);
+
+  // the header is written last: a checkpoint torn by a reset is not valid
+  res = fs->cfg.ckpt_erase_f(fs);
+  if (res == SPIFFS_OK && hdr.data_size != 0) {
+    res = fs->cfg.ckpt_write_f(fs, sizeof(spiffs_checkpoint_hdr), hdr.data_size, data);
+  }
+  if (res == SPIFFS_OK) {
+    res = fs->cfg.ckpt_write_f(fs, 0, sizeof(spiffs_checkpoint_hdr), (const u8_t *)&hdr);
+  }
+  if (res != SPIFFS_OK) return SPIFFS_ERR_CKPT;
+  fs->ckpt_live = 1;
+  return SPIFFS_OK;
+}
+
+// Invalidates the checkpoint saved last, before the flash is changed
+s32_t spiffs_checkpoint_drop(spiffs *fs) {
+  static const u32_t dropped = 0;
+  s32_t res = fs->cfg.ckpt_write_f(fs, offsetof(spiffs_checkpoint_hdr, live), sizeof(u32_t),
+      (const u8_t *)&dropped);
+  if (res != SPIFFS_OK) return SPIFFS_ERR_CKPT;
+  fs->ckpt_live = 0;
+  return SPIFFS_OK;
+}
+
+#endif // SPIFFS_CHECKPOINT
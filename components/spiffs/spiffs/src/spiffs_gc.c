@@ -52,6 +52,13 @@ s32_t spiffs_gc_quick(
     u16_t free_pages_in_block = 0;
 
     int obj_lookup_page = 0;
+#if SPIFFS_RAM_INDEX
+    if (spiffs_ram_index_get(fs)) {
+      // counted in ram, no need to read the object lookup
+      spiffs_ram_index_block_pages(fs, cur_block, &free_pages_in_block, &deleted_pages_in_block);
+      obj_lookup_page = SPIFFS_OBJ_LOOKUP_PAGES(fs);
+    }
+#endif
     // check each object lookup page
     while (res == SPIFFS_OK && obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs)) {
       int entry_offset = obj_lookup_page * entries_per_page;
@@ -195,6 +202,176 @@ s32_t spiffs_gc_check(
   return res;
 }
 
+// Counts the free and deleted pages of a block, from the ram index if there
+// is one, else from the object lookup
+static s32_t spiffs_gc_block_pages(
+    spiffs *fs,
+    spiffs_block_ix bix,
+    u16_t *free_pages,
+    u16_t *deleted_pages) {
+  s32_t res = SPIFFS_OK;
+  int obj_lookup_page = 0;
+  int entries_per_page = (SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id));
+  spiffs_obj_id *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
+  int cur_entry = 0;
+
+#if SPIFFS_RAM_INDEX
+  if (spiffs_ram_index_get(fs)) {
+    spiffs_ram_index_block_pages(fs, bix, free_pages, deleted_pages);
+    return SPIFFS_OK;
+  }
+#endif
+  *free_pages = 0;
+  *deleted_pages = 0;
+  // check each object lookup page, not cached: every block is counted
+  while (res == SPIFFS_OK && obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs)) {
+    int entry_offset = obj_lookup_page * entries_per_page;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, bix * SPIFFS_CFG_LOG_BLOCK_SZ(fs) + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+    // check each entry
+    while (res == SPIFFS_OK &&
+        cur_entry - entry_offset < entries_per_page && cur_entry < (int)(SPIFFS_PAGES_PER_BLOCK(fs)-SPIFFS_OBJ_LOOKUP_PAGES(fs))) {
+      spiffs_obj_id obj_id = obj_lu_buf[cur_entry-entry_offset];
+      if (obj_id == SPIFFS_OBJ_ID_FREE) {
+        (*free_pages)++;
+      } else if (obj_id == SPIFFS_OBJ_ID_DELETED) {
+        (*deleted_pages)++;
+      }
+      cur_entry++;
+    } // per entry
+    obj_lookup_page++;
+  } // per object lookup page
+  return res;
+}
+
+// Erases of the file system since the block was last erased
+static s32_t spiffs_gc_block_age(
+    spiffs *fs,
+    spiffs_block_ix bix,
+    spiffs_obj_id *erase_age) {
+  spiffs_obj_id erase_count;
+  s32_t res = _spiffs_rd(fs, SPIFFS_OP_C_READ | SPIFFS_OP_T_OBJ_LU2, 0,
+      SPIFFS_ERASE_COUNT_PADDR(fs, bix),
+      sizeof(spiffs_obj_id), (u8_t *)&erase_count);
+  SPIFFS_CHECK_RES(res);
+  if (fs->max_erase_count > erase_count) {
+    *erase_age = fs->max_erase_count - erase_count;
+  } else {
+    *erase_age = SPIFFS_OBJ_ID_FREE - (erase_count - fs->max_erase_count);
+  }
+  return res;
+}
+
+// Scores a block for the victim policy of the file system, the larger the
+// better. When the fs is crammed the age is ignored: free pages are needed
+// now, whatever the wear
+static s32_t spiffs_gc_score(
+    spiffs *fs,
+    u16_t deleted_pages,
+    u16_t used_pages,
+    spiffs_obj_id erase_age,
+    char fs_crammed) {
+  u32_t entries = SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs);
+  u32_t age = fs_crammed ? 0 : erase_age;
+  // deleted pages per page read and moved, 1/256 units
+  u32_t benefit = deleted_pages * 256 / (entries + used_pages);
+
+  if (fs->cfg.gc_policy != SPIFFS_GC_POLICY_GREEDY && fs->free_blocks <= 2) {
+    // the last free blocks are in use: an old block with few deleted pages
+    // frees nothing once the index pages of what it moves are rewritten
+    age = 0;
+  }
+  switch (fs->cfg.gc_policy) {
+  case SPIFFS_GC_POLICY_COST_BENEFIT:
+    return (s32_t)(benefit * (age + 1));
+  case SPIFFS_GC_POLICY_HOT_COLD:
+    if (used_pages && age * 100 < fs->block_count * SPIFFS_GC_HOT_AGE) {
+      // hot: what is still used is likely to be deleted soon, taken after
+      // any block of cold data
+      age = 0;
+    }
+    return (s32_t)(benefit * (age + 1));
+  default:
+    return deleted_pages * SPIFFS_GC_HEUR_W_DELET +
+        used_pages * SPIFFS_GC_HEUR_W_USED +
+        age * SPIFFS_GC_HEUR_W_ERASE_AGE;
+  }
+}
+
+// Reclaims one block ahead of the writers, moving at most max_pages used
+// pages: only blocks with deleted pages and without free ones are taken, the
+// best one for the victim policy first. It works while there are less than
+// SPIFFS_GC_BG_RESERVE free blocks (then any block is worth it, like for
+// spiffs_gc_check) or less than SPIFFS_GC_BG_WATERMARK percent of free pages
+// (then only blocks with at least as many deleted pages as used ones, not to
+// wear the flash for nothing).
+// Returns the pages moved, SPIFFS_ERR_NO_DELETED_BLOCKS if there is nothing
+// to do within max_pages
+s32_t spiffs_gc_slice(
+    spiffs *fs,
+    u32_t max_pages) {
+  s32_t res;
+  s32_t data_pages = SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs) * (fs->block_count - 2);
+  s32_t free_pages = data_pages - fs->stats_p_allocated - fs->stats_p_deleted;
+  u8_t short_of_blocks = fs->free_blocks < SPIFFS_GC_BG_RESERVE;
+  spiffs_block_ix bix;
+  spiffs_block_ix cand = (spiffs_block_ix)-1;
+  u16_t cand_used = 0;
+  u16_t cand_deleted = 0;
+  s32_t cand_score = 0;
+
+  if (!short_of_blocks && free_pages * 100 >= data_pages * SPIFFS_GC_BG_WATERMARK) {
+    return SPIFFS_ERR_NO_DELETED_BLOCKS;
+  }
+
+  for (bix = 0; bix < fs->block_count; bix++) {
+    u16_t free_pages_in_block;
+    u16_t deleted_pages_in_block;
+    res = spiffs_gc_block_pages(fs, bix, &free_pages_in_block, &deleted_pages_in_block);
+    SPIFFS_CHECK_RES(res);
+    u16_t used_pages_in_block = SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs) - free_pages_in_block - deleted_pages_in_block;
+    if (free_pages_in_block != 0 || deleted_pages_in_block == 0 || used_pages_in_block > max_pages ||
+        (!short_of_blocks && used_pages_in_block > deleted_pages_in_block)) {
+      continue;
+    }
+    // never crammed, the age counts: else the same blocks would be erased
+    // and filled again by the free cursor
+    spiffs_obj_id erase_age;
+    res = spiffs_gc_block_age(fs, bix, &erase_age);
+    SPIFFS_CHECK_RES(res);
+    s32_t score = spiffs_gc_score(fs, deleted_pages_in_block, used_pages_in_block, erase_age, 0);
+    if (cand == (spiffs_block_ix)-1 || score > cand_score) {
+      cand = bix;
+      cand_used = used_pages_in_block;
+      cand_deleted = deleted_pages_in_block;
+      cand_score = score;
+    }
+  }
+  // the pages moved need room outside the two blocks spiffs_gc_check keeps
+  if (cand == (spiffs_block_ix)-1 || (s32_t)cand_used > free_pages) {
+    return SPIFFS_ERR_NO_DELETED_BLOCKS;
+  }
+
+  SPIFFS_GC_DBG("gc_slice: block "_SPIPRIbl" used:"_SPIPRIi" dele:"_SPIPRIi" free_blocks:"_SPIPRIi"\n",
+      cand, cand_used, cand_deleted, fs->free_blocks);
+#if SPIFFS_GC_STATS
+  fs->stats_gc_runs++;
+#endif
+  if (cand_used == 0) {
+    fs->stats_p_deleted -= cand_deleted;
+  } else {
+    fs->cleaning = 1;
+    res = spiffs_gc_clean(fs, cand);
+    fs->cleaning = 0;
+    SPIFFS_CHECK_RES(res);
+    res = spiffs_gc_erase_page_stats(fs, cand);
+    SPIFFS_CHECK_RES(res);
+  }
+  res = spiffs_gc_erase_block(fs, cand);
+  SPIFFS_CHECK_RES(res);
+  return cand_used;
+}
+
 // Updates page statistics for a block that is about to be erased
 s32_t spiffs_gc_erase_page_stats(
     spiffs *fs,
@@ -232,20 +409,51 @@ s32_t spiffs_gc_erase_page_stats(
   return res;
 }
 
-// Finds block candidates to erase
+// Candidate a is worse than b: lower score, or same score and later block
+#define SPIFFS_GC_CAND_WORSE(blocks, scores, a, b) \
+  ((scores)[a] < (scores)[b] || ((scores)[a] == (scores)[b] && (blocks)[a] > (blocks)[b]))
+
+// Keeps the candidate at heap index ix in the min-heap of the best ones kept:
+// the root is the worst, the one to drop for a better block
+static void spiffs_gc_heap_down(
+    spiffs_block_ix *cand_blocks,
+    s32_t *cand_scores,
+    int count,
+    int ix) {
+  while (1) {
+    int worst = ix;
+    int child = 2*ix + 1;
+    int i;
+    for (i = 0; i < 2 && child + i < count; i++) {
+      if (SPIFFS_GC_CAND_WORSE(cand_blocks, cand_scores, child + i, worst)) {
+        worst = child + i;
+      }
+    }
+    if (worst == ix) break;
+    spiffs_block_ix b = cand_blocks[ix];
+    s32_t sc = cand_scores[ix];
+    cand_blocks[ix] = cand_blocks[worst];
+    cand_scores[ix] = cand_scores[worst];
+    cand_blocks[worst] = b;
+    cand_scores[worst] = sc;
+    ix = worst;
+  }
+}
+
+// Finds block candidates to erase, best first. Every block is scored in one
+// pass for the victim policy and the best ones that fit in the work area are
+// kept in a min-heap, sorted at the end
 s32_t spiffs_gc_find_candidate(
     spiffs *fs,
     spiffs_block_ix **block_candidates,
     int *candidate_count,
     char fs_crammed) {
   s32_t res = SPIFFS_OK;
-  u32_t blocks = fs->block_count;
-  spiffs_block_ix cur_block = 0;
-  u32_t cur_block_addr = 0;
-  spiffs_obj_id *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
-  int cur_entry = 0;
+  spiffs_block_ix cur_block;
+  int count = 0;
+  int last;
 
-  // using fs->work area as sorted candidate memory, (spiffs_block_ix)cand_bix/(s32_t)score
+  // using fs->work area as candidate memory, (spiffs_block_ix)cand_bix/(s32_t)score
   int max_candidates = MIN(fs->block_count, (SPIFFS_CFG_LOG_PAGE_SZ(fs)-8)/(sizeof(spiffs_block_ix) + sizeof(s32_t)));
   *candidate_count = 0;
   memset(fs->work, 0xff, SPIFFS_CFG_LOG_PAGE_SZ(fs));
@@ -259,88 +467,57 @@ s32_t spiffs_gc_find_candidate(
 
   *block_candidates = cand_blocks;
 
-  int entries_per_page = (SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id));
-
-  // check each block
-  while (res == SPIFFS_OK && blocks--) {
-    u16_t deleted_pages_in_block = 0;
-    u16_t used_pages_in_block = 0;
+  // score each block
+  for (cur_block = 0; res == SPIFFS_OK && cur_block < fs->block_count; cur_block++) {
+    u16_t free_pages_in_block;
+    u16_t deleted_pages_in_block;
+    u16_t used_pages_in_block;
+    spiffs_obj_id erase_age = 0;
 
-    int obj_lookup_page = 0;
-    // check each object lookup page
-    while (res == SPIFFS_OK && obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs)) {
-      int entry_offset = obj_lookup_page * entries_per_page;
-      res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
-          0, cur_block_addr + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
-      // check each entry
-      while (res == SPIFFS_OK &&
-          cur_entry - entry_offset < entries_per_page &&
-          cur_entry < (int)(SPIFFS_PAGES_PER_BLOCK(fs)-SPIFFS_OBJ_LOOKUP_PAGES(fs))) {
-        spiffs_obj_id obj_id = obj_lu_buf[cur_entry-entry_offset];
-        if (obj_id == SPIFFS_OBJ_ID_FREE) {
-          // when a free entry is encountered, scan logic ensures that all following entries are free also
-          res = 1; // kill object lu loop
-          break;
-        } else  if (obj_id == SPIFFS_OBJ_ID_DELETED) {
-          deleted_pages_in_block++;
-        } else {
-          used_pages_in_block++;
-        }
-        cur_entry++;
-      } // per entry
-      obj_lookup_page++;
-    } // per object lookup page
-    if (res == 1) res = SPIFFS_OK;
-
-    // calculate score and insert into candidate table
-    // stoneage sort, but probably not so many blocks
-    if (res == SPIFFS_OK /*&& deleted_pages_in_block > 0*/) {
-      // read erase count
-      spiffs_obj_id erase_count;
-      res = _spiffs_rd(fs, SPIFFS_OP_C_READ | SPIFFS_OP_T_OBJ_LU2, 0,
-          SPIFFS_ERASE_COUNT_PADDR(fs, cur_block),
-          sizeof(spiffs_obj_id), (u8_t *)&erase_count);
+    res = spiffs_gc_block_pages(fs, cur_block, &free_pages_in_block, &deleted_pages_in_block);
+    SPIFFS_CHECK_RES(res);
+    used_pages_in_block = SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs) - free_pages_in_block - deleted_pages_in_block;
+    if (!fs_crammed) {
+      res = spiffs_gc_block_age(fs, cur_block, &erase_age);
       SPIFFS_CHECK_RES(res);
+    }
 
-      spiffs_obj_id erase_age;
-      if (fs->max_erase_count > erase_count) {
-        erase_age = fs->max_erase_count - erase_count;
-      } else {
-        erase_age = SPIFFS_OBJ_ID_FREE - (erase_count - fs->max_erase_count);
-      }
-
-      s32_t score =
-          deleted_pages_in_block * SPIFFS_GC_HEUR_W_DELET +
-          used_pages_in_block * SPIFFS_GC_HEUR_W_USED +
-          erase_age * (fs_crammed ? 0 : SPIFFS_GC_HEUR_W_ERASE_AGE);
-      int cand_ix = 0;
-      SPIFFS_GC_DBG("gc_check: bix:"_SPIPRIbl" del:"_SPIPRIi" use:"_SPIPRIi" score:"_SPIPRIi"\n", cur_block, deleted_pages_in_block, used_pages_in_block, score);
-      while (cand_ix < max_candidates) {
-        if (cand_blocks[cand_ix] == (spiffs_block_ix)-1) {
-          cand_blocks[cand_ix] = cur_block;
-          cand_scores[cand_ix] = score;
-          break;
-        } else if (cand_scores[cand_ix] < score) {
-          int reorder_cand_ix = max_candidates - 2;
-          while (reorder_cand_ix >= cand_ix) {
-            cand_blocks[reorder_cand_ix + 1] = cand_blocks[reorder_cand_ix];
-            cand_scores[reorder_cand_ix + 1] = cand_scores[reorder_cand_ix];
-            reorder_cand_ix--;
-          }
-          cand_blocks[cand_ix] = cur_block;
-          cand_scores[cand_ix] = score;
-          break;
-        }
-        cand_ix++;
+    s32_t score = spiffs_gc_score(fs, deleted_pages_in_block, used_pages_in_block, erase_age, fs_crammed);
+    SPIFFS_GC_DBG("gc_check: bix:"_SPIPRIbl" del:"_SPIPRIi" use:"_SPIPRIi" score:"_SPIPRIi"\n", cur_block, deleted_pages_in_block, used_pages_in_block, score);
+
+    // top-k: push while there is room, else replace the worst kept if better
+    int ix;
+    if (count < max_candidates) {
+      ix = count++;
+      cand_blocks[ix] = cur_block;
+      cand_scores[ix] = score;
+      while (ix > 0 && SPIFFS_GC_CAND_WORSE(cand_blocks, cand_scores, ix, (ix-1)/2)) {
+        int parent = (ix-1)/2;
+        cand_blocks[ix] = cand_blocks[parent];
+        cand_scores[ix] = cand_scores[parent];
+        cand_blocks[parent] = cur_block;
+        cand_scores[parent] = score;
+        ix = parent;
       }
-      (*candidate_count)++;
+    } else if (score > cand_scores[0]) {
+      cand_blocks[0] = cur_block;
+      cand_scores[0] = score;
+      spiffs_gc_heap_down(cand_blocks, cand_scores, count, 0);
     }
-
-    cur_entry = 0;
-    cur_block++;
-    cur_block_addr += SPIFFS_CFG_LOG_BLOCK_SZ(fs);
   } // per block
 
+  // heap sort: the worst left goes to the end, the best ends up first
+  for (last = count - 1; last > 0; last--) {
+    spiffs_block_ix b = cand_blocks[0];
+    s32_t sc = cand_scores[0];
+    cand_blocks[0] = cand_blocks[last];
+    cand_scores[0] = cand_scores[last];
+    cand_blocks[last] = b;
+    cand_scores[last] = sc;
+    spiffs_gc_heap_down(cand_blocks, cand_scores, last, 0);
+  }
+  *candidate_count = count;
+
   return res;
 }
 
@@ -397,6 +574,12 @@ s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
     SPIFFS_GC_DBG("gc_clean: move free cursor to block "_SPIPRIbl"\n", fs->free_cursor_block_ix);
   }
 
+#if SPIFFS_APPEND_DEFER
+  // appended pages must be in their object index before they are moved
+  res = spiffs_object_append_commit_all(fs);
+  SPIFFS_CHECK_RES(res);
+#endif
+
   while (res == SPIFFS_OK && gc.state != FINISHED) {
     SPIFFS_GC_DBG("gc_clean: state = "_SPIPRIi" entry:"_SPIPRIi"\n", gc.state, cur_entry);
     gc.obj_id_found = 0; // reset (to no found data page)
@@ -443,6 +626,20 @@ s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
               SPIFFS_GC_DBG("gc_clean: MOVE_DATA no objix spix match, take in another run\n");
             } else {
               spiffs_page_ix new_data_pix;
+              spiffs_page_ix *entry;
+              if (gc.cur_objix_spix == 0) {
+                entry = &((spiffs_page_ix*)((u8_t *)objix_hdr + sizeof(spiffs_page_object_ix_header)))[p_hdr.span_ix];
+              } else {
+                entry = &((spiffs_page_ix*)((u8_t *)objix + sizeof(spiffs_page_object_ix)))[SPIFFS_OBJ_IX_ENTRY(fs, p_hdr.span_ix)];
+              }
+              if ((p_hdr.flags & SPIFFS_PH_FLAG_DELET) && *entry != cur_pix) {
+                // page not referenced by the object index, left by an append
+                // or a modify interrupted before the index was written
+                SPIFFS_GC_DBG("gc_clean: MOVE_DATA wipe unreferenced "_SPIPRIid":"_SPIPRIsp" page "_SPIPRIpg"\n", obj_id, p_hdr.span_ix, cur_pix);
+                res = spiffs_page_delete(fs, cur_pix);
+                SPIFFS_CHECK_RES(res);
+                break;
+              }
               if (p_hdr.flags & SPIFFS_PH_FLAG_DELET) {
                 // move page
                 res = spiffs_page_move(fs, 0, 0, obj_id, &p_hdr, cur_pix, &new_data_pix);
@@ -18,7 +18,7 @@ u32_t SPIFFS_buffer_bytes_for_filedescs(spiffs *fs, u32_t num_descs) {
 }
 #if SPIFFS_CACHE
 u32_t SPIFFS_buffer_bytes_for_cache(spiffs *fs, u32_t num_pages) {
-  return sizeof(spiffs_cache) + num_pages * (sizeof(spiffs_cache_page) + SPIFFS_CFG_LOG_PAGE_SZ(fs));
+  return SPIFFS_CACHE_BUF_SIZE(SPIFFS_CFG_LOG_PAGE_SZ(fs), num_pages);
 }
 #endif
 #endif
@@ -118,10 +118,14 @@ s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
 
 #if SPIFFS_CACHE
   fs->cache = cache;
-  fs->cache_size = (cache_size > (SPIFFS_CFG_LOG_PAGE_SZ(fs)*32)) ? SPIFFS_CFG_LOG_PAGE_SZ(fs)*32 : cache_size;
+  fs->cache_size = cache_size;
   spiffs_cache_init(fs);
 #endif
 
+#if SPIFFS_RAM_INDEX
+  spiffs_ram_index_init(fs);
+#endif
+
   s32_t res;
 
 #if SPIFFS_USE_MAGIC
@@ -131,7 +135,14 @@ s32_t SPIFFS_mount(spiffs *fs, spiffs_config *config, u8_t *work,
 
   fs->config_magic = SPIFFS_CONFIG_MAGIC;
 
+#if SPIFFS_CHECKPOINT
+  res = spiffs_checkpoint_load(fs);
+  if (res != SPIFFS_OK) {
+    res = spiffs_obj_lu_scan(fs);
+  }
+#else
   res = spiffs_obj_lu_scan(fs);
+#endif
   SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
 
   SPIFFS_DBG("page index byte len:         "_SPIPRIi"\n", (u32_t)SPIFFS_CFG_LOG_PAGE_SZ(fs));
@@ -167,6 +178,9 @@ void SPIFFS_unmount(spiffs *fs) {
       spiffs_fd_return(fs, cur_fd->file_nbr);
     }
   }
+#if SPIFFS_CHECKPOINT && !SPIFFS_READ_ONLY
+  (void)spiffs_checkpoint_save(fs);
+#endif
   fs->mounted = 0;
 
   SPIFFS_UNLOCK(fs);
@@ -430,6 +444,42 @@ s32_t SPIFFS_read(spiffs *fs, spiffs_file fh, void *buf, s32_t len) {
   return res;
 }
 
+s32_t SPIFFS_read_records(spiffs *fs, spiffs_file fh, void *buf, s32_t len, spiffs_record_len record_len) {
+  SPIFFS_API_DBG("%s "_SPIPRIfd " "_SPIPRIi "\n", __func__, fh, len);
+  s32_t res = spiffs_hydro_read(fs, fh, buf, len);
+  if (res == SPIFFS_ERR_END_OF_OBJECT) {
+    return 0;
+  }
+  if (res <= 0) {
+    return res;
+  }
+
+  // whole records read
+  s32_t used = 0;
+  s32_t rec = 0;
+  while (used < res && (rec = record_len((u8_t *)buf + used, res - used)) > 0 && rec <= res - used) {
+    used += rec;
+  }
+  if (used == res) {
+    return used;
+  }
+
+  SPIFFS_LOCK(fs);
+  spiffs_fd *fd;
+  s32_t err = spiffs_fd_get(fs, SPIFFS_FH_UNOFFS(fs, fh), &fd);
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, err);
+  if (rec >= 0 && used > 0 && fd->fdoffset < fd->size) {
+    // the start of a record, read again by the next call
+    fd->fdoffset -= res - used;
+  } else {
+    // not a record, or one that can never be read whole: skip the rest
+    fd->fdoffset = fd->size;
+  }
+  SPIFFS_UNLOCK(fs);
+
+  return used;
+}
+
 
 #if !SPIFFS_READ_ONLY
 static s32_t spiffs_hydro_write(spiffs *fs, spiffs_fd *fd, void *buf, u32_t offset, s32_t len) {
@@ -453,6 +503,67 @@ static s32_t spiffs_hydro_write(spiffs *fs, spiffs_fd *fd, void *buf, u32_t offs
   return len;
 
 }
+
+#if SPIFFS_APPEND_DEFER
+// Append through the cache page of the fd, filled up to the end of a data
+// page: the nucleus is given whole data pages, written without the index
+static s32_t spiffs_hydro_append(spiffs *fs, spiffs_fd *fd, u8_t *buf, u32_t offset, s32_t len) {
+  s32_t res = SPIFFS_OK;
+  spiffs_cache *cache = spiffs_get_cache(fs);
+  if (fd->cache_page && offset != fd->cache_page->offset + fd->cache_page->size) {
+    // not contiguous to the cache, write back cache first
+    res = spiffs_hydro_write(fs, fd,
+        spiffs_get_cache_page(fs, cache, fd->cache_page->ix),
+        fd->cache_page->offset, fd->cache_page->size);
+    spiffs_cache_fd_release(fs, fd->cache_page);
+    SPIFFS_CHECK_RES(res);
+  }
+  while (len > 0) {
+    if (fd->cache_page == 0) {
+      if (offset % SPIFFS_DATA_PAGE_SIZE(fs) == 0 && len >= (s32_t)SPIFFS_DATA_PAGE_SIZE(fs)) {
+        // whole data pages, no need to cache them
+        s32_t pages_len = len - len % SPIFFS_DATA_PAGE_SIZE(fs);
+        res = spiffs_hydro_write(fs, fd, buf, offset, pages_len);
+        SPIFFS_CHECK_RES(res);
+        buf += pages_len;
+        offset += pages_len;
+        len -= pages_len;
+        continue;
+      }
+      fd->cache_page = spiffs_cache_page_allocate_by_fd(fs, fd);
+      if (fd->cache_page == 0) {
+        // no cache page to gather the rest, write it as it is
+        res = spiffs_hydro_write(fs, fd, buf, offset, len);
+        SPIFFS_CHECK_RES(res);
+        return SPIFFS_OK;
+      }
+      fd->cache_page->offset = offset;
+      fd->cache_page->size = 0;
+      SPIFFS_CACHE_DBG("CACHE_WR_ALLO: allocating cache page "_SPIPRIi" for fd "_SPIPRIfd":"_SPIPRIid", append\n",
+          fd->cache_page->ix, fd->file_nbr, fd->obj_id);
+    }
+
+    u32_t page_end = (offset / SPIFFS_DATA_PAGE_SIZE(fs) + 1) * SPIFFS_DATA_PAGE_SIZE(fs);
+    u32_t to_cache = MIN((u32_t)len, page_end - offset);
+    u8_t *cpage_data = spiffs_get_cache_page(fs, cache, fd->cache_page->ix);
+    _SPIFFS_MEMCPY(&cpage_data[offset - fd->cache_page->offset], buf, to_cache);
+    fd->cache_page->size += to_cache;
+    buf += to_cache;
+    offset += to_cache;
+    len -= to_cache;
+
+    if (offset == page_end) {
+      // data page complete, write it
+      SPIFFS_CACHE_DBG("CACHE_WR_DUMP: dumping cache page "_SPIPRIi" for fd "_SPIPRIfd":"_SPIPRIid", page full, offs:"_SPIPRIi" size:"_SPIPRIi"\n",
+          fd->cache_page->ix, fd->file_nbr, fd->obj_id, fd->cache_page->offset, fd->cache_page->size);
+      res = spiffs_hydro_write(fs, fd, cpage_data, fd->cache_page->offset, fd->cache_page->size);
+      spiffs_cache_fd_release(fs, fd->cache_page);
+      SPIFFS_CHECK_RES(res);
+    }
+  }
+  return SPIFFS_OK;
+}
+#endif
 #endif // !SPIFFS_READ_ONLY
 
 s32_t SPIFFS_write(spiffs *fs, spiffs_file fh, void *buf, s32_t len) {
@@ -504,6 +615,15 @@ s32_t SPIFFS_write(spiffs *fs, spiffs_file fh, void *buf, s32_t len) {
 
 #if SPIFFS_CACHE_WR
   if ((fd->flags & SPIFFS_O_DIRECT) == 0) {
+#if SPIFFS_APPEND_DEFER
+    if (fd->flags & SPIFFS_O_APPEND) {
+      res = spiffs_hydro_append(fs, fd, (u8_t *)buf, offset, len);
+      SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+      fd->fdoffset += len;
+      SPIFFS_UNLOCK(fs);
+      return len;
+    }
+#endif
     if (len < (s32_t)SPIFFS_CFG_LOG_PAGE_SZ(fs)) {
       // small write, try to cache it
       u8_t alloc_cpage = 1;
@@ -826,6 +946,14 @@ static s32_t spiffs_fflush_cache(spiffs *fs, spiffs_file fh) {
       spiffs_cache_fd_release(fs, fd->cache_page);
     }
   }
+#if SPIFFS_APPEND_DEFER
+  if (res >= SPIFFS_OK) {
+    res = spiffs_object_append_commit(fd);
+    if (res < SPIFFS_OK) {
+      fs->err_code = res;
+    }
+  }
+#endif
 #endif
 
   return res;
@@ -1107,6 +1235,17 @@ s32_t SPIFFS_check(spiffs *fs) {
   SPIFFS_API_CHECK_MOUNT(fs);
   SPIFFS_LOCK(fs);
 
+#if SPIFFS_APPEND_DEFER
+  // the check would take the appended pages for garbage
+  res = spiffs_object_append_commit_all(fs);
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+#endif
+#if SPIFFS_RAM_INDEX
+  // the check rewrites the object lookup on its own: the ram index is not
+  // used until spiffs_obj_lu_scan rebuilds it
+  spiffs_ram_index_scan_start(fs);
+#endif
+
   res = spiffs_lookup_consistency_check(fs, 0);
 
   res = spiffs_object_index_consistency_check(fs);
@@ -1184,6 +1323,41 @@ s32_t SPIFFS_gc(spiffs *fs, u32_t size) {
 #endif // SPIFFS_READ_ONLY
 }
 
+s32_t SPIFFS_gc_slice(spiffs *fs, u32_t max_pages) {
+  SPIFFS_API_DBG("%s "_SPIPRIi "\n", __func__, max_pages);
+#if SPIFFS_READ_ONLY
+  (void)fs; (void)max_pages;
+  return SPIFFS_ERR_RO_NOT_IMPL;
+#else
+  s32_t res;
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  res = spiffs_gc_slice(fs, max_pages);
+
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+  SPIFFS_UNLOCK(fs);
+  return res;
+#endif // SPIFFS_READ_ONLY
+}
+
+#if SPIFFS_CHECKPOINT
+s32_t SPIFFS_checkpoint(spiffs *fs) {
+  SPIFFS_API_DBG("%s\n", __func__);
+  s32_t res;
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  res = spiffs_checkpoint_save(fs);
+
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+  SPIFFS_UNLOCK(fs);
+  return 0;
+}
+#endif
+
 s32_t SPIFFS_eof(spiffs *fs, spiffs_file fh) {
   SPIFFS_API_DBG("%s "_SPIPRIfd "\n", __func__, fh);
   s32_t res;
@@ -1,8 +1,7 @@
 #include "spiffs.h"
 #include "spiffs_nucleus.h"
 
-static s32_t spiffs_page_data_check(spiffs *fs, spiffs_fd *fd, spiffs_page_ix pix, spiffs_span_ix spix) {
-  s32_t res = SPIFFS_OK;
+static s32_t spiffs_page_data_ref_check(spiffs *fs, spiffs_page_ix pix) {
   if (pix == (spiffs_page_ix)-1) {
     // referring to page 0xffff...., bad object index
     return SPIFFS_ERR_INDEX_REF_FREE;
@@ -15,6 +14,12 @@ static s32_t spiffs_page_data_check(spiffs *fs, spiffs_fd *fd, spiffs_page_ix pi
     // referring to a bad page
     return SPIFFS_ERR_INDEX_REF_INVALID;
   }
+  return SPIFFS_OK;
+}
+
+static s32_t spiffs_page_data_check(spiffs *fs, spiffs_fd *fd, spiffs_page_ix pix, spiffs_span_ix spix) {
+  s32_t res = spiffs_page_data_ref_check(fs, pix);
+  SPIFFS_CHECK_RES(res);
 #if SPIFFS_PAGE_CHECK
   spiffs_page_header ph;
   res = _spiffs_rd(
@@ -230,6 +235,17 @@ s32_t spiffs_erase_block(
   u32_t addr = SPIFFS_BLOCK_TO_PADDR(fs, bix);
   s32_t size = SPIFFS_CFG_LOG_BLOCK_SZ(fs);
 
+#if SPIFFS_CHECKPOINT
+  // the erase result is ignored below, not this one
+  res = SPIFFS_HAL_MODIFY(fs, SPIFFS_OK);
+  SPIFFS_CHECK_RES(res);
+#endif
+
+#if SPIFFS_READ_UNLOCKED
+  // before the erase: a read ahead running meanwhile is thrown away
+  fs->erase_seq++;
+#endif
+
   // here we ignore res, just try erasing the block
   while (size > 0) {
     SPIFFS_DBG("erase "_SPIPRIad":"_SPIPRIi"\n", addr,  SPIFFS_CFG_PHYS_ERASE_SZ(fs));
@@ -239,6 +255,9 @@ s32_t spiffs_erase_block(
     size -= SPIFFS_CFG_PHYS_ERASE_SZ(fs);
   }
   fs->free_blocks++;
+#if SPIFFS_RAM_INDEX
+  spiffs_ram_index_erase_block(fs, bix);
+#endif
 
   // register erase count for this block
   res = _spiffs_wr(fs, SPIFFS_OP_C_WRTHRU | SPIFFS_OP_T_OBJ_LU2, 0,
@@ -327,6 +346,10 @@ static s32_t spiffs_obj_lu_scan_v(
   (void)bix;
   (void)user_const_p;
   (void)user_var_p;
+#if SPIFFS_RAM_INDEX
+  s32_t res = spiffs_ram_index_scan(fs, obj_id, bix, ix_entry);
+  SPIFFS_CHECK_RES(res);
+#endif
   if (obj_id == SPIFFS_OBJ_ID_FREE) {
     if (ix_entry == 0) {
       fs->free_blocks++;
@@ -422,6 +445,10 @@ s32_t spiffs_obj_lu_scan(
   fs->free_blocks = 0;
   fs->stats_p_allocated = 0;
   fs->stats_p_deleted = 0;
+#if SPIFFS_RAM_INDEX
+  // rebuild the ram index in the same pass
+  spiffs_ram_index_scan_start(fs);
+#endif
 
   res = spiffs_obj_lu_find_entry_visitor(fs,
       0,
@@ -440,6 +467,10 @@ s32_t spiffs_obj_lu_scan(
 
   SPIFFS_CHECK_RES(res);
 
+#if SPIFFS_RAM_INDEX
+  spiffs_ram_index_scan_end(fs);
+#endif
+
   return res;
 }
 
@@ -463,6 +494,10 @@ s32_t spiffs_obj_lu_find_free(
       return SPIFFS_ERR_FULL;
     }
   }
+#if SPIFFS_RAM_INDEX
+  res = spiffs_ram_index_find_free(fs, starting_block, starting_lu_entry, block_ix, lu_entry);
+  if (res == SPIFFS_RAM_INDEX_MISS)
+#endif
   res = spiffs_obj_lu_find_id(fs, starting_block, starting_lu_entry,
       SPIFFS_OBJ_ID_FREE, block_ix, lu_entry);
   if (res == SPIFFS_OK) {
@@ -534,6 +569,23 @@ s32_t spiffs_obj_lu_find_id_and_span(
   spiffs_block_ix bix;
   int entry;
 
+#if SPIFFS_RAM_INDEX
+  if (spix == 0 && (obj_id & SPIFFS_OBJ_ID_IX_FLAG)) {
+    // object index header
+    spiffs_page_ix hdr_pix;
+    res = spiffs_ram_index_find_id(fs, obj_id, exclusion_pix, &hdr_pix);
+    if (res != SPIFFS_RAM_INDEX_MISS) {
+      SPIFFS_CHECK_RES(res);
+      if (pix) {
+        *pix = hdr_pix;
+      }
+      fs->cursor_block_ix = SPIFFS_BLOCK_FOR_PAGE(fs, hdr_pix);
+      fs->cursor_obj_lu_entry = SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, hdr_pix);
+      return res;
+    }
+  }
+#endif
+
   res = spiffs_obj_lu_find_entry_visitor(fs,
       fs->cursor_block_ix,
       fs->cursor_obj_lu_entry,
@@ -750,6 +802,31 @@ s32_t spiffs_populate_ix_map(spiffs *fs, spiffs_fd *fd, u32_t vec_entry_start, u
 // Allocates a free defined page with given obj_id
 // Occupies object lookup entry and page
 // data may be NULL; where only page header is stored, len and page_offs is ignored
+// Finds a free page and occupies it in the object lookup for given object id
+static s32_t spiffs_page_occupy(
+    spiffs *fs,
+    spiffs_obj_id obj_id,
+    spiffs_block_ix *bix,
+    int *entry) {
+  s32_t res = SPIFFS_OK;
+
+  // find free entry
+  res = spiffs_obj_lu_find_free(fs, fs->free_cursor_block_ix, fs->free_cursor_obj_lu_entry, bix, entry);
+  SPIFFS_CHECK_RES(res);
+
+  // occupy page in object lookup
+  res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_UPDT,
+      0, SPIFFS_BLOCK_TO_PADDR(fs, *bix) + *entry * sizeof(spiffs_obj_id), sizeof(spiffs_obj_id), (u8_t*)&obj_id);
+  SPIFFS_CHECK_RES(res);
+#if SPIFFS_RAM_INDEX
+  spiffs_ram_index_lu_set(fs, SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, *bix, *entry), obj_id);
+#endif
+
+  fs->stats_p_allocated++;
+
+  return res;
+}
+
 s32_t spiffs_page_allocate_data(
     spiffs *fs,
     spiffs_obj_id obj_id,
@@ -763,17 +840,9 @@ s32_t spiffs_page_allocate_data(
   spiffs_block_ix bix;
   int entry;
 
-  // find free entry
-  res = spiffs_obj_lu_find_free(fs, fs->free_cursor_block_ix, fs->free_cursor_obj_lu_entry, &bix, &entry);
-  SPIFFS_CHECK_RES(res);
-
-  // occupy page in object lookup
-  res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_UPDT,
-      0, SPIFFS_BLOCK_TO_PADDR(fs, bix) + entry * sizeof(spiffs_obj_id), sizeof(spiffs_obj_id), (u8_t*)&obj_id);
+  res = spiffs_page_occupy(fs, obj_id, &bix, &entry);
   SPIFFS_CHECK_RES(res);
 
-  fs->stats_p_allocated++;
-
   // write page header
   ph->flags &= ~SPIFFS_PH_FLAG_USED;
   res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_DA | SPIFFS_OP_C_UPDT,
@@ -852,6 +921,9 @@ s32_t spiffs_page_move(
       sizeof(spiffs_obj_id),
       (u8_t *)&obj_id);
   SPIFFS_CHECK_RES(res);
+#if SPIFFS_RAM_INDEX
+  spiffs_ram_index_lu_set(fs, free_pix, obj_id);
+#endif
 
   fs->stats_p_allocated++;
 
@@ -885,6 +957,9 @@ s32_t spiffs_page_delete(
       sizeof(spiffs_obj_id),
       (u8_t *)&d_obj_id);
   SPIFFS_CHECK_RES(res);
+#if SPIFFS_RAM_INDEX
+  spiffs_ram_index_lu_set(fs, pix, d_obj_id);
+#endif
 
   fs->stats_p_deleted++;
   fs->stats_p_allocated--;
@@ -935,6 +1010,9 @@ s32_t spiffs_object_create(
   res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_UPDT,
       0, SPIFFS_BLOCK_TO_PADDR(fs, bix) + entry * sizeof(spiffs_obj_id), sizeof(spiffs_obj_id), (u8_t*)&obj_id);
   SPIFFS_CHECK_RES(res);
+#if SPIFFS_RAM_INDEX
+  spiffs_ram_index_lu_set(fs, SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, entry), obj_id);
+#endif
 
   fs->stats_p_allocated++;
 
@@ -1046,7 +1124,7 @@ void spiffs_cb_object_event(
     spiffs_span_ix spix,
     spiffs_page_ix new_pix,
     u32_t new_size) {
-#if SPIFFS_IX_MAP == 0
+#if SPIFFS_IX_MAP == 0 && SPIFFS_RAM_INDEX == 0
   (void)objix;
 #endif
   // update index caches in all file descriptors
@@ -1060,6 +1138,10 @@ void spiffs_cb_object_event(
     if ((cur_fd->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) != obj_id) continue; // fd not related to updated file
 #if !SPIFFS_TEMPORAL_FD_CACHE
     if (cur_fd->file_nbr == 0) continue; // fd closed
+#endif
+#if SPIFFS_READ_AHEAD
+    // the pages read ahead may have been rewritten
+    cur_fd->ra_count = 0;
 #endif
     if (spix == 0) { // object index header update
       if (ev != SPIFFS_EV_IX_DEL) {
@@ -1069,7 +1151,12 @@ void spiffs_cb_object_event(
         SPIFFS_DBG("       callback: setting fd "_SPIPRIfd":"_SPIPRIid"(fdoffs:"_SPIPRIi" offs:"_SPIPRIi") objix_hdr_pix to "_SPIPRIpg", size:"_SPIPRIi"\n",
             SPIFFS_FH_OFFS(fs, cur_fd->file_nbr), cur_fd->obj_id, cur_fd->fdoffset, cur_fd->offset, new_pix, new_size);
         cur_fd->objix_hdr_pix = new_pix;
+#if SPIFFS_APPEND_DEFER
+        // with pages not committed yet the size of the fd is ahead of the header
+        if (new_size != 0 && cur_fd->defer_count == 0) {
+#else
         if (new_size != 0) {
+#endif
           // update size and offsets for fds to this file
           cur_fd->size = new_size;
           u32_t act_new_size = new_size == SPIFFS_UNDEFINED_LEN ? 0 : new_size;
@@ -1102,6 +1189,10 @@ void spiffs_cb_object_event(
         SPIFFS_DBG("       callback: release fd "_SPIPRIfd":"_SPIPRIid" span:"_SPIPRIsp" objix_pix to "_SPIPRIpg"\n", SPIFFS_FH_OFFS(fs, cur_fd->file_nbr), cur_fd->obj_id, spix, new_pix);
         cur_fd->file_nbr = 0;
         cur_fd->obj_id = SPIFFS_OBJ_ID_DELETED;
+#if SPIFFS_APPEND_DEFER
+        // pages not committed are left to the gc
+        cur_fd->defer_count = 0;
+#endif
       }
     } // object index header update
     if (cur_fd->cursor_objix_spix == spix) {
@@ -1114,6 +1205,13 @@ void spiffs_cb_object_event(
     }
   } // fd update loop
 
+#if SPIFFS_RAM_INDEX
+  if (spix == 0) {
+    // object index header written, moved or deleted
+    spiffs_ram_index_object_event(fs, objix, ev, obj_id, new_pix);
+  }
+#endif
+
 #if SPIFFS_IX_MAP
 
   // update index maps
@@ -1198,6 +1296,13 @@ s32_t spiffs_object_open_by_page(
   fd->cursor_objix_spix = 0;
   fd->obj_id = obj_id;
   fd->flags = flags;
+#if SPIFFS_APPEND_DEFER
+  fd->defer_count = 0;
+#endif
+#if SPIFFS_READ_AHEAD
+  fd->ra_count = 0;
+  fd->ra_next = 0;
+#endif
 
   SPIFFS_VALIDATE_OBJIX(oix_hdr.p_hdr, fd->obj_id, 0);
 
@@ -1207,6 +1312,171 @@ s32_t spiffs_object_open_by_page(
 }
 
 #if !SPIFFS_READ_ONLY
+#if SPIFFS_APPEND_DEFER
+// Append whole data pages at the end of an object without touching its index:
+// the pages are listed in the fd until spiffs_object_append_commit
+static s32_t spiffs_object_append_defer(spiffs_fd *fd, u32_t offset, u8_t *data, u32_t len) {
+  spiffs *fs = fd->fs;
+  s32_t res = SPIFFS_OK;
+  u32_t written = 0;
+  spiffs_span_ix data_spix = offset / SPIFFS_DATA_PAGE_SIZE(fs);
+  spiffs_page_header *p_hdr;
+  spiffs_page_ix data_page;
+  spiffs_block_ix bix;
+  int entry;
+
+  while (written < len) {
+    // the listed pages must fit in the fd and in one object index page
+    if (fd->defer_count == SPIFFS_APPEND_DEFER_PAGES ||
+        (fd->defer_count > 0 &&
+            SPIFFS_OBJ_IX_ENTRY_SPAN_IX(fs, data_spix) != SPIFFS_OBJ_IX_ENTRY_SPAN_IX(fs, fd->defer_spix))) {
+      res = spiffs_object_append_commit(fd);
+      SPIFFS_CHECK_RES(res);
+    }
+
+    // header and data in one write: a torn page is not referenced by the
+    // index anyway
+    res = spiffs_page_occupy(fs, fd->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG, &bix, &entry);
+    SPIFFS_CHECK_RES(res);
+    p_hdr = (spiffs_page_header *)fs->work;
+    p_hdr->obj_id = fd->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG;
+    p_hdr->span_ix = data_spix;
+    p_hdr->flags = 0xff & ~(SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_USED);
+    _SPIFFS_MEMCPY(fs->work + sizeof(spiffs_page_header), &data[written], SPIFFS_DATA_PAGE_SIZE(fs));
+    data_page = SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, entry);
+    res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_DA | SPIFFS_OP_C_UPDT,
+        fd->file_nbr, SPIFFS_PAGE_TO_PADDR(fs, data_page), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->work);
+    SPIFFS_DBG("append: "_SPIPRIid" store deferred data page, "_SPIPRIpg":"_SPIPRIsp", written "_SPIPRIi"\n", fd->obj_id,
+        data_page, data_spix, written);
+    SPIFFS_CHECK_RES(res);
+
+    if (fd->defer_count == 0) {
+      fd->defer_spix = data_spix;
+    }
+    fd->defer_pix[fd->defer_count++] = data_page;
+    data_spix++;
+    written += SPIFFS_DATA_PAGE_SIZE(fs);
+    fd->size = offset+written;
+    fd->offset = offset+written;
+  }
+
+  return res;
+}
+
+// Write the data pages listed by spiffs_object_append_defer in the object
+// index, then the new size in the object index header. Until the header is
+// written the pages are not part of the object: after a reset the object has
+// its previous size and the gc scraps the pages.
+s32_t spiffs_object_append_commit(spiffs_fd *fd) {
+  spiffs *fs = fd->fs;
+  s32_t res = SPIFFS_OK;
+  spiffs_page_object_ix_header *objix_hdr = (spiffs_page_object_ix_header *)fs->work;
+  spiffs_page_object_ix *objix = (spiffs_page_object_ix *)fs->work;
+  spiffs_page_ix *entries;
+  spiffs_page_ix objix_pix;
+  spiffs_span_ix objix_spix;
+  u32_t i;
+
+  if (fd->defer_count == 0) {
+    return SPIFFS_OK;
+  }
+  objix_spix = SPIFFS_OBJ_IX_ENTRY_SPAN_IX(fs, fd->defer_spix);
+  SPIFFS_DBG("append: "_SPIPRIid" commit "_SPIPRIi" pages from span "_SPIPRIsp", size "_SPIPRIi"\n", fd->obj_id,
+      fd->defer_count, fd->defer_spix, fd->size);
+
+  if (objix_spix == 0) {
+    objix_pix = fd->objix_hdr_pix;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_IX | SPIFFS_OP_C_READ,
+        fd->file_nbr, SPIFFS_PAGE_TO_PADDR(fs, objix_pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->work);
+    SPIFFS_CHECK_RES(res);
+    SPIFFS_VALIDATE_OBJIX(objix_hdr->p_hdr, fd->obj_id, 0);
+    entries = (spiffs_page_ix*)((u8_t *)objix_hdr + sizeof(spiffs_page_object_ix_header));
+  } else if (SPIFFS_OBJ_IX_ENTRY(fs, fd->defer_spix) != 0) {
+    // the object index page holds the pages before, load it
+    if (fd->cursor_objix_spix == objix_spix) {
+      objix_pix = fd->cursor_objix_pix;
+    } else {
+      res = spiffs_obj_lu_find_id_and_span(fs, fd->obj_id | SPIFFS_OBJ_ID_IX_FLAG, objix_spix, 0, &objix_pix);
+      SPIFFS_CHECK_RES(res);
+    }
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_IX | SPIFFS_OP_C_READ,
+        fd->file_nbr, SPIFFS_PAGE_TO_PADDR(fs, objix_pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->work);
+    SPIFFS_CHECK_RES(res);
+    SPIFFS_VALIDATE_OBJIX(objix->p_hdr, fd->obj_id, objix_spix);
+    entries = (spiffs_page_ix*)((u8_t *)objix + sizeof(spiffs_page_object_ix));
+  } else {
+    // first pages of the object index page, create it
+    spiffs_page_header p_hdr;
+    p_hdr.obj_id = fd->obj_id | SPIFFS_OBJ_ID_IX_FLAG;
+    p_hdr.span_ix = objix_spix;
+    p_hdr.flags = 0xff & ~(SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_INDEX);
+    res = spiffs_page_allocate_data(fs, fd->obj_id | SPIFFS_OBJ_ID_IX_FLAG,
+        &p_hdr, 0, 0, 0, 1, &objix_pix);
+    SPIFFS_CHECK_RES(res);
+    memset(fs->work, 0xff, SPIFFS_CFG_LOG_PAGE_SZ(fs));
+    _SPIFFS_MEMCPY(fs->work, &p_hdr, sizeof(spiffs_page_header));
+    spiffs_cb_object_event(fs, (spiffs_page_object_ix *)fs->work,
+        SPIFFS_EV_IX_NEW, fd->obj_id, objix_spix, objix_pix, 0);
+    entries = (spiffs_page_ix*)((u8_t *)objix + sizeof(spiffs_page_object_ix));
+  }
+
+  for (i = 0; i < fd->defer_count; i++) {
+    entries[SPIFFS_OBJ_IX_ENTRY(fs, fd->defer_spix + i)] = fd->defer_pix[i];
+  }
+
+  if (objix_spix == 0) {
+    objix_hdr->size = fd->size;
+    if (fd->defer_spix == 0) {
+      // was an empty object, update same page (size was 0xffffffff)
+      res = spiffs_page_index_check(fs, fd, objix_pix, 0);
+      SPIFFS_CHECK_RES(res);
+      res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_IX | SPIFFS_OP_C_UPDT,
+          fd->file_nbr, SPIFFS_PAGE_TO_PADDR(fs, objix_pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->work);
+      SPIFFS_CHECK_RES(res);
+      spiffs_cb_object_event(fs, (spiffs_page_object_ix *)fs->work,
+          SPIFFS_EV_IX_UPD_HDR, fd->obj_id, 0, objix_pix, objix_hdr->size);
+    } else {
+      res = spiffs_object_update_index_hdr(fs, fd, fd->obj_id,
+          fd->objix_hdr_pix, fs->work, 0, 0, fd->size, 0);
+      SPIFFS_CHECK_RES(res);
+    }
+  } else {
+    // the entries written were free, update the page in place
+    res = spiffs_page_index_check(fs, fd, objix_pix, objix_spix);
+    SPIFFS_CHECK_RES(res);
+    res = _spiffs_wr(fs, SPIFFS_OP_T_OBJ_IX | SPIFFS_OP_C_UPDT,
+        fd->file_nbr, SPIFFS_PAGE_TO_PADDR(fs, objix_pix), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->work);
+    SPIFFS_CHECK_RES(res);
+    spiffs_cb_object_event(fs, (spiffs_page_object_ix *)fs->work,
+        SPIFFS_EV_IX_UPD, fd->obj_id, objix_spix, objix_pix, 0);
+    fd->cursor_objix_pix = objix_pix;
+    fd->cursor_objix_spix = objix_spix;
+    // update size in object index header page
+    res = spiffs_object_update_index_hdr(fs, fd, fd->obj_id,
+        fd->objix_hdr_pix, 0, 0, 0, fd->size, 0);
+    SPIFFS_CHECK_RES(res);
+  }
+
+  fd->defer_count = 0;
+  return res;
+}
+
+// Commit the pages appended through every fd: the gc and the check must not
+// find data pages the object index does not know of
+s32_t spiffs_object_append_commit_all(spiffs *fs) {
+  s32_t res = SPIFFS_OK;
+  u32_t i;
+  spiffs_fd *fds = (spiffs_fd *)fs->fd_space;
+  for (i = 0; i < fs->fd_count && res == SPIFFS_OK; i++) {
+    spiffs_fd *cur_fd = &fds[i];
+    if (cur_fd->file_nbr != 0 && cur_fd->defer_count > 0) {
+      res = spiffs_object_append_commit(cur_fd);
+    }
+  }
+  return res;
+}
+#endif // SPIFFS_APPEND_DEFER
+
 // Append to object
 // keep current object index (header) page in fs->work buffer
 s32_t spiffs_object_append(spiffs_fd *fd, u32_t offset, u8_t *data, u32_t len) {
@@ -1227,6 +1497,17 @@ s32_t spiffs_object_append(spiffs_fd *fd, u32_t offset, u8_t *data, u32_t len) {
   }
   SPIFFS_CHECK_RES(res);
 
+#if SPIFFS_APPEND_DEFER
+  if ((fd->flags & SPIFFS_O_APPEND) &&
+      offset % SPIFFS_DATA_PAGE_SIZE(fs) == 0 && len % SPIFFS_DATA_PAGE_SIZE(fs) == 0) {
+    // whole pages to a file opened for appending, the index is written later
+    return spiffs_object_append_defer(fd, offset, data, len);
+  }
+  // the index is written below, the pages listed before go first
+  res = spiffs_object_append_commit(fd);
+  SPIFFS_CHECK_RES(res);
+#endif
+
   spiffs_page_object_ix_header *objix_hdr = (spiffs_page_object_ix_header *)fs->work;
   spiffs_page_object_ix *objix = (spiffs_page_object_ix *)fs->work;
   spiffs_page_header p_hdr;
@@ -1696,6 +1977,20 @@ s32_t spiffs_object_find_object_index_header_by_name(
   spiffs_block_ix bix;
   int entry;
 
+#if SPIFFS_RAM_INDEX
+  spiffs_page_ix hdr_pix;
+  res = spiffs_ram_index_find_name(fs, name, &hdr_pix);
+  if (res != SPIFFS_RAM_INDEX_MISS) {
+    SPIFFS_CHECK_RES(res);
+    if (pix) {
+      *pix = hdr_pix;
+    }
+    fs->cursor_block_ix = SPIFFS_BLOCK_FOR_PAGE(fs, hdr_pix);
+    fs->cursor_obj_lu_entry = SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, hdr_pix);
+    return res;
+  }
+#endif
+
   res = spiffs_obj_lu_find_entry_visitor(fs,
       fs->cursor_block_ix,
       fs->cursor_obj_lu_entry,
@@ -1963,6 +2258,100 @@ s32_t spiffs_object_truncate(
 } // spiffs_object_truncate
 #endif // !SPIFFS_READ_ONLY
 
+#if SPIFFS_READ_AHEAD
+// Reads count data pages of fd into fd->ra_buf, the pages following each other
+// in the flash with a single hal read
+static s32_t spiffs_read_ahead_pages(
+    spiffs_fd *fd,
+    const spiffs_page_ix *pix,
+    u32_t count) {
+  spiffs *fs = fd->fs;
+  u32_t i, j;
+  s32_t res;
+
+  for (i = 0; i < count; i = j) {
+    for (j = i + 1; j < count && pix[j] == pix[j - 1] + 1; j++);
+    SPIFFS_DBG("read: ahead "_SPIPRIid" "_SPIPRIi" pages from "_SPIPRIpg"\n", fd->obj_id, j - i, pix[i]);
+    res = SPIFFS_HAL_READ(fs, SPIFFS_PAGE_TO_PADDR(fs, pix[i]), (j - i) * SPIFFS_CFG_LOG_PAGE_SZ(fs),
+        &fd->ra_buf[i * SPIFFS_CFG_LOG_PAGE_SZ(fs)]);
+    SPIFFS_CHECK_RES(res);
+  }
+  return SPIFFS_OK;
+}
+
+// Reads ahead the data pages of fd from data_spix, taken from the object index
+// (header) page of span index objix_spix loaded in fs->work, bypassing the cache.
+// Leaves fd->ra_count at 0 if there is less than two pages to read ahead.
+// Returns 1 if the lock has been released meanwhile: fs->work is no longer the
+// index page, and fd->ra_count is 0 if the pages must be found again
+static s32_t spiffs_object_read_ahead(
+    spiffs_fd *fd,
+    spiffs_span_ix data_spix,
+    spiffs_span_ix objix_spix) {
+  spiffs *fs = fd->fs;
+  spiffs_page_ix *entries;
+  spiffs_page_ix pix[SPIFFS_READ_AHEAD_PAGES];
+  u32_t count, file_pages, i;
+  s32_t res;
+
+  fd->ra_count = 0;
+  if (fd->size == SPIFFS_UNDEFINED_LEN) return SPIFFS_OK;
+  if (objix_spix == 0) {
+    entries = (spiffs_page_ix*)((u8_t *)fs->work + sizeof(spiffs_page_object_ix_header));
+    count = SPIFFS_OBJ_HDR_IX_LEN(fs);
+  } else {
+    entries = (spiffs_page_ix*)((u8_t *)fs->work + sizeof(spiffs_page_object_ix));
+    count = SPIFFS_OBJ_IX_LEN(fs);
+  }
+  // until the end of the index page, of the buffer and of the file
+  entries += SPIFFS_OBJ_IX_ENTRY(fs, data_spix);
+  count -= SPIFFS_OBJ_IX_ENTRY(fs, data_spix);
+  count = MIN(count, SPIFFS_READ_AHEAD_SIZE / SPIFFS_CFG_LOG_PAGE_SZ(fs));
+  file_pages = (fd->size + SPIFFS_DATA_PAGE_SIZE(fs) - 1) / SPIFFS_DATA_PAGE_SIZE(fs);
+  count = file_pages > data_spix ? MIN(count, file_pages - data_spix) : 0;
+  if (count < 2) return SPIFFS_OK;
+
+  for (i = 0; i < count; i++) {
+    res = spiffs_page_data_ref_check(fs, entries[i]);
+    SPIFFS_CHECK_RES(res);
+    pix[i] = entries[i];
+  }
+#if SPIFFS_READ_UNLOCKED
+  // the flash is read with the lock released, so that another file can be
+  // written meanwhile. spiffs_cb_object_event clears fd->ra_count if this file
+  // changes (its pages moved by the gc included) and fs->erase_seq counts the
+  // erases: if either happens the pages read may be stale
+  u32_t erase_seq = fs->erase_seq;
+  fd->ra_spix = data_spix;
+  fd->ra_count = count;
+  SPIFFS_UNLOCK(fs);
+  res = spiffs_read_ahead_pages(fd, pix, count);
+  SPIFFS_LOCK(fs);
+  fs->stats_ra_unlocked++;
+  if (fd->ra_count != count || fs->erase_seq != erase_seq) {
+    SPIFFS_DBG("read: ahead "_SPIPRIid":"_SPIPRIsp" changed meanwhile\n", fd->obj_id, data_spix);
+    fs->stats_ra_retries++;
+    fd->ra_count = 0;
+    return 1;
+  }
+  fd->ra_count = 0;
+  SPIFFS_CHECK_RES(res);
+#else
+  res = spiffs_read_ahead_pages(fd, pix, count);
+  SPIFFS_CHECK_RES(res);
+#endif
+#if SPIFFS_PAGE_CHECK
+  for (i = 0; i < count; i++) {
+    spiffs_page_header *ph = (spiffs_page_header *)&fd->ra_buf[i * SPIFFS_CFG_LOG_PAGE_SZ(fs)];
+    SPIFFS_VALIDATE_DATA(*ph, fd->obj_id & ~SPIFFS_OBJ_ID_IX_FLAG, data_spix + i);
+  }
+#endif
+  fd->ra_spix = data_spix;
+  fd->ra_count = count;
+  return SPIFFS_READ_UNLOCKED;
+}
+#endif
+
 s32_t spiffs_object_read(
     spiffs_fd *fd,
     u32_t offset,
@@ -1980,6 +2369,13 @@ s32_t spiffs_object_read(
   spiffs_page_object_ix *objix = (spiffs_page_object_ix *)fs->work;
 
   while (cur_offset < offset + len) {
+#if SPIFFS_READ_AHEAD
+    u8_t *ra_page = 0;
+    if (data_spix >= fd->ra_spix && data_spix < fd->ra_spix + fd->ra_count) {
+      // data page read ahead
+      ra_page = &fd->ra_buf[(data_spix - fd->ra_spix) * SPIFFS_CFG_LOG_PAGE_SZ(fs)];
+    } else {
+#endif
 #if SPIFFS_IX_MAP
     // check if we have a memory, index map and if so, if we're within index map's range
     // and if so, if the entry is populated
@@ -2024,6 +2420,29 @@ s32_t spiffs_object_read(
       }
 #if SPIFFS_IX_MAP
     }
+#endif
+#if SPIFFS_READ_AHEAD
+      if (data_spix == fd->ra_next && prev_objix_spix == SPIFFS_OBJ_IX_ENTRY_SPAN_IX(fs, data_spix)) {
+        // sequential read, the object index page is in fs->work: read ahead from this page
+        res = spiffs_object_read_ahead(fd, data_spix, prev_objix_spix);
+        SPIFFS_CHECK_RES(res);
+#if SPIFFS_READ_UNLOCKED
+        if (res > 0) {
+          // the lock has been released: the index page must be loaded again
+          res = SPIFFS_OK;
+          prev_objix_spix = (spiffs_span_ix)-1;
+          if (fd->ra_count == 0) {
+            // changed meanwhile: find this page again and read it with the lock
+            fd->ra_next = (spiffs_span_ix)-1;
+            continue;
+          }
+        }
+#endif
+        if (fd->ra_count > 0) {
+          ra_page = fd->ra_buf;
+        }
+      }
+    }
 #endif
     // all remaining data
     u32_t len_to_read = offset + len - cur_offset;
@@ -2031,12 +2450,17 @@ s32_t spiffs_object_read(
     len_to_read = MIN(len_to_read, SPIFFS_DATA_PAGE_SIZE(fs) - (cur_offset % SPIFFS_DATA_PAGE_SIZE(fs)));
     // remaining data in file
     len_to_read = MIN(len_to_read, fd->size);
-    SPIFFS_DBG("read: offset:"_SPIPRIi" rd:"_SPIPRIi" data spix:"_SPIPRIsp" is data_pix:"_SPIPRIpg" addr:"_SPIPRIad"\n", cur_offset, len_to_read, data_spix, data_pix,
-        (u32_t)(SPIFFS_PAGE_TO_PADDR(fs, data_pix) + sizeof(spiffs_page_header) + (cur_offset % SPIFFS_DATA_PAGE_SIZE(fs))));
     if (len_to_read <= 0) {
       res = SPIFFS_ERR_END_OF_OBJECT;
       break;
     }
+#if SPIFFS_READ_AHEAD
+    if (ra_page) {
+      _SPIFFS_MEMCPY(dst, &ra_page[sizeof(spiffs_page_header) + (cur_offset % SPIFFS_DATA_PAGE_SIZE(fs))], len_to_read);
+    } else {
+#endif
+    SPIFFS_DBG("read: offset:"_SPIPRIi" rd:"_SPIPRIi" data spix:"_SPIPRIsp" is data_pix:"_SPIPRIpg" addr:"_SPIPRIad"\n", cur_offset, len_to_read, data_spix, data_pix,
+        (u32_t)(SPIFFS_PAGE_TO_PADDR(fs, data_pix) + sizeof(spiffs_page_header) + (cur_offset % SPIFFS_DATA_PAGE_SIZE(fs))));
     res = spiffs_page_data_check(fs, fd, data_pix, data_spix);
     SPIFFS_CHECK_RES(res);
     res = _spiffs_rd(
@@ -2046,10 +2470,16 @@ s32_t spiffs_object_read(
         len_to_read,
         dst);
     SPIFFS_CHECK_RES(res);
+#if SPIFFS_READ_AHEAD
+    }
+#endif
     dst += len_to_read;
     cur_offset += len_to_read;
     fd->offset = cur_offset;
     data_spix++;
+#if SPIFFS_READ_AHEAD
+    fd->ra_next = data_spix;
+#endif
   }
 
   return res;
@@ -2142,6 +2572,11 @@ s32_t spiffs_obj_lu_find_free_obj_id(spiffs *fs, spiffs_obj_id *obj_id, const u8
   }
   state.compaction = 0;
   state.conflicting_name = conflicting_name;
+#if SPIFFS_RAM_INDEX
+  res = spiffs_ram_index_find_free_obj_id(fs, obj_id, conflicting_name);
+  if (res != SPIFFS_RAM_INDEX_MISS) return res;
+  res = SPIFFS_OK;
+#endif
   while (res == SPIFFS_OK && free_obj_id == SPIFFS_OBJ_ID_FREE) {
     if (state.max_obj_id - state.min_obj_id <= (spiffs_obj_id)SPIFFS_CFG_LOG_PAGE_SZ(fs)*8) {
       // possible to represent in bitmap
@@ -2225,9 +2660,9 @@ s32_t spiffs_obj_lu_find_free_obj_id(spiffs *fs, spiffs_obj_id *obj_id, const u8
 }
 #endif // !SPIFFS_READ_ONLY
 
-#if SPIFFS_TEMPORAL_FD_CACHE
+#if SPIFFS_TEMPORAL_FD_CACHE || SPIFFS_RAM_INDEX
 // djb2 hash
-static u32_t spiffs_hash(spiffs *fs, const u8_t *name) {
+u32_t spiffs_hash(spiffs *fs, const u8_t *name) {
   (void)fs;
   u32_t hash = 5381;
   u8_t c;
@@ -2329,6 +2764,12 @@ s32_t spiffs_fd_return(spiffs *fs, spiffs_file f) {
   fd->file_nbr = 0;
 #if SPIFFS_IX_MAP
   fd->ix_map = 0;
+#endif
+#if SPIFFS_APPEND_DEFER
+  fd->defer_count = 0;
+#endif
+#if SPIFFS_READ_AHEAD
+  fd->ra_count = 0;
 #endif
   return SPIFFS_OK;
 }
@@ -122,6 +122,8 @@
 #define SPIFFS_VIS_COUNTINUE_RELOAD     (SPIFFS_ERR_INTERNAL - 21)
 // visitor result, stop searching
 #define SPIFFS_VIS_END                  (SPIFFS_ERR_INTERNAL - 22)
+// ram index result, the answer is not known: scan the object lookup
+#define SPIFFS_RAM_INDEX_MISS           (SPIFFS_ERR_INTERNAL - 23)
 
 // updating an object index contents
 #define SPIFFS_EV_IX_UPD                (0)
@@ -356,23 +358,32 @@
 // stop searching at end of all look up pages
 #define SPIFFS_VIS_NO_WRAP      (1<<2)
 
+#if SPIFFS_CHECKPOINT
+// the checkpoint saved last no longer matches the flash once it is written or
+// erased: it is invalidated first
+#define SPIFFS_HAL_MODIFY(_fs, _op) \
+  (((_fs)->ckpt_live && spiffs_checkpoint_drop(_fs) != SPIFFS_OK) ? SPIFFS_ERR_CKPT : (_op))
+#else
+#define SPIFFS_HAL_MODIFY(_fs, _op) (_op)
+#endif
+
 #if SPIFFS_HAL_CALLBACK_EXTRA
 
 #define SPIFFS_HAL_WRITE(_fs, _paddr, _len, _src) \
-  (_fs)->cfg.hal_write_f((_fs), (_paddr), (_len), (_src))
+  SPIFFS_HAL_MODIFY((_fs), (_fs)->cfg.hal_write_f((_fs), (_paddr), (_len), (_src)))
 #define SPIFFS_HAL_READ(_fs, _paddr, _len, _dst) \
   (_fs)->cfg.hal_read_f((_fs), (_paddr), (_len), (_dst))
 #define SPIFFS_HAL_ERASE(_fs, _paddr, _len) \
-  (_fs)->cfg.hal_erase_f((_fs), (_paddr), (_len))
+  SPIFFS_HAL_MODIFY((_fs), (_fs)->cfg.hal_erase_f((_fs), (_paddr), (_len)))
 
 #else // SPIFFS_HAL_CALLBACK_EXTRA
 
 #define SPIFFS_HAL_WRITE(_fs, _paddr, _len, _src) \
-  (_fs)->cfg.hal_write_f((_paddr), (_len), (_src))
+  SPIFFS_HAL_MODIFY((_fs), (_fs)->cfg.hal_write_f((_paddr), (_len), (_src)))
 #define SPIFFS_HAL_READ(_fs, _paddr, _len, _dst) \
   (_fs)->cfg.hal_read_f((_paddr), (_len), (_dst))
 #define SPIFFS_HAL_ERASE(_fs, _paddr, _len) \
-  (_fs)->cfg.hal_erase_f((_paddr), (_len))
+  SPIFFS_HAL_MODIFY((_fs), (_fs)->cfg.hal_erase_f((_paddr), (_len)))
 
 #endif // SPIFFS_HAL_CALLBACK_EXTRA
 
@@ -383,11 +394,19 @@
 #define SPIFFS_CACHE_FLAG_OBJLU       (1<<2)
 #define SPIFFS_CACHE_FLAG_OBJIX       (1<<3)
 #define SPIFFS_CACHE_FLAG_DATA        (1<<4)
+#define SPIFFS_CACHE_FLAG_USED        (1<<5)
 #define SPIFFS_CACHE_FLAG_TYPE_WR     (1<<7)
 
+// no cache page (end of a list or of a hash chain)
+#define SPIFFS_CACHE_NIL              ((u16_t)0xffff)
+
 #define SPIFFS_CACHE_PAGE_SIZE(fs) \
   (sizeof(spiffs_cache_page) + SPIFFS_CFG_LOG_PAGE_SZ(fs))
 
+// memory for a cache of n pages: the cache struct, the pages and up to two hash buckets per page
+#define SPIFFS_CACHE_BUF_SIZE(log_page_size, n) \
+  (sizeof(spiffs_cache) + (n) * (sizeof(spiffs_cache_page) + (log_page_size) + 2*sizeof(u16_t)))
+
 #define spiffs_get_cache(fs) \
   ((spiffs_cache *)((fs)->cache))
 
@@ -402,9 +421,12 @@ typedef struct {
   // cache flags
   u8_t flags;
   // cache page index
-  u8_t ix;
-  // last access of this cache page
-  u32_t last_access;
+  u16_t ix;
+  // previous and next page in the LRU list (most recently used first), or next free page
+  u16_t prev;
+  u16_t next;
+  // next page in the same hash bucket
+  u16_t hnext;
   union {
     // type read cache
     struct {
@@ -425,17 +447,120 @@ typedef struct {
   };
 } spiffs_cache_page;
 
-// cache struct
+// cache struct: the pages in use are in a hash table (by page index for the read pages, by
+// object id for the write pages) and in a LRU list, the other ones in a free list
 typedef struct {
-  u8_t cpage_count;
-  u32_t last_access;
-  u32_t cpage_use_map;
-  u32_t cpage_use_mask;
+  u16_t cpage_count;
+  // number of hash buckets - 1 (a power of two - 1)
+  u16_t hash_mask;
+  // most and least recently used pages
+  u16_t lru_first;
+  u16_t lru_last;
+  // first free page
+  u16_t free_first;
+  // first page of each hash bucket
+  u16_t *hash;
   u8_t *cpages;
+  // lookups of the read cache served from RAM and from flash, pages evicted
+  u32_t hits;
+  u32_t misses;
+  u32_t evictions;
 } spiffs_cache;
 
 #endif
 
+#if SPIFFS_RAM_INDEX
+
+// memory for the ram index of a file system of phys_size bytes with room for the index header
+// pages of n objects: the index struct, two bits per page, a bit per object id (half a bit
+// per page) and the objects
+#define SPIFFS_RAM_INDEX_BUF_SIZE(phys_size, log_page_size, n) \
+  (sizeof(spiffs_ram_index) + 2*4*((((phys_size)/(log_page_size))+31)/32) + \
+      4*((((phys_size)/(log_page_size))/2+2+31)/32) + (n) * sizeof(spiffs_ram_index_obj))
+
+// ram index entry of an object
+typedef struct {
+  // object id, without the index flag
+  spiffs_obj_id obj_id;
+  // page of the object index header
+  spiffs_page_ix pix;
+  // hash of the name
+  u32_t name_hash;
+} spiffs_ram_index_obj;
+
+// ram index struct: a copy of the object lookup, one bit per lookup entry (bix *
+// SPIFFS_OBJ_LOOKUP_MAX_ENTRIES + entry) in each map, and the object index header
+// pages. It is built by spiffs_obj_lu_scan and updated with every object lookup
+// write and every object index event. An object found in the index is checked on
+// flash before it is used
+typedef struct {
+  // set when the maps and the objects match the object lookup
+  u8_t valid;
+  // set when some objects may be missing (more objects than obj_max or a stale
+  // entry): a name or id not found must be looked up on flash
+  u8_t partial;
+  u16_t obj_count;
+  u16_t obj_max;
+  // lookup entries in each map
+  u32_t entries;
+  // bit set if the lookup entry is free
+  u32_t *free_map;
+  // bit set if the lookup entry is deleted
+  u32_t *dele_map;
+  // object ids in id_map, the ids spiffs_obj_lu_find_free_obj_id can return
+  u32_t ids;
+  // bit set if the object id may be in use: set for every id written to the
+  // object lookup, cleared only when the object lookup is scanned again
+  u32_t *id_map;
+  spiffs_ram_index_obj *objs;
+  // lookups answered by the index and lookups that scanned the object lookup
+  u32_t hits;
+  u32_t scans;
+} spiffs_ram_index;
+
+#endif
+
+#if SPIFFS_CHECKPOINT
+
+#define SPIFFS_CKPT_MAGIC               0x54504b43
+#define SPIFFS_CKPT_VERSION             1
+
+// checkpoint of the state found by spiffs_obj_lu_scan, followed by the maps
+// and the objects of the ram index when it is valid
+typedef struct {
+  // SPIFFS_CKPT_MAGIC
+  u32_t magic;
+  // all ones while the checkpoint matches the flash, cleared before the
+  // first write or erase after it
+  u32_t live;
+  // checksum of what follows in the header and of the ram index data
+  u32_t check;
+  // bytes of ram index data after the header, 0 if there is none
+  u32_t data_size;
+  u32_t version;
+  // configuration the checkpoint has been saved with
+  u32_t phys_size;
+  u32_t log_block_size;
+  u32_t log_page_size;
+  // spiffs state
+  u32_t free_blocks;
+  u32_t stats_p_allocated;
+  u32_t stats_p_deleted;
+  u32_t free_cursor_block_ix;
+  u32_t free_cursor_obj_lu_entry;
+  u32_t max_erase_count;
+  // ram index state
+  u32_t obj_count;
+  u32_t partial;
+} spiffs_checkpoint_hdr;
+
+// bytes written by SPIFFS_checkpoint with a ram index of ram_index_size bytes
+// (0 if there is none)
+#define SPIFFS_CHECKPOINT_MAX_SIZE(ram_index_size) \
+  (sizeof(spiffs_checkpoint_hdr) + (ram_index_size))
+
+#endif
+
 
 // spiffs nucleus file descriptor
 typedef struct {
@@ -462,6 +587,24 @@ typedef struct {
 #if SPIFFS_CACHE_WR
   spiffs_cache_page *cache_page;
 #endif
+#if SPIFFS_APPEND_DEFER
+  // whole data pages appended after the size in the object index header,
+  // not in the object index until spiffs_object_append_commit
+  spiffs_page_ix defer_pix[SPIFFS_APPEND_DEFER_PAGES];
+  // span index of defer_pix[0]
+  spiffs_span_ix defer_spix;
+  // number of pages in defer_pix
+  u8_t defer_count;
+#endif
+#if SPIFFS_READ_AHEAD
+  // whole data pages (headers included) read ahead, from span index ra_spix
+  u8_t ra_buf[SPIFFS_READ_AHEAD_SIZE];
+  spiffs_span_ix ra_spix;
+  // number of pages in ra_buf, 0 if there is nothing read ahead
+  u8_t ra_count;
+  // span index after the last data page read: a read from there is sequential
+  spiffs_span_ix ra_next;
+#endif
 #if SPIFFS_TEMPORAL_FD_CACHE
   // djb2 hash of filename
   u32_t name_hash;
@@ -718,6 +861,14 @@ s32_t spiffs_object_append(
     u8_t *data,
     u32_t len);
 
+#if SPIFFS_APPEND_DEFER
+s32_t spiffs_object_append_commit(
+    spiffs_fd *fd);
+
+s32_t spiffs_object_append_commit_all(
+    spiffs *fs);
+#endif
+
 s32_t spiffs_object_modify(
     spiffs_fd *fd,
     u32_t offset,
@@ -760,6 +911,10 @@ s32_t spiffs_gc_clean(
     spiffs *fs,
     spiffs_block_ix bix);
 
+s32_t spiffs_gc_slice(
+    spiffs *fs,
+    u32_t max_pages);
+
 s32_t spiffs_gc_quick(
     spiffs *fs, u16_t max_free_pages);
 
@@ -786,6 +941,102 @@ void spiffs_fd_temporal_cache_rehash(
     const char *new_path);
 #endif
 
+#if SPIFFS_TEMPORAL_FD_CACHE || SPIFFS_RAM_INDEX
+u32_t spiffs_hash(
+    spiffs *fs,
+    const u8_t *name);
+#endif
+
+#if SPIFFS_RAM_INDEX
+void spiffs_ram_index_init(
+    spiffs *fs);
+
+spiffs_ram_index *spiffs_ram_index_get(
+    spiffs *fs);
+
+void spiffs_ram_index_scan_start(
+    spiffs *fs);
+
+s32_t spiffs_ram_index_scan(
+    spiffs *fs,
+    spiffs_obj_id obj_id,
+    spiffs_block_ix bix,
+    int ix_entry);
+
+void spiffs_ram_index_scan_end(
+    spiffs *fs);
+
+void spiffs_ram_index_lu_set(
+    spiffs *fs,
+    spiffs_page_ix pix,
+    spiffs_obj_id obj_id);
+
+void spiffs_ram_index_erase_block(
+    spiffs *fs,
+    spiffs_block_ix bix);
+
+void spiffs_ram_index_block_pages(
+    spiffs *fs,
+    spiffs_block_ix bix,
+    u16_t *free_pages,
+    u16_t *deleted_pages);
+
+s32_t spiffs_ram_index_find_free(
+    spiffs *fs,
+    spiffs_block_ix starting_block,
+    int starting_lu_entry,
+    spiffs_block_ix *block_ix,
+    int *lu_entry);
+
+s32_t spiffs_ram_index_find_id(
+    spiffs *fs,
+    spiffs_obj_id obj_id,
+    spiffs_page_ix exclusion_pix,
+    spiffs_page_ix *pix);
+
+s32_t spiffs_ram_index_find_name(
+    spiffs *fs,
+    const u8_t name[],
+    spiffs_page_ix *pix);
+
+s32_t spiffs_ram_index_find_free_obj_id(
+    spiffs *fs,
+    spiffs_obj_id *obj_id,
+    const u8_t *conflicting_name);
+
+void spiffs_ram_index_object_event(
+    spiffs *fs,
+    spiffs_page_object_ix *objix,
+    int ev,
+    spiffs_obj_id obj_id,
+    spiffs_page_ix new_pix);
+
+#if SPIFFS_CHECKPOINT
+u32_t spiffs_ram_index_ckpt_data(
+    spiffs *fs,
+    u8_t **data,
+    u32_t *obj_count,
+    u32_t *partial);
+
+u8_t *spiffs_ram_index_ckpt_restore(
+    spiffs *fs,
+    u32_t obj_count,
+    u32_t partial,
+    u32_t data_size);
+#endif
+#endif
+
+#if SPIFFS_CHECKPOINT
+s32_t spiffs_checkpoint_load(
+    spiffs *fs);
+
+s32_t spiffs_checkpoint_save(
+    spiffs *fs);
+
+s32_t spiffs_checkpoint_drop(
+    spiffs *fs);
+#endif
+
 #if SPIFFS_CACHE
 void spiffs_cache_init(
     spiffs *fs);
@@ -0,0 +1,402 @@
+/*
+ * spiffs_ram_index.c
+ *
+ * Index of the object lookup kept in RAM: the free and deleted lookup entries
+ * and the object index header page of each object, so that allocations and
+ * opens do not scan every object lookup page on flash.
+ */
+
+#include "spiffs.h"
+#include "spiffs_nucleus.h"
+
+#if SPIFFS_RAM_INDEX
+
+#define SPIFFS_RAM_INDEX_BIT(map, i) ((map)[(i) >> 5] & (1u << ((i) & 31)))
+#define SPIFFS_RAM_INDEX_SET(map, i) ((map)[(i) >> 5] |= (1u << ((i) & 31)))
+#define SPIFFS_RAM_INDEX_CLR(map, i) ((map)[(i) >> 5] &= ~(1u << ((i) & 31)))
+
+static spiffs_ram_index *spiffs_ram_index_mem(spiffs *fs) {
+  if (fs->cfg.ram_index == 0 || fs->cfg.ram_index_size < sizeof(spiffs_ram_index)) return 0;
+  return (spiffs_ram_index *)fs->cfg.ram_index;
+}
+
+// bit of the lookup entry of a page in the maps
+static u32_t spiffs_ram_index_bit(spiffs *fs, spiffs_page_ix pix) {
+  return SPIFFS_BLOCK_FOR_PAGE(fs, pix) * SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs) +
+      SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, pix);
+}
+
+static spiffs_ram_index_obj *spiffs_ram_index_obj_by_id(spiffs_ram_index *ri, spiffs_obj_id obj_id) {
+  u16_t i;
+  for (i = 0; i < ri->obj_count; i++) {
+    if (ri->objs[i].obj_id == obj_id) return &ri->objs[i];
+  }
+  return 0;
+}
+
+static void spiffs_ram_index_obj_remove(spiffs_ram_index *ri, spiffs_ram_index_obj *o) {
+  *o = ri->objs[--ri->obj_count];
+}
+
+static void spiffs_ram_index_obj_add(spiffs_ram_index *ri, spiffs_obj_id obj_id, spiffs_page_ix pix, u32_t name_hash) {
+  if (ri->obj_count == ri->obj_max) {
+    // no room: the objects not in the index are looked up on flash
+    ri->partial = 1;
+    return;
+  }
+  ri->objs[ri->obj_count].obj_id = obj_id;
+  ri->objs[ri->obj_count].pix = pix;
+  ri->objs[ri->obj_count].name_hash = name_hash;
+  ri->obj_count++;
+}
+
+// Reads the page an index entry points to: SPIFFS_OK if it is still the live object
+// index header of obj_id (and has the given name), SPIFFS_ERR_NOT_FOUND if not
+static s32_t spiffs_ram_index_check_hdr(spiffs *fs, spiffs_page_ix pix, spiffs_obj_id obj_id, const u8_t *name) {
+  s32_t res;
+  spiffs_page_object_ix_header objix_hdr;
+  res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+      0, SPIFFS_PAGE_TO_PADDR(fs, pix),
+      name ? sizeof(spiffs_page_object_ix_header) : sizeof(spiffs_page_header), (u8_t *)&objix_hdr);
+  SPIFFS_CHECK_RES(res);
+  if (objix_hdr.p_hdr.obj_id != (obj_id | SPIFFS_OBJ_ID_IX_FLAG) ||
+      objix_hdr.p_hdr.span_ix != 0 ||
+      (objix_hdr.p_hdr.flags & (SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_IXDELE)) !=
+          (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE)) {
+    return SPIFFS_ERR_NOT_FOUND;
+  }
+  if (name && strcmp((const char *)name, (const char *)objix_hdr.name) != 0) {
+    return SPIFFS_ERR_NOT_FOUND;
+  }
+  return SPIFFS_OK;
+}
+
+// Object ids spiffs_obj_lu_find_free_obj_id can return, 1 to max_objects + 1
+static u32_t spiffs_ram_index_ids(u32_t entries) {
+  return MIN(entries / 2 + 2, SPIFFS_OBJ_ID_IX_FLAG);
+}
+
+// Marks an object id found in the object lookup as used
+static void spiffs_ram_index_id_used(spiffs_ram_index *ri, spiffs_obj_id obj_id) {
+  if (obj_id == SPIFFS_OBJ_ID_FREE || obj_id == SPIFFS_OBJ_ID_DELETED) return;
+  obj_id &= ~SPIFFS_OBJ_ID_IX_FLAG;
+  if (obj_id < ri->ids) SPIFFS_RAM_INDEX_SET(ri->id_map, obj_id);
+}
+
+// Lays out the ram index in the memory given in the configuration, it is
+// built by the next spiffs_obj_lu_scan
+void spiffs_ram_index_init(spiffs *fs) {
+  spiffs_ram_index *ri = spiffs_ram_index_mem(fs);
+  if (ri == 0) return;
+  u32_t entries = fs->block_count * SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs);
+  u32_t map_sz = ((entries + 31) / 32) * sizeof(u32_t);
+  u32_t id_sz = ((spiffs_ram_index_ids(entries) + 31) / 32) * sizeof(u32_t);
+  memset(ri, 0, sizeof(spiffs_ram_index));
+  if (fs->cfg.ram_index_size < sizeof(spiffs_ram_index) + 2 * map_sz + id_sz) return; // too small, never valid
+  ri->entries = entries;
+  ri->ids = spiffs_ram_index_ids(entries);
+  ri->free_map = (u32_t *)((u8_t *)ri + sizeof(spiffs_ram_index));
+  ri->dele_map = (u32_t *)((u8_t *)ri->free_map + map_sz);
+  ri->id_map = (u32_t *)((u8_t *)ri->dele_map + map_sz);
+  ri->objs = (spiffs_ram_index_obj *)((u8_t *)ri->id_map + id_sz);
+  ri->obj_max = MIN(0xffff,
+      (fs->cfg.ram_index_size - sizeof(spiffs_ram_index) - 2 * map_sz - id_sz) / sizeof(spiffs_ram_index_obj));
+}
+
+// Returns the ram index if it matches the object lookup, else 0
+spiffs_ram_index *spiffs_ram_index_get(spiffs *fs) {
+  spiffs_ram_index *ri = spiffs_ram_index_mem(fs);
+  return ri && ri->valid ? ri : 0;
+}
+
+// Empties the ram index before it is rebuilt by spiffs_ram_index_scan: it is
+// not used until spiffs_ram_index_scan_end
+void spiffs_ram_index_scan_start(spiffs *fs) {
+  spiffs_ram_index *ri = spiffs_ram_index_mem(fs);
+  if (ri == 0 || ri->entries == 0) return;
+  u32_t map_sz = ((ri->entries + 31) / 32) * sizeof(u32_t);
+  memset(ri->free_map, 0, map_sz);
+  memset(ri->dele_map, 0, map_sz);
+  memset(ri->id_map, 0, ((ri->ids + 31) / 32) * sizeof(u32_t));
+  ri->obj_count = 0;
+  ri->valid = 0;
+  ri->partial = 0;
+}
+
+// Adds a lookup entry to the ram index being rebuilt, reading the page if it
+// is an object index
+s32_t spiffs_ram_index_scan(spiffs *fs, spiffs_obj_id obj_id, spiffs_block_ix bix, int ix_entry) {
+  spiffs_ram_index *ri = spiffs_ram_index_mem(fs);
+  if (ri == 0 || ri->entries == 0) return SPIFFS_OK;
+  u32_t bit = bix * SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs) + ix_entry;
+  spiffs_ram_index_id_used(ri, obj_id);
+  if (obj_id == SPIFFS_OBJ_ID_FREE) {
+    SPIFFS_RAM_INDEX_SET(ri->free_map, bit);
+  } else if (obj_id == SPIFFS_OBJ_ID_DELETED) {
+    SPIFFS_RAM_INDEX_SET(ri->dele_map, bit);
+  } else if (obj_id & SPIFFS_OBJ_ID_IX_FLAG) {
+    s32_t res;
+    spiffs_page_object_ix_header objix_hdr;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ,
+        0, SPIFFS_OBJ_LOOKUP_ENTRY_TO_PADDR(fs, bix, ix_entry), sizeof(spiffs_page_object_ix_header), (u8_t *)&objix_hdr);
+    SPIFFS_CHECK_RES(res);
+    if (objix_hdr.p_hdr.obj_id == obj_id && objix_hdr.p_hdr.span_ix == 0 &&
+        (objix_hdr.p_hdr.flags & (SPIFFS_PH_FLAG_FINAL | SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_USED | SPIFFS_PH_FLAG_IXDELE)) ==
+            (SPIFFS_PH_FLAG_DELET | SPIFFS_PH_FLAG_IXDELE) &&
+        spiffs_ram_index_obj_by_id(ri, obj_id & ~SPIFFS_OBJ_ID_IX_FLAG) == 0) {
+      spiffs_ram_index_obj_add(ri, obj_id & ~SPIFFS_OBJ_ID_IX_FLAG,
+          SPIFFS_OBJ_LOOKUP_ENTRY_TO_PIX(fs, bix, ix_entry), spiffs_hash(fs, objix_hdr.name));
+    }
+  }
+  return SPIFFS_OK;
+}
+
+// Every lookup entry has been given to spiffs_ram_index_scan
+void spiffs_ram_index_scan_end(spiffs *fs) {
+  spiffs_ram_index *ri = spiffs_ram_index_mem(fs);
+  if (ri == 0 || ri->entries == 0) return;
+  ri->valid = 1;
+}
+
+// An object lookup entry has been written
+void spiffs_ram_index_lu_set(spiffs *fs, spiffs_page_ix pix, spiffs_obj_id obj_id) {
+  spiffs_ram_index *ri = spiffs_ram_index_get(fs);
+  if (ri == 0) return;
+  u32_t bit = spiffs_ram_index_bit(fs, pix);
+  spiffs_ram_index_id_used(ri, obj_id);
+  SPIFFS_RAM_INDEX_CLR(ri->free_map, bit);
+  if (obj_id == SPIFFS_OBJ_ID_DELETED) {
+    SPIFFS_RAM_INDEX_SET(ri->dele_map, bit);
+  } else {
+    SPIFFS_RAM_INDEX_CLR(ri->dele_map, bit);
+  }
+}
+
+// A block has been erased
+void spiffs_ram_index_erase_block(spiffs *fs, spiffs_block_ix bix) {
+  spiffs_ram_index *ri = spiffs_ram_index_get(fs);
+  if (ri == 0) return;
+  u32_t bit = bix * SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs);
+  u32_t end = bit + SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs);
+  for (; bit < end; bit++) {
+    SPIFFS_RAM_INDEX_SET(ri->free_map, bit);
+    SPIFFS_RAM_INDEX_CLR(ri->dele_map, bit);
+  }
+}
+
+// Counts the free and deleted pages of a block, the index must be valid
+void spiffs_ram_index_block_pages(spiffs *fs, spiffs_block_ix bix, u16_t *free_pages, u16_t *deleted_pages) {
+  spiffs_ram_index *ri = spiffs_ram_index_get(fs);
+  u32_t bit = bix * SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs);
+  u32_t end = bit + SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs);
+  *free_pages = 0;
+  *deleted_pages = 0;
+  for (; bit < end; bit++) {
+    if (SPIFFS_RAM_INDEX_BIT(ri->free_map, bit)) (*free_pages)++;
+    if (SPIFFS_RAM_INDEX_BIT(ri->dele_map, bit)) (*deleted_pages)++;
+  }
+}
+
+// Finds the first free lookup entry from the given one, wrapping at the end like
+// spiffs_obj_lu_find_id. Returns SPIFFS_RAM_INDEX_MISS if the index is not valid
+s32_t spiffs_ram_index_find_free(spiffs *fs, spiffs_block_ix starting_block, int starting_lu_entry,
+    spiffs_block_ix *block_ix, int *lu_entry) {
+  spiffs_ram_index *ri = spiffs_ram_index_get(fs);
+  if (ri == 0) return SPIFFS_RAM_INDEX_MISS;
+  u32_t bit = starting_block * SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs) + starting_lu_entry;
+  u32_t left = ri->entries;
+  ri->hits++;
+  while (left > 0) {
+    if (bit >= ri->entries) bit = 0;
+    if ((bit & 31) == 0 && ri->free_map[bit >> 5] == 0) {
+      // skip a word without free entries
+      u32_t skip = MIN(32, MIN(left, ri->entries - bit));
+      bit += skip;
+      left -= skip;
+      continue;
+    }
+    if (SPIFFS_RAM_INDEX_BIT(ri->free_map, bit)) {
+      *block_ix = bit / SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs);
+      *lu_entry = bit % SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs);
+      return SPIFFS_OK;
+    }
+    bit++;
+    left--;
+  }
+  return SPIFFS_ERR_NOT_FOUND;
+}
+
+// Finds the object index header page of an object. Returns SPIFFS_RAM_INDEX_MISS
+// if the object lookup must be scanned
+s32_t spiffs_ram_index_find_id(spiffs *fs, spiffs_obj_id obj_id, spiffs_page_ix exclusion_pix, spiffs_page_ix *pix) {
+  spiffs_ram_index *ri = spiffs_ram_index_get(fs);
+  if (ri == 0) return SPIFFS_RAM_INDEX_MISS;
+  obj_id &= ~SPIFFS_OBJ_ID_IX_FLAG;
+  spiffs_ram_index_obj *o = spiffs_ram_index_obj_by_id(ri, obj_id);
+  if (o == 0) {
+    if (ri->partial) {
+      ri->scans++;
+      return SPIFFS_RAM_INDEX_MISS;
+    }
+    ri->hits++;
+    return SPIFFS_ERR_NOT_FOUND;
+  }
+  if (o->pix == exclusion_pix) {
+    // another header of the same object is wanted
+    ri->scans++;
+    return SPIFFS_RAM_INDEX_MISS;
+  }
+  s32_t res = spiffs_ram_index_check_hdr(fs, o->pix, obj_id, 0);
+  if (res == SPIFFS_ERR_NOT_FOUND) {
+    // stale entry: forget it, the lookup pages know better
+    spiffs_ram_index_obj_remove(ri, o);
+    ri->partial = 1;
+    ri->scans++;
+    return SPIFFS_RAM_INDEX_MISS;
+  }
+  SPIFFS_CHECK_RES(res);
+  ri->hits++;
+  *pix = o->pix;
+  return SPIFFS_OK;
+}
+
+// Finds the object index header page of an object by name. Returns
+// SPIFFS_RAM_INDEX_MISS if the object lookup must be scanned
+s32_t spiffs_ram_index_find_name(spiffs *fs, const u8_t name[], spiffs_page_ix *pix) {
+  spiffs_ram_index *ri = spiffs_ram_index_get(fs);
+  if (ri == 0) return SPIFFS_RAM_INDEX_MISS;
+  u32_t name_hash = spiffs_hash(fs, name);
+  u16_t i = 0;
+  while (i < ri->obj_count) {
+    spiffs_ram_index_obj *o = &ri->objs[i];
+    if (o->name_hash != name_hash) {
+      i++;
+      continue;
+    }
+    s32_t res = spiffs_ram_index_check_hdr(fs, o->pix, o->obj_id, name);
+    if (res == SPIFFS_OK) {
+      ri->hits++;
+      *pix = o->pix;
+      return SPIFFS_OK;
+    }
+    if (res != SPIFFS_ERR_NOT_FOUND) return res;
+    if (spiffs_ram_index_check_hdr(fs, o->pix, o->obj_id, 0) != SPIFFS_OK) {
+      // stale entry, not a hash collision
+      spiffs_ram_index_obj_remove(ri, o);
+      ri->partial = 1;
+      continue;
+    }
+    i++;
+  }
+  if (ri->partial) {
+    ri->scans++;
+    return SPIFFS_RAM_INDEX_MISS;
+  }
+  ri->hits++;
+  return SPIFFS_ERR_NOT_FOUND;
+}
+
+static s32_t spiffs_ram_index_ids_v(spiffs *fs, spiffs_obj_id id, spiffs_block_ix bix, int ix_entry,
+    const void *user_const_p, void *user_var_p) {
+  (void)bix;
+  (void)ix_entry;
+  (void)user_const_p;
+  spiffs_ram_index_id_used((spiffs_ram_index *)user_var_p, id);
+  return SPIFFS_VIS_COUNTINUE;
+}
+
+// Finds the lowest object id not in the object lookup, checking first that no
+// object has the conflicting name. The id map only forgets ids when the object
+// lookup is scanned, so it is scanned again when every id has been used since.
+// Returns SPIFFS_RAM_INDEX_MISS if the object lookup must be scanned
+s32_t spiffs_ram_index_find_free_obj_id(spiffs *fs, spiffs_obj_id *obj_id, const u8_t *conflicting_name) {
+  spiffs_ram_index *ri = spiffs_ram_index_get(fs);
+  if (ri == 0) return SPIFFS_RAM_INDEX_MISS;
+  s32_t res;
+  if (conflicting_name) {
+    spiffs_page_ix pix;
+    res = spiffs_ram_index_find_name(fs, conflicting_name, &pix);
+    if (res == SPIFFS_OK) return SPIFFS_ERR_CONFLICTING_NAME;
+    if (res != SPIFFS_ERR_NOT_FOUND) return res;
+  }
+  int pass;
+  for (pass = 0; pass < 2; pass++) {
+    u32_t id;
+    for (id = 1; id < ri->ids; id++) {
+      if ((id & 31) == 0 && ri->id_map[id >> 5] == 0xffffffff) {
+        id += 31;
+        continue;
+      }
+      if (!SPIFFS_RAM_INDEX_BIT(ri->id_map, id)) {
+        *obj_id = (spiffs_obj_id)id;
+        return SPIFFS_OK;
+      }
+    }
+    if (pass > 0) break;
+    // every id has been used since the last scan: forget the ones deleted
+    ri->scans++;
+    memset(ri->id_map, 0, ((ri->ids + 31) / 32) * sizeof(u32_t));
+    res = spiffs_obj_lu_find_entry_visitor(fs, 0, 0, 0, 0, spiffs_ram_index_ids_v, 0, ri, 0, 0);
+    if (res == SPIFFS_VIS_END) res = SPIFFS_OK;
+    if (res != SPIFFS_OK) {
+      ri->valid = 0;
+      return res;
+    }
+  }
+  return SPIFFS_ERR_FULL;
+}
+
+#if SPIFFS_CHECKPOINT
+// Bytes of the maps and of the objects of the ram index, contiguous in memory
+static u32_t spiffs_ram_index_data_size(spiffs_ram_index *ri, u32_t obj_count) {
+  return (u8_t *)&ri->objs[obj_count] - (u8_t *)ri->free_map;
+}
+
+// The ram index data saved by a checkpoint. Returns its size, 0 if the index
+// is not valid
+u32_t spiffs_ram_index_ckpt_data(spiffs *fs, u8_t **data, u32_t *obj_count, u32_t *partial) {
+  spiffs_ram_index *ri = spiffs_ram_index_get(fs);
+  if (ri == 0) return 0;
+  *data = (u8_t *)ri->free_map;
+  *obj_count = ri->obj_count;
+  *partial = ri->partial;
+  return spiffs_ram_index_data_size(ri, ri->obj_count);
+}
+
+// Prepares the ram index to be read from a checkpoint, it is valid after
+// spiffs_ram_index_scan_end. Returns the memory to read data_size bytes into,
+// 0 if they do not match the layout of the index
+u8_t *spiffs_ram_index_ckpt_restore(spiffs *fs, u32_t obj_count, u32_t partial, u32_t data_size) {
+  spiffs_ram_index *ri = spiffs_ram_index_mem(fs);
+  if (ri == 0 || ri->entries == 0) return 0;
+  ri->valid = 0;
+  if (obj_count > ri->obj_max || data_size != spiffs_ram_index_data_size(ri, obj_count)) return 0;
+  ri->obj_count = obj_count;
+  ri->partial = partial != 0;
+  return (u8_t *)ri->free_map;
+}
+#endif
+
+// An object index header has been written, moved or deleted (see spiffs_cb_object_event)
+void spiffs_ram_index_object_event(spiffs *fs, spiffs_page_object_ix *objix, int ev, spiffs_obj_id obj_id,
+    spiffs_page_ix new_pix) {
+  spiffs_ram_index *ri = spiffs_ram_index_get(fs);
+  if (ri == 0) return;
+  obj_id &= ~SPIFFS_OBJ_ID_IX_FLAG;
+  spiffs_ram_index_obj *o = spiffs_ram_index_obj_by_id(ri, obj_id);
+  // the name is in the header given with the event, unless it has only been moved
+  const u8_t *name = objix && ev != SPIFFS_EV_IX_MOV ? ((spiffs_page_object_ix_header *)objix)->name : 0;
+  if (ev == SPIFFS_EV_IX_DEL) {
+    // a stale header may be wiped while the live one is elsewhere
+    if (o && o->pix == new_pix) spiffs_ram_index_obj_remove(ri, o);
+  } else if (o) {
+    o->pix = new_pix;
+    if (name) o->name_hash = spiffs_hash(fs, name);
+  } else if (name) {
+    spiffs_ram_index_obj_add(ri, obj_id, new_pix, spiffs_hash(fs, name));
+  } else {
+    ri->partial = 1;
+  }
+}
+
+#endif // SPIFFS_RAM_INDEX
@@ -14,6 +14,7 @@
 
 #include "freertos/FreeRTOS.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_partition.h"
 #include "esp_spiffs.h"
 #include "esp_vfs.h"
@@ -21,9 +22,38 @@
 
 static const char* TAG = "SPIFFS";
 
+#if defined(CONFIG_SPIFFS_IO_STATS) || defined(CONFIG_SPIFFS_LOCK_STATS)
+static int spiffs_api_lat_bucket(uint32_t us)
+{
+    int bucket = 0;
+
+    while (bucket < ESP_SPIFFS_IO_LAT_BUCKETS - 1 && us >= (16U << (2 * bucket))) {
+        bucket++;
+    }
+    return bucket;
+}
+#endif
+
 void spiffs_api_lock(spiffs *fs)
 {
-    (void) xSemaphoreTake(((esp_spiffs_t *)(fs->user_data))->lock, portMAX_DELAY);
+    esp_spiffs_t *efs = (esp_spiffs_t *)(fs->user_data);
+#ifdef CONFIG_SPIFFS_LOCK_STATS
+    if (xSemaphoreTake(efs->lock, 0) != pdTRUE) {
+        // taken by another task: count the wait once the lock is ours
+        int64_t start = esp_timer_get_time();
+        (void) xSemaphoreTake(efs->lock, portMAX_DELAY);
+        uint32_t us = esp_timer_get_time() - start;
+        efs->locks.contended++;
+        efs->locks.wait_us += us;
+        if (us > efs->locks.max_us) {
+            efs->locks.max_us = us;
+        }
+        efs->locks.lat[spiffs_api_lat_bucket(us)]++;
+    }
+    efs->locks.ops++;
+#else
+    (void) xSemaphoreTake(efs->lock, portMAX_DELAY);
+#endif
 }
 
 void spiffs_api_unlock(spiffs *fs)
@@ -31,10 +61,38 @@ void spiffs_api_unlock(spiffs *fs)
     xSemaphoreGive(((esp_spiffs_t *)(fs->user_data))->lock);
 }
 
+#ifdef CONFIG_SPIFFS_IO_STATS
+static void spiffs_api_account(esp_spiffs_t *efs, esp_spiffs_io_op_stats_t *op, uint32_t size, int64_t start, esp_err_t err)
+{
+    uint32_t us = esp_timer_get_time() - start;
+    int bucket = spiffs_api_lat_bucket(us);
+
+    portENTER_CRITICAL(&efs->io_mux);
+    op->ops++;
+    op->bytes += size;
+    op->time_us += us;
+    if (us > op->max_us) {
+        op->max_us = us;
+    }
+    op->lat[bucket]++;
+    if (err) {
+        op->errors++;
+    }
+    portEXIT_CRITICAL(&efs->io_mux);
+}
+#endif
+
 s32_t spiffs_api_read(spiffs *fs, uint32_t addr, uint32_t size, uint8_t *dst)
 {
-    esp_err_t err = esp_partition_read(((esp_spiffs_t *)(fs->user_data))->partition, 
+    esp_spiffs_t *efs = (esp_spiffs_t *)(fs->user_data);
+#ifdef CONFIG_SPIFFS_IO_STATS
+    int64_t start = esp_timer_get_time();
+#endif
+    esp_err_t err = esp_partition_read(efs->partition, 
                                         addr, dst, size);
+#ifdef CONFIG_SPIFFS_IO_STATS
+    spiffs_api_account(efs, &efs->io.read, size, start, err);
+#endif
     if (err) {
         ESP_LOGE(TAG, "failed to read addr %08x, size %08x, err %d", addr, size, err);
         return -1;
@@ -44,8 +102,15 @@ s32_t spiffs_api_read(spiffs *fs, uint32_t addr, uint32_t size, uint8_t *dst)
 
 s32_t spiffs_api_write(spiffs *fs, uint32_t addr, uint32_t size, uint8_t *src)
 {
-    esp_err_t err = esp_partition_write(((esp_spiffs_t *)(fs->user_data))->partition, 
+    esp_spiffs_t *efs = (esp_spiffs_t *)(fs->user_data);
+#ifdef CONFIG_SPIFFS_IO_STATS
+    int64_t start = esp_timer_get_time();
+#endif
+    esp_err_t err = esp_partition_write(efs->partition, 
                                         addr, src, size);
+#ifdef CONFIG_SPIFFS_IO_STATS
+    spiffs_api_account(efs, &efs->io.write, size, start, err);
+#endif
     if (err) {
         ESP_LOGE(TAG, "failed to write addr %08x, size %08x, err %d", addr, size, err);
         return -1;
@@ -55,8 +120,21 @@ s32_t spiffs_api_write(spiffs *fs, uint32_t addr, uint32_t size, uint8_t *src)
 
 s32_t spiffs_api_erase(spiffs *fs, uint32_t addr, uint32_t size)
 {
-    esp_err_t err = esp_partition_erase_range(((esp_spiffs_t *)(fs->user_data))->partition, 
+    esp_spiffs_t *efs = (esp_spiffs_t *)(fs->user_data);
+#ifdef CONFIG_SPIFFS_IO_STATS
+    int64_t start = esp_timer_get_time();
+#endif
+    esp_err_t err = esp_partition_erase_range(efs->partition, 
                                         addr, size);
+#ifdef CONFIG_SPIFFS_IO_STATS
+    spiffs_api_account(efs, &efs->io.erase, size, start, err);
+    if (!err) {
+        uint32_t block = efs->cfg.phys_erase_block;
+        for (uint32_t s = addr / block; s < (addr + size) / block && s < efs->io.sectors; s++) {
+            efs->sector_erases[s]++;
+        }
+    }
+#endif
     if (err) {
         ESP_LOGE(TAG, "failed to erase addr %08x, size %08x, err %d", addr, size, err);
         return -1;
@@ -64,6 +142,105 @@ s32_t spiffs_api_erase(spiffs *fs, uint32_t addr, uint32_t size)
     return 0;
 }
 
+#ifdef CONFIG_SPIFFS_CHECKPOINT
+#define CKPT_SLOT_MAGIC 0x544F4C53 //"SLOT"
+
+/* Header of a slot of the checkpoint partition, written when the slot is erased for a new checkpoint:
+ * the slot with the highest sequence number holds the checkpoint saved last, it is used only by the
+ * SPIFFS partition it has been written for */
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t owner;         /*!< Address of the SPIFFS partition */
+    uint32_t reserved;
+} spiffs_api_ckpt_slot_t;
+
+static uint32_t spiffs_api_ckpt_addr(esp_spiffs_t *efs, uint32_t offset)
+{
+    return efs->ckpt_slot * efs->ckpt_slot_size + sizeof(spiffs_api_ckpt_slot_t) + offset;
+}
+
+esp_err_t spiffs_api_ckpt_init(esp_spiffs_t *efs, const char *label, uint32_t size)
+{
+    spiffs_api_ckpt_slot_t slot;
+    uint32_t i, slots;
+
+    efs->ckpt_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (efs->ckpt_partition == NULL) {
+        ESP_LOGW(TAG, "checkpoint partition %s not found, the mount scans the partition", label);
+        return ESP_ERR_NOT_FOUND;
+    }
+    efs->ckpt_slot_size = (size + sizeof(spiffs_api_ckpt_slot_t) + SPI_FLASH_SEC_SIZE - 1)
+                          / SPI_FLASH_SEC_SIZE * SPI_FLASH_SEC_SIZE;
+    slots = efs->ckpt_partition->size / efs->ckpt_slot_size;
+    if (slots == 0) {
+        ESP_LOGW(TAG, "checkpoint partition %s too small, %u bytes needed", label, efs->ckpt_slot_size);
+        efs->ckpt_partition = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    efs->ckpt_slot = slots - 1; //the first checkpoint goes to slot 0
+    efs->ckpt_seq = 0;
+    efs->ckpt_own = false;
+    for (i = 0; i < slots; i++) {
+        if (esp_partition_read(efs->ckpt_partition, i * efs->ckpt_slot_size, &slot, sizeof(slot)) != ESP_OK) {
+            continue;
+        }
+        if (slot.magic == CKPT_SLOT_MAGIC && slot.seq != 0 && (efs->ckpt_seq == 0 || slot.seq > efs->ckpt_seq)) {
+            efs->ckpt_slot = i;
+            efs->ckpt_seq = slot.seq;
+            efs->ckpt_own = slot.owner == efs->partition->address;
+        }
+    }
+    return ESP_OK;
+}
+
+s32_t spiffs_api_ckpt_read(spiffs *fs, uint32_t offset, uint32_t size, uint8_t *dst)
+{
+    esp_spiffs_t *efs = (esp_spiffs_t *)(fs->user_data);
+    if (!efs->ckpt_own || offset + size > efs->ckpt_slot_size - sizeof(spiffs_api_ckpt_slot_t)) {
+        return -1;
+    }
+    return esp_partition_read(efs->ckpt_partition, spiffs_api_ckpt_addr(efs, offset), dst, size) == ESP_OK ? 0 : -1;
+}
+
+s32_t spiffs_api_ckpt_write(spiffs *fs, uint32_t offset, uint32_t size, const uint8_t *src)
+{
+    esp_spiffs_t *efs = (esp_spiffs_t *)(fs->user_data);
+    if (!efs->ckpt_own || offset + size > efs->ckpt_slot_size - sizeof(spiffs_api_ckpt_slot_t)) {
+        return -1;
+    }
+    esp_err_t err = esp_partition_write(efs->ckpt_partition, spiffs_api_ckpt_addr(efs, offset), src, size);
+    if (err) {
+        ESP_LOGE(TAG, "failed to write checkpoint offset %08x, size %08x, err %d", offset, size, err);
+        return -1;
+    }
+    return 0;
+}
+
+s32_t spiffs_api_ckpt_erase(spiffs *fs)
+{
+    /* the slots are used in turn, so that each sector is erased once every (slots) checkpoints */
+    esp_spiffs_t *efs = (esp_spiffs_t *)(fs->user_data);
+    spiffs_api_ckpt_slot_t slot = { CKPT_SLOT_MAGIC, efs->ckpt_seq + 1, efs->partition->address, 0xFFFFFFFF };
+    if (slot.seq == 0) {
+        slot.seq = 1;
+    }
+    efs->ckpt_slot = (efs->ckpt_slot + 1) % (efs->ckpt_partition->size / efs->ckpt_slot_size);
+    efs->ckpt_own = false; //no checkpoint until the slot is ready
+    if (esp_partition_erase_range(efs->ckpt_partition, efs->ckpt_slot * efs->ckpt_slot_size,
+                                  efs->ckpt_slot_size) != ESP_OK ||
+        esp_partition_write(efs->ckpt_partition, efs->ckpt_slot * efs->ckpt_slot_size,
+                            &slot, sizeof(slot)) != ESP_OK) {
+        ESP_LOGE(TAG, "failed to start a checkpoint in slot %u", efs->ckpt_slot);
+        return -1;
+    }
+    efs->ckpt_seq = slot.seq;
+    efs->ckpt_own = true;
+    return 0;
+}
+#endif
+
 void spiffs_api_check(spiffs *fs, spiffs_check_type type, 
                             spiffs_check_report report, uint32_t arg1, uint32_t arg2)
 {
@@ -16,16 +16,31 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "spiffs.h"
 #include "esp_vfs.h"
+#include "esp_spiffs.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#if defined(CONFIG_SPIFFS_MTIME_PERIODIC) || defined(CONFIG_SPIFFS_MTIME_ON_SYNC)
+#define SPIFFS_MTIME_DEFERRED 1
+
+/**
+ * @brief mtime of a file kept in RAM
+ */
+typedef struct {
+    char name[CONFIG_SPIFFS_OBJ_NAME_LEN];  /*!< Object name, empty if the entry is free */
+    time_t mtime;                           /*!< Time of the last open for writing */
+    time_t written;                         /*!< mtime in the index header, 0 if not known: dirty if != mtime */
+} esp_spiffs_mtime_t;
+#endif
+
 /**
  * @brief SPIFFS definition structure
  */
@@ -41,6 +56,24 @@ typedef struct {
     uint32_t fds_sz;                        /*!< File Descriptor Buffer Length */
     uint8_t *cache;                         /*!< Cache Buffer */
     uint32_t cache_sz;                      /*!< Cache Buffer Length */
+#ifdef CONFIG_SPIFFS_IO_STATS
+    esp_spiffs_io_stats_t io;               /*!< Flash I/O since the mount or the last reset */
+    uint32_t *sector_erases;                /*!< Erases of each sector since the mount */
+    portMUX_TYPE io_mux;                    /*!< Protects io: a read ahead runs without the FS lock */
+#endif
+#ifdef CONFIG_SPIFFS_LOCK_STATS
+    esp_spiffs_lock_stats_t locks;          /*!< Waits for the FS lock since the mount or the last reset */
+#endif
+#ifdef CONFIG_SPIFFS_CHECKPOINT
+    const esp_partition_t* ckpt_partition;  /*!< Partition of the checkpoints, NULL if not found */
+    uint32_t ckpt_slot_size;                /*!< Bytes of a checkpoint slot, whole sectors */
+    uint32_t ckpt_slot;                     /*!< Slot of the checkpoint saved last */
+    uint32_t ckpt_seq;                      /*!< Sequence number of ckpt_slot, 0 if no slot is written */
+    bool ckpt_own;                          /*!< ckpt_slot has been written for this partition */
+#endif
+#ifdef SPIFFS_MTIME_DEFERRED
+    esp_spiffs_mtime_t mtimes[CONFIG_SPIFFS_MTIME_FILES]; /*!< Files opened for writing, protected by the FS lock */
+#endif
 } esp_spiffs_t;
 
 s32_t spiffs_api_read(spiffs *fs, uint32_t addr, uint32_t size, uint8_t *dst);
@@ -52,6 +85,16 @@ s32_t spiffs_api_erase(spiffs *fs, uint32_t addr, uint32_t size);
 void spiffs_api_check(spiffs *fs, spiffs_check_type type,
                             spiffs_check_report report, uint32_t arg1, uint32_t arg2);
 
+#ifdef CONFIG_SPIFFS_CHECKPOINT
+esp_err_t spiffs_api_ckpt_init(esp_spiffs_t *efs, const char *label, uint32_t size);
+
+s32_t spiffs_api_ckpt_read(spiffs *fs, uint32_t offset, uint32_t size, uint8_t *dst);
+
+s32_t spiffs_api_ckpt_write(spiffs *fs, uint32_t offset, uint32_t size, const uint8_t *src);
+
+s32_t spiffs_api_ckpt_erase(spiffs *fs);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
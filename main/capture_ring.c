@@ -0,0 +1,70 @@
+#include <string.h>
+
+#include "capture_ring.h"
+
+/* head and tail are free-running counters: the slot is the counter modulo CAPTURE_RING_SLOTS
+ * and head-tail is the number of records waiting to be processed.
+ * The acquire/release pairs make the record content visible before the index that publishes it */
+
+#define SLOT(i) ((i) & (CAPTURE_RING_SLOTS-1))
+
+void capture_ring_init(capture_ring_t *ring)
+{
+	ring->head = 0;
+	ring->tail = 0;
+	memset(&ring->stats, 0, sizeof(ring->stats));
+}
+
+capture_record_t *capture_ring_reserve(capture_ring_t *ring)
+{
+	uint32_t head = ring->head; //only the producer writes head
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	if(head - tail >= CAPTURE_RING_SLOTS){ //ring full
+		ring->stats.dropped++;
+		return NULL;
+	}
+
+	return &ring->slot[SLOT(head)];
+}
+
+void capture_ring_commit(capture_ring_t *ring)
+{
+	uint32_t head = ring->head;
+	uint32_t used;
+
+	if(ring->slot[SLOT(head)].sig_len > CAPTURE_FRAME_LEN)
+		ring->stats.truncated++;
+
+	__atomic_store_n(&ring->head, head+1, __ATOMIC_RELEASE);
+	ring->stats.pushed++;
+
+	used = head + 1 - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	if(used > ring->stats.high_water)
+		ring->stats.high_water = used;
+}
+
+capture_record_t *capture_ring_peek(capture_ring_t *ring)
+{
+	uint32_t tail = ring->tail; //only the consumer writes tail
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if(head == tail) //ring empty
+		return NULL;
+
+	return &ring->slot[SLOT(tail)];
+}
+
+void capture_ring_release(capture_ring_t *ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail+1, __ATOMIC_RELEASE);
+}
+
+void capture_ring_get_stats(capture_ring_t *ring, capture_ring_stats_t *stats)
+{
+	/* counters are written only by the producer: a torn snapshot is at most one packet old */
+	stats->pushed = ring->stats.pushed;
+	stats->dropped = ring->stats.dropped;
+	stats->truncated = ring->stats.truncated;
+	stats->high_water = ring->stats.high_water;
+}
@@ -0,0 +1,56 @@
+#ifndef CAPTURE_RING_H
+#define CAPTURE_RING_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/* Single-producer/single-consumer ring used to move sniffed frames out of the
+ * promiscuous callback. The producer is the Wi-Fi driver callback, the consumer
+ * is the processing task: no locks are taken, head is only written by the
+ * producer and tail only by the consumer. */
+
+#define CAPTURE_RING_SLOTS CONFIG_CAPTURE_RING_SLOTS //number of records in the ring (power of two)
+#define CAPTURE_FRAME_LEN CONFIG_CAPTURE_FRAME_LEN //max bytes of the frame copied in a record
+#define CAPTURE_RING_MAX_SIZE (64*1024) //the ring is static (.bss in DRAM), shared with Wi-Fi, lwIP and MQTT
+
+_Static_assert((CAPTURE_RING_SLOTS & (CAPTURE_RING_SLOTS-1)) == 0, "CAPTURE_RING_SLOTS must be a power of two");
+
+typedef struct {
+	int64_t us; //capture time (esp_timer_get_time)
+	int8_t rssi;
+	uint8_t channel;
+	uint16_t sig_len; //length of the frame on air, FCS included
+	uint16_t len; //bytes copied into frame[]
+	uint8_t frame[CAPTURE_FRAME_LEN]; //802.11 header followed by the frame body
+} capture_record_t;
+
+typedef struct {
+	uint32_t pushed; //records committed by the producer
+	uint32_t dropped; //records lost because the ring was full
+	uint32_t truncated; //records longer than CAPTURE_FRAME_LEN
+	uint32_t high_water; //max number of records waiting in the ring
+} capture_ring_stats_t;
+
+typedef struct {
+	volatile uint32_t head; //next slot to be written (producer)
+	volatile uint32_t tail; //next slot to be read (consumer)
+	capture_ring_stats_t stats; //written only by the producer
+	capture_record_t slot[CAPTURE_RING_SLOTS];
+} capture_ring_t;
+
+_Static_assert(sizeof(capture_ring_t) <= CAPTURE_RING_MAX_SIZE, "capture ring too big: lower CAPTURE_RING_SLOTS or CAPTURE_FRAME_LEN");
+
+void capture_ring_init(capture_ring_t *ring);
+
+/* Producer side: get a free slot (NULL if the ring is full), fill it, then commit it */
+capture_record_t *capture_ring_reserve(capture_ring_t *ring);
+void capture_ring_commit(capture_ring_t *ring);
+
+/* Consumer side: get the oldest record (NULL if the ring is empty), use it, then release it */
+capture_record_t *capture_ring_peek(capture_ring_t *ring);
+void capture_ring_release(capture_ring_t *ring);
+
+/* Snapshot of the counters (they are cumulative since capture_ring_init) */
+void capture_ring_get_stats(capture_ring_t *ring, capture_ring_stats_t *stats);
+
+#endif
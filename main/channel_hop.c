@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "channel_hop.h"
+
+static void set_dwell(channel_hop_t *hop)
+{
+	/* every channel gets min_dwell_ms, the rest of the cycle is shared by rate.
+	 * The +1 keeps the split defined when nothing has been captured yet */
+	int spare = hop->cycle_ms - hop->count*hop->min_dwell_ms;
+	uint32_t sum = 0;
+	uint8_t ch;
+	int i;
+
+	if(spare < 0)
+		spare = 0;
+
+	for(i=0; i<hop->count; i++)
+		sum += hop->rate[hop->channel[i]] + 1;
+
+	for(i=0; i<hop->count; i++){
+		ch = hop->channel[i];
+		hop->dwell_ms[ch] = hop->min_dwell_ms + (uint64_t)spare * (hop->rate[ch] + 1) / sum;
+	}
+}
+
+int channel_hop_init(channel_hop_t *hop, const char *list, int min_dwell_ms, int cycle_ms)
+{
+	const char *p = list;
+	char *end;
+	long ch;
+	int i;
+
+	memset(hop, 0, sizeof(*hop));
+	hop->idx = -1;
+	hop->min_dwell_ms = min_dwell_ms;
+	hop->cycle_ms = cycle_ms;
+
+	while(*p != '\0' && hop->count < HOP_MAX_CHANNEL){
+		ch = strtol(p, &end, 10);
+		if(end == p){ //not a number: skip the separator
+			p++;
+			continue;
+		}
+		p = end;
+
+		if(ch < 1 || ch > HOP_MAX_CHANNEL)
+			continue;
+		for(i=0; i<hop->count; i++)
+			if(hop->channel[i] == ch)
+				break;
+		if(i == hop->count) //not a duplicate
+			hop->channel[hop->count++] = ch;
+	}
+
+	if(hop->count > 0)
+		set_dwell(hop);
+
+	return hop->count;
+}
+
+void channel_hop_count(channel_hop_t *hop, uint8_t channel)
+{
+	if(channel >= 1 && channel <= HOP_MAX_CHANNEL)
+		hop->packets[channel]++;
+}
+
+uint8_t channel_hop_next(channel_hop_t *hop, int *dwell_ms)
+{
+	uint32_t dwell, rate;
+	uint8_t ch;
+
+	if(hop->idx >= 0){ //close the dwell on the current channel
+		ch = hop->channel[hop->idx];
+		dwell = hop->dwell_ms[ch];
+		rate = (hop->packets[ch] - hop->start) * 16000 / dwell;
+		hop->rate[ch] = (int32_t)hop->rate[ch] + ((int32_t)rate - (int32_t)hop->rate[ch]) / 4;
+		hop->time_ms[ch] += dwell;
+	}
+
+	hop->idx = (hop->idx + 1) % hop->count;
+	if(hop->idx == 0) //new cycle
+		set_dwell(hop);
+
+	ch = hop->channel[hop->idx];
+	hop->start = hop->packets[ch];
+	*dwell_ms = hop->dwell_ms[ch];
+
+	return ch;
+}
+
+void channel_hop_get_stats(channel_hop_t *hop, uint8_t channel, channel_hop_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	if(channel < 1 || channel > HOP_MAX_CHANNEL)
+		return;
+
+	stats->packets = hop->packets[channel];
+	stats->time_ms = hop->time_ms[channel];
+	stats->dwell_ms = hop->dwell_ms[channel];
+}
@@ -0,0 +1,48 @@
+#ifndef CHANNEL_HOP_H
+#define CHANNEL_HOP_H
+
+#include <stdint.h>
+
+/* Channel hopping scheduler: the radio visits a set of channels in a cycle of about
+ * cycle_ms milliseconds. Every channel gets at least min_dwell_ms, the rest of the cycle is
+ * split in proportion to the probe request rate observed on each channel (moving average
+ * over the last cycles), so busy channels are listened longer and quiet ones are still visited.
+ *
+ * channel_hop_count() is called by the promiscuous callback, the other functions by the
+ * hopping task: every counter has a single writer, no locks are needed. */
+
+#define HOP_MAX_CHANNEL 14 //channels are numbered from 1 to HOP_MAX_CHANNEL
+
+typedef struct {
+	uint32_t packets; //probe requests captured on the channel
+	uint32_t time_ms; //time spent on the channel
+	uint32_t dwell_ms; //current dwell time
+} channel_hop_stats_t;
+
+typedef struct {
+	uint8_t channel[HOP_MAX_CHANNEL]; //channels to visit
+	int count; //number of channels to visit
+	int idx; //index of the current channel, -1 before the first hop
+	int min_dwell_ms;
+	int cycle_ms;
+	uint32_t start; //packets of the current channel when the dwell started
+	uint32_t rate[HOP_MAX_CHANNEL+1]; //moving average of packets per second, x16 (indexed by channel)
+	volatile uint32_t packets[HOP_MAX_CHANNEL+1]; //written only by channel_hop_count (indexed by channel)
+	uint32_t time_ms[HOP_MAX_CHANNEL+1];
+	uint32_t dwell_ms[HOP_MAX_CHANNEL+1];
+} channel_hop_t;
+
+/* Parse the channel set, a comma separated list like "1,6,11" (invalid channels are skipped).
+ * Return the number of channels to visit: 0 or 1 means no hopping */
+int channel_hop_init(channel_hop_t *hop, const char *list, int min_dwell_ms, int cycle_ms);
+
+/* Account a probe request captured on channel */
+void channel_hop_count(channel_hop_t *hop, uint8_t channel);
+
+/* Close the dwell on the current channel and return the next channel, *dwell_ms is how long to stay there */
+uint8_t channel_hop_next(channel_hop_t *hop, int *dwell_ms);
+
+/* Snapshot of the counters of channel (cumulative since channel_hop_init) */
+void channel_hop_get_stats(channel_hop_t *hop, uint8_t channel, channel_hop_stats_t *stats);
+
+#endif
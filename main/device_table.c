@@ -0,0 +1,197 @@
+#include <string.h>
+
+#include "device_table.h"
+
+#define SLOT(i) ((i) & (DEVICE_TABLE_SIZE-1))
+
+static uint32_t mac_hash(const uint8_t *mac)
+{
+	/* the low bytes are random for randomized addresses and vendor specific otherwise:
+	 * mix all of them, the top bits of the product are the best ones */
+	uint32_t lo = mac[2] | mac[3] << 8 | mac[4] << 16 | (uint32_t)mac[5] << 24;
+	uint32_t hi = mac[0] | mac[1] << 8;
+
+	return (lo ^ hi * 0x85EBCA6B) * 0x9E3779B1;
+}
+
+static bool is_random(const uint8_t *mac)
+{
+	return DEVICE_GROUP_RANDOM && (mac[0] & 0x02); //locally administered address
+}
+
+static bool match(const device_entry_t *e, const pkt_info_t *info, bool by_fp)
+{
+	if(by_fp)
+		return e->by_fp && e->fp == info->fp;
+	return !e->by_fp && memcmp(e->mac, info->sa, sizeof(e->mac)) == 0;
+}
+
+static uint32_t ssid_hash(const uint8_t *data, int len)
+{
+	uint32_t h = 2166136261u; //FNV-1a
+	int i;
+
+	for(i=0; i<len; i++)
+		h = (h ^ data[i]) * 16777619u;
+
+	return h;
+}
+
+void device_table_clear(device_table_t *t)
+{
+	memset(t->entry, 0, sizeof(t->entry));
+	t->ssid_count = 0;
+	memset(&t->stats, 0, sizeof(t->stats));
+}
+
+static int ssid_intern(device_table_t *t, const uint8_t *data, int len)
+{
+	/* index of the SSID in the pool, -1 if the pool is full */
+	uint32_t h = ssid_hash(data, len);
+	device_ssid_t *s;
+	int i;
+
+	for(i=0; i<t->ssid_count; i++){
+		s = &t->ssid[i];
+		if(s->hash == h && s->len == len && memcmp(s->data, data, len) == 0)
+			return i;
+	}
+
+	if(t->ssid_count == DEVICE_SSID_POOL)
+		return -1;
+
+	s = &t->ssid[t->ssid_count];
+	s->hash = h;
+	s->len = len;
+	memcpy(s->data, data, len);
+
+	return t->ssid_count++;
+}
+
+static void add_ssid(device_table_t *t, device_entry_t *e, const ie_view_t *ssid)
+{
+	int i, idx, len;
+
+	if(ssid->data == NULL || ssid->len == 0) //wildcard probe request
+		return;
+
+	len = ssid->len < PROBE_SSID_MAX_LEN ? ssid->len : PROBE_SSID_MAX_LEN;
+	idx = ssid_intern(t, ssid->data, len);
+	if(idx < 0){
+		t->stats.ssid_dropped++;
+		return;
+	}
+
+	for(i=0; i<e->ssid_count; i++)
+		if(e->ssid[i] == idx) //already seen from this device
+			return;
+
+	if(e->ssid_count == PROBE_SSID_MAX){
+		t->stats.ssid_dropped++;
+		return;
+	}
+
+	e->ssid[e->ssid_count++] = idx;
+}
+
+int device_table_add(device_table_t *t, const pkt_info_t *info, uint16_t offset, int8_t rssi, uint8_t channel)
+{
+	bool by_fp = is_random(info->sa);
+	uint32_t h = by_fp ? info->fp * 0x9E3779B1 : mac_hash(info->sa);
+	uint32_t i = h >> (32 - __builtin_ctz(DEVICE_TABLE_SIZE));
+	device_entry_t *e;
+
+	for(;; i++){ //stops: the load is at most DEVICE_TABLE_MAX_LOAD < DEVICE_TABLE_SIZE
+		e = &t->entry[SLOT(i)];
+		if(!e->used || match(e, info, by_fp))
+			break;
+	}
+
+	if(!e->used){ //new device
+		if(t->stats.devices == DEVICE_TABLE_MAX_LOAD){
+			t->stats.full++;
+			return -1;
+		}
+
+		e->used = true;
+		e->by_fp = by_fp;
+		e->fp = info->fp;
+		e->macs = 1;
+		memcpy(e->mac, info->sa, sizeof(e->mac));
+		memcpy(e->last_mac, info->sa, sizeof(e->last_mac));
+		memcpy(e->digest, info->digest, PROBE_DIGEST_LEN);
+		e->rssi_min = rssi;
+		e->rssi_max = rssi;
+		e->first_offset = offset;
+		e->sn_first = info->sn;
+		t->stats.devices++;
+	}
+
+	if(e->count < UINT16_MAX){
+		e->count++;
+		e->rssi_sum += rssi;
+	}
+	if(rssi < e->rssi_min)
+		e->rssi_min = rssi;
+	if(rssi > e->rssi_max)
+		e->rssi_max = rssi;
+	if(memcmp(e->last_mac, info->sa, sizeof(e->last_mac)) != 0){ //new randomized address
+		memcpy(e->last_mac, info->sa, sizeof(e->last_mac));
+		if(e->macs < UINT8_MAX)
+			e->macs++;
+	}
+	e->last_offset = offset;
+	e->sn_last = info->sn;
+	if(info->htci != 0)
+		e->htci = info->htci;
+	if(channel < 16)
+		e->channels |= 1 << channel;
+	add_ssid(t, e, &info->ies.ssid);
+
+	t->stats.packets++;
+
+	return 0;
+}
+
+const device_entry_t *device_table_next(const device_table_t *t, int *pos)
+{
+	while(*pos < DEVICE_TABLE_SIZE){
+		const device_entry_t *e = &t->entry[(*pos)++];
+		if(e->used)
+			return e;
+	}
+
+	return NULL;
+}
+
+size_t device_table_record(const device_table_t *t, const device_entry_t *e, probe_record_t *rec)
+{
+	const device_ssid_t *s;
+	int i;
+
+	memcpy(rec->mac, e->mac, sizeof(rec->mac));
+	memcpy(rec->digest, e->digest, PROBE_DIGEST_LEN);
+	rec->fp = e->fp;
+	rec->macs = e->macs;
+	rec->first_offset = e->first_offset;
+	rec->last_offset = e->last_offset;
+	rec->count = e->count;
+	rec->rssi_min = e->rssi_min;
+	rec->rssi_max = e->rssi_max;
+	rec->rssi_mean = e->rssi_sum / e->count;
+	rec->sn_first = e->sn_first;
+	rec->sn_last = e->sn_last;
+	rec->htci = e->htci;
+	rec->channels = e->channels;
+	rec->ssid_count = e->ssid_count;
+	rec->ssids_len = 0;
+
+	for(i=0; i<e->ssid_count; i++){
+		s = &t->ssid[e->ssid[i]];
+		rec->ssids[rec->ssids_len++] = s->len;
+		memcpy(&rec->ssids[rec->ssids_len], s->data, s->len);
+		rec->ssids_len += s->len;
+	}
+
+	return probe_record_len(rec);
+}
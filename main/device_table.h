@@ -0,0 +1,86 @@
+#ifndef DEVICE_TABLE_H
+#define DEVICE_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+#include "pkt_decode.h"
+#include "probe_record.h"
+
+/* Per-window aggregation of the probe requests by source address. With DEVICE_GROUP_RANDOM
+ * the randomized (locally administered) addresses are grouped by IE fingerprint instead, so
+ * the bursts of a device that changes address end up in the same entry.
+ * Open addressing hash table with linear probing: no allocation, the memory is fixed
+ * at build time (DEVICE_TABLE_SIZE entries plus a pool of DEVICE_SSID_POOL SSIDs).
+ *
+ * Overflow policy: the table accepts new devices up to DEVICE_TABLE_MAX_LOAD entries,
+ * then device_table_add() fails and the caller must write out the table (the devices
+ * are split in more records in the same window, nothing is lost) and clear it.
+ * SSIDs that do not fit in the pool or in the PROBE_SSID_MAX slots of a device are
+ * only counted.
+ * The table is not thread safe: the caller must serialize the calls (lck_file in main.c). */
+
+#define DEVICE_TABLE_SIZE CONFIG_DEVICE_TABLE_SIZE //number of entries (power of two)
+#define DEVICE_TABLE_MAX_LOAD (DEVICE_TABLE_SIZE*3/4) //max number of devices, keeps the probe sequences short
+#define DEVICE_SSID_POOL 64 //different SSIDs in a window
+#define DEVICE_GROUP_RANDOM CONFIG_DEVICE_GROUP_RANDOM //key the randomized addresses by fingerprint
+
+_Static_assert((DEVICE_TABLE_SIZE & (DEVICE_TABLE_SIZE-1)) == 0, "DEVICE_TABLE_SIZE must be a power of two");
+
+typedef struct {
+	uint8_t mac[6]; //first address seen
+	uint8_t last_mac[6];
+	bool used;
+	bool by_fp; //keyed by fingerprint (randomized addresses)
+	uint8_t macs; //address changes + 1
+	uint32_t fp; //IE fingerprint of the first packet
+	uint8_t ssid_count;
+	uint8_t ssid[PROBE_SSID_MAX]; //indexes in the SSID pool
+	int8_t rssi_min;
+	int8_t rssi_max;
+	uint16_t count;
+	int32_t rssi_sum;
+	uint16_t first_offset; //seconds from the start of the window
+	uint16_t last_offset;
+	uint16_t sn_first;
+	uint16_t sn_last;
+	uint16_t htci;
+	uint16_t channels; //bit n set if captured on channel n
+	uint8_t digest[PROBE_DIGEST_LEN]; //digest of the first packet
+} device_entry_t;
+
+typedef struct {
+	uint32_t hash; //cheap check before comparing the bytes
+	uint8_t len;
+	uint8_t data[PROBE_SSID_MAX_LEN];
+} device_ssid_t;
+
+typedef struct {
+	uint32_t packets; //packets added
+	uint32_t devices; //entries used
+	uint32_t full; //packets refused because the table was full
+	uint32_t ssid_dropped; //SSIDs not stored (pool or device slots full)
+} device_table_stats_t;
+
+typedef struct {
+	device_entry_t entry[DEVICE_TABLE_SIZE];
+	device_ssid_t ssid[DEVICE_SSID_POOL];
+	int ssid_count; //SSIDs used in the pool
+	device_table_stats_t stats; //reset by device_table_clear
+} device_table_t;
+
+/* Empty the table and reset the counters */
+void device_table_clear(device_table_t *t);
+
+/* Account a probe request of the window. Return 0 on success, -1 if the table is full
+ * (the packet is not accounted: write out the table, clear it and add it again) */
+int device_table_add(device_table_t *t, const pkt_info_t *info, uint16_t offset, int8_t rssi, uint8_t channel);
+
+/* Iterate over the devices: *pos must be 0 at the first call. Return NULL at the end */
+const device_entry_t *device_table_next(const device_table_t *t, int *pos);
+
+/* Build the record of a device, return its length */
+size_t device_table_record(const device_table_t *t, const device_entry_t *e, probe_record_t *rec);
+
+#endif
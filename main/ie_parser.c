@@ -0,0 +1,60 @@
+#include <string.h>
+
+#include "ie_parser.h"
+
+int ie_parse_probe_req(const uint8_t *frame, int len, probe_ies_t *ies)
+{
+	const uint8_t *p, *end;
+	uint8_t id, ie_len;
+	ie_view_t *v;
+
+	memset(ies, 0, sizeof(*ies));
+
+	if(len < IE_MGMT_HDR_LEN)
+		return -1;
+
+	p = frame + IE_MGMT_HDR_LEN;
+	end = frame + len;
+
+	while(end - p >= 2){ //room for id and length
+		id = p[0];
+		ie_len = p[1];
+		p += 2;
+
+		if(ie_len > end - p){ //IE goes past the end of the frame
+			ies->truncated = true;
+			break;
+		}
+
+		switch(id){
+			case IE_ID_SSID: v = &ies->ssid; break;
+			case IE_ID_RATES: v = &ies->rates; break;
+			case IE_ID_EXT_RATES: v = &ies->ext_rates; break;
+			case IE_ID_DS_PARAMS: v = &ies->ds_params; break;
+			case IE_ID_HT_CAP: v = &ies->ht_cap; break;
+			case IE_ID_VHT_CAP: v = &ies->vht_cap; break;
+			case IE_ID_EXT_CAP: v = &ies->ext_cap; break;
+			case IE_ID_VENDOR:
+				v = NULL;
+				if(ie_len >= 3){ //OUI is present
+					if(ies->vendor_count < IE_VENDOR_MAX)
+						v = &ies->vendor[ies->vendor_count];
+					ies->vendor_count++;
+				}
+				break;
+			default: v = NULL; break;
+		}
+
+		if(v != NULL && v->data == NULL){ //keep the first occurrence
+			v->data = p;
+			v->len = ie_len;
+		}
+
+		if(ies->ie_count < IE_ORDER_MAX)
+			ies->order[ies->ie_count] = id;
+		ies->ie_count++;
+		p += ie_len;
+	}
+
+	return ies->ie_count;
+}
@@ -0,0 +1,56 @@
+#ifndef IE_PARSER_H
+#define IE_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Single pass parser of the information elements (IE) of a probe request.
+ * The views point into the frame (no copies): they are valid as long as the frame is. */
+
+#define IE_MGMT_HDR_LEN 24 //802.11 management header, the probe request body starts after it
+
+#define IE_ID_SSID 0
+#define IE_ID_RATES 1
+#define IE_ID_DS_PARAMS 3
+#define IE_ID_HT_CAP 45
+#define IE_ID_EXT_RATES 50
+#define IE_ID_EXT_CAP 127
+#define IE_ID_VHT_CAP 191
+#define IE_ID_VENDOR 221
+
+#define IE_VENDOR_MAX 8 //vendor specific IEs kept, the others are only counted
+#define IE_ORDER_MAX 24 //IDs kept in order of appearance
+
+typedef struct {
+	const uint8_t *data; //NULL if the IE is not present
+	uint8_t len;
+} ie_view_t;
+
+typedef struct {
+	ie_view_t ssid;
+	ie_view_t rates;
+	ie_view_t ext_rates;
+	ie_view_t ds_params; //data[0] is the channel
+	ie_view_t ht_cap;
+	ie_view_t vht_cap;
+	ie_view_t ext_cap;
+	ie_view_t vendor[IE_VENDOR_MAX]; //data[0..2] is the OUI
+	uint8_t vendor_count; //vendor IEs in the frame (can be more than IE_VENDOR_MAX)
+	uint8_t order[IE_ORDER_MAX]; //IDs of the first IE_ORDER_MAX IEs, in order of appearance
+	uint8_t ie_count; //IEs in the frame
+	bool truncated; //last IE goes past the end of the frame
+} probe_ies_t;
+
+/* Parse the IEs of a probe request: frame is the whole frame (header included) and
+ * len its length without FCS. Return the number of IEs found, -1 if the frame is too short */
+int ie_parse_probe_req(const uint8_t *frame, int len, probe_ies_t *ies);
+
+/* HT capabilities info (first two bytes of the HT capabilities IE, little endian), 0 if not present */
+static inline uint16_t ie_ht_cap_info(const probe_ies_t *ies)
+{
+	if(ies->ht_cap.data == NULL || ies->ht_cap.len < 2)
+		return 0;
+	return ies->ht_cap.data[0] | (ies->ht_cap.data[1] << 8);
+}
+
+#endif
@@ -0,0 +1,93 @@
+#include <string.h>
+#include <unistd.h>
+
+#include "log_writer.h"
+
+void log_writer_init(log_writer_t *w, uint8_t *buf, size_t size, int batch_records)
+{
+	memset(w, 0, sizeof(*w));
+	w->buf = buf;
+	w->size = size;
+	w->batch_records = batch_records > 0 ? batch_records : 1;
+}
+
+int log_writer_open(log_writer_t *w, const char *path)
+{
+	if(w->fp != NULL)
+		log_writer_close(w);
+
+	w->fp = fopen(path, "ab");
+	if(w->fp == NULL)
+		return -1;
+
+	setvbuf(w->fp, NULL, _IONBF, 0); //records are already buffered here: one write() per commit
+
+	return 0;
+}
+
+bool log_writer_is_open(log_writer_t *w)
+{
+	return w->fp != NULL;
+}
+
+int log_writer_append(log_writer_t *w, const void *rec, size_t len)
+{
+	if(w->fp == NULL || len > w->size)
+		return -1;
+
+	if(w->len+len > w->size && log_writer_flush(w) != 0) //no room for the record
+		return -1;
+
+	memcpy(w->buf+w->len, rec, len);
+	w->len += len;
+	w->pending++;
+
+	if(w->pending >= w->batch_records)
+		return log_writer_flush(w);
+
+	return 0;
+}
+
+int log_writer_flush(log_writer_t *w)
+{
+	size_t n;
+
+	if(w->fp == NULL)
+		return -1;
+
+	if(w->len > 0){
+		n = fwrite(w->buf, 1, w->len, w->fp);
+		w->bytes += n;
+		if(n != w->len){ //short write: only the rest is written by the next flush
+			memmove(w->buf, w->buf+n, w->len-n);
+			w->len -= n;
+			return -1;
+		}
+		w->records += w->pending;
+		w->commits++;
+	}
+
+	w->len = 0;
+	w->pending = 0;
+
+	//the bytes are in the file: SPIFFS keeps the last page and the index in RAM until they are synced
+	return fsync(fileno(w->fp)) == 0 ? 0 : -1;
+}
+
+int log_writer_close(log_writer_t *w)
+{
+	int ret;
+
+	if(w->fp == NULL)
+		return 0;
+
+	ret = log_writer_flush(w);
+	fclose(w->fp);
+	w->fp = NULL;
+
+	/* records not written are lost: the next window starts with an empty buffer */
+	w->len = 0;
+	w->pending = 0;
+
+	return ret;
+}
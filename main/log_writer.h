@@ -0,0 +1,44 @@
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Batched writer of a window file: the file is kept open and the records are accumulated
+ * in a RAM buffer, then written with a single write every batch_records records or when the
+ * buffer is full. log_writer_flush/log_writer_close are the points where everything appended is
+ * in the file and on flash (the flush syncs the file: see SPIFFS_APPEND_DEFER).
+ * The sniffer appends the frames of a window only when the device table is written out (end of
+ * the window or table full) and flushes right after: until then the window is only in RAM.
+ * The writer is not thread safe: the caller must serialize the calls (lck_file in main.c). */
+
+typedef struct {
+	FILE *fp; //NULL if closed
+	uint8_t *buf; //records waiting to be written
+	size_t size; //size of buf
+	size_t len; //bytes used in buf
+	int pending; //records in buf
+	int batch_records; //commit every batch_records records
+	uint32_t records; //records written since log_writer_init
+	uint32_t bytes; //bytes written since log_writer_init
+	uint32_t commits; //writes done since log_writer_init
+} log_writer_t;
+
+void log_writer_init(log_writer_t *w, uint8_t *buf, size_t size, int batch_records);
+
+/* Open path in append mode, return 0 on success */
+int log_writer_open(log_writer_t *w, const char *path);
+bool log_writer_is_open(log_writer_t *w);
+
+/* Append a record (len must not exceed the buffer size), return 0 on success */
+int log_writer_append(log_writer_t *w, const void *rec, size_t len);
+
+/* Commit the buffer, return 0 on success. After a short write the bytes not written stay in the buffer */
+int log_writer_flush(log_writer_t *w);
+
+/* Commit the buffer and close the file */
+int log_writer_close(log_writer_t *w);
+
+#endif
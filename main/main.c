@@ -22,6 +22,7 @@
 #include "esp_event.h"
 #include "esp_event_loop.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 
 #include "esp_log.h"
 #include "esp_spiffs.h"
@@ -29,7 +30,17 @@
 
 #include "apps/sntp/sntp.h"
 
-#include "md5.h"
+#include "capture_ring.h"
+#include "probe_record.h"
+#include "probe_codec.h"
+#include "log_writer.h"
+#include "pkt_decode.h"
+#include "device_table.h"
+#include "channel_hop.h"
+#include "prefilter.h"
+#include "seg_log.h"
+#include "raw_log.h"
+#include "ram_stage.h"
 #include "mqtt_client.h"
 #include "lwip/sockets.h"
 #include "lwip/dns.h"
@@ -51,9 +62,9 @@ static int BLINK_TIME_OFF = 1000; //LED blink time init off
 
  /* --- Some configurations --- */
 #define SSID_MAX_LEN (32+1) //max length of a SSID
-#define MD5_LEN (32+1) //length of md5 hash
+#define MD5_LEN (32+1) //length of md5 hash (as hex string)
 #define BUFFSIZE 1024 //size of buffer used to send data to the server
-#define NROWS 11 //max rows that buffer can have inside send_data, it can be changed modifying BUFFSIZE
+#define PAYLOAD_SIZE (BUFFSIZE-64) //max size of a MQTT payload: the rest of BUFFSIZE is left for MQTT header and topic
 #define MAX_FILES 3 //max number of files in SPIFFS partition
 
 /* TAG of ESP32 for I/O operation */
@@ -66,13 +77,32 @@ static bool ONCE = true;
 static bool WIFI_CONNECTED = false;
 /* True if ESP is connected to the MQTT broker, false otherwise */
 static bool MQTT_CONNECTED = false;
-/* If the variable is true the sniffer_task() will write on FILENAME1, otherwise on FILENAME2
- * The value of this variable is changed only by the function send_data() */
-static bool WHICH_FILE = false;
- /* True when the wifi-task lock a file (to be send) and set the other file for the sniffer-task*/
+/* True when a new window file has been started and its header is not written yet */
 static bool FILE_CHANGED = true;
 /* Lock used for mutual exclusion for I/O operation in the files */
 static _lock_t lck_file;
+/* Ring of window files waiting to be sent: rotated (and evicted) by the sniffer, peeked and popped by the wifi task,
+ * both with lck_file. A file is sent without the lock: it may be evicted meanwhile */
+static seg_log_t seg_log;
+/* True if the windows are stored in the raw partition CONFIG_LOG_RAW_PARTITION instead of the window files */
+static bool RAW_LOG = false;
+/* Windows in the raw partition: appended by the sniffer, read and acked by the wifi task, both with lck_file */
+static raw_log_t raw_log;
+/* True if the current window is kept in RAM (stage) instead of being written to flash. Protected by lck_file */
+static bool STAGED = false;
+/* Windows kept in RAM while the broker is reachable: built by the sniffer, sent by the wifi task, both with lck_file */
+static ram_stage_t stage;
+/* RAM buffer of stage */
+static uint8_t stage_buf[CONFIG_STAGE_SIZE > 0 ? CONFIG_STAGE_SIZE : 1];
+/* Writer of the window file used by the sniffer, protected by lck_file */
+static log_writer_t log_writer;
+/* RAM buffer of log_writer */
+static uint8_t log_buf[CONFIG_LOG_BATCH_RECORDS*PROBE_RECORD_MAX_LEN > PROBE_FRAME_MAX ?
+		CONFIG_LOG_BATCH_RECORDS*PROBE_RECORD_MAX_LEN : PROBE_FRAME_MAX];
+/* Encoder of the records of the current window into frames, protected by lck_file */
+static probe_encoder_t encoder;
+/* Devices seen in the current window, written to the window file at the end of it. Protected by lck_file */
+static device_table_t device_table;
 /* Lock used for MQTT connection to access to the MQTT_CONNECTED variable */
 static _lock_t lck_mqtt;
 
@@ -82,6 +112,23 @@ static TaskHandle_t xHandle_led = NULL;
 static TaskHandle_t xHandle_sniff = NULL;
 /* Handle for wifi task */
 static TaskHandle_t xHandle_wifi = NULL;
+/* Handle for processing task */
+static TaskHandle_t xHandle_proc = NULL;
+/* Handle for channel hopping task (NULL if the sniffer stays on CONFIG_CHANNEL) */
+static TaskHandle_t xHandle_hop = NULL;
+/* Handle for SPIFFS garbage collection task (NULL if CONFIG_GC_PERIOD is 0) */
+static TaskHandle_t xHandle_gc = NULL;
+/* Handle for main task: the garbage collection task notifies it when it has stopped */
+static TaskHandle_t xHandle_main = NULL;
+/* SPIFFS blocks reclaimed by the garbage collection task since the last window, protected by gc_mux */
+static uint32_t gc_blocks = 0;
+static portMUX_TYPE gc_mux = portMUX_INITIALIZER_UNLOCKED;
+/* Channel hopping scheduler and per-channel capture counters */
+static channel_hop_t channel_hop;
+/* Rules applied to the probe requests before they are copied into the capture ring */
+static prefilter_t prefilter;
+/* Sniffed packets waiting to be processed: filled by the promiscuous callback, drained by the processing task */
+static capture_ring_t capture_ring;
 /* Client variable for MQTT connection */
 static esp_mqtt_client_handle_t client;
 /* FreeRTOS event group to signal when we are connected & ready to make a request */
@@ -112,26 +159,46 @@ static void sniffer_task(void *pvParameter);
 static void wifi_sniffer_init(void);
 static void wifi_sniffer_deinit(void);
 static void wifi_sniffer_packet_handler(void *buff, wifi_promiscuous_pkt_type_t type);
-static void get_hash(unsigned char *data, int len_res, char hash[MD5_LEN]);
-static void get_ssid(unsigned char *data, char ssid[SSID_MAX_LEN], uint8_t ssid_len);
-static int get_sn(unsigned char *data);
-static void get_ht_capabilites_info(unsigned char *data, char htci[5], int pkt_len, int ssid_len);
+static void process_task(void *pvParameter);
+static void process_pkt(capture_record_t *rec);
+static void print_pkt_info(pkt_info_t *info, time_t timestamp, int8_t rssi);
 static void dumb(unsigned char *data, int len);
-static void save_pkt_info(uint8_t address[6], char *ssid, time_t timestamp, char *hash, int8_t rssi, int sn, char htci[5]);
+static void save_pkt_info(pkt_info_t *info, time_t timestamp, int8_t rssi, uint8_t channel);
+static void save_devices(void);
+static void hop_task(void *pvParameter);
+static void gc_task(void *pvParameter);
+static void hop_home(void);
 static int get_start_timestamp(void);
 
 static void wifi_task(void *pvParameter);
 static void wifi_connect_init(void);
 static void wifi_connect_deinit(void);
 static void mqtt_app_start(void);
-static int set_waiting_time(void);
-static void send_data(void);
-static void file_init(char *filename);
+static int set_waiting_time(int deadline);
+static void window_files_init(void);
+static void end_window(int start);
+static void log_flash_io(void);
+static bool send_data(int deadline);
+static int send_file(const char *path, char *topic, uint32_t *bytes);
+static int frame_len(const uint8_t *frame, unsigned int avail);
+static int send_raw_window(char *topic, uint32_t *bytes);
+static int read_raw_frame(raw_log_pos_t *cur, uint8_t *frame);
+static int send_staged_window(char *topic, uint32_t *bytes);
+static int open_window_file(void);
+static int window_append(const void *rec, size_t len, bool start);
+static int flash_append(const void *rec, size_t len, bool start);
+static void flash_append_window(const uint8_t *data, size_t len);
+static void flash_close_window(void);
+static void spill_windows(bool all);
+static void spill_open(void);
+static uint32_t backlog_bytes(void);
 
 static void reboot(char *msg_err); //called only by main thread
 
 void app_main(void)
 {
+	int i;
+
 	ESP_LOGI(TAG, "[+] Startup...");
 
 	ESP_ERROR_CHECK(nvs_flash_init()); //initializing NVS (Non-Volatile Storage)
@@ -176,8 +243,26 @@ void app_main(void)
 
 	_lock_init(&lck_file);
 	_lock_init(&lck_mqtt);
-	file_init(CONFIG_FILENAME1);
-	file_init(CONFIG_FILENAME2);
+	window_files_init();
+	log_writer_init(&log_writer, log_buf, sizeof(log_buf), CONFIG_LOG_BATCH_RECORDS);
+	probe_encoder_init(&encoder, DIGEST_ID == DIGEST_ID_MD5 ? 16 : 8);
+	ram_stage_init(&stage, stage_buf, CONFIG_STAGE_SIZE, CONFIG_STAGE_SIZE / 100 * CONFIG_STAGE_WATERMARK);
+	device_table_clear(&device_table);
+
+	capture_ring_init(&capture_ring);
+	channel_hop_init(&channel_hop, CONFIG_HOP_CHANNELS, CONFIG_HOP_MIN_DWELL, CONFIG_HOP_CYCLE_TIME);
+	if(prefilter_init(&prefilter, CONFIG_FILTER_RSSI_MIN, CONFIG_FILTER_RANDOM,
+			CONFIG_FILTER_OUI_ALLOW, CONFIG_FILTER_OUI_DENY, CONFIG_FILTER_MAC_DENY) > 0)
+		ESP_LOGW(TAG, "[SNIFFER] Some entries of the filter lists are not valid or too many: ignored");
+	if(prefilter.allow.listed && prefilter.allow.count == 0)
+		ESP_LOGE(TAG, "[SNIFFER] No valid OUI in the allow list \"%s\": every probe request is rejected", CONFIG_FILTER_OUI_ALLOW);
+
+	xHandle_main = xTaskGetCurrentTaskHandle(); //notified by the tasks using SPIFFS when they stop
+
+	ESP_LOGI(TAG, "[!] Starting processing task...");
+	xTaskCreate(&process_task, "processing_task", 10000, NULL, 2, &xHandle_proc);
+	if(xHandle_proc == NULL)
+		reboot("Impossible to create processing task");
 
 	ESP_LOGI(TAG, "[!] Starting sniffing task...");
 	xTaskCreate(&sniffer_task, "sniffig_task", 10000, NULL, 1, &xHandle_sniff);
@@ -189,16 +274,54 @@ void app_main(void)
 	if(xHandle_wifi == NULL)
 		reboot("Impossible to create Wi-Fi task");
 
+	if(CONFIG_GC_PERIOD > 0){
+		ESP_LOGI(TAG, "[!] Starting SPIFFS garbage collection task...");
+		xTaskCreate(&gc_task, "gc_task", 4096, NULL, tskIDLE_PRIORITY, &xHandle_gc);
+		if(xHandle_gc == NULL)
+			reboot("Impossible to create SPIFFS garbage collection task");
+	}
+
 	while(RUNNING){ //every 0.5s check if fatal error occurred
 		vTaskDelay(500 / portTICK_PERIOD_MS);
 	}
 
+	esp_wifi_set_promiscuous(false); //no more packets for the processing task
+
 	ESP_LOGW(TAG, "Deleting led task...");
 	vTaskDelete(xHandle_led);
 	ESP_LOGW(TAG, "Deleting sniffing task...");
 	vTaskDelete(xHandle_sniff);
+	if(xHandle_hop != NULL){ //not while it tunes the radio
+		ESP_LOGW(TAG, "Deleting channel hopping task...");
+		_lock_acquire(&lck_mqtt);
+		vTaskDelete(xHandle_hop);
+		_lock_release(&lck_mqtt);
+	}
+
+	/* the tasks using SPIFFS and lck_file stop at a safe point and notify it, each once: they are deleted after
+	 * that, not while they hold the SPIFFS lock or lck_file, which are needed below */
+	ESP_LOGW(TAG, "Stopping the tasks using the files...");
+	xTaskNotifyGive(xHandle_proc);
+	xTaskNotifyGive(xHandle_wifi);
+	for(i = xHandle_gc != NULL ? 3 : 2; i > 0; i--)
+		ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+
+	ESP_LOGW(TAG, "Deleting processing task...");
+	vTaskDelete(xHandle_proc);
 	ESP_LOGW(TAG, "Deleting Wi-Fi task...");
 	vTaskDelete(xHandle_wifi);
+	if(xHandle_gc != NULL){
+		ESP_LOGW(TAG, "Deleting SPIFFS garbage collection task...");
+		vTaskDelete(xHandle_gc);
+	}
+
+	save_devices();
+	if(STAGED) //what is only in RAM is written to flash
+		spill_open();
+	if(RAW_LOG)
+		raw_log_seal(&raw_log);
+	else
+		log_writer_close(&log_writer);
 
 	ESP_LOGW(TAG, "Unmounting SPIFFS");
 	esp_vfs_spiffs_unregister(NULL); //SPIFFS unmounted
@@ -262,6 +385,9 @@ static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event)
             MQTT_CONNECTED = true;
         	_lock_release(&lck_mqtt);
 
+            if(xHandle_wifi != NULL) //send the windows waiting in the backlog now
+                xTaskNotifyGive(xHandle_wifi);
+
 			set_blink_led(BLINK_MODE);
             break;
 
@@ -319,6 +445,28 @@ static void blink_task(void *pvParameter)
     }
 }
 
+static void gc_task(void *pvParameter)
+{
+	/* reclaim SPIFFS blocks when the other tasks are idle: SPIFFS is locked by one slice at a time */
+	uint32_t blocks;
+
+	while(true){
+		vTaskDelay(CONFIG_GC_PERIOD / portTICK_PERIOD_MS);
+		if(!RUNNING)
+			break;
+		if(esp_spiffs_gc(NULL, CONFIG_GC_BUDGET, &blocks) == ESP_OK){
+			portENTER_CRITICAL(&gc_mux);
+			gc_blocks += blocks;
+			portEXIT_CRITICAL(&gc_mux);
+		}
+		else
+			ESP_LOGW(TAG, "[SNIFFER] SPIFFS garbage collection failed");
+	}
+
+	xTaskNotifyGive(xHandle_main); //stopped between two runs: app_main can delete the task
+	vTaskSuspend(NULL);
+}
+
 static void set_blink_led(int state)
 {
 	switch(state){
@@ -429,51 +577,82 @@ static void initialize_sntp()
     sntp_init();
 }
 
-static void file_init(char *filename)
+static void window_files_init()
 {
-	FILE *fp = fopen(filename, "wb");
+	/* the closed segments can use 3/4 of the partition, the rest is left to the segment being written */
+	size_t total = 0, used = 0;
+	seg_log_stats_t st;
+	raw_log_stats_t rst;
+	const esp_partition_t *part;
+
+	if(CONFIG_LOG_RAW_PARTITION[0] != '\0'){ //records written directly to a data partition
+		part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CONFIG_LOG_RAW_PARTITION);
+		if(part == NULL || raw_log_mount(&raw_log, part) != 0){
+			RUNNING = false;
+			ESP_LOGE(TAG, "Error initializing raw partition %s", CONFIG_LOG_RAW_PARTITION);
+			return;
+		}
+		RAW_LOG = true;
+		raw_log_get_stats(&raw_log, &rst);
+		ESP_LOGI(TAG, "Raw partition %s initialized: %u bytes waiting to be sent", CONFIG_LOG_RAW_PARTITION, rst.bytes);
+		return;
+	}
 
-	if(fp == NULL){
+	esp_spiffs_info(NULL, &total, &used);
+	if(seg_log_init(&seg_log, CONFIG_LOG_SEGMENT_PATH, CONFIG_LOG_SEGMENTS, total/4*3) != 0){
 		RUNNING = false;
-		ESP_LOGE(TAG, "Error creating or initializing file %s", filename);
+		ESP_LOGE(TAG, "Error initializing window files %s*", CONFIG_LOG_SEGMENT_PATH);
 		return;
 	}
 
-	ESP_LOGI(TAG, "File %s initialized", filename);
-
-	fclose(fp);
+	seg_log_get_stats(&seg_log, &st);
+	ESP_LOGI(TAG, "Window files initialized: %u windows (%u bytes) waiting to be sent", st.segments, st.bytes);
 }
 
 static void wifi_task(void *pvParameter)
 {
 	int st = CONFIG_SNIFFING_TIME*1000;
+	int deadline = get_start_timestamp() + CONFIG_SNIFFING_TIME; //end of the open window
+	bool more = false; //the last drain stopped at the end of the window: the backlog is not empty
 
 	ESP_LOGI(TAG, "[WIFI] Wi-Fi task created");
 
 	mqtt_app_start();
 
-	while(true){
-		st = set_waiting_time(); //wait until the current minute ends
-		vTaskDelay(st / portTICK_PERIOD_MS);
+	while(RUNNING){
+		st = more ? 0 : set_waiting_time(deadline); //wait until the window ends or the broker is connected again
+		ulTaskNotifyTake(pdTRUE, st / portTICK_PERIOD_MS);
+		if(!RUNNING) //app_main is stopping the tasks
+			break;
+		if(set_waiting_time(deadline) == 0){ //also when it ended while data was sent
+			end_window(deadline - CONFIG_SNIFFING_TIME);
+			deadline = get_start_timestamp() + CONFIG_SNIFFING_TIME;
+		}
 
-		_lock_acquire(&lck_mqtt);
+		more = false;
+		_lock_acquire(&lck_mqtt); //the hopping task waits for it: the radio stays on the AP channel
+		if(xHandle_hop != NULL)
+			hop_home();
 		if(MQTT_CONNECTED)
-			send_data();
+			more = send_data(deadline);
 		else
-			ESP_LOGW(TAG, "[WI-FI] Impossible send data to %s. ESP32 is not connected to the broker", CONFIG_BROKER_ADDR);
+			ESP_LOGW(TAG, "[WI-FI] Impossible send data to %s. ESP32 is not connected to the broker (%u bytes waiting)",
+					CONFIG_BROKER_ADDR, backlog_bytes());
 		_lock_release(&lck_mqtt);
 	}
+
+	xTaskNotifyGive(xHandle_main); //stopped between two windows: app_main can delete the task
+	vTaskSuspend(NULL);
 }
 
-static int set_waiting_time()
+static int set_waiting_time(int deadline)
 {
-	int st;
+	/* milliseconds until deadline, 0 if it has passed */
 	time_t t;
 
 	time(&t);
-	st = (CONFIG_SNIFFING_TIME - (int)t % CONFIG_SNIFFING_TIME) * 1000;
 
-	return st;
+	return (int)t < deadline ? (deadline - (int)t) * 1000 : 0;
 }
 
 static void wifi_connect_init()
@@ -531,114 +710,449 @@ static void mqtt_app_start()
     ESP_LOGI(TAG, "[MQTT] Connecting to %s:%d", CONFIG_BROKER_ADDR, CONFIG_BROKER_PORT);
 }
 
-static void send_data()
+static void end_window(int start)
 {
-	FILE *fp = NULL;
-	int msg_id, tid;
-	int sending = true, reading = true, tot_read = 0, n = 1;
-	char *topic, buffer[BUFFSIZE], last_pkt = 'F';
-	ssize_t len = strlen(CONFIG_ETS)+strlen(CONFIG_ROOM)+strlen(CONFIG_ESP32_ID)+1;
+	/* close the window started at start: a window in RAM waits there to be sent, unless the broker is not reachable
+	 * (then all of them are written to flash) or they are above the watermark (the oldest ones are written).
+	 * A window in flash is closed and waits in seg_log (or in the raw partition) until it is sent */
+	static uint32_t windows = 0; //windows closed since boot
+	probe_file_hdr_t hdr;
+	ram_stage_stats_t st;
 
 	_lock_acquire(&lck_file);
-	if(WHICH_FILE){
-		WHICH_FILE = false;
-		FILE_CHANGED = true;
-		fp = fopen(CONFIG_FILENAME1, "r");
-		if(fp == NULL){
-			RUNNING = false;
-			ESP_LOGE(TAG, "[WI-FI] Impossible to open file %s and read information", CONFIG_FILENAME1);
-			return;
-		}
+	save_devices(); //one record per device seen in the window
+
+	if(FILE_CHANGED && open_window_file() == 0){ //no packets sniffed in the window: only the header
+		probe_file_hdr_init(&hdr, start);
+		window_append(&hdr, sizeof(hdr), true);
 	}
-	else{
-		WHICH_FILE = true;
-		FILE_CHANGED = true;
-		fp = fopen(CONFIG_FILENAME2, "r");
-		if(fp == NULL){
-			RUNNING = false;
-			ESP_LOGE(TAG, "[WI-FI] Impossible to open file %s and read information", CONFIG_FILENAME2);
-			return;
-		}
+
+	if(!STAGED) //the windows kept in RAM went to flash before it started (window_append)
+		flash_close_window();
+	else if(ram_stage_close(&stage) != 0){ //RAM_STAGE_MAX windows in RAM: the oldest ones go to flash
+		spill_windows(true);
+		ram_stage_close(&stage);
 	}
+	spill_windows(!MQTT_CONNECTED); //whatever the current window was, nothing stays in RAM without the broker
+	FILE_CHANGED = true;
+
+	ram_stage_get_stats(&stage, &st);
 	_lock_release(&lck_file);
 
-	topic = malloc(len*sizeof(char));
-	memset(topic, '\0', len);
+	if(CONFIG_STAGE_SIZE > 0)
+		ESP_LOGI(TAG, "[WI-FI] Only in RAM: %u records (%u bytes). Since boot: %u records sent from RAM, %u records (%u bytes) written to flash",
+				st.records, st.bytes, st.sent_records, st.spilled_records, st.spilled_bytes);
+
+	log_flash_io();
+
+	//the mtimes kept in RAM first, then the checkpoint: nothing is written if SPIFFS has not changed since the last one
+	windows++;
+	if(CONFIG_MTIME_SYNC_WINDOWS > 0 && windows % CONFIG_MTIME_SYNC_WINDOWS == 0 && esp_spiffs_sync_meta(NULL) == ESP_FAIL)
+		ESP_LOGW(TAG, "[SNIFFER] Impossible to write the modification time of the files");
+	if(CONFIG_CHECKPOINT_WINDOWS > 0 && windows % CONFIG_CHECKPOINT_WINDOWS == 0 && esp_spiffs_checkpoint(NULL) == ESP_FAIL)
+		ESP_LOGW(TAG, "[SNIFFER] Impossible to save the SPIFFS checkpoint");
+}
+
+static void log_flash_io()
+{
+	/* log the cache and index lookups, the waits for the lock and the flash I/O done by SPIFFS in the window (then reset) and the write amplification: bytes programmed
+	 * for each byte of the window files (the metadata, the mtimes, the seg_log state file and the GC are the overhead) */
+	static uint32_t written = 0; //log_writer.bytes at the end of the previous window
+	esp_spiffs_io_stats_t io;
+	esp_spiffs_cache_stats_t cs;
+	esp_spiffs_index_stats_t is;
+	esp_spiffs_lock_stats_t ls;
+	uint32_t logical, wa, blocks;
+
+	if(esp_spiffs_get_cache_stats(NULL, &cs, true) == ESP_OK)
+		ESP_LOGI(TAG, "[SNIFFER] SPIFFS cache: %u pages, %u hits, %u misses, %u evictions", cs.pages, cs.hits, cs.misses, cs.evictions);
+	if(esp_spiffs_get_index_stats(NULL, &is, true) == ESP_OK)
+		ESP_LOGI(TAG, "[SNIFFER] SPIFFS index: %u bytes, %u/%u files%s, %u lookups in RAM, %u scans", is.bytes, is.objects, is.capacity,
+				is.partial ? " (partial)" : "", is.hits, is.scans);
+	if(esp_spiffs_get_lock_stats(NULL, &ls, true) == ESP_OK) //the uploader and the sniffer on the same partition
+		ESP_LOGI(TAG, "[SNIFFER] SPIFFS lock: %u of %u calls waited (%u ms, slowest %u us), %u reads ahead without the lock (%u read again)",
+				ls.contended, ls.ops, ls.wait_us / 1000, ls.max_us, ls.unlocked_reads, ls.unlocked_retries);
+	if(xHandle_gc != NULL){
+		portENTER_CRITICAL(&gc_mux);
+		blocks = gc_blocks;
+		gc_blocks = 0;
+		portEXIT_CRITICAL(&gc_mux);
+		ESP_LOGI(TAG, "[SNIFFER] SPIFFS garbage collection: %u blocks reclaimed in background", blocks);
+	}
+
+	if(esp_spiffs_get_io_stats(NULL, &io, true) != ESP_OK)
+		return;
+
+	_lock_acquire(&lck_file);
+	logical = log_writer.bytes - written;
+	written = log_writer.bytes;
+	_lock_release(&lck_file);
+
+	wa = logical > 0 ? (uint64_t)io.write.bytes * 100 / logical : 0;
+	ESP_LOGI(TAG, "[SNIFFER] Flash: %u bytes programmed for %u bytes of window files (x%u.%02u), %u writes (%u ms), %u reads (%u bytes, %u ms), %u erases (%u ms)",
+			io.write.bytes, logical, wa / 100, wa % 100, io.write.ops, io.write.time_us / 1000,
+			io.read.ops, io.read.bytes, io.read.time_us / 1000, io.erase.ops, io.erase.time_us / 1000);
+	ESP_LOGI(TAG, "[SNIFFER] Flash: slowest write %u us, slowest erase %u us, %u errors. Erases of a sector since boot: %u to %u",
+			io.write.max_us, io.erase.max_us, io.read.errors + io.write.errors + io.erase.errors,
+			io.min_sector_erases, io.max_sector_erases);
+	ESP_LOGI(TAG, "[SNIFFER] Flash: %u index headers rewritten for the modification time, %u modification times kept in RAM",
+			io.mtime_writes, io.mtime_deferred);
+}
+
+static void flash_close_window()
+{
+	/* close the window written to flash and start the next one. Called with lck_file taken */
+	if(RAW_LOG){ //the window can be sent only after this
+		if(raw_log_seal(&raw_log) != 0)
+			ESP_LOGE(TAG, "[WI-FI] Impossible to save the last sniffed packets");
+	}
+	else if(log_writer_close(&log_writer) != 0) //the window file is complete only after this
+		ESP_LOGE(TAG, "[WI-FI] Impossible to save the last sniffed packets");
+
+	if(!RAW_LOG && seg_log_rotate(&seg_log) != 0){
+		RUNNING = false;
+		ESP_LOGE(TAG, "[WI-FI] Impossible to start a new window file");
+	}
+}
+
+static bool send_data(int deadline)
+{
+	/* send the waiting window files, oldest first, until the backlog is empty or a publish fails.
+	 * Return true if it stopped because the window ends at deadline: the next window must be started */
+	char path[SEG_LOG_PATH_LEN], *topic;
+	uint32_t bytes, seq, total = 0;
+	bool found;
+	int64_t start = esp_timer_get_time();
+	int ret = 0, popped, sent = 0;
+	bool late = false;
+	seg_log_stats_t st;
+	raw_log_stats_t rst;
+	ssize_t topic_len = strlen(CONFIG_ETS)+strlen(CONFIG_ROOM)+strlen(CONFIG_ESP32_ID)+3;
+
+	topic = malloc(topic_len*sizeof(char));
+	memset(topic, '\0', topic_len);
 	strcpy(topic, CONFIG_ETS);
 	strcat(topic, "/");
 	strcat(topic, CONFIG_ROOM);
 	strcat(topic, "/");
 	strcat(topic, CONFIG_ESP32_ID);
 
-	fscanf(fp, "%d", &tid);
-
 	ESP_LOGI(TAG, "[WI-FI] Sending information about sniffed packets to %s:%d", CONFIG_BROKER_ADDR, CONFIG_BROKER_PORT);
-	while(sending){
-		n = 1;
-		tot_read = 0;
-		memset(buffer, '\0', BUFFSIZE);
-
-		sprintf(buffer, "%c %d\n", last_pkt, tid); //sending also information about if it is last packet or not
-		tot_read = strlen(buffer);
-
-		reading = true;
-		while(fgets(buffer+tot_read, BUFFSIZE, fp) != NULL && reading){
-			n++;
-			tot_read = strlen(buffer);
-			if(n >= NROWS)
-				reading = false; //stop reading because buffer is full
+	while(RAW_LOG && !(late = set_waiting_time(deadline) == 0)){
+		bytes = 0;
+		ret = send_raw_window(topic, &bytes);
+		if(ret < 0){ //connection lost: the window is sent again later
+			ESP_LOGW(TAG, "[WI-FI] Impossible to send a window, %u bytes left", backlog_bytes());
+			break;
+		}
+		if(ret == 2) //nothing sealed to send
+			break;
+		if(ret == 1)
+			ESP_LOGE(TAG, "[WI-FI] Window in the raw partition is not valid: discarded");
+
+		total += bytes;
+		sent++;
+	}
+
+	while(!RAW_LOG && !(late = set_waiting_time(deadline) == 0)){
+		_lock_acquire(&lck_file); //a window spilled by the sniffer may rotate the segments and evict the oldest ones
+		found = seg_log_peek(&seg_log, path, &seq);
+		_lock_release(&lck_file);
+		if(!found)
+			break;
+
+		bytes = 0;
+		ret = send_file(path, topic, &bytes);
+		if(ret < 0){ //connection lost: the file is sent again later
+			ESP_LOGW(TAG, "[WI-FI] Impossible to send %s, %u bytes left", path, backlog_bytes());
+			break;
 		}
+		if(ret > 0)
+			ESP_LOGE(TAG, "[WI-FI] File %s is not valid: discarded", path);
+
+		_lock_acquire(&lck_file);
+		popped = seg_log_pop(&seg_log, seq);
+		_lock_release(&lck_file);
+		if(popped < 0)
+			ESP_LOGE(TAG, "[WI-FI] Impossible to save the state of the window files");
+		if(popped > 0) //evicted while it was sent
+			ESP_LOGW(TAG, "[WI-FI] File %s evicted while it was sent", path);
+		else{
+			total += bytes;
+			sent++;
+		}
+	}
+
+	while(ret >= 0 && !late && !(late = set_waiting_time(deadline) == 0)){ //the windows in RAM are newer than the ones in flash
+		bytes = 0;
+		ret = send_staged_window(topic, &bytes);
+		if(ret < 0){ //connection lost: the window stays in RAM (or goes to flash at the end of the window)
+			ESP_LOGW(TAG, "[WI-FI] Impossible to send a window kept in RAM, %u windows left", stage.windows);
+			break;
+		}
+		if(ret == 2)
+			break;
+		if(ret == 0){ //1: written to flash meanwhile, it is sent from there
+			total += bytes;
+			sent++;
+		}
+	}
+
+	if(sent > 0 && RAW_LOG){
+		raw_log_get_stats(&raw_log, &rst);
+		ESP_LOGI(TAG, "[WI-FI] Sent %d windows (%u bytes). Backlog: %u bytes. Evicted: %u sectors, %u bad entries",
+				sent, total, rst.bytes, rst.evicted_sectors, rst.bad_entries);
+	}
+	else if(sent > 0){
+		_lock_acquire(&lck_file);
+		seg_log_drained(&seg_log, total, (esp_timer_get_time() - start) / 1000);
+		seg_log_get_stats(&seg_log, &st);
+		_lock_release(&lck_file);
+		ESP_LOGI(TAG, "[WI-FI] Sent %d windows (%u bytes, %u B/s). Backlog: %u windows, %u bytes. Evicted: %u windows, %u bytes",
+				sent, total, st.drain_rate, st.segments, st.bytes, st.evicted_segments, st.evicted_bytes);
+	}
+
+	free(topic);
+
+	return late;
+}
+
+static int send_file(const char *path, char *topic, uint32_t *bytes)
+{
+	/* publish a window file: return 0 on success, -1 if a publish failed, 1 if the file is not valid.
+	 * The frames are read from SPIFFS straight into the message, without the stdio buffer */
+	esp_spiffs_file_t file;
+	int msg_id;
+	size_t len, n;
+	uint8_t buffer[PAYLOAD_SIZE];
+	probe_file_hdr_t *hdr = (probe_file_hdr_t *)buffer;
+
+	if(esp_spiffs_open(path, &file) != ESP_OK)
+		return 1;
+
+	/* every message starts with the header of the window file */
+	if(esp_spiffs_read_records(&file, hdr, sizeof(*hdr), NULL, &n) != ESP_OK || n != sizeof(*hdr) ||
+			!probe_file_hdr_valid(hdr)){
+		esp_spiffs_close(&file);
+		return 1;
+	}
+
+	while(true){
+		len = sizeof(*hdr);
 
-		if(reading){ //finished to read file
-			last_pkt = 'T'; //set as TRUE last packet -> next send is the last
-			buffer[0] = last_pkt;
-			sending = false;
+		//only whole frames in a message
+		if(esp_spiffs_read_records(&file, buffer+len, PAYLOAD_SIZE-len, frame_len, &n) != ESP_OK){
+			n = 0;
+			file.offset = file.size; //not readable: the rest of the file is lost, as after a corrupted frame
 		}
-		//else -> i need at least one more cycle to finish to read the file
+		len += n;
+
+		if(file.offset >= file.size) //finished to read file
+			hdr->flags |= PROBE_FLAG_LAST;
 
-		msg_id = esp_mqtt_client_publish(client, topic, buffer, strlen(buffer), 0, 0);
+		msg_id = esp_mqtt_client_publish(client, topic, (char *)buffer, len, 0, 0);
+		if(msg_id < 0){
+			esp_spiffs_close(&file);
+			return -1;
+		}
+		*bytes += len;
 		ESP_LOGI(TAG, "[WI-FI] Sent publish successful on topic=%s, msg_id=%d", topic, msg_id);
+
+		if(file.offset >= file.size)
+			break;
 	}
 
+	esp_spiffs_close(&file);
+	return 0;
+}
+
+static int frame_len(const uint8_t *frame, unsigned int avail)
+{
+	/* length of the frame of a window file starting at frame: 0 if its length is not read yet,
+	 * -1 if it is corrupted (the rest of the file is skipped) */
+	size_t len;
+
+	if(avail < 2)
+		return 0;
+	len = probe_frame_len(frame);
+
+	return len > PROBE_FRAME_MAX ? -1 : (int)len;
+}
+
+static int send_raw_window(char *topic, uint32_t *bytes)
+{
+	/* publish the oldest window of the raw partition and ack it: return 0 on success, -1 if a publish failed,
+	 * 1 if the window is not valid (it is discarded), 2 if there is nothing to send.
+	 * lck_file is taken only while a frame is read: the sniffer does not wait for the publishes */
+	raw_log_pos_t start, cur;
+	int msg_id, rec_len;
+	size_t len;
+	bool first;
+	uint8_t buffer[PAYLOAD_SIZE], frame[PROBE_FRAME_MAX];
+	probe_file_hdr_t *hdr = (probe_file_hdr_t *)buffer;
+
 	_lock_acquire(&lck_file);
-	if(WHICH_FILE){
-		fclose(fp);
-		file_init(CONFIG_FILENAME2);
+	raw_log_tail(&raw_log, &start);
+	cur = start;
+	rec_len = raw_log_read(&raw_log, &cur, hdr, sizeof(*hdr), &first);
+	if(rec_len <= 0){ //nothing to send or flash not readable
+		_lock_release(&lck_file);
+		return rec_len == 0 ? 2 : -1;
 	}
-	else{
-		fclose(fp);
-		file_init(CONFIG_FILENAME1);
+	if(rec_len != sizeof(*hdr) || !first || !probe_file_hdr_valid(hdr)){
+		raw_log_ack(&raw_log, &start, &cur);
+		_lock_release(&lck_file);
+		return 1;
 	}
 	_lock_release(&lck_file);
 
-	free(topic);
+	/* every message starts with the header of the window */
+	rec_len = read_raw_frame(&cur, frame);
+
+	while(true){
+		len = sizeof(*hdr);
+
+		while(rec_len > 0 && len+rec_len <= PAYLOAD_SIZE){ //only whole frames in a message
+			memcpy(buffer+len, frame, rec_len);
+			len += rec_len;
+			rec_len = read_raw_frame(&cur, frame);
+		}
+		if(rec_len < 0) //evicted while it was sent
+			return 1;
+
+		if(rec_len == 0) //end of the window
+			hdr->flags |= PROBE_FLAG_LAST;
+
+		msg_id = esp_mqtt_client_publish(client, topic, (char *)buffer, len, 0, 0);
+		if(msg_id < 0)
+			return -1;
+		*bytes += len;
+		ESP_LOGI(TAG, "[WI-FI] Sent publish successful on topic=%s, msg_id=%d", topic, msg_id);
+
+		if(rec_len == 0)
+			break;
+	}
+
+	_lock_acquire(&lck_file);
+	raw_log_ack(&raw_log, &start, &cur);
+	_lock_release(&lck_file);
+
+	return 0;
+}
+
+static int send_staged_window(char *topic, uint32_t *bytes)
+{
+	/* publish the oldest window kept in RAM and remove it: return 0 on success, -1 if a publish failed,
+	 * 1 if it has been written to flash meanwhile (it is sent from there), 2 if there is nothing to send.
+	 * lck_file is taken only while a message is copied out of the stage */
+	const uint8_t *data;
+	size_t len, wlen, frame_len, off = sizeof(probe_file_hdr_t);
+	uint32_t seq;
+	int msg_id;
+	bool last;
+	uint8_t buffer[PAYLOAD_SIZE];
+	probe_file_hdr_t *hdr = (probe_file_hdr_t *)buffer;
+
+	_lock_acquire(&lck_file);
+	if(!ram_stage_peek(&stage, &data, &wlen)){
+		_lock_release(&lck_file);
+		return 2;
+	}
+	seq = stage.first;
+	memcpy(hdr, data, sizeof(*hdr)); //every message starts with the header of the window
+	_lock_release(&lck_file);
+
+	do{
+		len = sizeof(*hdr);
+
+		_lock_acquire(&lck_file);
+		if(stage.first != seq || !ram_stage_peek(&stage, &data, &wlen)){
+			_lock_release(&lck_file);
+			return 1;
+		}
+		while(off < wlen && len+(frame_len = probe_frame_len(data+off)) <= PAYLOAD_SIZE){
+			memcpy(buffer+len, data+off, frame_len); //only whole frames in a message
+			len += frame_len;
+			off += frame_len;
+		}
+		_lock_release(&lck_file);
+
+		last = off >= wlen;
+		if(last)
+			hdr->flags |= PROBE_FLAG_LAST;
+
+		msg_id = esp_mqtt_client_publish(client, topic, (char *)buffer, len, 0, 0);
+		if(msg_id < 0)
+			return -1;
+		*bytes += len;
+		ESP_LOGI(TAG, "[WI-FI] Sent publish successful on topic=%s, msg_id=%d", topic, msg_id);
+	}while(!last);
+
+	_lock_acquire(&lck_file);
+	if(stage.first == seq)
+		ram_stage_pop(&stage, true);
+	_lock_release(&lck_file);
+
+	return 0;
+}
+
+static int read_raw_frame(raw_log_pos_t *cur, uint8_t *frame)
+{
+	/* read the frame of the raw partition at cur: return its length, 0 at the end of the window, -1 if evicted */
+	raw_log_pos_t next = *cur;
+	bool first;
+	int len;
+
+	_lock_acquire(&lck_file);
+	len = raw_log_read(&raw_log, &next, frame, PROBE_FRAME_MAX, &first);
+	_lock_release(&lck_file);
+
+	if(len > 0 && first) //cur stays at the start of the next window
+		return 0;
+	if(len > 0)
+		*cur = next;
+
+	return len;
 }
 
 static void sniffer_task(void *pvParameter)
 {
 	int sleep_time = CONFIG_SNIFFING_TIME*1000;
+	capture_ring_stats_t rs;
+	channel_hop_stats_t cs;
+	prefilter_stats_t fs;
+	int ch;
 
 	ESP_LOGI(TAG, "[SNIFFER] Sniffer task created");
 
 	ESP_LOGI(TAG, "[SNIFFER] Starting sniffing mode...");
 	wifi_sniffer_init();
-	ESP_LOGI(TAG, "[SNIFFER] Started. Sniffing on channel %d", CONFIG_CHANNEL);
+	if(channel_hop.count > 1){
+		ESP_LOGI(TAG, "[SNIFFER] Started. Hopping on channels %s", CONFIG_HOP_CHANNELS);
+		xTaskCreate(&hop_task, "hop_task", 2048, NULL, 3, &xHandle_hop);
+		if(xHandle_hop == NULL){
+			RUNNING = false;
+			ESP_LOGE(TAG, "[SNIFFER] Impossible to create channel hopping task");
+		}
+	}
+	else{
+		ESP_LOGI(TAG, "[SNIFFER] Started. Sniffing on channel %d", CONFIG_CHANNEL);
+	}
 
 	while(true){
 		vTaskDelay(sleep_time / portTICK_PERIOD_MS);
-    	_lock_acquire(&lck_mqtt);
-		/* if ESP is not connected to the broker
-		 * -> need to reset file after 1 minutes, because wifi-task will not ever send it and initialize it */
-		if(!MQTT_CONNECTED){
-			ESP_LOGW(TAG, "[SNIFFER] Initializing file...");
-			_lock_acquire(&lck_file);
-			if(WHICH_FILE)
-				file_init(CONFIG_FILENAME1);
-			else
-				file_init(CONFIG_FILENAME2);
-			_lock_release(&lck_file);
+
+		capture_ring_get_stats(&capture_ring, &rs);
+		ESP_LOGI(TAG, "[SNIFFER] Capture ring: pushed=%u, dropped=%u, truncated=%u, high-water=%u/%d",
+				rs.pushed, rs.dropped, rs.truncated, rs.high_water, CAPTURE_RING_SLOTS);
+		prefilter_get_stats(&prefilter, &fs);
+		ESP_LOGI(TAG, "[SNIFFER] Filter: passed=%u, rejected: rssi=%u, random=%u, oui-allow=%u, oui-deny=%u, mac-deny=%u",
+				fs.passed, fs.rssi, fs.random, fs.oui_allow, fs.oui_deny, fs.mac_deny);
+		for(ch=1; ch<=HOP_MAX_CHANNEL; ch++){
+			channel_hop_get_stats(&channel_hop, ch, &cs);
+			if(cs.packets > 0 || cs.time_ms > 0)
+				ESP_LOGI(TAG, "[SNIFFER] Channel %d: packets=%u, listened=%ums, dwell=%ums", ch, cs.packets, cs.time_ms, cs.dwell_ms);
 		}
-    	_lock_release(&lck_mqtt);
 	}
 }
 
@@ -679,102 +1193,157 @@ static void wifi_sniffer_deinit()
 
 static void wifi_sniffer_packet_handler(void* buff, wifi_promiscuous_pkt_type_t type)
 {
-	int pkt_len, fc, sn=0;
-	char ssid[SSID_MAX_LEN] = "\0", hash[MD5_LEN] = "\0", htci[5] = "\0";
-	uint8_t ssid_len;
-	time_t ts;
+	/* Runs in the Wi-Fi driver task: only copy the packet into the ring, everything else is done by process_task() */
+	int len;
+	capture_record_t *rec;
 
 	wifi_promiscuous_pkt_t *pkt = (wifi_promiscuous_pkt_t *)buff;
 	wifi_mgmt_hdr *mgmt = (wifi_mgmt_hdr *)pkt->payload;
 
-	fc = ntohs(mgmt->fctl);
-
-	if((fc & 0xFF00) == 0x4000){ //only look for probe request packets
-		time(&ts);
-
-		ssid_len = pkt->payload[25];
-		if(ssid_len > 0)
-			get_ssid(pkt->payload, ssid, ssid_len);
+	if((ntohs(mgmt->fctl) & 0xFF00) != 0x4000) //only look for probe request packets
+		return;
 
-		pkt_len = pkt->rx_ctrl.sig_len;
-		get_hash(pkt->payload, pkt_len-4, hash);
+	if(!prefilter_pass(&prefilter, mgmt->sa, pkt->rx_ctrl.rssi)) //rejected (counted by the filter)
+		return;
 
-		if(CONFIG_VERBOSE){
-			ESP_LOGI(TAG, "Dump");
-			dumb(pkt->payload, pkt_len);
-		}
+	rec = capture_ring_reserve(&capture_ring);
+	if(rec == NULL) //ring full: packet dropped (counted by the ring)
+		return;
 
-		sn = get_sn(pkt->payload);
+	len = pkt->rx_ctrl.sig_len;
+	rec->us = esp_timer_get_time();
+	rec->rssi = pkt->rx_ctrl.rssi;
+	rec->channel = pkt->rx_ctrl.channel;
+	rec->sig_len = len;
+	rec->len = len < CAPTURE_FRAME_LEN ? len : CAPTURE_FRAME_LEN;
+	memcpy(rec->frame, pkt->payload, rec->len);
+	capture_ring_commit(&capture_ring);
+	channel_hop_count(&channel_hop, rec->channel);
+
+	xTaskNotifyGive(xHandle_proc);
+}
 
-		get_ht_capabilites_info(pkt->payload, htci, pkt_len, ssid_len);
+static void hop_task(void *pvParameter)
+{
+	/* while the station is connected, the dwell on another channel is split in slices of at most HOP_MAX_OFF_TIME,
+	 * each followed by HOP_HOME_TIME on the AP channel: the station does not miss the beacons and the frames of the AP
+	 * for long. The packets captured meanwhile are counted on the AP channel */
+	wifi_ap_record_t ap;
+	int dwell, slice;
+	uint8_t ch, home;
 
-		ESP_LOGI(TAG, "ADDR=%02x:%02x:%02x:%02x:%02x:%02x, "
-				"SSID=%s, "
-				"TIMESTAMP=%d, "
-				"HASH=%s, "
-				"RSSI=%02d, "
-				"SN=%d, "
-				"HT CAP. INFO=%s",
-				mgmt->sa[0], mgmt->sa[1], mgmt->sa[2], mgmt->sa[3], mgmt->sa[4], mgmt->sa[5],
-				ssid,
-				(int)ts,
-				hash,
-				pkt->rx_ctrl.rssi,
-				sn,
-				htci);
+	ESP_LOGI(TAG, "[SNIFFER] Channel hopping task created");
 
-		save_pkt_info(mgmt->sa, ssid, ts, hash, pkt->rx_ctrl.rssi, sn, htci);
+	while(true){
+		ch = channel_hop_next(&channel_hop, &dwell);
+		home = esp_wifi_sta_get_ap_info(&ap) == ESP_OK ? ap.primary : 0; //0: not connected, nothing to go back to
+		if(home == ch)
+			home = 0;
+
+		while(dwell > 0){
+			slice = home != 0 && dwell > CONFIG_HOP_MAX_OFF_TIME ? CONFIG_HOP_MAX_OFF_TIME : dwell;
+			_lock_acquire(&lck_mqtt); //not while the Wi-Fi task is sending data
+			esp_wifi_set_channel(ch, WIFI_SECOND_CHAN_NONE);
+			_lock_release(&lck_mqtt);
+			vTaskDelay(slice / portTICK_PERIOD_MS);
+			dwell -= slice;
+
+			if(home != 0){
+				_lock_acquire(&lck_mqtt);
+				esp_wifi_set_channel(home, WIFI_SECOND_CHAN_NONE);
+				_lock_release(&lck_mqtt);
+				vTaskDelay(CONFIG_HOP_HOME_TIME / portTICK_PERIOD_MS);
+			}
+		}
 	}
 }
 
-static void get_hash(unsigned char *data, int len_res, char hash[MD5_LEN])
+static void hop_home()
 {
-	uint8_t pkt_hash[16];
+	/* tune the radio on the channel of the AP, used to send data. Called with lck_mqtt taken */
+	wifi_ap_record_t ap;
 
-	md5((uint8_t *)data, len_res, pkt_hash);
-
-	sprintf(hash, "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
-			pkt_hash[0], pkt_hash[1], pkt_hash[2], pkt_hash[3], pkt_hash[4], pkt_hash[5],
-			pkt_hash[6], pkt_hash[7], pkt_hash[8], pkt_hash[9], pkt_hash[10], pkt_hash[11],
-			pkt_hash[12], pkt_hash[13], pkt_hash[14], pkt_hash[15]);
+	if(esp_wifi_sta_get_ap_info(&ap) == ESP_OK)
+		esp_wifi_set_channel(ap.primary, WIFI_SECOND_CHAN_NONE);
 }
 
-static void get_ssid(unsigned char *data, char ssid[SSID_MAX_LEN], uint8_t ssid_len)
+static void process_task(void *pvParameter)
 {
-	int i, j;
+	capture_record_t *rec;
+
+	ESP_LOGI(TAG, "[SNIFFER] Processing task created");
+
+	while(RUNNING){
+		//wait for the callback to push something (or app_main to stop the task)
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-	for(i=26, j=0; i<26+ssid_len; i++, j++){
-		ssid[j] = data[i];
+		while((rec = capture_ring_peek(&capture_ring)) != NULL){
+			process_pkt(rec);
+			capture_ring_release(&capture_ring);
+		}
 	}
 
-	ssid[j] = '\0';
+	xTaskNotifyGive(xHandle_main); //the ring is drained out of lck_file: app_main can delete the task
+	vTaskSuspend(NULL);
 }
 
-static int get_sn(unsigned char *data)
+static void process_pkt(capture_record_t *rec)
 {
-	int sn;
-    char num[5] = "\0";
+	int pkt_len;
+	time_t ts;
+	pkt_info_t info;
 
-	sprintf(num, "%02x%02x", data[22], data[23]);
-    sscanf(num, "%x", &sn);
+	time(&ts);
+	ts -= (time_t)((esp_timer_get_time() - rec->us) / 1000000); //time spent waiting in the ring
 
-    return sn;
+	pkt_len = rec->sig_len - 4; //FCS excluded
+	if(pkt_len > rec->len) //truncated packet
+		pkt_len = rec->len;
+
+	if(pkt_decode(rec->frame, pkt_len, &info) != 0) //too short to be a probe request
+		return;
+
+	if(CONFIG_VERBOSE){
+		ESP_LOGI(TAG, "Dump");
+		dumb(rec->frame, rec->len);
+		print_pkt_info(&info, ts, rec->rssi);
+	}
+
+	save_pkt_info(&info, ts, rec->rssi, rec->channel);
 }
 
-static void get_ht_capabilites_info(unsigned char *data, char htci[5], int pkt_len, int ssid_len)
+static void print_pkt_info(pkt_info_t *info, time_t timestamp, int8_t rssi)
 {
-	int ht_start = 25+ssid_len+19;
+	/* only place where the decoded fields are turned into text */
+	char ssid[SSID_MAX_LEN] = "\0", hash[MD5_LEN] = "\0";
+	uint8_t *d = info->digest;
+	int ssid_len = info->ies.ssid.len < PROBE_SSID_MAX_LEN ? info->ies.ssid.len : PROBE_SSID_MAX_LEN;
 
-	/* 1) data[ht_start-1] is the byte that says if HT Capabilities is present or not (tag length).
-	 * 2) I need to check also that i'm not outside the payload: if HT Capabilities is not present in the packet,
-	 * for this reason i'm considering the ht_start must be lower than the total length of the packet less the last 4 bytes of FCS */
+	if(ssid_len > 0)
+		memcpy(ssid, info->ies.ssid.data, ssid_len);
+	ssid[ssid_len] = '\0';
 
-	if(data[ht_start-1]>0 && ht_start<pkt_len-4){ //HT capabilities is present
-		if(data[ht_start-4] == 1) //DSSS parameter is set -> need to shift of three bytes
-			sprintf(htci, "%02x%02x", data[ht_start+3], data[ht_start+1+3]);
-		else
-			sprintf(htci, "%02x%02x", data[ht_start], data[ht_start+1]);
-	}
+	sprintf(hash, "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
+			d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], d[8], d[9], d[10], d[11], d[12], d[13], d[14], d[15]);
+
+	ESP_LOGI(TAG, "ADDR=%02x:%02x:%02x:%02x:%02x:%02x, "
+			"SSID=%s, "
+			"TIMESTAMP=%d, "
+			"HASH=%s, "
+			"FP=%08x, "
+			"RSSI=%02d, "
+			"SN=%d, "
+			"FRAG=%d, "
+			"HT CAP. INFO=%04x",
+			info->sa[0], info->sa[1], info->sa[2], info->sa[3], info->sa[4], info->sa[5],
+			ssid,
+			(int)timestamp,
+			hash,
+			info->fp,
+			rssi,
+			info->sn,
+			info->frag,
+			info->htci);
 }
 
 static void dumb(unsigned char *data, int len)
@@ -801,38 +1370,179 @@ static void dumb(unsigned char *data, int len)
 	}
 }
 
-static void save_pkt_info(uint8_t address[6], char *ssid, time_t timestamp, char *hash, int8_t rssi, int sn, char htci[5])
+static void save_pkt_info(pkt_info_t *info, time_t timestamp, int8_t rssi, uint8_t channel)
 {
-	FILE *fp = NULL;
-	int stime;
+	static int stime; //start timestamp of the current window
+	probe_file_hdr_t hdr;
+	uint16_t offset;
 
 	_lock_acquire(&lck_file);
-	if(WHICH_FILE)
-		fp = fopen(CONFIG_FILENAME1, "a");
-	else
-		fp = fopen(CONFIG_FILENAME2, "a");
-	_lock_release(&lck_file);
-
-	if(fp == NULL){
+	if(open_window_file() != 0){
+		_lock_release(&lck_file);
 		ESP_LOGE(TAG, "[SNIFFER] Impossible to open file and save information about sniffed packets");
+		return;
 	}
 
 	if(FILE_CHANGED){
 		FILE_CHANGED = false;
 		stime = get_start_timestamp();
-		fprintf(fp, "%d\n", stime);
+		probe_file_hdr_init(&hdr, stime);
+		window_append(&hdr, sizeof(hdr), true);
 	}
 
-	fprintf(fp, "%02x:%02x:%02x:%02x:%02x:%02x %s %d %s %02d %d %s\n",
-			address[0], address[1], address[2], address[3], address[4], address[5],
-			ssid,
-			(int)timestamp,
-			hash,
-			rssi,
-			sn,
-			htci);
+	offset = (int)timestamp > stime ? (int)timestamp - stime : 0;
+	if(device_table_add(&device_table, info, offset, rssi, channel) != 0){
+		/* table full: write out the devices seen so far, they will have more records in this window */
+		ESP_LOGW(TAG, "[SNIFFER] Device table full (%d devices): writing it before the end of the window", DEVICE_TABLE_MAX_LOAD);
+		save_devices();
+		device_table_add(&device_table, info, offset, rssi, channel);
+	}
+	_lock_release(&lck_file);
+}
+
+static void save_devices()
+{
+	/* write the records of the devices in the table (encoded in frames), then clear it. Called with lck_file taken */
+	uint8_t buf[PROBE_RECORD_MAX_LEN];
+	probe_record_t *rec = (probe_record_t *)buf;
+	const device_entry_t *e;
+	const uint8_t *frame;
+	device_table_stats_t *st = &device_table.stats;
+	size_t len;
+	uint32_t bytes = 0;
+	int pos = 0, ret = 0;
+
+	if(st->devices == 0)
+		return;
+
+	while((e = device_table_next(&device_table, &pos)) != NULL){
+		device_table_record(&device_table, e, rec);
+		if(probe_encoder_add(&encoder, rec) == 0)
+			continue;
+		len = probe_encoder_take(&encoder, &frame); //frame full
+		ret |= window_append(frame, len, false);
+		bytes += len;
+		probe_encoder_add(&encoder, rec);
+	}
+	len = probe_encoder_take(&encoder, &frame);
+	ret |= window_append(frame, len, false);
+	bytes += len;
+	if(!STAGED) //written to flash: synced now, not at the end of the window
+		ret |= RAW_LOG ? raw_log_flush(&raw_log) : log_writer_flush(&log_writer);
+
+	if(ret != 0)
+		ESP_LOGE(TAG, "[SNIFFER] Impossible to save information about sniffed packets");
+
+	ESP_LOGI(TAG, "[SNIFFER] Device table: %u packets from %u devices, %u SSIDs dropped, %u bytes",
+			st->packets, st->devices, st->ssid_dropped, bytes);
+
+	device_table_clear(&device_table);
+}
+
+static int open_window_file()
+{
+	/* open the window file being written, if closed by end_window(). Called with lck_file taken */
+	char path[SEG_LOG_PATH_LEN];
+
+	if(RAW_LOG || log_writer_is_open(&log_writer))
+		return 0;
+
+	seg_log_head_path(&seg_log, path);
+	return log_writer_open(&log_writer, path);
+}
+
+static int window_append(const void *rec, size_t len, bool start)
+{
+	/* append a record to the current window, start is true for its header. A window is kept in RAM
+	 * if the broker is reachable when it starts, until it fits. Called with lck_file taken */
+	if(start){
+		STAGED = CONFIG_STAGE_SIZE > 0 && MQTT_CONNECTED;
+		if(!STAGED) //the windows still in RAM are older: they go to flash first, the stage is always newer than the flash
+			spill_windows(true);
+	}
+
+	if(STAGED){
+		if(ram_stage_append(&stage, rec, len) == 0)
+			return 0;
+		spill_open(); //no room: the window goes on in flash
+	}
+
+	return flash_append(rec, len, start);
+}
+
+static int flash_append(const void *rec, size_t len, bool start)
+{
+	/* append a record to the window being written to flash. Called with lck_file taken */
+	if(RAW_LOG)
+		return raw_log_append(&raw_log, rec, len, start);
+
+	if(open_window_file() != 0)
+		return -1;
+	return log_writer_append(&log_writer, rec, len);
+}
+
+static void flash_append_window(const uint8_t *data, size_t len)
+{
+	/* write a window (or the first part of it) kept in RAM: the header, then one frame at a time */
+	size_t off = sizeof(probe_file_hdr_t), frame_len;
+	int ret;
+
+	if(len < off)
+		return;
+
+	ret = flash_append(data, off, true);
+	for(; off < len; off += frame_len){
+		frame_len = probe_frame_len(data+off);
+		ret |= flash_append(data+off, frame_len, false);
+	}
+
+	if(ret != 0)
+		ESP_LOGE(TAG, "[SNIFFER] Impossible to write the windows kept in RAM to flash");
+}
+
+static void spill_windows(bool all)
+{
+	/* write the closed windows kept in RAM to flash, oldest first: all of them, or while they are above
+	 * the watermark. Called with lck_file taken */
+	const uint8_t *data;
+	size_t len;
+
+	while((all || ram_stage_over(&stage)) && ram_stage_peek(&stage, &data, &len)){
+		flash_append_window(data, len);
+		flash_close_window();
+		ram_stage_pop(&stage, false);
+	}
+}
+
+static void spill_open()
+{
+	/* write everything kept in RAM to flash, the current window included: it goes on in flash.
+	 * Called with lck_file taken */
+	const uint8_t *data;
+	size_t len;
+
+	spill_windows(true);
+	data = ram_stage_open(&stage, &len);
+	flash_append_window(data, len);
+	ram_stage_drop_open(&stage);
+	STAGED = false;
+}
+
+static uint32_t backlog_bytes()
+{
+	raw_log_stats_t st;
+	uint32_t bytes;
+
+	_lock_acquire(&lck_file);
+	if(!RAW_LOG)
+		bytes = seg_log.stats.bytes;
+	else{
+		raw_log_get_stats(&raw_log, &st);
+		bytes = st.bytes;
+	}
+	_lock_release(&lck_file);
 
-	fclose(fp);
+	return bytes;
 }
 
 static int get_start_timestamp()
@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "digest.h"
+#include "pkt_decode.h"
+
+#define SA_OFFSET 10 //source address in the management header
+#define SEQCTL_OFFSET 22 //sequence control in the management header
+#define FP_BUF_LEN 256 //stable IE content hashed by fingerprint(), the rest is ignored
+
+typedef struct {
+	uint8_t data[FP_BUF_LEN];
+	int len;
+} fp_buf_t;
+
+static void fp_add(fp_buf_t *b, const uint8_t *data, int len)
+{
+	if(len > FP_BUF_LEN - b->len)
+		len = FP_BUF_LEN - b->len;
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+}
+
+static void fp_add_ie(fp_buf_t *b, const ie_view_t *v)
+{
+	uint8_t len = v->data != NULL ? v->len : 0;
+
+	fp_add(b, &len, 1); //an empty IE and a missing one are different
+	if(v->data != NULL)
+		fp_add(b, v->data, v->len);
+}
+
+static uint32_t fingerprint(const probe_ies_t *ies)
+{
+	/* Only what depends on the device (chipset, driver, OS) and not on the single probe request:
+	 * IE order, supported rates, HT/VHT/extended capabilities, OUI and type of the vendor IEs.
+	 * The address, the sequence number, the SSID, the channel (DS params) and the content of
+	 * the vendor IEs (e.g. the WPS UUID, that some devices randomize) are left out */
+	fp_buf_t b;
+	int i;
+
+	b.len = 0;
+	fp_add(&b, ies->order, ies->ie_count < IE_ORDER_MAX ? ies->ie_count : IE_ORDER_MAX);
+	fp_add_ie(&b, &ies->rates);
+	fp_add_ie(&b, &ies->ext_rates);
+	fp_add_ie(&b, &ies->ht_cap);
+	fp_add_ie(&b, &ies->vht_cap);
+	fp_add_ie(&b, &ies->ext_cap);
+	for(i=0; i<ies->vendor_count && i<IE_VENDOR_MAX; i++)
+		fp_add(&b, ies->vendor[i].data, ies->vendor[i].len < 4 ? ies->vendor[i].len : 4);
+
+	return (uint32_t)xxh64(b.data, b.len, 0);
+}
+
+int pkt_decode(const uint8_t *frame, int len, pkt_info_t *info)
+{
+	uint16_t seqctl;
+
+	if(ie_parse_probe_req(frame, len, &info->ies) < 0)
+		return -1;
+
+	memcpy(info->sa, frame+SA_OFFSET, sizeof(info->sa));
+
+	seqctl = frame[SEQCTL_OFFSET] | (frame[SEQCTL_OFFSET+1] << 8); //little endian on air
+	info->sn = seqctl >> 4;
+	info->frag = seqctl & 0x0F;
+
+	info->htci = ie_ht_cap_info(&info->ies);
+	info->fp = fingerprint(&info->ies);
+
+	digest(frame, len, info->digest);
+
+	return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef PKT_DECODE_H
+#define PKT_DECODE_H
+
+#include <stdint.h>
+
+#include "ie_parser.h"
+#include "probe_record.h"
+
+/* Per-packet fields of a probe request as plain integers and raw bytes:
+ * no text is produced here, hex/decimal rendering is left to whoever prints them */
+
+typedef struct {
+	uint8_t sa[6]; //source address
+	uint16_t sn; //sequence number (12 bits)
+	uint8_t frag; //fragment number (4 bits)
+	uint16_t htci; //HT capabilities info, 0 if not present
+	uint8_t digest[PROBE_DIGEST_LEN]; //digest of the frame, FCS excluded (see digest.h)
+	uint32_t fp; //fingerprint of the stable IEs: the same for all the probe requests of a device, whatever its address
+	probe_ies_t ies;
+} pkt_info_t;
+
+/* Decode a probe request: frame is the whole frame and len its length without FCS.
+ * Return 0 on success, -1 if the frame is too short */
+int pkt_decode(const uint8_t *frame, int len, pkt_info_t *info);
+
+#endif
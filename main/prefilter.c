@@ -0,0 +1,204 @@
+#include <string.h>
+
+#include "prefilter.h"
+
+#define OUI_SHIFT (32 - __builtin_ctz(PF_OUI_SLOTS))
+#define OUI_SLOT(mul, oui) (((oui) * (mul)) >> OUI_SHIFT)
+#define MUL_TRIES 4096 //multipliers tried to build a perfect hash table
+
+static int parse_hex(const char **p, uint8_t *out, int n)
+{
+	/* parse n bytes like "aa:bb:cc", skipping what comes before. Return 0 on success,
+	 * 1 if an entry is not valid (it is skipped), -1 at the end of the string */
+	const char *s = *p;
+	int i, j, v, d;
+	char c;
+
+	while(*s == ',' || *s == ' ')
+		s++;
+	if(*s == '\0')
+		return -1;
+
+	for(i=0; i<n; i++){
+		if(i > 0 && (*s == ':' || *s == '-'))
+			s++;
+		for(j=0, v=0; j<2; j++){
+			c = *s;
+			if(c >= '0' && c <= '9') d = c - '0';
+			else if(c >= 'a' && c <= 'f') d = c - 'a' + 10;
+			else if(c >= 'A' && c <= 'F') d = c - 'A' + 10;
+			else break;
+			v = v << 4 | d;
+			s++;
+		}
+		if(j < 2)
+			break;
+		out[i] = v;
+	}
+
+	if(i < n || (*s != ',' && *s != ' ' && *s != '\0')){ //skip the rest of the entry
+		while(*s != ',' && *s != '\0')
+			s++;
+		*p = s;
+		return 1;
+	}
+
+	*p = s;
+	return 0;
+}
+
+static uint32_t oui_of(const uint8_t *mac)
+{
+	return mac[0] << 16 | mac[1] << 8 | mac[2];
+}
+
+static bool oui_build(pf_oui_set_t *set, const uint32_t *oui, int n)
+{
+	/* look for a multiplier that sends every OUI to a different slot */
+	uint32_t mul, s;
+	int t, i;
+
+	for(t=0; t<MUL_TRIES; t++){
+		mul = 0x9E3779B1 + 2*t*0x10001; //odd
+		memset(set->key, 0xFF, sizeof(set->key));
+		for(i=0; i<n; i++){
+			s = OUI_SLOT(mul, oui[i]);
+			if(set->key[s] != PF_OUI_EMPTY && set->key[s] != oui[i])
+				break;
+			set->key[s] = oui[i];
+		}
+		if(i == n){
+			set->mul = mul;
+			set->count = n;
+			return true;
+		}
+	}
+
+	memset(set->key, 0xFF, sizeof(set->key));
+	set->count = 0;
+	return false;
+}
+
+static int oui_init(pf_oui_set_t *set, const char *list)
+{
+	uint32_t oui[PF_OUI_MAX];
+	uint8_t b[3];
+	int n = 0, bad = 0, ret;
+
+	while((ret = parse_hex(&list, b, 3)) >= 0){
+		set->listed = true;
+		if(ret > 0 || n == PF_OUI_MAX)
+			bad++;
+		else
+			oui[n++] = oui_of(b);
+	}
+
+	if(!oui_build(set, oui, n)) //the set is empty: an allow set rejects every OUI
+		bad += n;
+
+	return bad;
+}
+
+static bool oui_contains(const pf_oui_set_t *set, uint32_t oui)
+{
+	return set->key[OUI_SLOT(set->mul, oui)] == oui;
+}
+
+static void bloom_bits(const uint8_t *mac, uint32_t *bit)
+{
+	/* double hashing: bit i is h1 + i*h2, h2 is odd so the PF_BLOOM_K bits are different */
+	uint32_t lo = mac[2] | mac[3] << 8 | mac[4] << 16 | (uint32_t)mac[5] << 24;
+	uint32_t hi = mac[0] | mac[1] << 8;
+	uint32_t h1 = (lo ^ hi * 0x85EBCA6B) * 0x9E3779B1;
+	uint32_t h2 = (((lo * 0xC2B2AE35) ^ hi) * 0x27D4EB2F) | 1;
+	int i;
+
+	for(i=0; i<PF_BLOOM_K; i++)
+		bit[i] = (h1 + i*h2) >> (32 - __builtin_ctz(PF_BLOOM_BITS));
+}
+
+static void bloom_add(prefilter_t *pf, const uint8_t *mac)
+{
+	uint32_t bit[PF_BLOOM_K];
+	int i;
+
+	bloom_bits(mac, bit);
+	for(i=0; i<PF_BLOOM_K; i++)
+		pf->bloom[bit[i]/32] |= 1u << (bit[i]%32);
+}
+
+static bool bloom_contains(const prefilter_t *pf, const uint8_t *mac)
+{
+	uint32_t bit[PF_BLOOM_K];
+	int i;
+
+	bloom_bits(mac, bit);
+	for(i=0; i<PF_BLOOM_K; i++)
+		if((pf->bloom[bit[i]/32] & (1u << (bit[i]%32))) == 0)
+			return false;
+
+	return true;
+}
+
+int prefilter_init(prefilter_t *pf, int rssi_min, int random_policy,
+		const char *oui_allow, const char *oui_deny, const char *mac_deny)
+{
+	uint8_t mac[6];
+	int bad = 0, ret;
+
+	memset(pf, 0, sizeof(*pf));
+	pf->rssi_min = rssi_min;
+	pf->random_policy = random_policy;
+
+	bad += oui_init(&pf->allow, oui_allow);
+	bad += oui_init(&pf->deny, oui_deny);
+
+	while((ret = parse_hex(&mac_deny, mac, 6)) >= 0){
+		if(ret > 0){
+			bad++;
+			continue;
+		}
+		bloom_add(pf, mac);
+		pf->bloom_count++;
+	}
+
+	return bad;
+}
+
+bool prefilter_pass(prefilter_t *pf, const uint8_t *sa, int8_t rssi)
+{
+	uint32_t oui;
+
+	if(rssi < pf->rssi_min){
+		pf->stats.rssi++;
+		return false;
+	}
+
+	if(pf->random_policy != PF_RANDOM_ANY && ((sa[0] & 0x02) != 0) != (pf->random_policy == PF_RANDOM_ONLY)){
+		pf->stats.random++;
+		return false;
+	}
+
+	oui = oui_of(sa);
+	if(pf->allow.listed && !oui_contains(&pf->allow, oui)){ //fails closed: an empty set contains nothing
+		pf->stats.oui_allow++;
+		return false;
+	}
+	if(pf->deny.count > 0 && oui_contains(&pf->deny, oui)){
+		pf->stats.oui_deny++;
+		return false;
+	}
+
+	if(pf->bloom_count > 0 && bloom_contains(pf, sa)){
+		pf->stats.mac_deny++;
+		return false;
+	}
+
+	pf->stats.passed++;
+	return true;
+}
+
+void prefilter_get_stats(prefilter_t *pf, prefilter_stats_t *stats)
+{
+	*stats = pf->stats;
+}
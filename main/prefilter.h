@@ -0,0 +1,66 @@
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Early rejection of the probe requests, run in the promiscuous callback before the packet
+ * is copied into the capture ring. Only O(1) checks on fields of the radio header and of the
+ * 802.11 header, in this order:
+ *  - RSSI floor
+ *  - locally administered (randomized) address policy
+ *  - OUI allow set (if the list is not blank only the listed OUIs pass: none if no entry is valid)
+ *    and OUI deny set: perfect hash tables
+ *  - address denylist: Bloom filter (false positives are possible, false negatives are not)
+ * Every rule has its own rejection counter. The configuration is built by prefilter_init()
+ * and then only read: the counters are written only by the callback. */
+
+#define PF_RANDOM_ANY 0 //no check on the locally administered bit
+#define PF_RANDOM_DROP 1 //drop the randomized addresses
+#define PF_RANDOM_ONLY 2 //keep only the randomized addresses
+
+#define PF_OUI_MAX 16 //OUIs in a set
+#define PF_OUI_SLOTS 64 //slots of the perfect hash table of a set (power of two)
+#define PF_OUI_EMPTY 0xFFFFFFFF
+#define PF_BLOOM_BITS 1024 //bits of the address denylist (power of two)
+#define PF_BLOOM_K 3 //bits set for each address
+
+typedef struct {
+	uint32_t key[PF_OUI_SLOTS]; //OUI, PF_OUI_EMPTY if the slot is free
+	uint32_t mul; //multiplier without collisions on the keys
+	int count;
+	bool listed; //the list is not blank, even if no entry is valid
+} pf_oui_set_t;
+
+typedef struct {
+	uint32_t passed;
+	uint32_t rssi; //below the RSSI floor
+	uint32_t random; //locally administered bit policy
+	uint32_t oui_allow; //OUI not in the allow set
+	uint32_t oui_deny; //OUI in the deny set
+	uint32_t mac_deny; //address in the denylist
+} prefilter_stats_t;
+
+typedef struct {
+	int rssi_min;
+	int random_policy; //PF_RANDOM_*
+	pf_oui_set_t allow;
+	pf_oui_set_t deny;
+	uint32_t bloom[PF_BLOOM_BITS/32];
+	int bloom_count; //addresses in the denylist
+	prefilter_stats_t stats;
+} prefilter_t;
+
+/* Build the filter. The lists are separated by commas, the bytes of OUIs ("aa:bb:cc") and
+ * addresses ("aa:bb:cc:dd:ee:ff") by colons or dashes. Return the number of entries that are
+ * not valid or do not fit (they are ignored) */
+int prefilter_init(prefilter_t *pf, int rssi_min, int random_policy,
+		const char *oui_allow, const char *oui_deny, const char *mac_deny);
+
+/* Return true if the packet from sa received at rssi must be processed */
+bool prefilter_pass(prefilter_t *pf, const uint8_t *sa, int8_t rssi);
+
+/* Snapshot of the counters (cumulative since prefilter_init) */
+void prefilter_get_stats(prefilter_t *pf, prefilter_stats_t *stats);
+
+#endif
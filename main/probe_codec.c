@@ -0,0 +1,197 @@
+#include <string.h>
+
+#include "probe_codec.h"
+
+typedef struct {
+	probe_encoder_t *enc;
+	size_t pos;
+	bool full;
+} writer_t;
+
+static void put(writer_t *w, const void *data, size_t len)
+{
+	if(w->pos + len > PROBE_FRAME_MAX){
+		w->full = true;
+		return;
+	}
+	memcpy(w->enc->buf + w->pos, data, len);
+	w->pos += len;
+}
+
+static void put_varint(writer_t *w, uint32_t v)
+{
+	uint8_t b[5];
+	int n = 0;
+
+	while(v >= 0x80){
+		b[n++] = v | 0x80;
+		v >>= 7;
+	}
+	b[n++] = v;
+	put(w, b, n);
+}
+
+static uint32_t zigzag(int32_t v)
+{
+	return (uint32_t)v << 1 ^ (uint32_t)(v >> 31);
+}
+
+static int find_mac(const probe_encoder_t *enc, const uint8_t *mac)
+{
+	int i;
+
+	for(i=0; i<enc->nmac; i++)
+		if(memcmp(enc->mac[i], mac, 6) == 0)
+			return i;
+	return -1;
+}
+
+static int find_u32(const uint32_t *dict, int n, uint32_t v)
+{
+	int i;
+
+	for(i=0; i<n; i++)
+		if(dict[i] == v)
+			return i;
+	return -1;
+}
+
+static int find_ssid(const probe_encoder_t *enc, const uint8_t *ssid)
+{
+	/* ssid is a length byte and the bytes, the dictionary points to a literal in the frame */
+	const uint8_t *s;
+	int i;
+
+	for(i=0; i<enc->nssid; i++){
+		s = enc->buf + enc->ssid[i];
+		if(s[0] >> 1 == ssid[0] && memcmp(s+1, ssid+1, ssid[0]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static void start_frame(probe_encoder_t *enc)
+{
+	enc->len = 2;
+	enc->records = 0;
+	enc->mean = 0;
+	enc->nmac = enc->noui = enc->nfp = enc->nssid = 0;
+}
+
+void probe_encoder_init(probe_encoder_t *enc, int digest_len)
+{
+	memset(enc, 0, sizeof(*enc));
+	enc->digest_len = digest_len;
+}
+
+int probe_encoder_add(probe_encoder_t *enc, const probe_record_t *rec)
+{
+	writer_t w = { enc, 0, false };
+	uint8_t nmac, noui, nfp, nssid, tag;
+	uint32_t oui = rec->mac[0] << 16 | rec->mac[1] << 8 | rec->mac[2];
+	const uint8_t *s;
+	int i, idx, count = rec->ssid_count > 7 ? 7 : rec->ssid_count;
+
+	if(enc->len == 0) //the last frame has been taken
+		start_frame(enc);
+	w.pos = enc->len;
+
+	/* the entries added are dropped if the record does not fit */
+	nmac = enc->nmac;
+	noui = enc->noui;
+	nfp = enc->nfp;
+	nssid = enc->nssid;
+
+	tag = count << PROBE_TAG_SSIDS_SHIFT;
+	if(rec->macs > 1)
+		tag |= PROBE_TAG_MACS;
+	if(rec->htci != 0)
+		tag |= PROBE_TAG_HTCI;
+	if(find_mac(enc, rec->mac) >= 0)
+		tag |= PROBE_TAG_MAC;
+	else if(find_u32(enc->oui, enc->noui, oui) >= 0)
+		tag |= PROBE_TAG_OUI;
+	if(find_u32(enc->fp, enc->nfp, rec->fp) >= 0)
+		tag |= PROBE_TAG_FP;
+	put(&w, &tag, 1);
+
+	if(tag & PROBE_TAG_MAC)
+		put_varint(&w, find_mac(enc, rec->mac));
+	else{
+		if(tag & PROBE_TAG_OUI){
+			put_varint(&w, find_u32(enc->oui, enc->noui, oui));
+			put(&w, rec->mac+3, 3);
+		}
+		else{
+			put(&w, rec->mac, 6);
+			if(noui < PROBE_DICT_MAX)
+				enc->oui[noui++] = oui;
+		}
+		if(nmac < PROBE_DICT_MAX)
+			memcpy(enc->mac[nmac++], rec->mac, 6);
+	}
+
+	put(&w, rec->digest, enc->digest_len);
+
+	if(tag & PROBE_TAG_FP)
+		put_varint(&w, find_u32(enc->fp, enc->nfp, rec->fp));
+	else{
+		put(&w, &rec->fp, 4);
+		if(nfp < PROBE_DICT_MAX)
+			enc->fp[nfp++] = rec->fp;
+	}
+
+	if(tag & PROBE_TAG_MACS)
+		put_varint(&w, rec->macs - 1);
+	put_varint(&w, rec->first_offset);
+	put_varint(&w, (uint16_t)(rec->last_offset - rec->first_offset));
+	put_varint(&w, rec->count > 0 ? rec->count - 1 : 0);
+	put_varint(&w, zigzag(rec->rssi_mean - enc->mean));
+	put_varint(&w, (uint8_t)(rec->rssi_mean - rec->rssi_min));
+	put_varint(&w, (uint8_t)(rec->rssi_max - rec->rssi_mean));
+	put_varint(&w, rec->sn_first);
+	put_varint(&w, (rec->sn_last - rec->sn_first) & 0xFFF);
+	if(tag & PROBE_TAG_HTCI)
+		put_varint(&w, rec->htci);
+	put_varint(&w, rec->channels);
+
+	for(i=0, s=rec->ssids; i<count; i++, s+=1+s[0]){
+		idx = find_ssid(enc, s);
+		if(idx >= 0)
+			put_varint(&w, idx << 1 | 1);
+		else{
+			if(nssid < PROBE_DICT_MAX)
+				enc->ssid[nssid++] = w.pos;
+			put_varint(&w, s[0] << 1);
+			put(&w, s+1, s[0]);
+		}
+	}
+
+	if(w.full)
+		return 1;
+
+	enc->len = w.pos;
+	enc->records++;
+	enc->mean = rec->rssi_mean;
+	enc->nmac = nmac;
+	enc->noui = noui;
+	enc->nfp = nfp;
+	enc->nssid = nssid;
+
+	return 0;
+}
+
+size_t probe_encoder_take(probe_encoder_t *enc, const uint8_t **frame)
+{
+	size_t len = enc->records > 0 ? enc->len : 0;
+
+	if(len > 0){
+		enc->buf[0] = (len - 2) & 0xFF;
+		enc->buf[1] = (len - 2) >> 8;
+	}
+	*frame = enc->buf;
+	enc->len = 0;
+	enc->records = 0;
+
+	return len;
+}
@@ -0,0 +1,57 @@
+#ifndef PROBE_CODEC_H
+#define PROBE_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "probe_record.h"
+
+/* Encoder of the records of a window into frames (see probe_record.h), decoded on the host by
+ * tools/probe_codec.py. Every record starts with a tag byte (PROBE_TAG_*), then:
+ *  - address: index in the address dictionary, or index in the OUI dictionary and the other
+ *    3 bytes, or the 6 bytes (added to both dictionaries)
+ *  - digest: the significant bytes only (16 for MD5, 8 for the 64-bit digests)
+ *  - fingerprint: index in the fingerprint dictionary or the 4 bytes (added to it)
+ *  - macs - 1 if PROBE_TAG_MACS
+ *  - first_offset, last_offset - first_offset, count - 1
+ *  - rssi_mean as zig-zag delta from the mean of the previous record of the frame, mean - min, max - mean
+ *  - sn_first, (sn_last - sn_first) modulo 4096
+ *  - htci if PROBE_TAG_HTCI, channels
+ *  - ssid_count SSIDs (count in the tag): index*2+1 in the SSID dictionary, or length*2 and the bytes
+ *    (added to it)
+ * The numbers are unsigned LEB128 varints. The dictionaries start empty in every frame and hold
+ * at most PROBE_DICT_MAX entries each (then the values are written in full). */
+
+#define PROBE_DICT_MAX 32
+
+#define PROBE_TAG_MAC 0x01 //address in the dictionary
+#define PROBE_TAG_OUI 0x02 //OUI in the dictionary
+#define PROBE_TAG_FP 0x04 //fingerprint in the dictionary
+#define PROBE_TAG_MACS 0x08 //more than one address
+#define PROBE_TAG_HTCI 0x10 //htci not 0
+#define PROBE_TAG_SSIDS_SHIFT 5 //bits 5-7: number of SSIDs
+
+typedef struct {
+	uint8_t buf[PROBE_FRAME_MAX]; //frame being built: length and records
+	size_t len; //bytes used in buf
+	int records; //records in the frame
+	int digest_len; //significant bytes of the digests
+	int8_t mean; //rssi_mean of the previous record
+	uint8_t nmac, noui, nfp, nssid; //entries of the dictionaries
+	uint8_t mac[PROBE_DICT_MAX][6];
+	uint32_t oui[PROBE_DICT_MAX];
+	uint32_t fp[PROBE_DICT_MAX];
+	uint16_t ssid[PROBE_DICT_MAX]; //offsets of the SSIDs (length byte and bytes) in buf
+} probe_encoder_t;
+
+/* Start an empty frame, digest_len is the number of significant bytes of the digests */
+void probe_encoder_init(probe_encoder_t *enc, int digest_len);
+
+/* Encode a record into the frame: return 0 on success, 1 if it does not fit (take the frame and add it again) */
+int probe_encoder_add(probe_encoder_t *enc, const probe_record_t *rec);
+
+/* Return the frame and its length (0 if it has no records) and start an empty one.
+ * frame is valid until the next call to probe_encoder_add */
+size_t probe_encoder_take(probe_encoder_t *enc, const uint8_t **frame);
+
+#endif
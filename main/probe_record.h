@@ -0,0 +1,87 @@
+#ifndef PROBE_RECORD_H
+#define PROBE_RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "digest.h"
+
+/* Binary format of the window files and of the MQTT payloads (see tools/probe_codec.py).
+ *
+ * A window file is a probe_file_hdr_t followed by frames. A frame is a 16-bit length and the
+ * probe_record_t records, one per device seen in the window (the probe requests of a device are
+ * aggregated by device_table.c), encoded by probe_codec.c against dictionaries that start
+ * empty in every frame.
+ * Every MQTT message carries the same header (PROBE_FLAG_LAST set on the last message of a window)
+ * followed by whole frames, so each message can be decoded on its own.
+ * All the fields are little endian. */
+
+#define PROBE_MAGIC0 'P'
+#define PROBE_MAGIC1 'R'
+#define PROBE_RECORD_VERSION 6 //2: sn is the 12-bit sequence number, htci is little endian; 3: one record per device; 4: channels, digest algorithm in the flags; 5: fingerprint; 6: encoded frames
+
+#define PROBE_FLAG_LAST 0x01 //last message of the window
+#define PROBE_FLAG_DIGEST_MASK 0x06 //algorithm of the digests (DIGEST_ID_*)
+#define PROBE_FLAG_DIGEST(id) ((id) << 1)
+
+#define PROBE_DIGEST_LEN DIGEST_LEN
+#define PROBE_SSID_MAX_LEN 32
+#define PROBE_SSID_MAX 4 //max number of SSIDs in a record
+
+typedef struct {
+	uint8_t magic[2]; //PROBE_MAGIC0, PROBE_MAGIC1
+	uint8_t version; //PROBE_RECORD_VERSION
+	uint8_t flags; //PROBE_FLAG_*
+	int32_t start_ts; //start timestamp of the window (seconds)
+} __attribute__((packed)) probe_file_hdr_t;
+
+typedef struct {
+	uint8_t mac[6]; //source address (the first one if macs > 1)
+	uint8_t digest[PROBE_DIGEST_LEN]; //raw digest of the first packet of the device in the window
+	uint32_t fp; //fingerprint of the stable IEs of the first packet (see pkt_decode.c)
+	uint8_t macs; //number of source addresses (more than 1 if randomized addresses are grouped by fingerprint)
+	uint16_t first_offset; //seconds from the start of the window to the first packet
+	uint16_t last_offset; //seconds from the start of the window to the last packet
+	uint16_t count; //number of packets
+	int8_t rssi_min;
+	int8_t rssi_max;
+	int8_t rssi_mean;
+	uint16_t sn_first; //sequence number of the first packet
+	uint16_t sn_last; //sequence number of the last packet
+	uint16_t htci; //HT capabilities info, 0 if not present
+	uint16_t channels; //bit n set if the device has been captured on channel n
+	uint8_t ssid_count;
+	uint8_t ssids_len; //bytes of ssids[]
+	uint8_t ssids[]; //ssid_count SSIDs, each one is a length byte followed by the SSID (not null terminated)
+} __attribute__((packed)) probe_record_t;
+
+#define PROBE_RECORD_MAX_LEN (sizeof(probe_record_t) + PROBE_SSID_MAX*(1+PROBE_SSID_MAX_LEN))
+
+#define PROBE_FRAME_MAX 944 //max length of a frame (length included): a header and a frame fit in a MQTT message
+
+static inline void probe_file_hdr_init(probe_file_hdr_t *hdr, int32_t start_ts)
+{
+	hdr->magic[0] = PROBE_MAGIC0;
+	hdr->magic[1] = PROBE_MAGIC1;
+	hdr->version = PROBE_RECORD_VERSION;
+	hdr->flags = PROBE_FLAG_DIGEST(DIGEST_ID);
+	hdr->start_ts = start_ts;
+}
+
+static inline bool probe_file_hdr_valid(const probe_file_hdr_t *hdr)
+{
+	return hdr->magic[0] == PROBE_MAGIC0 && hdr->magic[1] == PROBE_MAGIC1 && hdr->version == PROBE_RECORD_VERSION;
+}
+
+static inline size_t probe_record_len(const probe_record_t *rec)
+{
+	return sizeof(probe_record_t) + rec->ssids_len;
+}
+
+static inline size_t probe_frame_len(const uint8_t *frame)
+{
+	return 2 + (frame[0] | frame[1] << 8);
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "ram_stage.h"
+
+static size_t closed_len(const ram_stage_t *st)
+{
+	return st->windows > 0 ? st->end[st->windows-1] : 0;
+}
+
+void ram_stage_init(ram_stage_t *st, uint8_t *buf, size_t size, size_t watermark)
+{
+	memset(st, 0, sizeof(*st));
+	st->buf = buf;
+	st->size = size;
+	st->watermark = watermark;
+}
+
+int ram_stage_append(ram_stage_t *st, const void *rec, size_t len)
+{
+	if(st->len + len > st->size)
+		return -1;
+
+	memcpy(st->buf + st->len, rec, len);
+	st->len += len;
+	st->records[st->windows]++;
+	st->stats.records++;
+	st->stats.bytes += len;
+
+	return 0;
+}
+
+int ram_stage_close(ram_stage_t *st)
+{
+	if(st->windows == RAM_STAGE_MAX)
+		return -1;
+
+	st->end[st->windows] = st->len;
+	st->windows++;
+	st->records[st->windows] = 0;
+
+	return 0;
+}
+
+bool ram_stage_over(const ram_stage_t *st)
+{
+	return st->windows > 0 && (closed_len(st) > st->watermark || st->windows == RAM_STAGE_MAX);
+}
+
+bool ram_stage_peek(const ram_stage_t *st, const uint8_t **data, size_t *len)
+{
+	if(st->windows == 0)
+		return false;
+
+	*data = st->buf;
+	*len = st->end[0];
+	return true;
+}
+
+const uint8_t *ram_stage_open(const ram_stage_t *st, size_t *len)
+{
+	*len = st->len - closed_len(st);
+	return st->buf + closed_len(st);
+}
+
+void ram_stage_pop(ram_stage_t *st, bool sent)
+{
+	size_t len;
+	int i;
+
+	if(st->windows == 0)
+		return;
+
+	len = st->end[0];
+	if(sent){
+		st->stats.sent_records += st->records[0];
+		st->stats.sent_bytes += len;
+	}
+	else{
+		st->stats.spilled_records += st->records[0];
+		st->stats.spilled_bytes += len;
+	}
+	st->stats.records -= st->records[0];
+	st->stats.bytes -= len;
+
+	memmove(st->buf, st->buf + len, st->len - len);
+	st->len -= len;
+	st->windows--;
+	for(i=0; i<st->windows; i++)
+		st->end[i] = st->end[i+1] - len;
+	memmove(st->records, st->records + 1, (st->windows + 1) * sizeof(st->records[0]));
+	st->first++;
+}
+
+void ram_stage_drop_open(ram_stage_t *st)
+{
+	size_t len = st->len - closed_len(st);
+
+	st->stats.spilled_records += st->records[st->windows];
+	st->stats.spilled_bytes += len;
+	st->stats.records -= st->records[st->windows];
+	st->stats.bytes -= len;
+
+	st->len = closed_len(st);
+	st->records[st->windows] = 0;
+}
+
+void ram_stage_get_stats(const ram_stage_t *st, ram_stage_stats_t *stats)
+{
+	*stats = st->stats;
+}
@@ -0,0 +1,64 @@
+#ifndef RAM_STAGE_H
+#define RAM_STAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* RAM buffer of the windows, written before the flash: while the broker is reachable a window
+ * is built here and sent from here, without being written to flash and read back. The buffer
+ * holds the closed windows, oldest first, followed by the window being written (open).
+ * A window leaves the buffer when it has been sent or when it is spilled to flash by the caller
+ * (the buffer is above the watermark, the uplink is down or the open window does not fit).
+ * The counters tell what is only in RAM (lost at a reboot) and what has been persisted.
+ * Not thread safe: the caller must serialize the calls. */
+
+#define RAM_STAGE_MAX 16 //max number of closed windows
+
+typedef struct {
+	uint32_t records; //records only in RAM now (closed and open windows)
+	uint32_t bytes;
+	uint32_t sent_records; //records sent from RAM, never written to flash (since boot)
+	uint32_t sent_bytes;
+	uint32_t spilled_records; //records moved to flash (persisted) since boot
+	uint32_t spilled_bytes;
+} ram_stage_stats_t;
+
+typedef struct {
+	uint8_t *buf;
+	size_t size; //size of buf
+	size_t watermark; //bytes above which the closed windows should be spilled
+	size_t len; //bytes used in buf
+	int windows; //closed windows
+	size_t end[RAM_STAGE_MAX]; //end of each closed window in buf
+	uint16_t records[RAM_STAGE_MAX+1]; //records of each window, the last one is the open window
+	uint32_t first; //sequence number of the oldest closed window: changes at every pop
+	ram_stage_stats_t stats;
+} ram_stage_t;
+
+void ram_stage_init(ram_stage_t *st, uint8_t *buf, size_t size, size_t watermark);
+
+/* Append a record to the open window, return 0 on success, -1 if there is no room */
+int ram_stage_append(ram_stage_t *st, const void *rec, size_t len);
+
+/* Close the open window, return 0 on success, -1 if there are already RAM_STAGE_MAX closed windows */
+int ram_stage_close(ram_stage_t *st);
+
+/* True if the closed windows should be spilled: above the watermark or RAM_STAGE_MAX windows */
+bool ram_stage_over(const ram_stage_t *st);
+
+/* Oldest closed window, false if there are none. data is valid until the next pop or drop */
+bool ram_stage_peek(const ram_stage_t *st, const uint8_t **data, size_t *len);
+
+/* Part of the open window in RAM (len is 0 if nothing has been appended) */
+const uint8_t *ram_stage_open(const ram_stage_t *st, size_t *len);
+
+/* Remove the oldest closed window: it has been sent, or written to flash if sent is false */
+void ram_stage_pop(ram_stage_t *st, bool sent);
+
+/* The open window has been written to flash: remove it */
+void ram_stage_drop_open(ram_stage_t *st);
+
+void ram_stage_get_stats(const ram_stage_t *st, ram_stage_stats_t *stats);
+
+#endif
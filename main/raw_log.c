@@ -0,0 +1,299 @@
+#include <string.h>
+
+#include "raw_log.h"
+
+#define MAGIC 0x474F4C52 //"RLOG"
+#define FREE32 0xFFFFFFFF
+#define LEN_FREE 0xFFFF //length of an entry not written
+#define E_START 0x01 //entry flag cleared in the first entry of a group
+#define E_SENT 0x02 //entry flag cleared when the group has been acked
+
+typedef struct {
+	uint32_t magic;
+	uint32_t seq; //sequence number of the sector: the highest is the head
+	uint32_t consumed; //FREE32, cleared when every group in the sector has been acked
+	uint32_t reserved;
+} raw_sector_hdr_t;
+
+typedef struct {
+	uint16_t len; //length of the record, LEN_FREE if not written
+	uint8_t flags; //E_*, active low: a bit can be cleared later without erasing the sector
+	uint8_t check; //check byte of the record
+} raw_entry_hdr_t;
+
+#define SECTOR_HDR sizeof(raw_sector_hdr_t)
+#define SECTOR_ADDR(log, seq) (((seq) % (log)->nsect) * RAW_LOG_SECTOR)
+#define LINEAR(pos) ((uint64_t)(pos).seq * RAW_LOG_SECTOR + (pos).off)
+
+static uint8_t check_byte(const uint8_t *rec, size_t len)
+{
+	uint8_t c = 0xA5 ^ len ^ len >> 8;
+
+	while(len-- > 0)
+		c = (c << 1 | c >> 7) + *rec++;
+
+	return c;
+}
+
+static int next_entry(const raw_log_t *log, raw_log_pos_t *pos, raw_entry_hdr_t *e, raw_log_pos_t limit)
+{
+	/* move pos to the next entry before limit and read its header: return 0 if found, 1 at limit, -1 on error */
+	while(LINEAR(*pos) < LINEAR(limit)){
+		if(pos->off + RAW_LOG_ENTRY_HDR <= RAW_LOG_SECTOR){
+			if(esp_partition_read(log->part, SECTOR_ADDR(log, pos->seq) + pos->off, e, sizeof(*e)) != ESP_OK)
+				return -1;
+			if(e->len != LEN_FREE && pos->off + RAW_LOG_ENTRY_HDR + e->len <= RAW_LOG_SECTOR)
+				return 0;
+		}
+		pos->seq++; //the rest of the sector is not used
+		pos->off = SECTOR_HDR;
+	}
+
+	return 1;
+}
+
+static int find_group(const raw_log_t *log, raw_log_pos_t *pos, raw_log_pos_t limit)
+{
+	/* move pos to the first group not acked before limit (or to limit). Return 0 on success */
+	raw_entry_hdr_t e;
+	int ret;
+
+	while((ret = next_entry(log, pos, &e, limit)) == 0){
+		if((e.flags & (E_START|E_SENT)) == E_SENT)
+			return 0;
+		pos->off += RAW_LOG_ENTRY_HDR + e.len;
+	}
+	if(ret < 0)
+		return -1;
+
+	*pos = limit;
+	return 0;
+}
+
+static int erase_ahead(raw_log_t *log)
+{
+	/* erase the sector after the head: if the tail is still there, its groups are lost */
+	uint32_t seq = log->head.seq + 1;
+	raw_log_pos_t pos;
+
+	if(log->tail.seq + log->nsect <= seq){
+		if(find_group(log, &log->tail, log->sealed) != 0)
+			return -1;
+		if(log->tail.seq + log->nsect <= seq){
+			pos.seq = seq - log->nsect + 1;
+			pos.off = SECTOR_HDR;
+			if(LINEAR(log->sealed) < LINEAR(pos)) //a group longer than the partition
+				log->sealed = pos;
+			if(find_group(log, &pos, log->sealed) != 0)
+				return -1;
+			log->tail = pos;
+			log->stats.evicted_sectors++;
+		}
+	}
+
+	if(esp_partition_erase_range(log->part, SECTOR_ADDR(log, seq), RAW_LOG_SECTOR) != ESP_OK)
+		return -1;
+	log->stats.erases++;
+
+	return 0;
+}
+
+static int next_sector(raw_log_t *log)
+{
+	/* move the head to the next sector (already erased) and erase the one after it */
+	raw_sector_hdr_t hdr = { MAGIC, log->head.seq + 1, FREE32, FREE32 };
+
+	if(esp_partition_write(log->part, SECTOR_ADDR(log, hdr.seq), &hdr, sizeof(hdr)) != ESP_OK)
+		return -1;
+	log->stats.writes++;
+
+	log->head.seq = hdr.seq;
+	log->head.off = SECTOR_HDR;
+
+	return erase_ahead(log);
+}
+
+int raw_log_mount(raw_log_t *log, const esp_partition_t *part)
+{
+	raw_sector_hdr_t hdr;
+	raw_entry_hdr_t e;
+	uint32_t i, seq;
+	bool found = false;
+
+	memset(log, 0, sizeof(*log));
+	log->part = part;
+	log->nsect = part->size / RAW_LOG_SECTOR;
+	if(log->nsect < 3)
+		return -1;
+
+	for(i=0; i<log->nsect; i++){ //the head is the sector with the highest sequence number
+		if(esp_partition_read(part, i*RAW_LOG_SECTOR, &hdr, sizeof(hdr)) != ESP_OK)
+			return -1;
+		if(hdr.magic == MAGIC && hdr.seq % log->nsect == i && (!found || hdr.seq > log->head.seq)){
+			log->head.seq = hdr.seq;
+			found = true;
+		}
+	}
+
+	if(!found){ //not a log: start from sector 0 (sequence number nsect)
+		log->head.seq = log->nsect - 1;
+		log->head.off = RAW_LOG_SECTOR;
+		log->tail = log->sealed = log->head;
+		if(esp_partition_erase_range(part, 0, RAW_LOG_SECTOR) != ESP_OK)
+			return -1;
+		log->stats.erases++;
+		return next_sector(log);
+	}
+
+	/* the end of the head is the first entry not written (or not valid: the sector is closed) */
+	log->head.off = SECTOR_HDR;
+	while(log->head.off + RAW_LOG_ENTRY_HDR <= RAW_LOG_SECTOR){
+		if(esp_partition_read(part, SECTOR_ADDR(log, log->head.seq) + log->head.off, &e, sizeof(e)) != ESP_OK)
+			return -1;
+		if(e.len == LEN_FREE)
+			break;
+		if(log->head.off + RAW_LOG_ENTRY_HDR + e.len > RAW_LOG_SECTOR){
+			log->head.off = RAW_LOG_SECTOR;
+			break;
+		}
+		log->head.off += RAW_LOG_ENTRY_HDR + e.len;
+	}
+	log->sealed = log->head;
+
+	/* the tail is in the oldest sector not consumed, going back from the head while the sectors are valid */
+	log->tail = log->head;
+	for(seq=log->head.seq, i=0; i<log->nsect-1; seq--, i++){
+		if(esp_partition_read(part, SECTOR_ADDR(log, seq), &hdr, sizeof(hdr)) != ESP_OK)
+			return -1;
+		if(hdr.magic != MAGIC || hdr.seq != seq || hdr.consumed != FREE32)
+			break;
+		log->tail.seq = seq;
+		log->tail.off = SECTOR_HDR;
+	}
+	if(find_group(log, &log->tail, log->sealed) != 0)
+		return -1;
+
+	return erase_ahead(log); //it may have been interrupted
+}
+
+int raw_log_append(raw_log_t *log, const void *rec, size_t len, bool start)
+{
+	raw_entry_hdr_t e;
+
+	if(len == 0 || len > RAW_LOG_MAX_LEN)
+		return -1;
+
+	if(log->head.off + log->len + RAW_LOG_ENTRY_HDR + len > RAW_LOG_SECTOR){ //the rest of the sector is left empty
+		if(raw_log_flush(log) != 0 || next_sector(log) != 0)
+			return -1;
+	}
+	else if(log->len + RAW_LOG_ENTRY_HDR + len > RAW_LOG_BUF){
+		if(raw_log_flush(log) != 0)
+			return -1;
+	}
+
+	e.len = len;
+	e.flags = start ? 0xFF & ~E_START : 0xFF;
+	e.check = check_byte(rec, len);
+	memcpy(log->buf + log->len, &e, sizeof(e));
+	memcpy(log->buf + log->len + sizeof(e), rec, len);
+	log->len += RAW_LOG_ENTRY_HDR + len;
+	log->stats.records++;
+
+	return 0;
+}
+
+int raw_log_flush(raw_log_t *log)
+{
+	if(log->len == 0)
+		return 0;
+
+	if(esp_partition_write(log->part, SECTOR_ADDR(log, log->head.seq) + log->head.off, log->buf, log->len) != ESP_OK)
+		return -1;
+	log->stats.writes++;
+	log->head.off += log->len;
+	log->len = 0;
+
+	return 0;
+}
+
+int raw_log_seal(raw_log_t *log)
+{
+	if(raw_log_flush(log) != 0)
+		return -1;
+
+	log->sealed = log->head;
+	return 0;
+}
+
+void raw_log_tail(const raw_log_t *log, raw_log_pos_t *cur)
+{
+	*cur = log->tail;
+}
+
+int raw_log_read(raw_log_t *log, raw_log_pos_t *cur, void *rec, size_t size, bool *start)
+{
+	raw_entry_hdr_t e;
+	int ret;
+
+	while(true){
+		if(LINEAR(*cur) < LINEAR(log->tail)) //evicted (or already acked)
+			return -1;
+
+		ret = next_entry(log, cur, &e, log->sealed);
+		if(ret != 0)
+			return ret < 0 ? -1 : 0;
+
+		if(e.len <= size && esp_partition_read(log->part, SECTOR_ADDR(log, cur->seq) + cur->off + RAW_LOG_ENTRY_HDR,
+				rec, e.len) != ESP_OK)
+			return -1;
+		cur->off += RAW_LOG_ENTRY_HDR + e.len;
+
+		if(e.len > size || check_byte(rec, e.len) != e.check){ //torn write or not a record of the caller
+			log->stats.bad_entries++;
+			continue;
+		}
+
+		*start = (e.flags & E_START) == 0;
+		return e.len;
+	}
+}
+
+int raw_log_ack(raw_log_t *log, const raw_log_pos_t *start, const raw_log_pos_t *end)
+{
+	static const uint32_t consumed = 0;
+	raw_log_pos_t pos = *start;
+	raw_entry_hdr_t e;
+	uint32_t seq;
+
+	if(LINEAR(*start) != LINEAR(log->tail) || LINEAR(*end) > LINEAR(log->sealed))
+		return 0; //evicted while it was sent
+
+	if(next_entry(log, &pos, &e, *end) == 0 && (e.flags & E_START) == 0){
+		e.flags &= ~E_SENT;
+		if(esp_partition_write(log->part, SECTOR_ADDR(log, pos.seq) + pos.off + offsetof(raw_entry_hdr_t, flags),
+				&e.flags, 1) != ESP_OK)
+			return -1;
+		log->stats.writes++;
+	}
+
+	seq = log->tail.seq;
+	log->tail = *end;
+	if(find_group(log, &log->tail, log->sealed) != 0)
+		return -1;
+
+	for(; seq != log->tail.seq; seq++){ //the tail left these sectors
+		if(esp_partition_write(log->part, SECTOR_ADDR(log, seq) + offsetof(raw_sector_hdr_t, consumed),
+				&consumed, sizeof(consumed)) != ESP_OK)
+			return -1;
+		log->stats.writes++;
+	}
+
+	return 0;
+}
+
+void raw_log_get_stats(const raw_log_t *log, raw_log_stats_t *stats)
+{
+	*stats = log->stats;
+	stats->bytes = LINEAR(log->sealed) > LINEAR(log->tail) ? LINEAR(log->sealed) - LINEAR(log->tail) : 0;
+}
@@ -0,0 +1,82 @@
+#ifndef RAW_LOG_H
+#define RAW_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_partition.h"
+
+/* Log-structured record store on a raw data partition, written with esp_partition_write
+ * without SPIFFS and the VFS. The partition is a ring of 4 KB sectors: sector seq % nsect holds
+ * the sequence number seq, written in its header with the state of the sector. A sector is
+ * filled with entries (4 bytes header + record) and is never rewritten until it is erased:
+ * the sector after the write head is always kept erased, so an append never waits for an erase
+ * of the sector it writes (the oldest data there is evicted if not sent yet).
+ * Records are grouped (a window: its file header is the first record of the group). The reader
+ * walks the log with a cursor from the tail and acks a whole group when it has been sent: the
+ * ack clears a bit of the first entry of the group and, when the tail leaves a sector, a bit of
+ * its header. At mount the head, the tail and the first group not sent are recovered from the
+ * sector headers and the entries, so the backlog survives a reboot.
+ * Not thread safe: the caller must serialize the calls. */
+
+#define RAW_LOG_SECTOR 4096 //flash erase unit
+#define RAW_LOG_BUF 1024 //records buffered in RAM before a write
+#define RAW_LOG_ENTRY_HDR 4 //bytes before each record
+#define RAW_LOG_MAX_LEN (RAW_LOG_BUF-RAW_LOG_ENTRY_HDR) //max length of a record
+
+/* position in the log: sector sequence number and offset in the sector */
+typedef struct {
+	uint32_t seq;
+	uint32_t off;
+} raw_log_pos_t;
+
+typedef struct {
+	uint32_t bytes; //bytes sealed and not acked (backlog)
+	uint32_t records; //records appended since the mount
+	uint32_t writes; //esp_partition_write calls since the mount (entries and headers)
+	uint32_t erases; //sectors erased since the mount
+	uint32_t evicted_sectors; //sectors erased before their data was acked
+	uint32_t bad_entries; //entries skipped by the reader (wrong check byte or length)
+} raw_log_stats_t;
+
+typedef struct {
+	const esp_partition_t *part;
+	uint32_t nsect; //sectors in the partition
+	raw_log_pos_t head; //end of the data written to flash
+	raw_log_pos_t sealed; //end of the data visible to the reader
+	raw_log_pos_t tail; //first group not acked
+	uint8_t buf[RAW_LOG_BUF]; //entries appended after head, not written yet
+	size_t len; //bytes used in buf
+	raw_log_stats_t stats;
+} raw_log_t;
+
+/* Recover the log written in part, or start an empty one if part does not contain a log.
+ * Everything found in the partition is sealed. Return 0 on success */
+int raw_log_mount(raw_log_t *log, const esp_partition_t *part);
+
+/* Append a record (at most RAW_LOG_MAX_LEN bytes), start is true for the first record of a group.
+ * Return 0 on success */
+int raw_log_append(raw_log_t *log, const void *rec, size_t len, bool start);
+
+/* Write the buffered records to the flash, return 0 on success */
+int raw_log_flush(raw_log_t *log);
+
+/* Flush and make everything appended visible to the reader: call it when a group is complete */
+int raw_log_seal(raw_log_t *log);
+
+/* Position of the first group not acked */
+void raw_log_tail(const raw_log_t *log, raw_log_pos_t *cur);
+
+/* Read the record at cur (at most size bytes) and move cur after it; start is set if the record
+ * is the first of a group. Return the length of the record, 0 if there is nothing sealed after
+ * cur, -1 if cur has been evicted or the flash can not be read */
+int raw_log_read(raw_log_t *log, raw_log_pos_t *cur, void *rec, size_t size, bool *start);
+
+/* The group from start (a position returned by raw_log_tail) to end has been sent: the tail
+ * moves to end. Nothing is done if the group has been evicted meanwhile. Return 0 on success */
+int raw_log_ack(raw_log_t *log, const raw_log_pos_t *start, const raw_log_pos_t *end);
+
+void raw_log_get_stats(const raw_log_t *log, raw_log_stats_t *stats);
+
+#endif
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "seg_log.h"
+
+#define STATE_MAGIC 0x474F4C53 //"SLOG"
+
+typedef struct {
+	uint32_t magic;
+	uint32_t nsegs;
+	uint32_t gen; //the newest valid state is loaded
+	uint32_t head;
+	uint32_t tail;
+	uint32_t evicted_segments;
+	uint32_t evicted_bytes;
+	uint32_t check; //check word of the fields above
+} seg_log_state_t;
+
+#define SLOT(log, seq) ((seq) % (log)->nsegs)
+
+static void seg_path(const seg_log_t *log, uint32_t seq, char *path)
+{
+	snprintf(path, SEG_LOG_PATH_LEN, "%s%02u.log", log->prefix, (unsigned)SLOT(log, seq));
+}
+
+static void state_path(const seg_log_t *log, uint32_t gen, char *path)
+{
+	snprintf(path, SEG_LOG_PATH_LEN, "%s.%u.idx", log->prefix, (unsigned)(gen % 2));
+}
+
+static uint32_t check_word(const seg_log_state_t *s)
+{
+	const uint32_t *w = (const uint32_t *)s;
+	uint32_t c = 0xA5A5A5A5;
+	int i;
+
+	for(i=0; i<offsetof(seg_log_state_t, check)/sizeof(uint32_t); i++)
+		c = (c << 5 | c >> 27) ^ w[i];
+
+	return c;
+}
+
+static uint32_t file_size(const char *path)
+{
+	struct stat st;
+
+	if(stat(path, &st) != 0)
+		return 0;
+	return st.st_size;
+}
+
+static int truncate_file(const char *path)
+{
+	FILE *fp = fopen(path, "wb");
+
+	if(fp == NULL)
+		return -1;
+	fclose(fp);
+	return 0;
+}
+
+static int save_state(seg_log_t *log)
+{
+	seg_log_state_t s;
+	char path[SEG_LOG_PATH_LEN];
+	FILE *fp;
+	int ret;
+
+	/* the other file keeps the previous state until this one is complete */
+	s.magic = STATE_MAGIC;
+	s.nsegs = log->nsegs;
+	s.gen = log->gen + 1;
+	s.head = log->head;
+	s.tail = log->tail;
+	s.evicted_segments = log->stats.evicted_segments;
+	s.evicted_bytes = log->stats.evicted_bytes;
+	s.check = check_word(&s);
+
+	state_path(log, s.gen, path);
+	fp = fopen(path, "wb");
+	if(fp == NULL)
+		return -1;
+	ret = fwrite(&s, sizeof(s), 1, fp) == 1 ? 0 : -1;
+	if(fclose(fp) != 0)
+		ret = -1;
+	if(ret == 0)
+		log->gen = s.gen;
+
+	return ret;
+}
+
+static bool read_state(const seg_log_t *log, uint32_t gen, seg_log_state_t *s)
+{
+	char path[SEG_LOG_PATH_LEN];
+	FILE *fp;
+	bool ok;
+
+	state_path(log, gen, path);
+	fp = fopen(path, "rb");
+	if(fp == NULL)
+		return false;
+	ok = fread(s, sizeof(*s), 1, fp) == 1;
+	fclose(fp);
+
+	/* a different number of segments changes the file of every sequence number: not usable */
+	return ok && s->magic == STATE_MAGIC && s->check == check_word(s) && s->gen % 2 == gen &&
+			s->nsegs == log->nsegs && s->head - s->tail < log->nsegs;
+}
+
+static bool load_state(seg_log_t *log)
+{
+	seg_log_state_t s[2];
+	bool ok[2];
+	int i;
+
+	ok[0] = read_state(log, 0, &s[0]);
+	ok[1] = read_state(log, 1, &s[1]);
+	if(!ok[0] && !ok[1])
+		return false;
+	i = !ok[0] || (ok[1] && (int32_t)(s[1].gen - s[0].gen) > 0);
+
+	log->gen = s[i].gen;
+	log->head = s[i].head;
+	log->tail = s[i].tail;
+	log->stats.evicted_segments = s[i].evicted_segments;
+	log->stats.evicted_bytes = s[i].evicted_bytes;
+
+	return true;
+}
+
+static void rebuild_state(seg_log_t *log)
+{
+	/* the segments of the ring are in consecutive slots, tail..head, the others have been removed:
+	 * the ring starts after a missing slot. If every slot is there the ring was full and the head
+	 * is the empty file (truncated at the rotation) or else the file written last (mtime).
+	 * The eviction counters start again */
+	char path[SEG_LOG_PATH_LEN];
+	bool found[SEG_LOG_MAX];
+	struct stat st;
+	time_t newest = 0;
+	int i, n = 0, start = -1, empty = -1, len = 0;
+
+	for(i=0; i<log->nsegs; i++){
+		seg_path(log, i, path);
+		found[i] = stat(path, &st) == 0;
+		if(!found[i])
+			continue;
+		if(st.st_size == 0)
+			empty = i;
+		if(n++ == 0 || st.st_mtime >= newest){
+			newest = st.st_mtime;
+			start = (i + 1) % log->nsegs; //the tail if the ring is full
+		}
+	}
+	if(n == 0)
+		return;
+	if(empty >= 0)
+		start = (empty + 1) % log->nsegs;
+
+	for(i=0; n < log->nsegs && i < log->nsegs; i++){
+		if(!found[i] && found[(i + 1) % log->nsegs]){
+			start = (i + 1) % log->nsegs;
+			break;
+		}
+	}
+	while(len < n && found[(start + len) % log->nsegs])
+		len++;
+
+	for(i=len; i<log->nsegs; i++){ //out of the ring: left by an interrupted eviction
+		if(found[(start + i) % log->nsegs]){
+			seg_path(log, start + i, path);
+			remove(path);
+		}
+	}
+
+	log->tail = start;
+	log->head = start + len - 1; //the last one is closed by seg_log_init if it is not empty
+}
+
+static void drop_tail(seg_log_t *log, bool sent)
+{
+	char path[SEG_LOG_PATH_LEN];
+	uint32_t size = log->size[SLOT(log, log->tail)];
+
+	seg_path(log, log->tail, path);
+	remove(path);
+
+	if(sent){
+		log->stats.sent_segments++;
+		log->stats.sent_bytes += size;
+	}
+	else{
+		log->stats.evicted_segments++;
+		log->stats.evicted_bytes += size;
+	}
+	log->stats.segments--;
+	log->stats.bytes -= size;
+	log->tail++;
+}
+
+static void close_head(seg_log_t *log)
+{
+	char path[SEG_LOG_PATH_LEN];
+	uint32_t size;
+
+	seg_path(log, log->head, path);
+	size = file_size(path);
+
+	log->size[SLOT(log, log->head)] = size;
+	log->stats.segments++;
+	log->stats.bytes += size;
+	log->head++;
+
+	/* oldest first: keep a slot for the head and stay in the budget (the newest segment is always kept) */
+	while(log->head - log->tail > log->nsegs - 1 || (log->stats.bytes > log->budget && log->head - log->tail > 1))
+		drop_tail(log, false);
+}
+
+int seg_log_init(seg_log_t *log, const char *prefix, int nsegs, size_t budget)
+{
+	char path[SEG_LOG_PATH_LEN];
+	uint32_t seq;
+
+	memset(log, 0, sizeof(*log));
+	strncpy(log->prefix, prefix, sizeof(log->prefix)-1);
+	log->nsegs = nsegs < 2 ? 2 : nsegs > SEG_LOG_MAX ? SEG_LOG_MAX : nsegs;
+	log->budget = budget;
+
+	if(!load_state(log)) //no state file (or both damaged): keep the segments found
+		rebuild_state(log);
+
+	/* a previous state may still list the segments removed before the last one was written */
+	for(; log->tail!=log->head; log->tail++){
+		seg_path(log, log->tail, path);
+		if(file_size(path) > 0)
+			break;
+		remove(path);
+	}
+
+	for(seq=log->tail; seq!=log->head; seq++){
+		seg_path(log, seq, path);
+		log->size[SLOT(log, seq)] = file_size(path);
+		log->stats.segments++;
+		log->stats.bytes += log->size[SLOT(log, seq)];
+	}
+
+	seg_log_head_path(log, path);
+	if(file_size(path) > 0) //written before the reboot: it is a closed segment now
+		close_head(log);
+
+	seg_log_head_path(log, path);
+	if(truncate_file(path) != 0)
+		return -1;
+
+	return save_state(log);
+}
+
+void seg_log_head_path(const seg_log_t *log, char *path)
+{
+	seg_path(log, log->head, path);
+}
+
+int seg_log_rotate(seg_log_t *log)
+{
+	char path[SEG_LOG_PATH_LEN];
+
+	close_head(log);
+
+	seg_log_head_path(log, path);
+	if(truncate_file(path) != 0)
+		return -1;
+
+	return save_state(log);
+}
+
+bool seg_log_peek(const seg_log_t *log, char *path, uint32_t *seq)
+{
+	if(log->tail == log->head)
+		return false;
+
+	seg_path(log, log->tail, path);
+	*seq = log->tail;
+	return true;
+}
+
+int seg_log_pop(seg_log_t *log, uint32_t seq)
+{
+	if(log->tail == log->head || log->tail != seq)
+		return 1;
+
+	drop_tail(log, true);
+
+	return save_state(log);
+}
+
+void seg_log_drained(seg_log_t *log, uint32_t bytes, uint32_t ms)
+{
+	log->stats.drain_rate = (uint64_t)bytes * 1000 / (ms > 0 ? ms : 1);
+}
+
+void seg_log_get_stats(const seg_log_t *log, seg_log_stats_t *stats)
+{
+	*stats = log->stats;
+}
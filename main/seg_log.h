@@ -0,0 +1,65 @@
+#ifndef SEG_LOG_H
+#define SEG_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Store-and-forward log of window files: a ring of nsegs segment files on SPIFFS, one per window.
+ * Segments are numbered with a free-running sequence number (the file is prefix + seq % nsegs):
+ * head is the segment being written, tail..head-1 are the closed segments waiting to be sent.
+ * When the ring is full (nsegs-1 closed segments) or the closed segments exceed the byte budget,
+ * the oldest ones are evicted. head, tail and the eviction counters are saved at every change,
+ * alternately in two state files with a generation number and a check word: a reset while one
+ * is written leaves the other one, so the backlog survives a reboot. If no state file can be read
+ * the ring is rebuilt from the segment files found on SPIFFS.
+ * Not thread safe: the caller must serialize the calls. */
+
+#define SEG_LOG_MAX 64 //max number of segments
+#define SEG_LOG_PATH_LEN 32
+
+typedef struct {
+	uint32_t segments; //closed segments waiting to be sent (backlog depth)
+	uint32_t bytes; //bytes of the closed segments waiting to be sent
+	uint32_t sent_segments; //segments sent since boot
+	uint32_t sent_bytes;
+	uint32_t evicted_segments; //segments evicted before being sent (saved in the state file)
+	uint32_t evicted_bytes;
+	uint32_t drain_rate; //bytes per second of the last drain
+} seg_log_stats_t;
+
+typedef struct {
+	char prefix[SEG_LOG_PATH_LEN-8]; //path of the segments without the suffix
+	int nsegs;
+	size_t budget; //max bytes of the closed segments
+	uint32_t head; //segment being written
+	uint32_t tail; //oldest segment not sent
+	uint32_t gen; //generation of the last state saved (state file gen % 2)
+	uint32_t size[SEG_LOG_MAX]; //bytes of the closed segments, indexed by slot
+	seg_log_stats_t stats;
+} seg_log_t;
+
+/* Load the newest valid state file (or rebuild the ring from the segment files) and recover the
+ * segments: the segment that was being written at the reboot is closed. Return 0 on success */
+int seg_log_init(seg_log_t *log, const char *prefix, int nsegs, size_t budget);
+
+/* Path of the segment being written */
+void seg_log_head_path(const seg_log_t *log, char *path);
+
+/* Close the segment being written and start the next one (empty), evicting the oldest
+ * segments if needed. Return 0 on success */
+int seg_log_rotate(seg_log_t *log);
+
+/* Path and sequence number of the oldest segment waiting to be sent, false if the backlog is empty */
+bool seg_log_peek(const seg_log_t *log, char *path, uint32_t *seq);
+
+/* The segment seq (returned by seg_log_peek) has been sent: remove it. Return 0 on success,
+ * 1 if it has been evicted meanwhile (nothing is done), -1 if the state file can not be written */
+int seg_log_pop(seg_log_t *log, uint32_t seq);
+
+/* Account a drain of the backlog: bytes sent in ms milliseconds */
+void seg_log_drained(seg_log_t *log, uint32_t bytes, uint32_t ms);
+
+void seg_log_get_stats(const seg_log_t *log, seg_log_stats_t *stats);
+
+#endif
@@ -0,0 +1,2 @@
+/* Subset of sdkconfig used by the packet path on the host */
+#define CONFIG_DIGEST_MD5 1
@@ -0,0 +1,506 @@
+/* Host test and benchmark of the packet path of the processing task. Probe requests with the
+ * IEs in different orders are parsed by ie_parse_probe_req and by the fixed offset functions it
+ * replaced (get_ssid, get_ht_capabilites_info), comparing the HT capabilities found and the CPU
+ * cycles. Every prefix of each frame is parsed from a buffer of its exact size, checking that no
+ * view points past its end. Then a frame is decoded by pkt_decode and by the sprintf/sscanf path
+ * of process_pkt it replaced (get_hash, get_sn), checking that they find the same fields. Last,
+ * md5, xxh64 and siphash24 are checked against their reference vectors and the bytes per cycle of
+ * each digest are measured, with the md5 before the streaming API (md5_old.c) as the baseline.
+ * Usage: pkt_bench [iterations] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_UNIT "cyc"
+#else
+#define CYCLE_UNIT "ns"
+#endif
+
+#include "ie_parser.h"
+#include "pkt_decode.h"
+#include "md5.h"
+#include "digest.h"
+
+#define SSID_MAX_LEN (32+1)
+#define MD5_LEN (32+1)
+#define FRAME_MAX 256
+#define FCS_LEN 4
+#define RUNS 20 //best of RUNS runs of the iterations
+
+typedef struct {
+	const char *name;
+	const uint8_t *ies[8]; //IEs in order of appearance, NULL terminated
+	uint8_t frame[FRAME_MAX+FCS_LEN];
+	int len; //without FCS
+} test_frame_t;
+
+static const uint8_t ie_ssid[] = { IE_ID_SSID, 7, 'e', 'd', 'u', 'r', 'o', 'a', 'm' };
+static const uint8_t ie_rates[] = { IE_ID_RATES, 8, 0x82, 0x84, 0x8b, 0x96, 0x0c, 0x12, 0x18, 0x24 };
+static const uint8_t ie_ext_rates[] = { IE_ID_EXT_RATES, 4, 0x30, 0x48, 0x60, 0x6c };
+static const uint8_t ie_ds[] = { IE_ID_DS_PARAMS, 1, 6 };
+static const uint8_t ie_ht[] = { IE_ID_HT_CAP, 26, 0x2d, 0x01, 0x17, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+static const uint8_t ie_ext_cap[] = { IE_ID_EXT_CAP, 8, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x40 };
+static const uint8_t ie_vendor[] = { IE_ID_VENDOR, 7, 0x00, 0x50, 0xf2, 0x08, 0x00, 0x10, 0x00 };
+
+static test_frame_t frames[] = {
+	{ "rates, ext, HT (assumed)", { ie_ssid, ie_rates, ie_ext_rates, ie_ht, ie_ext_cap, ie_vendor } },
+	{ "rates, DS, ext, HT", { ie_ssid, ie_rates, ie_ds, ie_ext_rates, ie_ht, ie_ext_cap, ie_vendor } },
+	{ "rates, ext, DS, HT", { ie_ssid, ie_rates, ie_ext_rates, ie_ds, ie_ht, ie_ext_cap, ie_vendor } },
+};
+
+#define FRAMES (sizeof(frames)/sizeof(frames[0]))
+
+/* RFC 1321 */
+static const struct {
+	const char *msg;
+	const char *md5;
+} md5_vectors[] = {
+	{ "", "d41d8cd98f00b204e9800998ecf8427e" },
+	{ "a", "0cc175b9c0f1b6a831c399e269772661" },
+	{ "abc", "900150983cd24fb0d6963f7d28e17f72" },
+	{ "message digest", "f96b697d7cb7938d525a2f31aaf161d0" },
+	{ "abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b" },
+	{ "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "d174ab98d277d9f5a5611c2c9f419d9f" },
+	{ "12345678901234567890123456789012345678901234567890123456789012345678901234567890", "57edf4a22be3c955ac49da2e2107b67a" },
+};
+
+/* SipHash-2-4 of the reference implementation: key 00..0f, message 00..n-1 for n = 0..63 */
+static const uint64_t siphash_vectors[64] = {
+	0x726fdb47dd0e0e31ULL, 0x74f839c593dc67fdULL, 0x0d6c8009d9a94f5aULL, 0x85676696d7fb7e2dULL,
+	0xcf2794e0277187b7ULL, 0x18765564cd99a68dULL, 0xcbc9466e58fee3ceULL, 0xab0200f58b01d137ULL,
+	0x93f5f5799a932462ULL, 0x9e0082df0ba9e4b0ULL, 0x7a5dbbc594ddb9f3ULL, 0xf4b32f46226bada7ULL,
+	0x751e8fbc860ee5fbULL, 0x14ea5627c0843d90ULL, 0xf723ca908e7af2eeULL, 0xa129ca6149be45e5ULL,
+	0x3f2acc7f57c29bdbULL, 0x699ae9f52cbe4794ULL, 0x4bc1b3f0968dd39cULL, 0xbb6dc91da77961bdULL,
+	0xbed65cf21aa2ee98ULL, 0xd0f2cbb02e3b67c7ULL, 0x93536795e3a33e88ULL, 0xa80c038ccd5ccec8ULL,
+	0xb8ad50c6f649af94ULL, 0xbce192de8a85b8eaULL, 0x17d835b85bbb15f3ULL, 0x2f2e6163076bcfadULL,
+	0xde4daaaca71dc9a5ULL, 0xa6a2506687956571ULL, 0xad87a3535c49ef28ULL, 0x32d892fad841c342ULL,
+	0x7127512f72f27cceULL, 0xa7f32346f95978e3ULL, 0x12e0b01abb051238ULL, 0x15e034d40fa197aeULL,
+	0x314dffbe0815a3b4ULL, 0x027990f029623981ULL, 0xcadcd4e59ef40c4dULL, 0x9abfd8766a33735cULL,
+	0x0e3ea96b5304a7d0ULL, 0xad0c42d6fc585992ULL, 0x187306c89bc215a9ULL, 0xd4a60abcf3792b95ULL,
+	0xf935451de4f21df2ULL, 0xa9538f0419755787ULL, 0xdb9acddff56ca510ULL, 0xd06c98cd5c0975ebULL,
+	0xe612a3cb9ecba951ULL, 0xc766e62cfcadaf96ULL, 0xee64435a9752fe72ULL, 0xa192d576b245165aULL,
+	0x0a8787bf8ecb74b2ULL, 0x81b3e73d20b49b6fULL, 0x7fa8220ba3b2eceaULL, 0x245731c13ca42499ULL,
+	0xb78dbfaf3a8d83bdULL, 0xea1ad565322a1a0bULL, 0x60e61c23a3795013ULL, 0x6606d7e446282b93ULL,
+	0x6ca4ecb15c5f91e1ULL, 0x9f626da15c9625f3ULL, 0xe51b38608ef25f57ULL, 0x958a324ceb064572ULL,
+};
+
+/* xxHash64 of the reference implementation, message (i*7+1) & 0xff for i = 0..len-1 */
+static const struct {
+	int len;
+	uint64_t seed;
+	uint64_t hash;
+} xxh64_vectors[] = {
+	{ 0, 0x0ULL, 0xef46db3751d8e999ULL },
+	{ 1, 0x0ULL, 0x8a4127811b21e730ULL },
+	{ 3, 0x0ULL, 0xb6e6c910c2fd373aULL },
+	{ 4, 0x0ULL, 0x22eda2cf6af4c124ULL },
+	{ 7, 0x0ULL, 0x34084d91a233a751ULL },
+	{ 8, 0x0ULL, 0xc6f1803a5e0b3222ULL },
+	{ 15, 0x0ULL, 0x514c6f58d37ce6f1ULL },
+	{ 16, 0x0ULL, 0xafe8f989a0735a8eULL },
+	{ 31, 0x0ULL, 0x6ab1c40e29f50073ULL },
+	{ 32, 0x0ULL, 0x5a0756fbe9ecd3d1ULL },
+	{ 33, 0x0ULL, 0xdc50cdc37bb9c183ULL },
+	{ 63, 0x0ULL, 0x10dd94885c71894aULL },
+	{ 64, 0x0ULL, 0x90083da9cdb9d795ULL },
+	{ 100, 0x0ULL, 0xd248bfc5208b0b16ULL },
+	{ 255, 0x0ULL, 0x5da8139d7acf3995ULL },
+	{ 0, 0x9e3779b1ULL, 0xac75fda2929b17efULL },
+	{ 1, 0x9e3779b1ULL, 0x211ae13247ce135fULL },
+	{ 3, 0x9e3779b1ULL, 0x0ccdb2c7c2850613ULL },
+	{ 4, 0x9e3779b1ULL, 0x446be1f3228ed3c3ULL },
+	{ 7, 0x9e3779b1ULL, 0x5410e6030daf84b3ULL },
+	{ 8, 0x9e3779b1ULL, 0xb872c2fb02e71655ULL },
+	{ 15, 0x9e3779b1ULL, 0x03a2931c2f195ce5ULL },
+	{ 16, 0x9e3779b1ULL, 0x170f6a9cdd26fb1cULL },
+	{ 31, 0x9e3779b1ULL, 0xbb6d29b38190a8ffULL },
+	{ 32, 0x9e3779b1ULL, 0x0518cc93bc88a896ULL },
+	{ 33, 0x9e3779b1ULL, 0x157ce0e9c56b5988ULL },
+	{ 63, 0x9e3779b1ULL, 0x20ab6c1bad83813fULL },
+	{ 64, 0x9e3779b1ULL, 0xa2fe2536872fcb89ULL },
+	{ 100, 0x9e3779b1ULL, 0xbccf07579af475cdULL },
+	{ 255, 0x9e3779b1ULL, 0x23d5f0be1cf55f03ULL },
+};
+
+static const int digest_sizes[] = { 80, 256, 512, 1500 };
+
+void md5_old(const uint8_t *initial_msg, size_t initial_len, uint8_t *digest);
+
+static volatile uint32_t sink; //keeps the results of the benchmarked calls alive
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+static void build_frame(test_frame_t *f)
+{
+	static const uint8_t hdr[IE_MGMT_HDR_LEN] = {
+		0x40, 0x00, 0x00, 0x00, //probe request, duration
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, //destination
+		0xda, 0xa1, 0x19, 0x12, 0x34, 0x56, //source
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, //BSSID
+		0x50, 0x3a //sequence 0x3a5, fragment 0
+	};
+	int i;
+
+	memcpy(f->frame, hdr, sizeof(hdr));
+	f->len = sizeof(hdr);
+	for(i=0; f->ies[i] != NULL; i++){
+		memcpy(f->frame+f->len, f->ies[i], 2+f->ies[i][1]);
+		f->len += 2+f->ies[i][1];
+	}
+	memset(f->frame+f->len, 0xa5, FCS_LEN);
+}
+
+/* --- fixed offset functions of main.c before the parser --- */
+
+static void get_ssid(unsigned char *data, char ssid[SSID_MAX_LEN], uint8_t ssid_len)
+{
+	int i, j;
+
+	for(i=26, j=0; i<26+ssid_len; i++, j++){
+		ssid[j] = data[i];
+	}
+
+	ssid[j] = '\0';
+}
+
+static uint16_t get_ht_capabilites_info(unsigned char *data, int pkt_len, int ssid_len)
+{
+	int ht_start = 25+ssid_len+19;
+
+	if(data[ht_start-1]>0 && ht_start<pkt_len-4){ //HT capabilities is present
+		if(data[ht_start-4] == 1) //DSSS parameter is set -> need to shift of three bytes
+			return (data[ht_start+3] << 8) | data[ht_start+1+3];
+		else
+			return (data[ht_start] << 8) | data[ht_start+1];
+	}
+
+	return 0;
+}
+
+static void get_hash(unsigned char *data, int len_res, uint8_t pkt_hash[PROBE_DIGEST_LEN], char hash[MD5_LEN])
+{
+	md5((uint8_t *)data, len_res, pkt_hash);
+
+	sprintf(hash, "%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x",
+			pkt_hash[0], pkt_hash[1], pkt_hash[2], pkt_hash[3], pkt_hash[4], pkt_hash[5],
+			pkt_hash[6], pkt_hash[7], pkt_hash[8], pkt_hash[9], pkt_hash[10], pkt_hash[11],
+			pkt_hash[12], pkt_hash[13], pkt_hash[14], pkt_hash[15]);
+}
+
+static int get_sn(unsigned char *data)
+{
+	int sn;
+	char num[5] = "\0";
+
+	sprintf(num, "%02x%02x", data[22], data[23]);
+	sscanf(num, "%x", &sn);
+
+	return sn;
+}
+
+/* --- ie_parser --- */
+
+static int view_in(const ie_view_t *v, const uint8_t *frame, int len)
+{
+	return v->data == NULL || (v->data >= frame + IE_MGMT_HDR_LEN && v->data + v->len <= frame + len);
+}
+
+static int check_prefixes(const test_frame_t *f)
+{
+	/* each prefix in a buffer of its size: a read past it is caught by the sanitizers */
+	probe_ies_t ies, full;
+	uint8_t *buf;
+	int len, i, n, ok = 1;
+
+	ie_parse_probe_req(f->frame, f->len, &full);
+	if(full.truncated || full.ht_cap.data == NULL || full.ssid.len != ie_ssid[1] || full.ie_count != full.vendor_count + 5 + (full.ds_params.data != NULL)){
+		printf("%s: parsed wrong\n", f->name);
+		return -1;
+	}
+
+	for(len=0; len<=f->len && ok; len++){
+		buf = malloc(len > 0 ? len : 1);
+		memcpy(buf, f->frame, len);
+		n = ie_parse_probe_req(buf, len, &ies);
+		if(len < IE_MGMT_HDR_LEN)
+			ok = n == -1;
+		else{
+			ok = n == ies.ie_count && n <= full.ie_count && (len < f->len || !ies.truncated) &&
+					view_in(&ies.ssid, buf, len) && view_in(&ies.rates, buf, len) && view_in(&ies.ext_rates, buf, len) &&
+					view_in(&ies.ds_params, buf, len) && view_in(&ies.ht_cap, buf, len) &&
+					view_in(&ies.vht_cap, buf, len) && view_in(&ies.ext_cap, buf, len);
+			for(i=0; i<ies.vendor_count && i<IE_VENDOR_MAX; i++)
+				ok = ok && view_in(&ies.vendor[i], buf, len);
+		}
+		free(buf);
+	}
+	if(!ok){
+		printf("%s: prefix of %d bytes parsed wrong\n", f->name, len-1);
+		return -1;
+	}
+
+	return 0;
+}
+
+static double bench_old(test_frame_t *f, int iterations)
+{
+	char ssid[SSID_MAX_LEN];
+	uint64_t t, best = UINT64_MAX;
+	int run, i;
+
+	for(run=0; run<RUNS; run++){
+		t = cycles();
+		for(i=0; i<iterations; i++){
+			get_ssid(f->frame, ssid, f->frame[25]);
+			sink += get_ht_capabilites_info(f->frame, f->len+FCS_LEN, f->frame[25]) + ssid[0];
+			__asm__ volatile("" ::: "memory");
+		}
+		t = cycles() - t;
+		if(t < best)
+			best = t;
+	}
+
+	return (double)best / iterations;
+}
+
+static double bench_parser(test_frame_t *f, int iterations)
+{
+	probe_ies_t ies;
+	uint64_t t, best = UINT64_MAX;
+	int run, i;
+
+	for(run=0; run<RUNS; run++){
+		t = cycles();
+		for(i=0; i<iterations; i++){
+			ie_parse_probe_req(f->frame, f->len, &ies);
+			sink += ie_ht_cap_info(&ies) + ies.ssid.len;
+			__asm__ volatile("" ::: "memory");
+		}
+		t = cycles() - t;
+		if(t < best)
+			best = t;
+	}
+
+	return (double)best / iterations;
+}
+
+static int bench_ie_parser(int iterations)
+{
+	probe_ies_t ies;
+	uint16_t old_htci, htci;
+	unsigned k;
+
+	printf("ie_parser: %d iterations, best of %d runs\n", iterations, RUNS);
+	printf("  %-26s %5s %12s %12s   %s\n", "IE layout", "bytes", "old fns", "parser", "old HT caps");
+	for(k=0; k<FRAMES; k++){
+		build_frame(&frames[k]);
+		if(check_prefixes(&frames[k]) != 0)
+			return -1;
+
+		ie_parse_probe_req(frames[k].frame, frames[k].len, &ies);
+		htci = (ies.ht_cap.data[0] << 8) | ies.ht_cap.data[1]; //byte order of get_ht_capabilites_info
+		old_htci = get_ht_capabilites_info(frames[k].frame, frames[k].len+FCS_LEN, frames[k].frame[25]);
+		printf("  %-26s %5d %8.1f %s %8.1f %s   ", frames[k].name, frames[k].len,
+				bench_old(&frames[k], iterations), CYCLE_UNIT, bench_parser(&frames[k], iterations), CYCLE_UNIT);
+		if(old_htci == htci)
+			printf("correct\n");
+		else
+			printf("wrong (%04x)\n", old_htci);
+	}
+	printf("  every prefix of the frames parsed within its bounds\n");
+
+	return 0;
+}
+
+/* --- pkt_decode --- */
+
+static void decode_old(test_frame_t *f, char ssid[SSID_MAX_LEN], uint8_t digest[PROBE_DIGEST_LEN], int *sn, uint16_t *htci)
+{
+	/* the fields found by process_pkt before pkt_decode, text included */
+	char hash[MD5_LEN];
+	probe_ies_t ies;
+	uint8_t ssid_len;
+
+	ie_parse_probe_req(f->frame, f->len, &ies);
+	ssid_len = ies.ssid.len < PROBE_SSID_MAX_LEN ? ies.ssid.len : PROBE_SSID_MAX_LEN;
+	if(ssid_len > 0)
+		memcpy(ssid, ies.ssid.data, ssid_len);
+	ssid[ssid_len] = '\0';
+	get_hash(f->frame, f->len, digest, hash);
+	*sn = get_sn(f->frame);
+	*htci = ie_ht_cap_info(&ies);
+}
+
+static int bench_pkt_decode(int iterations)
+{
+	test_frame_t *f = &frames[1];
+	char ssid[SSID_MAX_LEN];
+	uint8_t digest[PROBE_DIGEST_LEN];
+	uint16_t htci;
+	pkt_info_t info;
+	uint64_t t, best[3] = { UINT64_MAX, UINT64_MAX, UINT64_MAX };
+	int run, i, sn, m;
+
+	decode_old(f, ssid, digest, &sn, &htci);
+	if(pkt_decode(f->frame, f->len, &info) != 0 || memcmp(info.digest, digest, PROBE_DIGEST_LEN) != 0 ||
+			info.htci != htci || info.sn != 0x3a5 || info.frag != 0 || memcmp(info.sa, f->frame+10, 6) != 0){
+		printf("pkt_decode: fields decoded wrong\n");
+		return -1;
+	}
+
+	for(run=0; run<RUNS; run++){
+		for(m=0; m<3; m++){
+			t = cycles();
+			for(i=0; i<iterations; i++){
+				if(m == 0)
+					decode_old(f, ssid, digest, &sn, &htci);
+				else if(m == 1)
+					pkt_decode(f->frame, f->len, &info);
+				else
+					md5(f->frame, f->len, info.digest);
+				sink += digest[0] + info.digest[0];
+				__asm__ volatile("" ::: "memory");
+			}
+			t = cycles() - t;
+			if(t < best[m])
+				best[m] = t;
+		}
+	}
+
+	printf("pkt_decode: %d byte frame, %d iterations, best of %d runs\n", f->len, iterations, RUNS);
+	printf("  sprintf/sscanf (get_hash, get_sn) %8.1f %s\n", (double)best[0] / iterations, CYCLE_UNIT);
+	printf("  pkt_decode                        %8.1f %s\n", (double)best[1] / iterations, CYCLE_UNIT);
+	printf("  md5 of the frame, in both         %8.1f %s\n", (double)best[2] / iterations, CYCLE_UNIT);
+
+	return 0;
+}
+
+/* --- digests --- */
+
+static int check_digests(void)
+{
+	uint8_t key[16], msg[300], d[16], ref[16];
+	char hex[MD5_LEN];
+	md5_ctx_t ctx;
+	unsigned i;
+	int n, k;
+
+	for(i=0; i<sizeof(md5_vectors)/sizeof(md5_vectors[0]); i++){
+		md5((const uint8_t *)md5_vectors[i].msg, strlen(md5_vectors[i].msg), d);
+		for(k=0; k<16; k++)
+			sprintf(hex+2*k, "%02x", d[k]);
+		if(strcmp(hex, md5_vectors[i].md5) != 0){
+			printf("md5 of \"%s\" is %s\n", md5_vectors[i].msg, hex);
+			return -1;
+		}
+	}
+
+	for(i=0; i<sizeof(msg); i++)
+		msg[i] = i * 7 + 1;
+	for(n=0; n<(int)sizeof(msg); n++){ //split updates and the old md5 give the same digest
+		md5_old(msg, n, ref);
+		md5_init(&ctx);
+		md5_update(&ctx, msg, n/3);
+		md5_update(&ctx, msg+n/3, n/2-n/3);
+		md5_update(&ctx, msg+n/2, n-n/2);
+		md5_final(&ctx, d);
+		if(memcmp(d, ref, 16) != 0){
+			printf("md5 of %d bytes differs from the old one\n", n);
+			return -1;
+		}
+	}
+
+	for(i=0; i<sizeof(xxh64_vectors)/sizeof(xxh64_vectors[0]); i++){
+		if(xxh64(msg, xxh64_vectors[i].len, xxh64_vectors[i].seed) != xxh64_vectors[i].hash){
+			printf("xxh64 of %d bytes (seed %llx) is wrong\n", xxh64_vectors[i].len, (unsigned long long)xxh64_vectors[i].seed);
+			return -1;
+		}
+	}
+
+	for(i=0; i<sizeof(key); i++)
+		key[i] = i;
+	for(i=0; i<64; i++)
+		msg[i] = i;
+	for(n=0; n<64; n++){
+		if(siphash24(key, msg, n) != siphash_vectors[n]){
+			printf("siphash24 of %d bytes is wrong\n", n);
+			return -1;
+		}
+	}
+
+	printf("digests: md5, xxh64 and siphash24 match the reference vectors\n");
+	return 0;
+}
+
+static double bench_digest(int alg, const uint8_t *data, int len, int iterations)
+{
+	static const uint8_t key[16] = { 0 };
+	uint8_t d[16];
+	uint64_t t, best = UINT64_MAX;
+	int run, i;
+
+	for(run=0; run<RUNS; run++){
+		t = cycles();
+		for(i=0; i<iterations; i++){
+			switch(alg){
+				case 0: md5_old(data, len, d); break;
+				case 1: md5(data, len, d); break;
+				case 2: sink += xxh64(data, len, 0); break;
+				default: sink += siphash24(key, data, len); break;
+			}
+			sink += d[0];
+			__asm__ volatile("" ::: "memory");
+		}
+		t = cycles() - t;
+		if(t < best)
+			best = t;
+	}
+
+	return (double)len * iterations / best;
+}
+
+static int bench_digests(int iterations)
+{
+	uint8_t data[1500];
+	unsigned i;
+
+	if(check_digests() != 0)
+		return -1;
+
+	for(i=0; i<sizeof(data); i++)
+		data[i] = i * 31 + 7;
+	printf("digests: %d iterations, best of %d runs, bytes per %s\n", iterations, RUNS, CYCLE_UNIT);
+	printf("  %5s %10s %10s %10s %10s\n", "bytes", "md5 old", "md5", "xxh64", "siphash");
+	for(i=0; i<sizeof(digest_sizes)/sizeof(digest_sizes[0]); i++){
+		printf("  %5d %10.3f %10.3f %10.2f %10.2f\n", digest_sizes[i],
+				bench_digest(0, data, digest_sizes[i], iterations), bench_digest(1, data, digest_sizes[i], iterations),
+				bench_digest(2, data, digest_sizes[i], iterations), bench_digest(3, data, digest_sizes[i], iterations));
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+
+	if(bench_ie_parser(iterations) != 0 || bench_pkt_decode(iterations) != 0 || bench_digests(iterations / 50) != 0)
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,203 @@
+#
+# Decoder of the binary windows written by the sniffer (window files in
+# SPIFFS or in the raw partition, MQTT payloads), see main/probe_record.h
+# and main/probe_codec.h for the format.
+#
+#   from probe_codec import read_window
+#   start_ts, last, records = read_window(payload)
+#
+# Every record is a dict: mac, macs, digest, fp, first, last (timestamps),
+# count, rssi (min, mean, max), sn (first, last), htci, channels, ssids.
+
+import struct
+
+HDR = struct.Struct('<2sBBi')
+FRAME_LEN = struct.Struct('<H')
+
+MAGIC = b'PR'
+VERSION = 6
+FLAG_LAST = 0x01
+DIGESTS = {0: 'md5', 1: 'xxh64', 2: 'siphash'}  # flags bits 1-2
+DIGEST_BYTES = {0: 16, 1: 8, 2: 8}  # significant bytes of the digests
+DIGEST_LEN = 16
+
+DICT_MAX = 32
+TAG_MAC = 0x01
+TAG_OUI = 0x02
+TAG_FP = 0x04
+TAG_MACS = 0x08
+TAG_HTCI = 0x10
+TAG_SSIDS_SHIFT = 5
+
+
+class FormatError(Exception):
+    pass
+
+
+class _Frame(object):
+    """Cursor on a frame with its dictionaries (empty at the start of every frame)"""
+
+    def __init__(self, data):
+        self.data = bytearray(data)
+        self.off = 0
+        self.macs = []
+        self.ouis = []
+        self.fps = []
+        self.ssids = []
+        self.mean = 0
+
+    def take(self, n):
+        if self.off + n > len(self.data):
+            raise FormatError('truncated record')
+        b = self.data[self.off:self.off + n]
+        self.off += n
+        return bytes(b)
+
+    def byte(self):
+        return bytearray(self.take(1))[0]
+
+    def varint(self):
+        v = shift = 0
+        while True:
+            b = self.byte()
+            v |= (b & 0x7f) << shift
+            if b < 0x80:
+                return v
+            shift += 7
+            if shift > 28:
+                raise FormatError('bad varint')
+
+    def ref(self, table, name, i=None):
+        if i is None:
+            i = self.varint()
+        if i >= len(table):
+            raise FormatError('bad %s index %d' % (name, i))
+        return table[i]
+
+    def done(self):
+        return self.off >= len(self.data)
+
+
+def _int8(v):
+    v &= 0xff
+    return v - 256 if v > 127 else v
+
+
+def _zigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def decode_record(f, digest_bytes):
+    """Decode the record at the cursor of frame f, updating its dictionaries"""
+    tag = f.byte()
+
+    if tag & TAG_MAC:
+        mac = f.ref(f.macs, 'address')
+    else:
+        if tag & TAG_OUI:
+            mac = f.ref(f.ouis, 'OUI') + f.take(3)
+        else:
+            mac = f.take(6)
+            if len(f.ouis) < DICT_MAX:
+                f.ouis.append(mac[:3])
+        if len(f.macs) < DICT_MAX:
+            f.macs.append(mac)
+
+    digest = f.take(digest_bytes) + b'\0' * (DIGEST_LEN - digest_bytes)
+
+    if tag & TAG_FP:
+        fp = f.ref(f.fps, 'fingerprint')
+    else:
+        fp = struct.unpack('<I', f.take(4))[0]
+        if len(f.fps) < DICT_MAX:
+            f.fps.append(fp)
+
+    macs = f.varint() + 1 if tag & TAG_MACS else 1
+    first = f.varint()
+    last = (first + f.varint()) & 0xffff
+    count = f.varint() + 1
+    mean = _int8(f.mean + _zigzag(f.varint()))
+    rssi_min = _int8(mean - f.varint())
+    rssi_max = _int8(mean + f.varint())
+    f.mean = mean
+    sn_first = f.varint()
+    sn_last = (sn_first + f.varint()) & 0xfff
+    htci = f.varint() if tag & TAG_HTCI else 0
+    channels = f.varint()
+
+    ssids = []
+    for _ in range(tag >> TAG_SSIDS_SHIFT):
+        code = f.varint()
+        if code & 1:
+            ssids.append(f.ref(f.ssids, 'SSID', code >> 1))
+            continue
+        n = code >> 1
+        if n > 32:
+            raise FormatError('bad SSID length %d' % n)
+        ssid = f.take(n)
+        if len(f.ssids) < DICT_MAX:
+            f.ssids.append(ssid)
+        ssids.append(ssid)
+
+    return {
+        'mac': mac,
+        'ssids': ssids,
+        'first': first,
+        'last': last,
+        'count': count,
+        'digest': digest,
+        'fp': fp,
+        'macs': macs,
+        'rssi': (rssi_min, mean, rssi_max),
+        'sn': (sn_first, sn_last),
+        'htci': htci,
+        'channels': [ch for ch in range(16) if channels & (1 << ch)],
+    }
+
+
+def decode_frame(data, digest_bytes):
+    """Decode the records of a frame (without its length)"""
+    f = _Frame(data)
+    records = []
+    while not f.done():
+        records.append(decode_record(f, digest_bytes))
+    return records
+
+
+def read_header(data):
+    """Decode the header of a window: return (start_ts, flags)"""
+    if len(data) < HDR.size:
+        raise FormatError('truncated header')
+    magic, version, flags, start_ts = HDR.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise FormatError('bad magic %r' % magic)
+    if version != VERSION:
+        raise FormatError('unsupported version %d' % version)
+    return start_ts, flags
+
+
+def read_window(data):
+    """Decode a window file or MQTT payload: return (start_ts, last, records)
+
+    For the 64-bit digests only the first 8 bytes of 'digest' are meaningful."""
+    start_ts, flags = read_header(data)
+    digest_bytes = DIGEST_BYTES.get((flags >> 1) & 3)
+    if digest_bytes is None:
+        raise FormatError('unknown digest')
+
+    records = []
+    off = HDR.size
+    while off < len(data):
+        if off + FRAME_LEN.size > len(data):
+            raise FormatError('truncated frame at offset %d' % off)
+        n = FRAME_LEN.unpack_from(data, off)[0]
+        off += FRAME_LEN.size
+        if off + n > len(data):
+            raise FormatError('truncated frame at offset %d' % off)
+        for r in decode_frame(data[off:off + n], digest_bytes):
+            r['first'] += start_ts
+            r['last'] += start_ts
+            records.append(r)
+        off += n
+
+    return start_ts, bool(flags & FLAG_LAST), records
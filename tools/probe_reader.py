@@ -0,0 +1,65 @@
+#!/usr/bin/env python
+#
+# Host-side reader of the binary probe records written by the sniffer
+# (window files and MQTT payloads, see main/probe_record.h), decoded by
+# probe_codec.py.
+#
+# Usage: probe_reader.py FILE [FILE ...]
+#
+# Every FILE is a window file or a single MQTT payload. Records (one per
+# device seen in the window) are printed one per line:
+#   MAC[+ADDRESSES] FINGERPRINT FIRST LAST COUNT RSSI_MIN/MEAN/MAX SN_FIRST-SN_LAST HT_CAPABILITIES_INFO CHANNELS HASH SSID,...
+
+from __future__ import print_function
+
+import binascii
+import sys
+
+from probe_codec import DIGESTS, HDR, FormatError, read_window
+
+
+def format_record(r):
+    return '%s%s %08x %d %d %d %d/%d/%d %d-%d %s %s %s %s' % (
+        ':'.join('%02x' % b for b in bytearray(r['mac'])),
+        '+%d' % (r['macs'] - 1) if r['macs'] > 1 else '',
+        r['fp'],
+        r['first'],
+        r['last'],
+        r['count'],
+        r['rssi'][0], r['rssi'][1], r['rssi'][2],
+        r['sn'][0], r['sn'][1],
+        '%04x' % r['htci'] if r['htci'] else '-',
+        ','.join('%d' % ch for ch in r['channels']) or '-',
+        binascii.hexlify(r['digest']).decode('ascii'),
+        ','.join(s.decode('utf-8', 'replace') for s in r['ssids']))
+
+
+def main(argv):
+    if len(argv) < 2:
+        print('usage: %s FILE [FILE ...]' % argv[0], file=sys.stderr)
+        return 2
+
+    ret = 0
+    for path in argv[1:]:
+        with open(path, 'rb') as f:
+            data = f.read()
+        try:
+            start_ts, last, records = read_window(data)
+        except FormatError as e:
+            print('%s: %s' % (path, e), file=sys.stderr)
+            ret = 1
+            continue
+        flags = HDR.unpack_from(data, 0)[2]
+        print('# %s: start %d, %d devices, %d packets, %d bytes (%.1f bytes/record), %s%s' % (
+            path, start_ts, len(records), sum(r['count'] for r in records), len(data),
+            float(len(data) - HDR.size) / len(records) if records else 0,
+            DIGESTS.get((flags >> 1) & 3, 'unknown digest'),
+            ', last' if last else ''))
+        for r in records:
+            print(format_record(r))
+
+    return ret
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_partition.h"
+
+#define MAX_PARTITIONS 16
+
+typedef struct {
+	esp_partition_t part;
+	uint8_t *mem;
+	esp_partition_ram_stats_t stats;
+} ram_partition_t;
+
+static ram_partition_t partitions[MAX_PARTITIONS];
+static int count;
+static uint32_t next_address = 0x110000; //after the factory app of the partition tables
+
+static ram_partition_t *ram_of(const esp_partition_t *partition)
+{
+	return (ram_partition_t *)partition; //part is the first member
+}
+
+static bool in_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+	return offset <= partition->size && size <= partition->size - offset;
+}
+
+const esp_partition_t *esp_partition_ram_add(const char *label, esp_partition_subtype_t subtype, uint32_t size)
+{
+	ram_partition_t *p;
+
+	if(count == MAX_PARTITIONS || size % SPI_FLASH_SEC_SIZE != 0)
+		return NULL;
+
+	p = &partitions[count];
+	p->mem = malloc(size);
+	if(p->mem == NULL)
+		return NULL;
+	memset(p->mem, 0xFF, size);
+
+	p->part.type = ESP_PARTITION_TYPE_DATA;
+	p->part.subtype = subtype;
+	p->part.address = next_address;
+	p->part.size = size;
+	strncpy(p->part.label, label, sizeof(p->part.label)-1);
+	next_address += size;
+	count++;
+
+	return &p->part;
+}
+
+void esp_partition_ram_stats(const esp_partition_t *partition, esp_partition_ram_stats_t *stats, bool reset)
+{
+	ram_partition_t *p = ram_of(partition);
+
+	*stats = p->stats;
+	if(reset)
+		memset(&p->stats, 0, sizeof(p->stats));
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+	int i;
+
+	for(i=0; i<count; i++){
+		if(partitions[i].part.type != type)
+			continue;
+		if(subtype != ESP_PARTITION_SUBTYPE_ANY && partitions[i].part.subtype != subtype)
+			continue;
+		if(label != NULL && strcmp(partitions[i].part.label, label) != 0)
+			continue;
+		return &partitions[i].part;
+	}
+
+	return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+	ram_partition_t *p = ram_of(partition);
+
+	if(!in_range(partition, src_offset, size))
+		return ESP_ERR_INVALID_SIZE;
+
+	memcpy(dst, p->mem + src_offset, size);
+	p->stats.reads++;
+	p->stats.read_bytes += size;
+
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+	ram_partition_t *p = ram_of(partition);
+	const uint8_t *s = src;
+	size_t i;
+
+	if(!in_range(partition, dst_offset, size))
+		return ESP_ERR_INVALID_SIZE;
+
+	for(i=0; i<size; i++) //NOR flash: only 1 -> 0
+		p->mem[dst_offset+i] &= s[i];
+	p->stats.writes++;
+	p->stats.write_bytes += size;
+	if(size > 0)
+		p->stats.programs += (dst_offset + size - 1) / ESP_PARTITION_RAM_PROG_PAGE - dst_offset / ESP_PARTITION_RAM_PROG_PAGE + 1;
+
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t start_addr, size_t size)
+{
+	ram_partition_t *p = ram_of(partition);
+
+	if(start_addr % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0)
+		return ESP_ERR_INVALID_ARG;
+	if(!in_range(partition, start_addr, size))
+		return ESP_ERR_INVALID_SIZE;
+
+	memset(p->mem + start_addr, 0xFF, size);
+	p->stats.erases += size / SPI_FLASH_SEC_SIZE;
+
+	return ESP_OK;
+}
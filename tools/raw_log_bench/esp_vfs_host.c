@@ -0,0 +1,202 @@
+/* Host stand-ins used by the SPIFFS glue (esp_spiffs.c, spiffs_api.c) and by the sources of main/
+ * built on the host: the VFS with the stdio calls on its paths, the FreeRTOS mutexes, esp_timer
+ * and the flash geometry */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_vfs.h"
+#include "rom/spi_flash.h"
+
+#undef time
+
+typedef struct {
+	int fd;
+} host_file_t;
+
+esp_rom_spiflash_chip_t g_rom_flashchip = { 256, 4096 };
+time_t esp_vfs_host_now;
+
+static char vfs_base[ESP_VFS_PATH_MAX+1];
+static esp_vfs_t vfs;
+static void *vfs_ctx;
+
+int64_t esp_timer_get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	pthread_mutex_t *m = malloc(sizeof(*m));
+
+	if(m != NULL)
+		pthread_mutex_init(m, NULL);
+	return m;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+	if(ticks == 0)
+		return pthread_mutex_trylock(sem) == 0 ? pdTRUE : pdFALSE;
+	return pthread_mutex_lock(sem) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+	return pthread_mutex_unlock(sem) == 0 ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+	if(sem == NULL)
+		return;
+	pthread_mutex_destroy(sem);
+	free(sem);
+}
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+
+	if(size > 0){
+		size_t n = len < size - 1 ? len : size - 1;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return len;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size)
+{
+	size_t len = strnlen(dst, size);
+
+	if(len == size)
+		return len + strlen(src);
+	return len + strlcpy(dst + len, src, size - len);
+}
+
+esp_err_t esp_vfs_register(const char *base_path, const esp_vfs_t *v, void *ctx)
+{
+	if(vfs_base[0] != '\0' || strlen(base_path) > ESP_VFS_PATH_MAX)
+		return ESP_ERR_NO_MEM;
+	strcpy(vfs_base, base_path);
+	vfs = *v;
+	vfs_ctx = ctx;
+	return ESP_OK;
+}
+
+esp_err_t esp_vfs_unregister(const char *base_path)
+{
+	if(strcmp(vfs_base, base_path) != 0)
+		return ESP_ERR_INVALID_STATE;
+	vfs_base[0] = '\0';
+	return ESP_OK;
+}
+
+static const char *vfs_path(const char *path)
+{
+	/* path in the registered file system, NULL if not there */
+	size_t len = strlen(vfs_base);
+
+	if(len == 0 || strncmp(path, vfs_base, len) != 0 || path[len] != '/'){
+		errno = ENOENT;
+		return NULL;
+	}
+	return path + len;
+}
+
+FILE *esp_vfs_host_fopen(const char *path, const char *mode)
+{
+	const char *p = vfs_path(path);
+	host_file_t *f;
+	int flags;
+
+	if(p == NULL)
+		return NULL;
+	switch(mode[0]){
+		case 'r':
+			flags = strchr(mode, '+') ? O_RDWR : O_RDONLY;
+			break;
+		case 'w':
+			flags = (strchr(mode, '+') ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+			break;
+		case 'a':
+			flags = (strchr(mode, '+') ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND;
+			break;
+		default:
+			errno = EINVAL;
+			return NULL;
+	}
+
+	f = malloc(sizeof(*f));
+	if(f == NULL)
+		return NULL;
+	f->fd = vfs.open_p(vfs_ctx, p, flags, 0);
+	if(f->fd < 0){
+		free(f);
+		return NULL;
+	}
+	return (FILE *)f;
+}
+
+size_t esp_vfs_host_fwrite(const void *ptr, size_t size, size_t n, FILE *fp)
+{
+	ssize_t ret = size * n > 0 ? vfs.write_p(vfs_ctx, ((host_file_t *)fp)->fd, ptr, size * n) : 0;
+
+	return ret > 0 ? (size_t)ret / size : 0;
+}
+
+size_t esp_vfs_host_fread(void *ptr, size_t size, size_t n, FILE *fp)
+{
+	ssize_t ret = size * n > 0 ? vfs.read_p(vfs_ctx, ((host_file_t *)fp)->fd, ptr, size * n) : 0;
+
+	return ret > 0 ? (size_t)ret / size : 0;
+}
+
+int esp_vfs_host_fclose(FILE *fp)
+{
+	int ret = vfs.close_p(vfs_ctx, ((host_file_t *)fp)->fd);
+
+	free(fp);
+	return ret == 0 ? 0 : EOF;
+}
+
+int esp_vfs_host_setvbuf(FILE *fp, char *buf, int mode, size_t size)
+{
+	return 0; //not buffered: every fwrite is a write of the VFS, as with _IONBF
+}
+
+int esp_vfs_host_fileno(FILE *fp)
+{
+	return ((host_file_t *)fp)->fd;
+}
+
+int esp_vfs_host_fsync(int fd)
+{
+	return vfs.fsync_p != NULL ? vfs.fsync_p(vfs_ctx, fd) : 0;
+}
+
+int esp_vfs_host_remove(const char *path)
+{
+	const char *p = vfs_path(path);
+
+	return p != NULL ? vfs.unlink_p(vfs_ctx, p) : -1;
+}
+
+int esp_vfs_host_stat(const char *path, struct stat *st)
+{
+	const char *p = vfs_path(path);
+
+	return p != NULL ? vfs.stat_p(vfs_ctx, p, st) : -1;
+}
@@ -0,0 +1,58 @@
+#ifndef ESP_PARTITION_H
+#define ESP_PARTITION_H
+
+/* Host stand-in of the ESP-IDF partition API: the partitions are RAM buffers with the
+ * semantics of a NOR flash (a write can only clear bits, an erase sets a whole sector to 0xFF) */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum {
+	ESP_PARTITION_TYPE_APP = 0x00,
+	ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+	ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+	ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+	esp_partition_type_t type;
+	esp_partition_subtype_t subtype;
+	uint32_t address;
+	uint32_t size;
+	char label[17];
+	bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t start_addr, size_t size);
+
+/* --- host only --- */
+
+typedef struct {
+	uint32_t reads;
+	uint64_t read_bytes;
+	uint32_t writes;
+	uint64_t write_bytes;
+	uint32_t programs; //flash pages of ESP_PARTITION_RAM_PROG_PAGE bytes programmed by the writes
+	uint32_t erases; //sectors erased
+} esp_partition_ram_stats_t;
+
+#define ESP_PARTITION_RAM_PROG_PAGE 256 //page of the NOR flash: a write is a program of each page it touches
+
+/* Add a partition of size bytes (erased), return NULL if there is no room for it */
+const esp_partition_t *esp_partition_ram_add(const char *label, esp_partition_subtype_t subtype, uint32_t size);
+
+/* Snapshot of the operations done on partition, reset them if reset is true */
+void esp_partition_ram_stats(const esp_partition_t *partition, esp_partition_ram_stats_t *stats, bool reset);
+
+#endif
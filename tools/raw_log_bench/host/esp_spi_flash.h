@@ -0,0 +1,6 @@
+#ifndef ESP_SPI_FLASH_H
+#define ESP_SPI_FLASH_H
+
+#include "esp_partition.h" //SPI_FLASH_SEC_SIZE
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef ESP_VFS_H
+#define ESP_VFS_H
+
+/* Host stand-in of the ESP-IDF VFS: a single file system registered at a time, reached through
+ * the stdio subset of vfs_stdio.h. The clock read by time() is the one set by the bench */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include "esp_err.h"
+
+#define ESP_VFS_PATH_MAX 15
+#define ESP_VFS_FLAG_CONTEXT_PTR 1
+
+typedef struct {
+	int flags;
+	ssize_t (*write_p)(void *ctx, int fd, const void *data, size_t size);
+	off_t (*lseek_p)(void *ctx, int fd, off_t size, int mode);
+	ssize_t (*read_p)(void *ctx, int fd, void *dst, size_t size);
+	int (*open_p)(void *ctx, const char *path, int flags, int mode);
+	int (*close_p)(void *ctx, int fd);
+	int (*fstat_p)(void *ctx, int fd, struct stat *st);
+	int (*fsync_p)(void *ctx, int fd);
+	int (*stat_p)(void *ctx, const char *path, struct stat *st);
+	int (*link_p)(void *ctx, const char *n1, const char *n2);
+	int (*unlink_p)(void *ctx, const char *path);
+	int (*rename_p)(void *ctx, const char *src, const char *dst);
+	DIR *(*opendir_p)(void *ctx, const char *name);
+	struct dirent *(*readdir_p)(void *ctx, DIR *pdir);
+	int (*readdir_r_p)(void *ctx, DIR *pdir, struct dirent *entry, struct dirent **out_dirent);
+	long (*telldir_p)(void *ctx, DIR *pdir);
+	void (*seekdir_p)(void *ctx, DIR *pdir, long offset);
+	int (*closedir_p)(void *ctx, DIR *pdir);
+	int (*mkdir_p)(void *ctx, const char *name, mode_t mode);
+	int (*rmdir_p)(void *ctx, const char *name);
+} esp_vfs_t;
+
+esp_err_t esp_vfs_register(const char *base_path, const esp_vfs_t *vfs, void *ctx);
+esp_err_t esp_vfs_unregister(const char *base_path);
+
+/* --- host only --- */
+
+/* the DIR of newlib, embedded in the DIR of the SPIFFS glue (glibc keeps its own opaque) */
+struct esp_vfs_host_dir {
+	uint16_t dd_vfs_idx;
+	uint16_t dd_rsv;
+};
+
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+
+/* seconds returned by time() in the file system: set by the bench */
+extern time_t esp_vfs_host_now;
+#define time(t) (esp_vfs_host_now)
+
+#endif
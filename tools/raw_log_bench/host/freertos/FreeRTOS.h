@@ -0,0 +1,23 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+/* Host stand-in of the FreeRTOS subset used by the SPIFFS glue: the tasks are pthreads */
+
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h> //configASSERT of FreeRTOSConfig.h
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+
+typedef pthread_mutex_t portMUX_TYPE;
+
+#define vPortCPUInitializeMutex(mux) pthread_mutex_init(mux, NULL)
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef ROM_SPI_FLASH_H
+#define ROM_SPI_FLASH_H
+
+#include <stdint.h>
+
+typedef struct {
+	uint32_t page_size;
+	uint32_t sector_size;
+} esp_rom_spiflash_chip_t;
+
+/* the geometry of the flash of the ESP32 (esp_vfs_host.c) */
+extern esp_rom_spiflash_chip_t g_rom_flashchip;
+
+#endif
@@ -0,0 +1,40 @@
+/* Subset of sdkconfig used by the SPIFFS core, the SPIFFS glue and the records on the host */
+#define CONFIG_SPIFFS_MAX_PARTITIONS 3
+#define CONFIG_SPIFFS_CACHE 1
+#define CONFIG_SPIFFS_CACHE_PAGES 16
+#define CONFIG_SPIFFS_CACHE_WR 1
+#define CONFIG_SPIFFS_APPEND_DEFER 1
+#define CONFIG_SPIFFS_APPEND_DEFER_PAGES 16
+#define CONFIG_SPIFFS_READ_AHEAD 1
+#define CONFIG_SPIFFS_READ_AHEAD_PAGES 4
+#define CONFIG_SPIFFS_READ_UNLOCKED 1
+#define CONFIG_SPIFFS_PAGE_CHECK 1
+#define CONFIG_SPIFFS_GC_MAX_RUNS 10
+#define CONFIG_SPIFFS_GC_BG_RESERVE 5
+#define CONFIG_SPIFFS_GC_BG_WATERMARK 20
+#define CONFIG_SPIFFS_GC_POLICY_COST_BENEFIT 1
+#define CONFIG_SPIFFS_GC_SLICE_PAGES 8
+#define CONFIG_SPIFFS_PAGE_SIZE 256
+#define CONFIG_SPIFFS_OBJ_NAME_LEN 32
+#define CONFIG_SPIFFS_USE_MAGIC 1
+#define CONFIG_SPIFFS_USE_MAGIC_LENGTH 1
+#ifndef CONFIG_SPIFFS_META_LENGTH //8 for the SPIFFS glue (vfs_bench): time_t has 64 bits on the host
+#define CONFIG_SPIFFS_META_LENGTH 4
+#endif
+#define CONFIG_SPIFFS_USE_MTIME 1
+#if !defined(CONFIG_SPIFFS_MTIME_PERIODIC) && !defined(CONFIG_SPIFFS_MTIME_ON_SYNC) //set by the vfs_bench variants
+#define CONFIG_SPIFFS_MTIME_ON_OPEN 1
+#endif
+#define CONFIG_SPIFFS_MTIME_PERIOD 300
+#define CONFIG_SPIFFS_MTIME_FILES 8
+#define CONFIG_MTIME_SYNC_WINDOWS 10
+#define CONFIG_DIGEST_MD5 1
+#define CONFIG_LOG_BATCH_RECORDS 16
+#define CONFIG_LOG_SEGMENTS 32
+#define CONFIG_GC_BUDGET 100000
+#define CONFIG_SPIFFS_RAM_INDEX 1
+#define CONFIG_SPIFFS_RAM_INDEX_OBJECTS 64
+#define CONFIG_SPIFFS_CHECKPOINT 1
+#define CONFIG_SPIFFS_CHECKPOINT_PARTITION "spiffs_ckpt"
+#define CONFIG_SPIFFS_IO_STATS 1
+#define CONFIG_SPIFFS_LOCK_STATS 1
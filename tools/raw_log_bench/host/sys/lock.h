@@ -0,0 +1,6 @@
+#ifndef SYS_LOCK_H
+#define SYS_LOCK_H
+
+/* newlib only: nothing of it is used by the SPIFFS glue on the host */
+
+#endif
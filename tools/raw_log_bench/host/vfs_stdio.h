@@ -0,0 +1,30 @@
+#ifndef VFS_STDIO_H
+#define VFS_STDIO_H
+
+/* Included before the sources of main/ built on the host: their stdio calls on the paths of the
+ * registered file system go through its esp_vfs_t, as newlib does on the device */
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+FILE *esp_vfs_host_fopen(const char *path, const char *mode);
+size_t esp_vfs_host_fwrite(const void *ptr, size_t size, size_t n, FILE *fp);
+size_t esp_vfs_host_fread(void *ptr, size_t size, size_t n, FILE *fp);
+int esp_vfs_host_fclose(FILE *fp);
+int esp_vfs_host_setvbuf(FILE *fp, char *buf, int mode, size_t size);
+int esp_vfs_host_fileno(FILE *fp);
+int esp_vfs_host_fsync(int fd);
+int esp_vfs_host_remove(const char *path);
+int esp_vfs_host_stat(const char *path, struct stat *st);
+
+#define fopen esp_vfs_host_fopen
+#define fwrite esp_vfs_host_fwrite
+#define fread esp_vfs_host_fread
+#define fclose esp_vfs_host_fclose
+#define setvbuf esp_vfs_host_setvbuf
+#define fileno esp_vfs_host_fileno
+#define fsync esp_vfs_host_fsync
+#define remove esp_vfs_host_remove
+#define stat(path, st) esp_vfs_host_stat(path, st)
+
+#endif
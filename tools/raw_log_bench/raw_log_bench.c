@@ -0,0 +1,1676 @@
+/* Host benchmark of the storage of the windows: the SPIFFS path of main.c (a window file per
+ * window written by log_writer in batches, the seg_log state file, the uploader reading the file
+ * through a stdio-sized buffer and removing it) against raw_log on a data partition.
+ * Both run on RAM partitions with the semantics of the flash (esp_partition_ram.c) and the
+ * flash operations of each path are counted. The records read back are checked, then raw_log
+ * is mounted again to check the recovery of an interrupted window. Then the latency of the
+ * appends to a ring of window files is modeled with the garbage collection run only inside the
+ * writes and with the background slices between them, and a trace of windows with the broker
+ * away now and then is replayed with each victim policy of the garbage collection. SPIFFS
+ * partitions of growing size are mounted with the object lookup scan and from a checkpoint. Last,
+ * the flash pages programmed by the appends to a file are counted, with and without O_APPEND,
+ * a file is found after a reset while it was appended and the window files left in the ring are
+ * read back. A window file is then sent in MQTT messages through fopen and fread and with
+ * SPIFFS_read_records, counting the CPU cycles of each path. Last, a sniffer thread appends
+ * windows while an uploader thread reads a file, the flash operations taking their modeled
+ * time one at a time, and the time each of them waits for the lock of SPIFFS is counted.
+ * Usage: raw_log_bench [windows] [devices per window] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "esp_partition.h"
+#include "spiffs.h"
+#include "spiffs_nucleus.h"
+#include "probe_record.h"
+#include "raw_log.h"
+
+#define SPIFFS_SIZE 0xF0000 //storage of partitions_spiffs.csv
+#define RAWLOG_SIZE 0x80000 //rawlog of partitions_rawlog.csv
+#define CKPT_SIZE 0x8000 //the checkpoint of 16 MB (the partition tables have 0x4000 for 1 MB)
+#define MAX_FILES 3
+#define STDIO_BUF 128 //size of the buffer of a FILE in newlib
+
+typedef struct {
+	uint64_t write_ns;
+	uint64_t read_ns;
+	esp_partition_ram_stats_t write;
+	esp_partition_ram_stats_t read;
+} bench_result_t;
+
+static spiffs fs;
+static uint8_t spiffs_work[2*256];
+static uint8_t spiffs_fds[MAX_FILES*sizeof(spiffs_fd)];
+static uint8_t spiffs_cache_buf[SPIFFS_CACHE_BUF_SIZE(256, CONFIG_SPIFFS_CACHE_PAGES)] __attribute__((aligned(8)));
+#if SPIFFS_RAM_INDEX
+static uint8_t spiffs_index_buf[SPIFFS_RAM_INDEX_BUF_SIZE(SPIFFS_SIZE, 256, CONFIG_SPIFFS_RAM_INDEX_OBJECTS)] __attribute__((aligned(8)));
+#endif
+static const esp_partition_t *spiffs_part;
+#if SPIFFS_CHECKPOINT
+static const esp_partition_t *ckpt_part;
+#endif
+static raw_log_t raw_log;
+static uint64_t payload; //bytes of records written
+static uint32_t *sector_erases; //erases of each sector of the SPIFFS partition, if not NULL
+static uint64_t gc_write_bytes; //bytes written while the garbage collection moves pages
+
+/* the lock of the file systems (efs->lock): a task counts the time it waited for it */
+static pthread_mutex_t fs_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread uint64_t lock_wait_ns;
+static __thread uint32_t lock_waits;
+
+static uint64_t now_ns(void);
+static void flash_begin(int op, u32_t size);
+static void flash_end(void);
+
+void spiffs_api_lock(spiffs *fs)
+{
+	uint64_t t;
+
+	if(pthread_mutex_trylock(&fs_lock) != 0){
+		t = now_ns();
+		pthread_mutex_lock(&fs_lock);
+		lock_wait_ns += now_ns() - t;
+		lock_waits++;
+	}
+}
+
+void spiffs_api_unlock(spiffs *fs)
+{
+	pthread_mutex_unlock(&fs_lock);
+}
+
+/* the partition of a file system is its user_data */
+static s32_t hal_read(spiffs *fs, u32_t addr, u32_t size, u8_t *dst)
+{
+	esp_err_t err;
+
+	flash_begin(0, size);
+	err = esp_partition_read(fs->user_data, addr, dst, size);
+	flash_end();
+	return err == ESP_OK ? 0 : -1;
+}
+
+static s32_t hal_write(spiffs *fs, u32_t addr, u32_t size, u8_t *src)
+{
+	esp_err_t err;
+
+	if(fs->cleaning)
+		gc_write_bytes += size;
+	flash_begin(1, size);
+	err = esp_partition_write(fs->user_data, addr, src, size);
+	flash_end();
+	return err == ESP_OK ? 0 : -1;
+}
+
+static s32_t hal_erase(spiffs *fs, u32_t addr, u32_t size)
+{
+	esp_err_t err;
+
+	if(sector_erases != NULL)
+		sector_erases[addr / SPI_FLASH_SEC_SIZE]++;
+	flash_begin(2, size);
+	err = esp_partition_erase_range(fs->user_data, addr, size);
+	flash_end();
+	return err == ESP_OK ? 0 : -1;
+}
+
+#if SPIFFS_CHECKPOINT
+/* a single checkpoint at the start of ckpt_part (the device uses the slots of the partition in turn) */
+static s32_t ckpt_read(spiffs *fs, u32_t offset, u32_t size, u8_t *dst)
+{
+	return esp_partition_read(ckpt_part, offset, dst, size) == ESP_OK ? 0 : -1;
+}
+
+static s32_t ckpt_write(spiffs *fs, u32_t offset, u32_t size, const u8_t *src)
+{
+	return esp_partition_write(ckpt_part, offset, src, size) == ESP_OK ? 0 : -1;
+}
+
+static s32_t ckpt_erase(spiffs *fs)
+{
+	return esp_partition_erase_range(ckpt_part, 0, ckpt_part->size) == ESP_OK ? 0 : -1;
+}
+#endif
+
+static uint64_t now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static uint32_t rnd(uint32_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 17;
+	*s ^= *s << 5;
+	return *s;
+}
+
+static int make_record(uint32_t window, int i, uint8_t *rec)
+{
+	/* a record with the size of a device record (0-3 SSIDs) and a content depending on (window, i) */
+	uint32_t s = window * 7919 + i * 104729 + 1;
+	int len = sizeof(probe_record_t) + (rnd(&s) % 4) * (1 + 4 + rnd(&s) % 12), k;
+
+	for(k=0; k<len; k++)
+		rec[k] = rnd(&s);
+	return len;
+}
+
+static void make_hdr(uint32_t window, probe_file_hdr_t *hdr)
+{
+	probe_file_hdr_init(hdr, 1500000000 + window * 60);
+}
+
+static void add_stats(esp_partition_ram_stats_t *acc, const esp_partition_t *part)
+{
+	esp_partition_ram_stats_t st;
+
+	esp_partition_ram_stats(part, &st, true);
+	acc->reads += st.reads;
+	acc->read_bytes += st.read_bytes;
+	acc->writes += st.writes;
+	acc->write_bytes += st.write_bytes;
+	acc->programs += st.programs;
+	acc->erases += st.erases;
+}
+
+/* --- SPIFFS path --- */
+
+static int spiffs_mount_ram(void)
+{
+	spiffs_config cfg;
+	s32_t res;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.hal_read_f = hal_read;
+	cfg.hal_write_f = hal_write;
+	cfg.hal_erase_f = hal_erase;
+	cfg.log_block_size = SPI_FLASH_SEC_SIZE;
+	cfg.log_page_size = 256;
+	cfg.phys_addr = 0;
+	cfg.phys_erase_block = SPI_FLASH_SEC_SIZE;
+	cfg.phys_size = spiffs_part->size;
+	cfg.gc_policy = SPIFFS_GC_POLICY;
+#if SPIFFS_RAM_INDEX
+	cfg.ram_index = spiffs_index_buf;
+	cfg.ram_index_size = sizeof(spiffs_index_buf);
+#endif
+
+	fs.user_data = (void *)spiffs_part;
+	res = SPIFFS_mount(&fs, &cfg, spiffs_work, spiffs_fds, sizeof(spiffs_fds), spiffs_cache_buf, sizeof(spiffs_cache_buf), NULL);
+	if(res != SPIFFS_OK){
+		SPIFFS_format(&fs);
+		res = SPIFFS_mount(&fs, &cfg, spiffs_work, spiffs_fds, sizeof(spiffs_fds), spiffs_cache_buf, sizeof(spiffs_cache_buf), NULL);
+	}
+	return res == SPIFFS_OK ? 0 : -1;
+}
+
+static void seg_path(uint32_t window, char *path)
+{
+	sprintf(path, "/win%02u.log", (unsigned)(window % CONFIG_LOG_SEGMENTS));
+}
+
+static const char *state_path(uint32_t gen)
+{
+	/* seg_log writes its state alternately in two files */
+	return gen % 2 ? "/win.1.idx" : "/win.0.idx";
+}
+
+static int save_state(uint32_t head, uint32_t tail)
+{
+	static uint32_t gen;
+	uint32_t state[8] = { 0x474F4C53, CONFIG_LOG_SEGMENTS, ++gen, head, tail, 0, 0, 0 };
+	spiffs_file fd = SPIFFS_open(&fs, state_path(gen), SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_WRONLY, 0);
+
+	if(fd < 0)
+		return -1;
+	SPIFFS_write(&fs, fd, state, sizeof(state));
+	return SPIFFS_close(&fs, fd);
+}
+
+static int spiffs_write_window(uint32_t window, int devices)
+{
+	/* end_window(): the devices are appended in batches, the file is closed, the next one truncated */
+	uint8_t buf[CONFIG_LOG_BATCH_RECORDS*PROBE_RECORD_MAX_LEN];
+	char path[32];
+	spiffs_file fd;
+	size_t len;
+	int i, pending = 0;
+	spiffs_stat st;
+
+	seg_path(window, path);
+	fd = SPIFFS_open(&fs, path, SPIFFS_O_CREAT|SPIFFS_O_APPEND|SPIFFS_O_WRONLY, 0);
+	if(fd < 0)
+		return -1;
+
+	make_hdr(window, (probe_file_hdr_t *)buf);
+	len = sizeof(probe_file_hdr_t);
+	for(i=0; i<devices; i++){
+		len += make_record(window, i, buf + len);
+		if(++pending == CONFIG_LOG_BATCH_RECORDS || i == devices-1){
+			if(SPIFFS_write(&fs, fd, buf, len) != (s32_t)len)
+				return -1;
+			payload += len;
+			len = 0;
+			pending = 0;
+		}
+	}
+	SPIFFS_close(&fs, fd);
+
+	SPIFFS_stat(&fs, path, &st);
+	seg_path(window+1, path);
+	fd = SPIFFS_open(&fs, path, SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_WRONLY, 0);
+	if(fd < 0)
+		return -1;
+	SPIFFS_close(&fs, fd);
+
+	return save_state(window+1, window);
+}
+
+static int spiffs_send_window(uint32_t window, int devices)
+{
+	/* send_file() and seg_log_pop(): read the file through a buffer of STDIO_BUF bytes and remove it */
+	uint8_t file[1+CONFIG_LOG_BATCH_RECORDS*PROBE_RECORD_MAX_LEN], rec[PROBE_RECORD_MAX_LEN];
+	uint8_t *data = NULL;
+	size_t size = 0;
+	char path[32];
+	spiffs_file fd;
+	s32_t n;
+	int i, len, ret = 0;
+	uint32_t off;
+
+	seg_path(window, path);
+	fd = SPIFFS_open(&fs, path, SPIFFS_O_RDONLY, 0);
+	if(fd < 0)
+		return -1;
+	while((n = SPIFFS_read(&fs, fd, file, STDIO_BUF)) > 0){
+		data = realloc(data, size + n);
+		memcpy(data + size, file, n);
+		size += n;
+	}
+	SPIFFS_close(&fs, fd);
+
+	off = sizeof(probe_file_hdr_t);
+	for(i=0; i<devices && ret == 0; i++){
+		len = make_record(window, i, rec);
+		if(off + len > size || memcmp(data + off, rec, len) != 0)
+			ret = -1;
+		off += len;
+	}
+	free(data);
+
+	SPIFFS_remove(&fs, path);
+	if(save_state(window+1, window+1) != 0)
+		return -1;
+	return ret == 0 && off == size ? 0 : -1;
+}
+
+/* --- raw partition path --- */
+
+static int raw_write_window(uint32_t window, int devices)
+{
+	uint8_t rec[PROBE_RECORD_MAX_LEN];
+	int i, len;
+
+	make_hdr(window, (probe_file_hdr_t *)rec);
+	if(raw_log_append(&raw_log, rec, sizeof(probe_file_hdr_t), true) != 0)
+		return -1;
+	payload += sizeof(probe_file_hdr_t);
+	for(i=0; i<devices; i++){
+		len = make_record(window, i, rec);
+		if(raw_log_append(&raw_log, rec, len, false) != 0)
+			return -1;
+		payload += len;
+	}
+
+	return raw_log_seal(&raw_log);
+}
+
+static int raw_send_window(uint32_t window, int devices)
+{
+	uint8_t rec[PROBE_RECORD_MAX_LEN], exp[PROBE_RECORD_MAX_LEN];
+	raw_log_pos_t start, cur;
+	bool first;
+	int i, len;
+
+	raw_log_tail(&raw_log, &start);
+	cur = start;
+	if(raw_log_read(&raw_log, &cur, rec, sizeof(rec), &first) != sizeof(probe_file_hdr_t) || !first)
+		return -1;
+	make_hdr(window, (probe_file_hdr_t *)exp);
+	if(memcmp(rec, exp, sizeof(probe_file_hdr_t)) != 0)
+		return -1;
+
+	for(i=0; i<devices; i++){
+		len = raw_log_read(&raw_log, &cur, rec, sizeof(rec), &first);
+		if(len <= 0 || first || len != make_record(window, i, exp) || memcmp(rec, exp, len) != 0)
+			return -1;
+	}
+
+	return raw_log_ack(&raw_log, &start, &cur);
+}
+
+static int run(const char *name, const esp_partition_t *part, int (*write_window)(uint32_t, int),
+		int (*send_window)(uint32_t, int), int windows, int devices, bench_result_t *res)
+{
+	uint64_t t;
+	uint32_t w;
+
+	memset(res, 0, sizeof(*res));
+	payload = 0;
+	esp_partition_ram_stats(part, &res->write, true);
+	memset(&res->write, 0, sizeof(res->write));
+
+	for(w=0; w<(uint32_t)windows; w++){
+		t = now_ns();
+		if(write_window(w, devices) != 0){
+			printf("%s: write of window %u failed\n", name, w);
+			return -1;
+		}
+		res->write_ns += now_ns() - t;
+		add_stats(&res->write, part);
+
+		t = now_ns();
+		if(send_window(w, devices) != 0){
+			printf("%s: window %u read back wrong\n", name, w);
+			return -1;
+		}
+		res->read_ns += now_ns() - t;
+		add_stats(&res->read, part);
+	}
+
+	printf("%-7s write: %7.1f us/window %6.1f reads %6.1f writes %8.0f bytes (x%.2f) %5.2f erases | "
+			"read: %7.1f us/window %6.1f reads %8.0f bytes\n", name,
+			res->write_ns / 1e3 / windows, (double)res->write.reads / windows, (double)res->write.writes / windows,
+			(double)res->write.write_bytes / windows,
+			(double)res->write.write_bytes / payload, (double)(res->write.erases + res->read.erases) / windows,
+			res->read_ns / 1e3 / windows, (double)res->read.reads / windows, (double)res->read.read_bytes / windows);
+
+	return 0;
+}
+
+static int check_recovery(const esp_partition_t *part, int devices)
+{
+	/* an interrupted window is recovered (sealed) at the mount, an acked one is not sent again */
+	uint8_t rec[PROBE_RECORD_MAX_LEN];
+	raw_log_stats_t st;
+	raw_log_pos_t cur;
+	bool first;
+	uint64_t t;
+	int i, n = 0;
+
+	if(raw_write_window(1000000, devices) != 0)
+		return -1;
+	for(i=0; i<devices/2; i++)
+		raw_log_append(&raw_log, rec, make_record(1000001, i, rec), i == 0);
+	raw_log_flush(&raw_log);
+
+	t = now_ns();
+	if(raw_log_mount(&raw_log, part) != 0)
+		return -1;
+	t = now_ns() - t;
+
+	if(raw_send_window(1000000, devices) != 0)
+		return -1;
+	raw_log_tail(&raw_log, &cur);
+	while(raw_log_read(&raw_log, &cur, rec, sizeof(rec), &first) > 0)
+		n++;
+	raw_log_get_stats(&raw_log, &st);
+
+	printf("raw_log mount: %.1f us, %d of %d records of the interrupted window recovered, %u bytes waiting\n",
+			t / 1e3, n, devices/2, st.bytes);
+	return n == devices/2 ? 0 : -1;
+}
+
+/* --- mount --- */
+
+typedef struct {
+	u32_t free_blocks, allocated, deleted, max_erase_count, objects;
+} mount_state_t;
+
+static int mount_part(spiffs *mfs, const esp_partition_t *part, u8_t *index, u32_t index_size, bool ckpt,
+		mount_state_t *state, uint64_t *ns, esp_partition_ram_stats_t *io)
+{
+	/* io counts the reads of both partitions */
+	esp_partition_ram_stats_t ckpt_io;
+	spiffs_config cfg;
+	uint64_t t;
+	s32_t res;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.hal_read_f = hal_read;
+	cfg.hal_write_f = hal_write;
+	cfg.hal_erase_f = hal_erase;
+	cfg.log_block_size = SPI_FLASH_SEC_SIZE;
+	cfg.log_page_size = 256;
+	cfg.phys_erase_block = SPI_FLASH_SEC_SIZE;
+	cfg.phys_size = part->size;
+	cfg.gc_policy = SPIFFS_GC_POLICY;
+#if SPIFFS_RAM_INDEX
+	cfg.ram_index = index;
+	cfg.ram_index_size = index_size;
+#endif
+#if SPIFFS_CHECKPOINT
+	if(ckpt){
+		cfg.ckpt_read_f = ckpt_read;
+		cfg.ckpt_write_f = ckpt_write;
+		cfg.ckpt_erase_f = ckpt_erase;
+	}
+#endif
+
+	mfs->user_data = (void *)part;
+	esp_partition_ram_stats(part, io, true);
+#if SPIFFS_CHECKPOINT
+	esp_partition_ram_stats(ckpt_part, &ckpt_io, true);
+#endif
+	t = now_ns();
+	res = SPIFFS_mount(mfs, &cfg, spiffs_work, spiffs_fds, sizeof(spiffs_fds), spiffs_cache_buf, sizeof(spiffs_cache_buf), NULL);
+	*ns = now_ns() - t;
+	esp_partition_ram_stats(part, io, true);
+#if SPIFFS_CHECKPOINT
+	esp_partition_ram_stats(ckpt_part, &ckpt_io, true);
+	io->reads += ckpt_io.reads;
+	io->read_bytes += ckpt_io.read_bytes;
+#endif
+	if(res != SPIFFS_OK)
+		return -1;
+
+	state->free_blocks = mfs->free_blocks;
+	state->allocated = mfs->stats_p_allocated;
+	state->deleted = mfs->stats_p_deleted;
+	state->max_erase_count = mfs->max_erase_count;
+	state->objects = 0;
+#if SPIFFS_RAM_INDEX
+	if(spiffs_ram_index_get(mfs) != NULL)
+		state->objects = spiffs_ram_index_get(mfs)->obj_count;
+#endif
+	return 0;
+}
+
+#if SPIFFS_CHECKPOINT
+static int fill_part(spiffs *mfs, uint32_t size, int files)
+{
+	/* files of size/2/files bytes each, with one of them removed to leave deleted pages */
+	static uint8_t buf[4096];
+	char path[32];
+	spiffs_file fd;
+	uint32_t left;
+	int i;
+
+	memset(buf, 0x5A, sizeof(buf));
+	for(i=0; i<files; i++){
+		sprintf(path, "/f%03d", i);
+		fd = SPIFFS_open(mfs, path, SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_WRONLY, 0);
+		if(fd < 0)
+			return -1;
+		for(left=size/2/files; left>0; left-=left < sizeof(buf) ? left : sizeof(buf))
+			if(SPIFFS_write(mfs, fd, buf, left < sizeof(buf) ? left : sizeof(buf)) < 0)
+				return -1;
+		SPIFFS_close(mfs, fd);
+	}
+	return SPIFFS_remove(mfs, "/f000") == SPIFFS_OK ? 0 : -1;
+}
+
+static int bench_mount(void)
+{
+	/* each partition is filled, unmounted (checkpoint saved) and mounted with the scan and from the
+	 * checkpoint: the state must be the same. Then a file is written (the checkpoint is dropped) and the
+	 * checkpoint saved at the unmount must match the scan again */
+	static const uint32_t sizes[] = { 0x40000, 0xF0000, 0x400000, 0x1000000 };
+	const esp_partition_t *part;
+	esp_partition_ram_stats_t scan_io, ckpt_io;
+	mount_state_t scan_st, ckpt_st;
+	uint64_t scan_ns, ckpt_ns;
+	spiffs mfs;
+	u8_t *index;
+	u32_t index_size;
+	spiffs_file fd;
+	char label[16];
+	unsigned i;
+
+	for(i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++){
+		sprintf(label, "mount%u", i);
+		index_size = SPIFFS_RAM_INDEX ? SPIFFS_RAM_INDEX_BUF_SIZE(sizes[i], 256, CONFIG_SPIFFS_RAM_INDEX_OBJECTS) : 0;
+		part = esp_partition_ram_add(label, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, sizes[i]);
+		index = malloc(index_size < 1000 ? 1000 : index_size + 1); //also the data of /f000
+		memset(&mfs, 0, sizeof(mfs));
+		if(part == NULL || index == NULL)
+			return -1;
+
+		mount_part(&mfs, part, index, index_size, true, &scan_st, &scan_ns, &scan_io);
+		SPIFFS_unmount(&mfs);
+		mfs.user_data = (void *)part;
+		if(SPIFFS_format(&mfs) != SPIFFS_OK || mount_part(&mfs, part, index, index_size, true, &scan_st, &scan_ns, &scan_io) != 0 ||
+				fill_part(&mfs, sizes[i], 32) != 0)
+			return -1;
+		SPIFFS_unmount(&mfs);
+
+		if(mount_part(&mfs, part, index, index_size, false, &scan_st, &scan_ns, &scan_io) != 0)
+			return -1;
+		SPIFFS_unmount(&mfs);
+		if(mount_part(&mfs, part, index, index_size, true, &ckpt_st, &ckpt_ns, &ckpt_io) != 0 || !mfs.ckpt_live ||
+				memcmp(&scan_st, &ckpt_st, sizeof(scan_st)) != 0){
+			printf("mount of %u KB: the checkpoint does not match the scan\n", sizes[i] / 1024);
+			return -1;
+		}
+
+		fd = SPIFFS_open(&mfs, "/f000", SPIFFS_O_CREAT|SPIFFS_O_WRONLY, 0);
+		if(fd < 0 || SPIFFS_write(&mfs, fd, index, 1000) != 1000 || SPIFFS_close(&mfs, fd) != SPIFFS_OK || mfs.ckpt_live)
+			return -1;
+		SPIFFS_unmount(&mfs);
+		if(mount_part(&mfs, part, index, index_size, false, &scan_st, &scan_ns, &scan_io) != 0)
+			return -1;
+		SPIFFS_unmount(&mfs);
+		if(mount_part(&mfs, part, index, index_size, true, &ckpt_st, &ckpt_ns, &ckpt_io) != 0 || !mfs.ckpt_live ||
+				memcmp(&scan_st, &ckpt_st, sizeof(scan_st)) != 0){
+			printf("mount of %u KB: the checkpoint saved after a write does not match the scan\n", sizes[i] / 1024);
+			return -1;
+		}
+		SPIFFS_unmount(&mfs);
+
+		printf("spiffs mount %5u KB: scan %8.1f us %5u reads %8llu bytes | checkpoint %6.1f us %2u reads %5llu bytes\n",
+				sizes[i] / 1024, scan_ns / 1e3, scan_io.reads, (unsigned long long)scan_io.read_bytes,
+				ckpt_ns / 1e3, ckpt_io.reads, (unsigned long long)ckpt_io.read_bytes);
+		free(index);
+	}
+
+	return 0;
+}
+#endif
+
+/* --- garbage collection --- */
+
+/* flash time of the operations, typical of the SPI NOR flash of the ESP32 modules */
+#define FLASH_OP_US 10 //command and address of a read or a write
+#define FLASH_READ_BPUS 5 //bytes read per us
+#define FLASH_PROG_US 700 //program of a 256 byte page
+#define FLASH_ERASE_US 45000 //erase of a 4 KB sector
+
+static uint32_t flash_us(const esp_partition_t *part, uint32_t *erases, esp_partition_ram_stats_t *acc)
+{
+	/* modeled time of the operations done on part since the last call, added to acc if not NULL */
+	esp_partition_ram_stats_t st;
+
+	esp_partition_ram_stats(part, &st, true);
+	*erases += st.erases;
+	if(acc != NULL){
+		acc->reads += st.reads;
+		acc->read_bytes += st.read_bytes;
+		acc->writes += st.writes;
+		acc->write_bytes += st.write_bytes;
+		acc->programs += st.programs;
+		acc->erases += st.erases;
+	}
+	return (st.reads + st.writes) * FLASH_OP_US + st.read_bytes / FLASH_READ_BPUS +
+			st.write_bytes * FLASH_PROG_US / 256 + st.erases * FLASH_ERASE_US;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	return *(const uint32_t *)a < *(const uint32_t *)b ? -1 : *(const uint32_t *)a > *(const uint32_t *)b;
+}
+
+static int gc_format(spiffs *gfs, const esp_partition_t *part)
+{
+	/* the first mount configures gfs for the format */
+	esp_partition_ram_stats_t io;
+	mount_state_t st;
+	uint64_t ns;
+
+	memset(gfs, 0, sizeof(*gfs));
+#if SPIFFS_RAM_INDEX
+	mount_part(gfs, part, spiffs_index_buf, sizeof(spiffs_index_buf), false, &st, &ns, &io);
+	SPIFFS_unmount(gfs);
+	if(SPIFFS_format(gfs) != SPIFFS_OK || mount_part(gfs, part, spiffs_index_buf, sizeof(spiffs_index_buf), false, &st, &ns, &io) != 0)
+		return -1;
+#else
+	mount_part(gfs, part, NULL, 0, false, &st, &ns, &io);
+	SPIFFS_unmount(gfs);
+	if(SPIFFS_format(gfs) != SPIFFS_OK || mount_part(gfs, part, NULL, 0, false, &st, &ns, &io) != 0)
+		return -1;
+#endif
+	return 0;
+}
+
+static int gc_run(const char *name, const esp_partition_t *part, bool background, int windows, int devices)
+{
+	/* the broker is not reachable: window files are appended in batches and closed, the oldest one of the
+	 * ring is truncated for the next window and the state file is rewritten. The latency of each of them
+	 * is the flash time of its operations; in background mode the idle time after each of them
+	 * runs slices for CONFIG_GC_BUDGET. Then the files of the ring are read back */
+	uint8_t buf[CONFIG_LOG_BATCH_RECORDS*PROBE_RECORD_MAX_LEN], rec[PROBE_RECORD_MAX_LEN];
+	uint32_t state[8] = { 0x474F4C53, CONFIG_LOG_SEGMENTS, 0, 0, 0, 0, 0, 0 };
+	uint32_t *lat, n = 0, stalls = 0, erases = 0, bg_blocks = 0, bg_pages = 0, us, e;
+	spiffs gfs;
+	spiffs_file fd;
+	char path[32];
+	size_t len;
+	int w, i, pending;
+	s32_t res;
+
+	lat = malloc(windows * (devices / CONFIG_LOG_BATCH_RECORDS + 4) * sizeof(uint32_t));
+	if(lat == NULL || gc_format(&gfs, part) != 0)
+		return -1;
+	flash_us(part, &erases, NULL);
+	erases = 0;
+
+	for(w=0; w<windows; w++){
+		seg_path(w, path);
+		e = 0;
+		fd = SPIFFS_open(&gfs, path, SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_APPEND|SPIFFS_O_WRONLY, 0);
+		lat[n++] = flash_us(part, &e, NULL);
+		if(fd < 0){
+			printf("spiffs gc %s: window %d could not be created, error %d\n", name, w, SPIFFS_errno(&gfs));
+			return -1;
+		}
+
+		make_hdr(w, (probe_file_hdr_t *)buf);
+		len = sizeof(probe_file_hdr_t);
+		for(i=0, pending=0; i<=devices; i++){
+			if(i < devices){
+				len += make_record(w, i, buf + len);
+				if(++pending < CONFIG_LOG_BATCH_RECORDS && i < devices-1)
+					continue;
+				if(SPIFFS_write(&gfs, fd, buf, len) != (s32_t)len){
+					printf("spiffs gc %s: window %d could not be appended, error %d (%d files of %d devices in %u KB)\n",
+							name, w, SPIFFS_errno(&gfs), CONFIG_LOG_SEGMENTS, devices, part->size / 1024);
+					return -1;
+				}
+			}
+			else if(SPIFFS_close(&gfs, fd) != SPIFFS_OK){
+				printf("spiffs gc %s: window %d could not be closed, error %d\n", name, w, SPIFFS_errno(&gfs));
+				return -1;
+			}
+			lat[n++] = flash_us(part, &e, NULL);
+			len = 0;
+			pending = 0;
+
+			for(us=0; background && us < CONFIG_GC_BUDGET; us+=flash_us(part, &erases, NULL)){
+				if((res = SPIFFS_gc_slice(&gfs, CONFIG_SPIFFS_GC_SLICE_PAGES)) < 0)
+					break;
+				bg_blocks++;
+				bg_pages += res;
+			}
+			SPIFFS_clearerr(&gfs);
+		}
+		state[2] = state[3] = w + 1;
+		fd = SPIFFS_open(&gfs, state_path(w), SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_WRONLY, 0);
+		if(fd < 0 || SPIFFS_write(&gfs, fd, state, sizeof(state)) != sizeof(state) || SPIFFS_close(&gfs, fd) != SPIFFS_OK)
+			return -1;
+		lat[n++] = flash_us(part, &e, NULL);
+		stalls += e;
+		erases += e;
+	}
+
+	for(w=windows > CONFIG_LOG_SEGMENTS ? windows-CONFIG_LOG_SEGMENTS : 0; w<windows; w++){
+		seg_path(w, path);
+		fd = SPIFFS_open(&gfs, path, SPIFFS_O_RDONLY, 0);
+		if(fd < 0 || SPIFFS_read(&gfs, fd, buf, sizeof(probe_file_hdr_t)) != sizeof(probe_file_hdr_t))
+			return -1;
+		for(i=0; i<devices; i++){
+			len = make_record(w, i, rec);
+			if(SPIFFS_read(&gfs, fd, buf, len) != (s32_t)len || memcmp(buf, rec, len) != 0){
+				printf("spiffs gc %s: window %d read back wrong\n", name, w);
+				return -1;
+			}
+		}
+		SPIFFS_close(&gfs, fd);
+	}
+	SPIFFS_unmount(&gfs);
+
+	qsort(lat, n, sizeof(uint32_t), cmp_u32);
+	printf("spiffs gc %-10s appends: p50 %6.1f ms p99 %6.1f ms p99.9 %6.1f ms max %6.1f ms, %u erases inside them | "
+			"%u erases, %u blocks and %u pages moved in background\n", name, lat[n/2] / 1e3, lat[n*99/100] / 1e3,
+			lat[n*999/1000] / 1e3, lat[n-1] / 1e3, stalls, erases, bg_blocks, bg_pages);
+	free(lat);
+	return 0;
+}
+
+static int bench_gc(int windows, int devices)
+{
+	const esp_partition_t *part = esp_partition_ram_add("gc", ESP_PARTITION_SUBTYPE_DATA_SPIFFS, SPIFFS_SIZE);
+
+	if(part == NULL)
+		return -1;
+	printf("%d windows of %d devices not sent, in a ring of %d files: flash time of %d us per read or write, "
+			"%d us per page programmed, %d us per erase\n", windows, devices, CONFIG_LOG_SEGMENTS,
+			FLASH_OP_US, FLASH_PROG_US, FLASH_ERASE_US);
+	if(gc_run("inline", part, false, windows, devices) != 0 || gc_run("background", part, true, windows, devices) != 0)
+		return -1;
+	return 0;
+}
+
+/* --- garbage collection policies --- */
+
+#define POLICY_MIN_SIZE 0x20000
+#define POLICY_FILL 80 //partition size in percent of a full ring of windows
+
+typedef struct {
+	uint16_t devices; //devices of the window
+	bool online; //the broker is reachable at the end of the window
+} trace_t;
+
+static trace_t *make_trace(int windows, int devices)
+{
+	/* a day of windows: the devices follow the time of the day with a jitter, the broker goes away
+	 * now and then for 100 windows on average (the files are kept, the oldest are dropped when they
+	 * are too many) and the backlog is sent when it comes back */
+	trace_t *trace = malloc(windows * sizeof(trace_t));
+	uint32_t s = 12345, day;
+	bool online = true;
+	int w;
+
+	for(w=0; trace != NULL && w<windows; w++){
+		day = w % 1440 < 720 ? w % 1440 : 1440 - w % 1440;
+		trace[w].devices = devices * (50 + 100 * day / 720) / 100 * (90 + rnd(&s) % 21) / 100;
+		if(rnd(&s) % 100 < 1)
+			online = !online;
+		trace[w].online = online;
+	}
+	return trace;
+}
+
+static int policy_send(spiffs *gfs, uint32_t window, int devices)
+{
+	uint8_t buf[PROBE_RECORD_MAX_LEN], rec[PROBE_RECORD_MAX_LEN];
+	char path[32];
+	spiffs_file fd;
+	int i, len, ret = 0;
+
+	seg_path(window, path);
+	fd = SPIFFS_open(gfs, path, SPIFFS_O_RDONLY, 0);
+	if(fd < 0 || SPIFFS_read(gfs, fd, buf, sizeof(probe_file_hdr_t)) != sizeof(probe_file_hdr_t))
+		return -1;
+	for(i=0; i<devices && ret == 0; i++){
+		len = make_record(window, i, rec);
+		if(SPIFFS_read(gfs, fd, buf, len) != len || memcmp(buf, rec, len) != 0)
+			ret = -1;
+	}
+	SPIFFS_close(gfs, fd);
+	return ret == 0 && SPIFFS_remove(gfs, path) == SPIFFS_OK ? 0 : -1;
+}
+
+static int policy_window(spiffs *gfs, const trace_t *trace, int w, uint32_t *sizes, uint32_t *tail, uint32_t *bytes,
+		uint32_t budget)
+{
+	/* write window w, drop or send the oldest ones and rewrite the state file: return 0 on success,
+	 * 1 if the file system is full, -1 if a window is read back wrong */
+	uint8_t buf[CONFIG_LOG_BATCH_RECORDS*PROBE_RECORD_MAX_LEN];
+	uint32_t state[8] = { 0x474F4C53, CONFIG_LOG_SEGMENTS, w + 1, w + 1, 0, 0, 0, 0 };
+	spiffs_file fd;
+	char path[32];
+	size_t len;
+	int d, pending;
+
+	seg_path(w, path);
+	fd = SPIFFS_open(gfs, path, SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_APPEND|SPIFFS_O_WRONLY, 0);
+	if(fd < 0)
+		return 1;
+	make_hdr(w, (probe_file_hdr_t *)buf);
+	len = sizeof(probe_file_hdr_t);
+	sizes[w] = 0;
+	for(d=0, pending=0; d<trace[w].devices; d++){
+		len += make_record(w, d, buf + len);
+		if(++pending < CONFIG_LOG_BATCH_RECORDS && d < trace[w].devices-1)
+			continue;
+		if(SPIFFS_write(gfs, fd, buf, len) != (s32_t)len){
+			SPIFFS_close(gfs, fd);
+			return 1;
+		}
+		sizes[w] += len;
+		len = 0;
+		pending = 0;
+	}
+	if(SPIFFS_close(gfs, fd) != SPIFFS_OK)
+		return 1;
+	payload += sizes[w];
+	*bytes += sizes[w];
+
+	/* seg_log_close(): a slot for the next window and the closed files within the budget */
+	while(w + 1 - *tail > CONFIG_LOG_SEGMENTS - 1 || (*bytes > budget && w + 1 - *tail > 1)){
+		seg_path(*tail, path);
+		if(SPIFFS_remove(gfs, path) != SPIFFS_OK)
+			return 1;
+		*bytes -= sizes[(*tail)++];
+	}
+
+	for(; trace[w].online && *tail <= (uint32_t)w; *bytes -= sizes[(*tail)++])
+		if(policy_send(gfs, *tail, trace[*tail].devices) != 0)
+			return -1;
+
+	state[4] = *tail;
+	fd = SPIFFS_open(gfs, state_path(w), SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_WRONLY, 0);
+	if(fd < 0 || SPIFFS_write(gfs, fd, state, sizeof(state)) != sizeof(state)){
+		SPIFFS_close(gfs, fd);
+		return 1;
+	}
+	return SPIFFS_close(gfs, fd) == SPIFFS_OK ? 0 : 1;
+}
+
+static int policy_run(const char *name, u8_t policy, const esp_partition_t *part, const trace_t *trace, int windows)
+{
+	/* replay the trace with the background slices after each window, as the sniffer does: the flash written
+	 * per byte of records and the spread of the erases of the sectors */
+	uint32_t sectors = part->size / SPI_FLASH_SEC_SIZE, tail = 0, bytes = 0, us, erases = 0, total, used, min, max, i;
+	uint32_t *sizes = malloc(windows * sizeof(uint32_t));
+	esp_partition_ram_stats_t io;
+	double mean, var = 0;
+	spiffs gfs;
+	int w, ret = 0;
+
+	sector_erases = calloc(sectors, sizeof(uint32_t));
+	if(sizes == NULL || sector_erases == NULL || gc_format(&gfs, part) != 0 || SPIFFS_info(&gfs, &total, &used) != SPIFFS_OK){
+		ret = -1;
+		windows = 0;
+	}
+	gfs.cfg.gc_policy = policy;
+	memset(sector_erases, 0, sectors * sizeof(uint32_t));
+	esp_partition_ram_stats(part, &io, true);
+	memset(&io, 0, sizeof(io));
+	payload = 0;
+	gc_write_bytes = 0;
+
+	for(w=0; w<windows && ret == 0; w++){
+		ret = policy_window(&gfs, trace, w, sizes, &tail, &bytes, total / 4 * 3);
+		flash_us(part, &erases, &io);
+		for(us=0; ret == 0 && us < CONFIG_GC_BUDGET; us+=flash_us(part, &erases, &io))
+			if(SPIFFS_gc_slice(&gfs, CONFIG_SPIFFS_GC_SLICE_PAGES) < 0)
+				break;
+		SPIFFS_clearerr(&gfs);
+	}
+	SPIFFS_unmount(&gfs);
+	flash_us(part, &erases, &io);
+
+	if(ret > 0)
+		printf("spiffs gc %-12s file system full at window %d (%u bytes of records)\n", name, w - 1, (unsigned)payload);
+	else if(ret < 0)
+		printf("spiffs gc %s: window %u read back wrong\n", name, tail);
+	else {
+		min = max = sector_erases[0];
+		for(i=0; i<sectors; i++){
+			min = sector_erases[i] < min ? sector_erases[i] : min;
+			max = sector_erases[i] > max ? sector_erases[i] : max;
+		}
+		mean = (double)io.erases / sectors;
+		for(i=0; i<sectors; i++)
+			var += (sector_erases[i] - mean) * (sector_erases[i] - mean);
+		printf("spiffs gc %-12s x%.3f written (x%.3f moving pages), %5u erases, erases per sector: min %3u mean %6.1f "
+				"max %3u sd %5.1f\n", name, (double)io.write_bytes / payload, (double)gc_write_bytes / payload, io.erases,
+				min, mean, max, sqrt(var / sectors));
+	}
+	free(sector_erases);
+	sector_erases = NULL;
+	free(sizes);
+	return ret < 0 ? -1 : 0;
+}
+
+static uint32_t policy_size(int devices)
+{
+	/* the budget of the closed windows (3/4 of the file system) holds about 3/5 of a full ring of windows of
+	 * the average size: while the broker is away the budget evicts the oldest ones, the file system stays
+	 * 3/4 full and the garbage collection has to move live pages. Smaller, greedy fills it up */
+	uint32_t size = CONFIG_LOG_SEGMENTS * devices * (sizeof(probe_record_t) + 16) * POLICY_FILL / 100;
+
+	size = (size + 0xFFFF) & ~0xFFFF;
+	return size > POLICY_MIN_SIZE ? size : POLICY_MIN_SIZE;
+}
+
+static int bench_policy(int windows, int devices)
+{
+	const esp_partition_t *part = esp_partition_ram_add("policy", ESP_PARTITION_SUBTYPE_DATA_SPIFFS, policy_size(devices));
+	trace_t *trace = make_trace(windows, devices);
+	int ret = -1;
+
+	if(part == NULL || trace == NULL)
+		return -1;
+	printf("trace of %d windows of %d devices on average, with the broker away now and then, in %u KB\n", windows, devices,
+			part->size / 1024);
+	if(policy_run("greedy", SPIFFS_GC_POLICY_GREEDY, part, trace, windows) == 0 &&
+			policy_run("cost-benefit", SPIFFS_GC_POLICY_COST_BENEFIT, part, trace, windows) == 0 &&
+			policy_run("hot/cold", SPIFFS_GC_POLICY_HOT_COLD, part, trace, windows) == 0)
+		ret = 0;
+	free(trace);
+	return ret;
+}
+
+/* --- appends --- */
+
+static int append_window(spiffs *afs, uint32_t window, int devices, int batch, spiffs_flags flags)
+{
+	/* the records of a window appended to a new file in writes of batch records */
+	uint8_t buf[CONFIG_LOG_BATCH_RECORDS*PROBE_RECORD_MAX_LEN];
+	char path[32];
+	spiffs_file fd;
+	size_t len = 0;
+	int i, pending = 0;
+
+	seg_path(window, path);
+	fd = SPIFFS_open(afs, path, SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_WRONLY|flags, 0);
+	if(fd < 0){
+		printf("spiffs: %s could not be created, error %d\n", path, SPIFFS_errno(afs));
+		return -1;
+	}
+	for(i=0; i<devices; i++){
+		len += make_record(window, i, buf + len);
+		if(++pending < batch && i < devices-1)
+			continue;
+		if(SPIFFS_write(afs, fd, buf, len) != (s32_t)len){
+			printf("spiffs: %s could not be appended after %d records, error %d\n", path, i+1-pending, SPIFFS_errno(afs));
+			SPIFFS_close(afs, fd);
+			return -1;
+		}
+		payload += len;
+		len = 0;
+		pending = 0;
+	}
+	return SPIFFS_close(afs, fd) == SPIFFS_OK ? 0 : -1;
+}
+
+static int append_check(spiffs *afs, uint32_t window, int from, int to)
+{
+	/* the file of window holds the records from..to-1 of window, and nothing else */
+	uint8_t buf[PROBE_RECORD_MAX_LEN], rec[PROBE_RECORD_MAX_LEN];
+	char path[32];
+	spiffs_file fd;
+	int i, len, ret = 0;
+
+	seg_path(window, path);
+	fd = SPIFFS_open(afs, path, SPIFFS_O_RDONLY, 0);
+	if(fd < 0)
+		return -1;
+	for(i=from; i<to && ret == 0; i++){
+		len = make_record(window, i, rec);
+		if(SPIFFS_read(afs, fd, buf, len) != len || memcmp(buf, rec, len) != 0)
+			ret = -1;
+	}
+	if(ret == 0 && SPIFFS_read(afs, fd, buf, 1) > 0)
+		ret = -1;
+	SPIFFS_close(afs, fd);
+	return ret;
+}
+
+static int append_run(const char *name, const esp_partition_t *part, int windows, int devices, int batch, spiffs_flags flags)
+{
+	/* page programs of the flash per KB of records appended, in the files of a ring written one at a time */
+	esp_partition_ram_stats_t io;
+	spiffs afs;
+	int w;
+
+	if(gc_format(&afs, part) != 0)
+		return -1;
+	esp_partition_ram_stats(part, &io, true);
+	payload = 0;
+	for(w=0; w<windows; w++){
+		if(append_window(&afs, w, devices, batch, flags) != 0 || append_check(&afs, w, 0, devices) != 0){
+			printf("spiffs append %s: window %d read back wrong\n", name, w);
+			SPIFFS_unmount(&afs);
+			return -1;
+		}
+	}
+	SPIFFS_unmount(&afs);
+	esp_partition_ram_stats(part, &io, true);
+
+	printf("spiffs append %-26s %6.2f page programs/KB %6.2f writes/KB %6.2f KB written/KB %6.3f erases/KB\n", name,
+			io.programs * 1024.0 / payload, io.writes * 1024.0 / payload, (double)io.write_bytes / payload,
+			io.erases * 1024.0 / payload);
+	return 0;
+}
+
+static int lookup_pages(spiffs *afs, const esp_partition_t *part, spiffs_obj_id obj_id)
+{
+	/* data pages of obj_id not deleted in the object lookup of every block */
+	spiffs_obj_id lu[SPI_FLASH_SEC_SIZE / 256];
+	int n = 0;
+	u32_t bix, i;
+
+	for(bix=0; bix<afs->block_count; bix++){
+		esp_partition_read(part, bix * SPI_FLASH_SEC_SIZE, lu, sizeof(lu));
+		for(i=0; i<SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(afs); i++)
+			n += lu[i] == obj_id;
+	}
+	return n;
+}
+
+static int append_reset(const esp_partition_t *part, int devices)
+{
+	/* a reset while a file is appended: the file holds the bytes appended up to the last fflush at least, and
+	 * nothing else than the bytes appended. The pages written after the last commit are not part of it: the rest
+	 * is appended again and every block holding pages of the file is cleaned by the gc, which must scrap them */
+	static uint8_t stream[PROBE_RECORD_MAX_LEN*1024], file[PROBE_RECORD_MAX_LEN*1024];
+	spiffs_obj_id lu[SPI_FLASH_SEC_SIZE / 256];
+	esp_partition_ram_stats_t io;
+	mount_state_t st;
+	spiffs_stat s;
+	spiffs_file fd;
+	spiffs afs;
+	uint64_t ns;
+	int i, n, lost, left;
+	u32_t bix, blocks[32], nblocks, len = 0, flushed = 0, size;
+	bool found;
+
+	for(n=0; n<devices && len + PROBE_RECORD_MAX_LEN <= sizeof(stream); n++)
+		len += make_record(0, n, stream + len);
+
+	if(gc_format(&afs, part) != 0)
+		return -1;
+	fd = SPIFFS_open(&afs, "/win00.log", SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_APPEND|SPIFFS_O_WRONLY, 0);
+	if(fd < 0)
+		return -1;
+	for(i=0; i<n; i++){ //writes of the size of a record, fflush after half of them
+		if(SPIFFS_write(&afs, fd, stream + i * len / n, (i + 1) * len / n - i * len / n) < 0)
+			return -1;
+		if(i == n / 2 - 1){
+			if(SPIFFS_fflush(&afs, fd) < 0)
+				return -1;
+			flushed = (i + 1) * len / n;
+		}
+	}
+
+	/* reset: the fd and the RAM state are lost, nothing else is written */
+	memset(&afs, 0, sizeof(afs));
+	if(mount_part(&afs, part, spiffs_index_buf, sizeof(spiffs_index_buf), false, &st, &ns, &io) != 0 ||
+			SPIFFS_stat(&afs, "/win00.log", &s) != SPIFFS_OK || s.size < flushed || s.size > len ||
+			(fd = SPIFFS_open(&afs, "/win00.log", SPIFFS_O_RDONLY, 0)) < 0 ||
+			SPIFFS_read(&afs, fd, file, s.size) != (s32_t)s.size || memcmp(file, stream, s.size) != 0){
+		printf("spiffs append reset: the file is not a part of the bytes appended up to the last fflush\n");
+		return -1;
+	}
+	SPIFFS_close(&afs, fd);
+	size = s.size;
+	lost = lookup_pages(&afs, part, s.obj_id) - (s.size + SPIFFS_DATA_PAGE_SIZE(&afs) - 1) / SPIFFS_DATA_PAGE_SIZE(&afs);
+
+	fd = SPIFFS_open(&afs, "/win00.log", SPIFFS_O_APPEND|SPIFFS_O_WRONLY, 0);
+	if(fd < 0 || SPIFFS_write(&afs, fd, stream + size, len - size) != (s32_t)(len - size) ||
+			SPIFFS_close(&afs, fd) != SPIFFS_OK || SPIFFS_stat(&afs, "/win00.log", &s) != SPIFFS_OK)
+		return -1;
+	for(bix=0, nblocks=0; bix<afs.block_count && nblocks<sizeof(blocks)/sizeof(blocks[0]); bix++){
+		esp_partition_read(part, bix * SPI_FLASH_SEC_SIZE, lu, sizeof(lu));
+		for(i=0, found=false; i<(int)SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(&afs); i++)
+			found |= lu[i] == s.obj_id;
+		if(found)
+			blocks[nblocks++] = bix;
+	}
+	for(i=0; i<(int)nblocks; i++){ //the pages moved by the gc are not chased: the blocks are not erased
+		bix = blocks[i];
+		afs.cleaning = 1;
+		if(spiffs_gc_clean(&afs, bix) != SPIFFS_OK)
+			return -1;
+		afs.cleaning = 0;
+	}
+	left = lookup_pages(&afs, part, s.obj_id) - (s.size + SPIFFS_DATA_PAGE_SIZE(&afs) - 1) / SPIFFS_DATA_PAGE_SIZE(&afs);
+	if(append_check(&afs, 0, 0, n) != 0 || left != 0){
+		printf("spiffs append reset: the file is wrong after the gc (%d pages not in the file)\n", left);
+		return -1;
+	}
+	SPIFFS_unmount(&afs);
+
+	printf("spiffs append reset: %u of %u bytes found after the reset (%u flushed), %d data pages written after "
+			"the last commit scrapped by the gc\n", (unsigned)size, (unsigned)len, (unsigned)flushed, lost);
+	return 0;
+}
+
+static int bench_append(int windows, int devices)
+{
+	const esp_partition_t *part = esp_partition_ram_add("append", ESP_PARTITION_SUBTYPE_DATA_SPIFFS, SPIFFS_SIZE);
+
+	if(part == NULL)
+		return -1;
+	printf("%d windows of %d devices appended to the files of a ring, written one record at a time or in batches "
+			"of %d\n", windows, devices, CONFIG_LOG_BATCH_RECORDS);
+	if(append_run("records, write at the end", part, windows, devices, 1, 0) != 0 ||
+			append_run("records, O_APPEND", part, windows, devices, 1, SPIFFS_O_APPEND) != 0 ||
+			append_run("batches, write at the end", part, windows, devices, CONFIG_LOG_BATCH_RECORDS, 0) != 0 ||
+			append_run("batches, O_APPEND", part, windows, devices, CONFIG_LOG_BATCH_RECORDS, SPIFFS_O_APPEND) != 0)
+		return -1;
+	return append_reset(part, devices);
+}
+
+/* --- reads --- */
+
+static int read_window(spiffs *rfs, uint32_t window, int devices, s32_t chunk)
+{
+	/* send_file(): the file of window read to the end in reads of chunk bytes, and checked */
+	static uint8_t file[PROBE_RECORD_MAX_LEN*1024];
+	uint8_t rec[PROBE_RECORD_MAX_LEN];
+	char path[32];
+	spiffs_file fd;
+	size_t size = 0;
+	s32_t n;
+	int i, len;
+
+	seg_path(window, path);
+	fd = SPIFFS_open(rfs, path, SPIFFS_O_RDONLY, 0);
+	if(fd < 0)
+		return -1;
+	while(size + chunk <= sizeof(file) && (n = SPIFFS_read(rfs, fd, file + size, chunk)) > 0)
+		size += n;
+	SPIFFS_close(rfs, fd);
+
+	for(i=0, n=0; i<devices; i++){
+		len = make_record(window, i, rec);
+		if(n + len > (s32_t)size || memcmp(file + n, rec, len) != 0)
+			return -1;
+		n += len;
+	}
+	return n == (s32_t)size ? 0 : -1;
+}
+
+static int bench_read(int windows, int devices)
+{
+	/* the window files left in the ring by the appends, read back through a stdio buffer and in bigger reads */
+	static const s32_t chunks[] = { STDIO_BUF, 1024 };
+	const esp_partition_t *part = esp_partition_ram_add("read", ESP_PARTITION_SUBTYPE_DATA_SPIFFS, SPIFFS_SIZE);
+	esp_partition_ram_stats_t io;
+	spiffs rfs;
+	uint32_t erases = 0, us;
+	uint64_t ns;
+	int c, w, first = windows > CONFIG_LOG_SEGMENTS ? windows - CONFIG_LOG_SEGMENTS : 0;
+
+	if(part == NULL || gc_format(&rfs, part) != 0)
+		return -1;
+	for(w=0; w<windows; w++)
+		if(append_window(&rfs, w, devices, CONFIG_LOG_BATCH_RECORDS, SPIFFS_O_APPEND) != 0)
+			return -1;
+
+	printf("%d window files of %d devices read back from a ring of %d files\n", windows - first, devices,
+			CONFIG_LOG_SEGMENTS);
+	for(c=0; c<(int)(sizeof(chunks)/sizeof(chunks[0])); c++){
+		memset(&io, 0, sizeof(io));
+		flash_us(part, &erases, NULL);
+		ns = now_ns();
+		for(w=first, us=0; w<windows; w++){
+			if(read_window(&rfs, w, devices, chunks[c]) != 0){
+				printf("spiffs read: window %d read back wrong\n", w);
+				return -1;
+			}
+			us += flash_us(part, &erases, &io);
+		}
+		ns = now_ns() - ns;
+		printf("spiffs read %4d bytes at a time: %6.1f us/file (flash %7.1f us) %6.1f reads %8.0f bytes\n",
+				(int)chunks[c], ns / 1000.0 / (windows - first), (double)us / (windows - first),
+				(double)io.reads / (windows - first), (double)io.read_bytes / (windows - first));
+	}
+	SPIFFS_unmount(&rfs);
+	return 0;
+}
+
+/* --- uploader --- */
+
+#define PAYLOAD_SIZE (1024-64) //PAYLOAD_SIZE of main.c
+
+typedef struct {
+	/* a FILE of newlib: the reads go through a buffer of STDIO_BUF bytes */
+	spiffs *fs;
+	spiffs_file fd;
+	uint8_t buf[STDIO_BUF];
+	size_t pos, len;
+} stdio_file_t;
+
+static size_t stdio_fread(stdio_file_t *fp, void *dst, size_t n)
+{
+	size_t done = 0, k;
+	s32_t r;
+
+	while(done < n){
+		if(fp->pos == fp->len){
+			if((r = SPIFFS_read(fp->fs, fp->fd, fp->buf, STDIO_BUF)) <= 0)
+				break;
+			fp->pos = 0;
+			fp->len = r;
+		}
+		k = n - done < fp->len - fp->pos ? n - done : fp->len - fp->pos;
+		memcpy((uint8_t *)dst + done, fp->buf + fp->pos, k);
+		fp->pos += k;
+		done += k;
+	}
+	return done;
+}
+
+static int stdio_read_frame(stdio_file_t *fp, uint8_t *frame)
+{
+	/* read_frame() of main.c before esp_spiffs_read_records */
+	size_t len;
+
+	if(stdio_fread(fp, frame, 2) != 2)
+		return 0;
+	len = probe_frame_len(frame);
+	if(len > PROBE_FRAME_MAX || stdio_fread(fp, frame+2, len-2) != len-2)
+		return 0;
+	return len;
+}
+
+static uint32_t publish(const uint8_t *msg, size_t len, uint32_t sum)
+{
+	/* esp_mqtt_client_publish(): a checksum of the messages, the same for both paths */
+	size_t i;
+
+	for(i=0; i<len; i++)
+		sum = sum * 31 + msg[i];
+	return sum * 31 + len;
+}
+
+static int upload_stdio(spiffs *ufs, const char *path, uint32_t *sum, size_t *bytes)
+{
+	/* send_file() through fopen and fread: SPIFFS -> FILE buffer -> frame -> message */
+	stdio_file_t fp;
+	uint8_t buffer[PAYLOAD_SIZE], frame[PROBE_FRAME_MAX];
+	probe_file_hdr_t *hdr = (probe_file_hdr_t *)buffer;
+	int frame_len;
+	size_t len;
+
+	memset(&fp, 0, sizeof(fp));
+	fp.fs = ufs;
+	if((fp.fd = SPIFFS_open(ufs, path, SPIFFS_O_RDONLY, 0)) < 0)
+		return -1;
+	if(stdio_fread(&fp, hdr, sizeof(*hdr)) != sizeof(*hdr) || !probe_file_hdr_valid(hdr)){
+		SPIFFS_close(ufs, fp.fd);
+		return -1;
+	}
+	frame_len = stdio_read_frame(&fp, frame);
+	while(true){
+		len = sizeof(*hdr);
+		while(frame_len > 0 && len+frame_len <= PAYLOAD_SIZE){
+			memcpy(buffer+len, frame, frame_len);
+			len += frame_len;
+			frame_len = stdio_read_frame(&fp, frame);
+		}
+		if(frame_len == 0)
+			hdr->flags |= PROBE_FLAG_LAST;
+		*sum = publish(buffer, len, *sum);
+		*bytes += len;
+		if(frame_len == 0)
+			break;
+	}
+	SPIFFS_close(ufs, fp.fd);
+	return 0;
+}
+
+static s32_t frame_len(const u8_t *frame, u32_t avail)
+{
+	/* frame_len() of main.c */
+	size_t len;
+
+	if(avail < 2)
+		return 0;
+	len = probe_frame_len(frame);
+	return len > PROBE_FRAME_MAX ? -1 : (s32_t)len;
+}
+
+static int upload_records(spiffs *ufs, const char *path, uint32_t *sum, size_t *bytes)
+{
+	/* send_file() with esp_spiffs_read_records: SPIFFS -> message */
+	uint8_t buffer[PAYLOAD_SIZE];
+	probe_file_hdr_t *hdr = (probe_file_hdr_t *)buffer;
+	spiffs_file fd;
+	spiffs_stat s;
+	s32_t n;
+	size_t len;
+	bool last;
+
+	if((fd = SPIFFS_open(ufs, path, SPIFFS_O_RDONLY, 0)) < 0 || SPIFFS_fstat(ufs, fd, &s) != SPIFFS_OK)
+		return -1;
+	if(SPIFFS_read(ufs, fd, hdr, sizeof(*hdr)) != sizeof(*hdr) || !probe_file_hdr_valid(hdr)){
+		SPIFFS_close(ufs, fd);
+		return -1;
+	}
+	do{
+		len = sizeof(*hdr);
+		if((n = SPIFFS_read_records(ufs, fd, buffer+len, PAYLOAD_SIZE-len, frame_len)) < 0)
+			break;
+		len += n;
+		last = (u32_t)SPIFFS_tell(ufs, fd) >= s.size;
+		if(last)
+			hdr->flags |= PROBE_FLAG_LAST;
+		*sum = publish(buffer, len, *sum);
+		*bytes += len;
+	} while(!last);
+	SPIFFS_close(ufs, fd);
+	return n < 0 ? -1 : 0;
+}
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return now_ns();
+#endif
+}
+
+static int bench_upload(int windows, int devices)
+{
+	/* a window file of frames sent windows times through each path: CPU cycles per byte of the messages */
+	static int (*const paths[])(spiffs *, const char *, uint32_t *, size_t *) = { upload_stdio, upload_records };
+	static const char *const names[] = { "fopen/fread", "SPIFFS_read_records" };
+	const esp_partition_t *part = esp_partition_ram_add("upload", ESP_PARTITION_SUBTYPE_DATA_SPIFFS, SPIFFS_SIZE);
+	uint8_t buf[PROBE_FRAME_MAX+PROBE_RECORD_MAX_LEN];
+	esp_partition_ram_stats_t io;
+	uint32_t sums[2] = { 0, 0 }, erases = 0;
+	uint64_t c0;
+	size_t len = 0, flen, bytes;
+	spiffs_file fd;
+	spiffs ufs;
+	int p, w, i, rlen;
+
+	if(part == NULL || gc_format(&ufs, part) != 0)
+		return -1;
+	/* the window file: a header and frames of whole records (the frames of window_append) */
+	fd = SPIFFS_open(&ufs, "/win00.log", SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_APPEND|SPIFFS_O_WRONLY, 0);
+	make_hdr(0, (probe_file_hdr_t *)buf);
+	if(fd < 0 || SPIFFS_write(&ufs, fd, buf, sizeof(probe_file_hdr_t)) < 0)
+		return -1;
+	for(i=0, flen=2; i<=devices; i++){
+		rlen = i < devices ? make_record(0, i, buf + flen) : 0;
+		if(i == devices || flen + rlen > PROBE_FRAME_MAX){
+			buf[0] = (flen - 2) & 0xFF;
+			buf[1] = (flen - 2) >> 8;
+			if(SPIFFS_write(&ufs, fd, buf, flen) != (s32_t)flen)
+				return -1;
+			len += flen;
+			memmove(buf + 2, buf + flen, rlen);
+			flen = 2;
+		}
+		flen += rlen;
+	}
+	if(SPIFFS_close(&ufs, fd) != SPIFFS_OK)
+		return -1;
+
+	printf("a window file of %d devices (%u bytes of frames) sent %d times, messages of %d bytes at most\n",
+			devices, (unsigned)len, windows, PAYLOAD_SIZE);
+	for(p=0; p<2; p++){
+		flash_us(part, &erases, NULL);
+		memset(&io, 0, sizeof(io));
+		bytes = 0;
+		c0 = cycles();
+		for(w=0; w<windows; w++){
+			if(paths[p](&ufs, "/win00.log", &sums[p], &bytes) != 0)
+				return -1;
+		}
+		c0 = cycles() - c0;
+		flash_us(part, &erases, &io);
+		printf("spiffs upload %-20s %6.3f bytes/cycle %8.0f cycles/file %6.1f reads/file\n", names[p],
+				(double)bytes / c0, (double)c0 / windows, (double)io.reads / windows);
+	}
+	SPIFFS_unmount(&ufs);
+	if(sums[0] != sums[1]){
+		printf("spiffs upload: the messages are not the same\n");
+		return -1;
+	}
+	return 0;
+}
+
+/* --- concurrent sniffer and uploader --- */
+
+#define CONC_MIN_SIZE 0x80000 //a partition filled by the ring of window files: the gc erases blocks meanwhile
+#define CONC_WINDOWS 40
+#define CONC_BATCH_US 2000 //the sniffer waits for the records of a batch
+#define CONC_PUBLISH_US 1000 //the uploader publishes a message
+
+/* one SPI flash: while bench_concurrent runs an operation holds it for its modeled time */
+static pthread_mutex_t flash_bus = PTHREAD_MUTEX_INITIALIZER;
+static bool flash_timed; //set before the threads are created
+
+static void sleep_us(uint64_t us)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	t.tv_nsec += us * 1000;
+	t.tv_sec += t.tv_nsec / 1000000000;
+	t.tv_nsec %= 1000000000;
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) != 0);
+}
+
+static void flash_begin(int op, u32_t size)
+{
+	if(!flash_timed)
+		return;
+	pthread_mutex_lock(&flash_bus);
+	sleep_us(FLASH_OP_US + (op == 0 ? size / FLASH_READ_BPUS : op == 1 ? size * FLASH_PROG_US / 256 :
+			size / SPI_FLASH_SEC_SIZE * FLASH_ERASE_US));
+}
+
+static void flash_end(void)
+{
+	if(flash_timed)
+		pthread_mutex_unlock(&flash_bus);
+}
+
+typedef struct {
+	spiffs *fs;
+	bool done; //the sniffer has written its windows (atomic)
+	int devices;
+	uint32_t sum; //checksum of the file read by the uploader
+	uint32_t writes, files, bad;
+	uint64_t write_ns, max_write_ns;
+	uint64_t wait_ns[2]; //time waited for the lock by the sniffer and by the uploader
+	uint32_t waits[2];
+	int err;
+} conc_t;
+
+static uint32_t conc_size(int devices)
+{
+	/* the ring, the file truncated for the next window and the file of the uploader take about 2/3 of it
+	 * (the records have 0-3 SSIDs of 0-11 bytes: sizeof(probe_record_t) + 16 bytes on average) */
+	uint32_t size = (CONFIG_LOG_SEGMENTS + 2) * devices * (sizeof(probe_record_t) + 16) * 3 / 2;
+
+	size = (size + 0xFFFF) & ~0xFFFF;
+	return size > CONC_MIN_SIZE ? size : CONC_MIN_SIZE;
+}
+
+static void *conc_sniffer(void *arg)
+{
+	/* log_writer: the windows appended to the ring of files in batches, the latency of each write */
+	conc_t *c = arg;
+	uint8_t buf[CONFIG_LOG_BATCH_RECORDS*PROBE_RECORD_MAX_LEN];
+	char path[32];
+	spiffs_file fd;
+	uint64_t t;
+	size_t len;
+	int w, i, pending;
+
+	for(w=1; w<=CONC_WINDOWS && c->err == 0; w++){
+		seg_path(w, path);
+		fd = SPIFFS_open(c->fs, path, SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_WRONLY|SPIFFS_O_APPEND, 0);
+		if(fd < 0){
+			printf("spiffs concurrent: %s could not be created, error %d\n", path, SPIFFS_errno(c->fs));
+			c->err = -1;
+			break;
+		}
+		for(i=0, len=0, pending=0; i<c->devices; i++){
+			len += make_record(w, i, buf + len);
+			if(++pending < CONFIG_LOG_BATCH_RECORDS && i < c->devices-1)
+				continue;
+			sleep_us(CONC_BATCH_US);
+			t = now_ns();
+			if(SPIFFS_write(c->fs, fd, buf, len) != (s32_t)len){
+				printf("spiffs concurrent: %s could not be appended, error %d\n", path, SPIFFS_errno(c->fs));
+				c->err = -1;
+				break;
+			}
+			t = now_ns() - t;
+			c->write_ns += t;
+			if(t > c->max_write_ns)
+				c->max_write_ns = t;
+			c->writes++;
+			len = 0;
+			pending = 0;
+		}
+		if(SPIFFS_close(c->fs, fd) != SPIFFS_OK)
+			c->err = -1;
+	}
+	c->wait_ns[0] = lock_wait_ns;
+	c->waits[0] = lock_waits;
+	__atomic_store_n(&c->done, true, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void *conc_uploader(void *arg)
+{
+	/* send_file: the window file of the uploader read again and again in messages until the sniffer is done */
+	conc_t *c = arg;
+	uint8_t msg[PAYLOAD_SIZE];
+	uint32_t sum;
+	spiffs_file fd;
+	s32_t n;
+
+	while(!__atomic_load_n(&c->done, __ATOMIC_ACQUIRE)){
+		if((fd = SPIFFS_open(c->fs, "/upload.log", SPIFFS_O_RDONLY, 0)) < 0){
+			c->err = -1;
+			break;
+		}
+		sum = 0;
+		while((n = SPIFFS_read(c->fs, fd, msg, sizeof(msg))) > 0){
+			sum = publish(msg, n, sum);
+			sleep_us(CONC_PUBLISH_US);
+		}
+		SPIFFS_close(c->fs, fd);
+		if(n < 0 || sum != c->sum)
+			c->bad++;
+		c->files++;
+	}
+	c->wait_ns[1] = lock_wait_ns;
+	c->waits[1] = lock_waits;
+	return NULL;
+}
+
+static int bench_concurrent(int devices)
+{
+	/* the uploader reads a window file while the sniffer appends to the ring: the flash is shared (each operation
+	 * takes its modeled time), the time each of them waits for the lock of the file system is counted */
+	const esp_partition_t *part = esp_partition_ram_add("concurrent", ESP_PARTITION_SUBTYPE_DATA_SPIFFS, conc_size(devices));
+	uint8_t buf[CONFIG_LOG_BATCH_RECORDS*PROBE_RECORD_MAX_LEN];
+	pthread_t sniffer, uploader;
+	spiffs cfs;
+	spiffs_file fd;
+	conc_t c;
+	uint32_t erases = 0;
+	size_t len;
+	int i, w;
+
+	memset(&c, 0, sizeof(c));
+	c.fs = &cfs;
+	c.devices = devices;
+	if(part == NULL || gc_format(&cfs, part) != 0){
+		printf("spiffs concurrent: impossible to create a partition of %u KB\n", conc_size(devices) / 1024);
+		return -1;
+	}
+	/* the file to send (its records in one go) and a full ring */
+	fd = SPIFFS_open(&cfs, "/upload.log", SPIFFS_O_CREAT|SPIFFS_O_TRUNC|SPIFFS_O_WRONLY, 0);
+	for(i=0; i<devices && fd >= 0; i++){
+		len = make_record(1000000, i, buf);
+		c.sum = publish(buf, len, c.sum);
+		if(SPIFFS_write(&cfs, fd, buf, len) != (s32_t)len)
+			break;
+	}
+	if(fd < 0 || i < devices || SPIFFS_close(&cfs, fd) != SPIFFS_OK){
+		printf("spiffs concurrent: the file to upload could not be written, error %d\n", SPIFFS_errno(&cfs));
+		return -1;
+	}
+	/* the uploader sees its file as it was written in one go, in messages */
+	fd = SPIFFS_open(&cfs, "/upload.log", SPIFFS_O_RDONLY, 0);
+	for(c.sum=0; (len = SPIFFS_read(&cfs, fd, buf, PAYLOAD_SIZE)) > 0; )
+		c.sum = publish(buf, len, c.sum);
+	SPIFFS_close(&cfs, fd);
+	for(w=-CONFIG_LOG_SEGMENTS+1; w<=0; w++)
+		if(append_window(&cfs, w, devices, CONFIG_LOG_BATCH_RECORDS, SPIFFS_O_APPEND) != 0)
+			return -1;
+#if SPIFFS_READ_UNLOCKED
+	cfs.stats_ra_unlocked = cfs.stats_ra_retries = 0;
+#endif
+	flash_us(part, &erases, NULL);
+	erases = 0;
+
+	flash_timed = true;
+	pthread_create(&uploader, NULL, conc_uploader, &c);
+	pthread_create(&sniffer, NULL, conc_sniffer, &c);
+	pthread_join(sniffer, NULL);
+	pthread_join(uploader, NULL);
+	flash_timed = false;
+	flash_us(part, &erases, NULL);
+
+	printf("%d windows appended to a %u KB partition while the uploader reads a window file in %d byte messages (%u erases)\n",
+			CONC_WINDOWS, part->size / 1024, PAYLOAD_SIZE, erases);
+	printf("spiffs concurrent: sniffer %6.0f us/write (slowest %6.0f us), waited %5u times %7.1f ms for the lock\n",
+			c.write_ns / 1000.0 / c.writes, c.max_write_ns / 1000.0, c.waits[0], c.wait_ns[0] / 1e6);
+	printf("spiffs concurrent: uploader %4u files read, waited %5u times %7.1f ms for the lock",
+			c.files, c.waits[1], c.wait_ns[1] / 1e6);
+#if SPIFFS_READ_UNLOCKED
+	printf(", %u reads ahead without the lock (%u read again)", cfs.stats_ra_unlocked, cfs.stats_ra_retries);
+#endif
+	printf("\n");
+	for(w=CONC_WINDOWS-CONFIG_LOG_SEGMENTS+1; w<=CONC_WINDOWS && c.err == 0; w++)
+		if(append_check(&cfs, w, 0, devices) != 0)
+			c.err = -1;
+	SPIFFS_unmount(&cfs);
+	if(c.err != 0 || c.bad != 0){
+		printf("spiffs concurrent: %u files read wrong, error %d\n", c.bad, c.err);
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int windows = argc > 1 ? atoi(argv[1]) : 500;
+	int devices = argc > 2 ? atoi(argv[2]) : 150;
+	const esp_partition_t *raw_part;
+	bench_result_t res;
+	raw_log_stats_t st;
+
+	spiffs_part = esp_partition_ram_add("storage", ESP_PARTITION_SUBTYPE_DATA_SPIFFS, SPIFFS_SIZE);
+	raw_part = esp_partition_ram_add("rawlog", 0x40, RAWLOG_SIZE);
+#if SPIFFS_CHECKPOINT
+	ckpt_part = esp_partition_ram_add("spiffs_ckpt", 0x41, CKPT_SIZE);
+#endif
+	if(spiffs_part == NULL || raw_part == NULL || spiffs_mount_ram() != 0 || raw_log_mount(&raw_log, raw_part) != 0){
+		printf("Impossible to create the partitions\n");
+		return 1;
+	}
+
+	printf("%d windows of %d devices, sent after each window\n", windows, devices);
+	if(run("spiffs", spiffs_part, spiffs_write_window, spiffs_send_window, windows, devices, &res) != 0)
+		return 1;
+	printf("spiffs cache: %u pages, %u hits, %u misses, %u evictions\n", spiffs_get_cache(&fs)->cpage_count,
+			spiffs_get_cache(&fs)->hits, spiffs_get_cache(&fs)->misses, spiffs_get_cache(&fs)->evictions);
+#if SPIFFS_RAM_INDEX
+	if(spiffs_ram_index_get(&fs) != NULL)
+		printf("spiffs index: %u bytes, %u files, %u lookups in RAM, %u scans\n", (unsigned)sizeof(spiffs_index_buf),
+				spiffs_ram_index_get(&fs)->obj_count, spiffs_ram_index_get(&fs)->hits, spiffs_ram_index_get(&fs)->scans);
+#endif
+	if(run("raw_log", raw_part, raw_write_window, raw_send_window, windows, devices, &res) != 0)
+		return 1;
+
+	raw_log_get_stats(&raw_log, &st);
+	printf("raw_log: %u records, %u erases, %u evicted sectors, %u bad entries\n",
+			st.records, st.erases, st.evicted_sectors, st.bad_entries);
+
+	if(check_recovery(raw_part, devices) != 0)
+		return 1;
+
+	if(bench_gc(windows, devices) != 0){
+		printf("spiffs gc: a window could not be written\n");
+		return 1;
+	}
+	if(bench_policy(windows, devices) != 0){
+		printf("spiffs gc: the trace could not be replayed\n");
+		return 1;
+	}
+	if(bench_append(windows / 10, devices) != 0 || bench_read(windows / 10, devices) != 0 ||
+			bench_upload(windows, devices) != 0 || bench_concurrent(devices) != 0)
+		return 1;
+
+#if SPIFFS_CHECKPOINT
+	return bench_mount() == 0 ? 0 : 1;
+#else
+	return 0;
+#endif
+}
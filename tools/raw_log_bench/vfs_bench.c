@@ -0,0 +1,301 @@
+/* Host benchmark of the window files through the SPIFFS glue of the device: esp_spiffs.c and
+ * spiffs_api.c mount the RAM partitions of esp_partition_ram.c and are reached by the stdio
+ * calls of main/log_writer.c (vfs_stdio.h). The records of a window are appended opening and
+ * closing the file for each of them, as save_pkt_info did, and with log_writer keeping the file
+ * open and writing batches of 1 and CONFIG_LOG_BATCH_RECORDS records. The flash operations per
+ * record are counted and the files are read back and checked. Then the windows of a minute each are
+ * written to the ring of window files as end_window does, with the SPIFFS_MTIME_POLICY the bench
+ * was built with (vfs_bench, vfs_bench_periodic, vfs_bench_on_sync): the flash pages programmed
+ * per minute are counted and stat must return the time of the last open of each file, before and
+ * after the partition is mounted again.
+ * Usage: vfs_bench [windows] [records per window] [mtime windows] [mtime records per window] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sdkconfig.h"
+#include "esp_partition.h"
+#include "esp_spiffs.h"
+#include "esp_vfs.h"
+#include "vfs_stdio.h"
+#include "log_writer.h"
+
+#undef time
+
+#define SPIFFS_SIZE 0xF0000 //storage of partitions_spiffs.csv
+#define CKPT_SIZE 0x8000
+#define BASE_PATH "/spiffs"
+#define REC_LEN 31 //a device record with an SSID
+#define WINDOW_SECONDS 60 //SNIFFING_TIME of main.c
+#define STATE_PATH(gen) ((gen) % 2 ? BASE_PATH "/win.1.idx" : BASE_PATH "/win.0.idx") //written alternately
+
+#if defined(CONFIG_SPIFFS_MTIME_PERIODIC)
+#define MTIME_POLICY "periodic"
+#elif defined(CONFIG_SPIFFS_MTIME_ON_SYNC)
+#define MTIME_POLICY "on sync"
+#else
+#define MTIME_POLICY "on open"
+#endif
+
+typedef enum {
+	MODE_PER_RECORD, //fopen, fwrite and fclose for each record
+	MODE_BATCH_1, //log_writer, a write per record
+	MODE_BATCH, //log_writer, a write every CONFIG_LOG_BATCH_RECORDS records
+} append_mode_t;
+
+static const char *mode_names[] = { "open/append/close", "log_writer batch 1", "log_writer batch " };
+
+static const esp_partition_t *spiffs_part;
+static uint8_t log_buf[CONFIG_LOG_BATCH_RECORDS*REC_LEN];
+
+static uint64_t now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void make_record(int window, int i, uint8_t *rec)
+{
+	uint32_t s = window * 7919 + i * 104729 + 1;
+	int k;
+
+	for(k=0; k<REC_LEN; k++){
+		s ^= s << 13;
+		s ^= s >> 17;
+		s ^= s << 5;
+		rec[k] = s;
+	}
+}
+
+static void window_path(int window, char *path)
+{
+	sprintf(path, BASE_PATH "/win%02d.log", window);
+}
+
+static int write_window(append_mode_t mode, int window, int records)
+{
+	log_writer_t w;
+	uint8_t rec[REC_LEN];
+	char path[32];
+	FILE *fp;
+	int i;
+
+	window_path(window, path);
+	if(mode != MODE_PER_RECORD){
+		log_writer_init(&w, log_buf, sizeof(log_buf), mode == MODE_BATCH ? CONFIG_LOG_BATCH_RECORDS : 1);
+		if(log_writer_open(&w, path) != 0)
+			return -1;
+	}
+
+	for(i=0; i<records; i++){
+		make_record(window, i, rec);
+		if(mode != MODE_PER_RECORD){
+			if(log_writer_append(&w, rec, REC_LEN) != 0)
+				return -1;
+			continue;
+		}
+		if((fp = fopen(path, "a")) == NULL)
+			return -1;
+		if(fwrite(rec, 1, REC_LEN, fp) != REC_LEN){
+			fclose(fp);
+			return -1;
+		}
+		fclose(fp);
+	}
+
+	return mode != MODE_PER_RECORD ? log_writer_close(&w) : 0;
+}
+
+static int check_window(int window, int records)
+{
+	uint8_t rec[REC_LEN], expected[REC_LEN];
+	char path[32];
+	FILE *fp;
+	int i;
+
+	window_path(window, path);
+	if((fp = fopen(path, "rb")) == NULL)
+		return -1;
+	for(i=0; i<records; i++){
+		make_record(window, i, expected);
+		if(fread(rec, 1, REC_LEN, fp) != REC_LEN || memcmp(rec, expected, REC_LEN) != 0)
+			break;
+	}
+	if(i == records && fread(rec, 1, 1, fp) != 0) //nothing after the last record
+		i = -1;
+	fclose(fp);
+	remove(path);
+
+	return i == records ? 0 : -1;
+}
+
+static int bench_log_writer(int windows, int records)
+{
+	esp_partition_ram_stats_t st;
+	uint64_t t, ns;
+	uint32_t n = windows * records;
+	int mode, win;
+
+	printf("log_writer: %d windows of %d records of %d bytes\n", windows, records, REC_LEN);
+	for(mode=MODE_PER_RECORD; mode<=MODE_BATCH; mode++){
+		if(esp_spiffs_format(NULL) != ESP_OK){
+			printf("Impossible to format the partition\n");
+			return -1;
+		}
+		esp_partition_ram_stats(spiffs_part, &st, true);
+
+		ns = 0;
+		for(win=0; win<windows; win++){
+			esp_vfs_host_now += WINDOW_SECONDS;
+			t = now_ns();
+			if(write_window(mode, win, records) != 0){
+				printf("%s: window %d not written\n", mode_names[mode], win);
+				return -1;
+			}
+			ns += now_ns() - t;
+		}
+		esp_partition_ram_stats(spiffs_part, &st, true);
+
+		for(win=0; win<windows; win++){
+			if(check_window(win, records) != 0){
+				printf("%s: window %d read back is wrong\n", mode_names[mode], win);
+				return -1;
+			}
+		}
+
+		if(mode == MODE_BATCH)
+			printf("%s%-3d", mode_names[mode], CONFIG_LOG_BATCH_RECORDS);
+		else
+			printf("%-21s", mode_names[mode]);
+		printf(" %6.2f reads %5.2f writes %6.4f erases per record, %8.0f records/s\n",
+				(double)st.reads / n, (double)st.writes / n, (double)st.erases / n, n / (ns / 1e9));
+	}
+
+	return 0;
+}
+
+static int mtime_window(int window, int devices)
+{
+	/* the files opened for writing by a window: the window file ("ab"), the next one of the ring
+	 * truncated and a state file of seg_log ("wb") */
+	uint32_t state[8] = { 0x474F4C53, CONFIG_LOG_SEGMENTS, window+1, window+1, window, 0, 0, 0 };
+	char path[32];
+	FILE *fp;
+
+	if(write_window(MODE_BATCH, window % CONFIG_LOG_SEGMENTS, devices) != 0)
+		return -1;
+
+	window_path((window + 1) % CONFIG_LOG_SEGMENTS, path);
+	if((fp = fopen(path, "wb")) == NULL)
+		return -1;
+	fclose(fp);
+
+	if((fp = fopen(STATE_PATH(window), "wb")) == NULL)
+		return -1;
+	if(fwrite(state, 1, sizeof(state), fp) != sizeof(state)){
+		fclose(fp);
+		return -1;
+	}
+	return fclose(fp);
+}
+
+static int mtime_check(const time_t *opened, int window)
+{
+	/* stat returns the time of the last open for writing of each file */
+	struct stat st;
+	char path[32];
+	int i;
+
+	for(i=0; i<CONFIG_LOG_SEGMENTS; i++){
+		window_path(i, path);
+		if(opened[i] != 0 && (stat(path, &st) != 0 || st.st_mtime != opened[i])){
+			printf("mtime %s: wrong mtime of %s\n", MTIME_POLICY, path);
+			return -1;
+		}
+	}
+	if(stat(STATE_PATH(window), &st) != 0 || st.st_mtime != esp_vfs_host_now){
+		printf("mtime %s: wrong mtime of %s\n", MTIME_POLICY, STATE_PATH(window));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int bench_mtime(const esp_vfs_spiffs_conf_t *conf, int windows, int devices)
+{
+	/* a window a minute, esp_spiffs_sync_meta every CONFIG_MTIME_SYNC_WINDOWS windows as end_window */
+	time_t opened[CONFIG_LOG_SEGMENTS]; //time of the last open of each window file
+	esp_partition_ram_stats_t st;
+	esp_spiffs_io_stats_t io;
+	int win;
+
+	if(esp_spiffs_format(NULL) != ESP_OK){
+		printf("Impossible to format the partition\n");
+		return -1;
+	}
+	memset(opened, 0, sizeof(opened));
+	esp_spiffs_get_io_stats(NULL, &io, true);
+	esp_partition_ram_stats(spiffs_part, &st, true);
+	for(win=0; win<windows; win++){
+		esp_vfs_host_now += WINDOW_SECONDS;
+		if(mtime_window(win, devices) != 0 ||
+				((win + 1) % CONFIG_MTIME_SYNC_WINDOWS == 0 && esp_spiffs_sync_meta(NULL) != ESP_OK)){
+			printf("mtime %s: window %d not written\n", MTIME_POLICY, win);
+			return -1;
+		}
+		opened[win % CONFIG_LOG_SEGMENTS] = opened[(win + 1) % CONFIG_LOG_SEGMENTS] = esp_vfs_host_now;
+	}
+	esp_spiffs_get_io_stats(NULL, &io, true);
+	esp_partition_ram_stats(spiffs_part, &st, true);
+
+	if(mtime_check(opened, windows-1) != 0) //the mtimes still in RAM
+		return -1;
+	if(esp_vfs_spiffs_unregister(NULL) != ESP_OK || esp_vfs_spiffs_register(conf) != ESP_OK){
+		printf("Impossible to mount SPIFFS again\n");
+		return -1;
+	}
+	if(mtime_check(opened, windows-1) != 0) //the mtimes written at the unmount
+		return -1;
+
+	printf("mtime %s: %d windows of %d records, a window a minute, esp_spiffs_sync_meta every %d windows\n",
+			MTIME_POLICY, windows, devices, CONFIG_MTIME_SYNC_WINDOWS);
+	printf("  %7.1f page programs/min %5.2f mtime writes/min %5.2f kept in RAM/min %6.3f erases/min\n",
+			(double)st.programs / windows, (double)io.mtime_writes / windows, (double)io.mtime_deferred / windows,
+			(double)st.erases / windows);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int windows = argc > 1 ? atoi(argv[1]) : 4;
+	int records = argc > 2 ? atoi(argv[2]) : 3000;
+	int mtime_windows = argc > 3 ? atoi(argv[3]) : 100;
+	int devices = argc > 4 ? atoi(argv[4]) : 150;
+	esp_vfs_spiffs_conf_t conf = {
+		.base_path = BASE_PATH,
+		.partition_label = NULL,
+		.max_files = 3,
+		.format_if_mount_failed = true,
+	};
+
+	spiffs_part = esp_partition_ram_add("storage", ESP_PARTITION_SUBTYPE_DATA_SPIFFS, SPIFFS_SIZE);
+	if(spiffs_part == NULL || esp_partition_ram_add(CONFIG_SPIFFS_CHECKPOINT_PARTITION, 0x41, CKPT_SIZE) == NULL){
+		printf("Impossible to create the partitions\n");
+		return 1;
+	}
+	esp_vfs_host_now = 1500000000;
+	if(esp_vfs_spiffs_register(&conf) != ESP_OK){
+		printf("Impossible to mount SPIFFS\n");
+		return 1;
+	}
+
+	if(bench_log_writer(windows, records) != 0 || bench_mtime(&conf, mtime_windows, devices) != 0)
+		return 1;
+
+	return esp_vfs_spiffs_unregister(NULL) == ESP_OK ? 0 : 1;
+}